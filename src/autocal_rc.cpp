@@ -16,6 +16,7 @@
 #include "Dbt.h"
 
 #include <CommCtrl.h>
+#include <algorithm>
 #include <vector>
 #include <fstream>
 #include <string>
@@ -23,10 +24,15 @@
 #include <iomanip>
 #include <sstream>
 #include <unordered_map>
+#include <map>
+#include <mutex>
 
 #include "util\ld.hpp" // local display
 #include "devices\arduino.hpp"
 #include "util\settings.hpp"
+#include "util\discovery.hpp"
+#include "util\log_ring.hpp"
+#include "util\serial_rx.hpp"
 #include "tests\lt_trip_test_rc.hpp"
 #include "tests\st_trip_test_rc.hpp"
 #include "tests\inst_trip_test_rc.hpp"
@@ -39,12 +45,16 @@
 // 1.0 - original
 constexpr float AUTOCAL_RC_VERSION = 1.0;
 
-#define WM_CALIBRATION_UPDATE_MSG (WM_APP + 1) // Custom message for updating UI
-
 #define ID_EDITCHILD 100
 #define ID_TOOL_BAR 101
 #define ID_TIMER_1 1
 #define ID_TIMER_2 2 //
+#define ID_TIMER_LOG 3 // picks up PrintToScreen() text for the edit box
+
+const int LOG_UI_INTERVAL_MS = 50;
+
+// once the edit box has more than this, the oldest text goes
+const int EDIT_BOX_MAX_CHARS = 4 * 1024 * 1024;
 
 const char g_szClassName[] = "urc_autocal_lite";
 
@@ -113,8 +123,24 @@ bool ProductionMode = false;
 // we have already made sure this directory exists
 std::string iniFile = "C:\\urc\\apps\\autocal_rc\\autocal_rc.ini";
 
+// which COM port each device was on last time; see util\discovery.hpp
+std::string discoveryCacheFile = "C:\\urc\\apps\\autocal_rc\\devices.txt";
+
+// test results that haven't made it into the database yet; see util\db_queue.hpp
+std::string dbJournalFile = "C:\\urc\\apps\\autocal_rc\\db_journal.txt";
+
+// every result we get off a unit, and where the Database menu exports them to; see util\results_store.hpp
+std::string resultsStoreFile = "C:\\urc\\apps\\autocal_rc\\results.txt";
+std::string resultsCSVFile = "C:\\urc\\apps\\autocal_rc\\results.csv";
+std::string resultsColumnarFile = "C:\\urc\\apps\\autocal_rc\\results.col";
+
+// where the AWG and the BK are: "USB" (VISA), or their address on the LAN, e.g.
+// "192.168.1.50" (raw SCPI on port 5025); see SCPI_TRANSPORT::Open()
+std::string rigolAddress = "USB";
+std::string bkAddress = "USB";
+
 // global variables
-static std::ofstream log_file;
+static LOG_RING::LogPipeline logPipeline; // everything PrintToScreen() says, on its way to the log file and the edit box
 bool ArduinoAbortTimingTest = false;
 bool RigolDualChannelMode = false;
 
@@ -213,44 +239,35 @@ void WriteConfigurationFile()
 {
 }
 
-// everybody should call this to post a message saying to update the UI
+// everybody should call this to put a line on the screen (and in the log file);
+// safe from any thread, and cheap: the line just goes in logPipeline, and the UI
+// thread picks up everything waiting on ID_TIMER_LOG
 void PrintToScreen(const std::string &msg)
 {
-	// Dynamically allocate a copy of the message string to send it to the UI thread
-	std::string *message = new std::string(msg);
-
-	// Post the message to the UI thread
-	// The LPARAM will be a pointer to the dynamically allocated std::string
-	PostMessage(hwndMain, WM_CALIBRATION_UPDATE_MSG, 0, reinterpret_cast<LPARAM>(message));
-
-	// log everything we print to the screen to the log file as well
-	if (log_file.is_open())
-	{
-		log_file.write(msg.c_str(), msg.size());
-		log_file.write("\n", 1);
-	}
+	logPipeline.Post(msg);
 }
 
-// prints out a message to our edit box, which is a scrollable list of all the
-// text we've entered
-static void _PrintToScreen(const std::string &message)
+// adds text to the end of our edit box, which is a scrollable list of all the
+// text we've printed
+static void AppendToEditBox(const std::string &text)
 {
-	std::string messageToPrint;
+	if (text.empty())
+		return;
 
-	// append a newline to the message, unless it ends with our
-	// special sequence of two pipe characters
-	if (message.rfind("||") != message.length() - 2)
-		messageToPrint = message + "\r\n";
-	else
+	int length = GetWindowTextLength(hwndEdit);
+
+	// keep the edit box from growing forever; drop the oldest quarter or so
+	if (length + (int)text.size() > EDIT_BOX_MAX_CHARS)
 	{
-		// don't add a newline, but remove the special sequence
-		messageToPrint = message;
-		messageToPrint.erase(messageToPrint.length() - 2);
+		int cut = (std::min)(length, length + (int)text.size() - EDIT_BOX_MAX_CHARS + EDIT_BOX_MAX_CHARS / 4);
+
+		SendMessageA(hwndEdit, EM_SETSEL, 0, cut);
+		SendMessageA(hwndEdit, EM_REPLACESEL, 0, (LPARAM) "");
+		length = GetWindowTextLength(hwndEdit);
 	}
 
-	SendMessageA(hwndEdit, EM_SETSEL, 0, -1);									// Select all
-	SendMessageA(hwndEdit, EM_SETSEL, -1, -1);									// Unselect and stay at the end pos
-	SendMessageA(hwndEdit, EM_REPLACESEL, 0, (LPARAM)(messageToPrint.c_str())); // append text to current pos and scroll down
+	SendMessageA(hwndEdit, EM_SETSEL, length, length);				  // go to the end
+	SendMessageA(hwndEdit, EM_REPLACESEL, 0, (LPARAM)(text.c_str())); // append text and scroll down
 }
 
 void scr_printf(const char *format, ...)
@@ -409,78 +426,104 @@ void FindEquipment(bool findKeithley, bool findTripUnit, bool findArduino)
 	SetStatusBarText("Searching for devices...");
 	EnumeratePorts();
 
+	std::vector<int> ports;
+	std::vector<DISCOVERY::DeviceKind> wanted;
+
+	for (int port : commPorts)
+	{
+		if (CommPortIsAvailable(port))
+			ports.push_back(port);
+	}
+
 	if (findKeithley)
 	{
 		hKeithley.commPort = 0;
-		for (int i = 0; i < commPorts.size(); i++)
-		{
-			if (CommPortIsAvailable(commPorts[i]))
-			{
-				PrintToScreen("searching for Keithley on com: " + std::to_string(commPorts[i]));
-				if (KEITHLEY::Connect(&hKeithley.handle, commPorts[i]))
-				{
-					hKeithley.commPort = commPorts[i];
-					PrintToScreen("Keithley found on comm port " + std::to_string(commPorts[i]));
-					break;
-				}
-				else
-				{
-					CloseCommPort(&hKeithley.handle);
-				}
-			}
-		}
-		if (0 == hKeithley.commPort)
-			PrintToScreen("Keithley not found");
+		wanted.push_back(DISCOVERY::DeviceKind::KEITHLEY);
 	}
 
 	if (findTripUnit)
 	{
 		hTripUnit.commPort = 0;
-		for (int i = 0; i < commPorts.size(); i++)
-		{
-			if (CommPortIsAvailable(commPorts[i]))
-			{
-				PrintToScreen("searching for trip unit on com: " + std::to_string(commPorts[i]));
-				if (ConnectTripUnit(&hTripUnit.handle, commPorts[i], &tripUnitType))
-				{
-					hTripUnit.commPort = commPorts[i];
-					PrintToScreen("Trip Unit found on comm port " + std::to_string(commPorts[i]));
-					break;
-				}
-				else
-				{
-					CloseCommPort(&hTripUnit.handle);
-				}
-			}
-		}
-
-		if (0 == hTripUnit.commPort)
-			PrintToScreen("Trip Unit not found");
+		wanted.push_back(DISCOVERY::DeviceKind::TRIP_UNIT);
 	}
 
 	if (findArduino)
 	{
 		hArduino.commPort = 0;
+		wanted.push_back(DISCOVERY::DeviceKind::ARDUINO);
+	}
+
+	// ConnectTripUnit() tells us what kind of trip unit it is; hang on to that per port,
+	// since any of the ports could be the one
+	std::map<int, TripUnitType> tripUnitTypes;
+	std::mutex tripUnitTypesMutex;
+
+	auto probe = [&tripUnitTypes, &tripUnitTypesMutex](int port, DISCOVERY::DeviceKind kind, HANDLE *handle) -> bool
+	{
+		TripUnitType type;
+
+		PrintToScreen("searching for " + DISCOVERY::DeviceKindToString(kind) + " on com: " + std::to_string(port));
 
-		for (int i = 0; i < commPorts.size(); i++)
+		switch (kind)
 		{
-			if (CommPortIsAvailable(commPorts[i]))
+		case DISCOVERY::DeviceKind::KEITHLEY:
+			return KEITHLEY::Connect(handle, port);
+
+		case DISCOVERY::DeviceKind::TRIP_UNIT:
+			if (!ConnectTripUnit(handle, port, &type))
+				return false;
 			{
-				PrintToScreen("searching for Arduino on com: " + std::to_string(commPorts[i]));
-				if (ARDUINO::Connect(&hArduino.handle, commPorts[i]))
-				{
-					hArduino.commPort = commPorts[i];
-					PrintToScreen("Arduino found on comm port " + std::to_string(commPorts[i]));
-					break;
-				}
-				else
-				{
-					CloseCommPort(&hArduino.handle);
-				}
+				std::lock_guard<std::mutex> lock(tripUnitTypesMutex);
+				tripUnitTypes[port] = type;
 			}
+			return true;
+
+		case DISCOVERY::DeviceKind::ARDUINO:
+			return ARDUINO::Connect(handle, port);
+
+		default:
+			return false;
+		}
+	};
+
+	DISCOVERY::DiscoveryCache cache;
+	cache.Load(discoveryCacheFile);
+
+	std::vector<DISCOVERY::FoundDevice> found = DISCOVERY::FindDevices(ports, wanted, probe, FTDI::SerialNumberForCommPort, cache);
+
+	for (DISCOVERY::FoundDevice &device : found)
+	{
+		switch (device.kind)
+		{
+		case DISCOVERY::DeviceKind::KEITHLEY:
+			hKeithley.handle = device.handle;
+			hKeithley.commPort = device.port;
+			PrintToScreen("Keithley found on comm port " + std::to_string(device.port));
+			break;
+
+		case DISCOVERY::DeviceKind::TRIP_UNIT:
+			hTripUnit.handle = device.handle;
+			hTripUnit.commPort = device.port;
+			tripUnitType = tripUnitTypes[device.port];
+			PrintToScreen("Trip Unit found on comm port " + std::to_string(device.port));
+			break;
+
+		case DISCOVERY::DeviceKind::ARDUINO:
+			hArduino.handle = device.handle;
+			hArduino.commPort = device.port;
+			PrintToScreen("Arduino found on comm port " + std::to_string(device.port));
+			break;
 		}
 	}
 
+	if (findKeithley && 0 == hKeithley.commPort)
+		PrintToScreen("Keithley not found");
+
+	if (findTripUnit && 0 == hTripUnit.commPort)
+		PrintToScreen("Trip Unit not found");
+
+	cache.Save(discoveryCacheFile);
+
 	PrintConnectionStatus();
 	StatusBarReady();
 }
@@ -490,9 +533,13 @@ void Shutdown()
 {
 	WriteConfigurationFile();
 	DB::Disconnect();
+	RESULTS_STORE::Results().Close();
 
 	CloseCommPort(&hTripUnit.handle);
 	CloseCommPort(&hKeithley.handle);
+
+	// (last, so everything above still makes it to the log file)
+	logPipeline.Stop();
 }
 
 bool SendGetBaudRate(HANDLE hComm)
@@ -509,7 +556,7 @@ bool SendSetBaudRate(HANDLE hComm, uint32_t baud)
 	msg.msgHdr.Type = MSG_SET_BAUD_RATE;
 	msg.msgHdr.Version = PROTOCOL_VERSION;
 	msg.msgHdr.Length = 4;
-	msg.msgHdr.Seq = SequenceNumber();
+	msg.msgHdr.Seq = SequenceNumber(hComm);
 	msg.msgHdr.Dst = ADDR_DISP_LOCAL;
 	msg.msgHdr.Src = ADDR_CAL_APP;
 
@@ -1641,8 +1688,8 @@ void PrintConnectionStatus()
 	PrintConnectionColumns("Trip Unit", "Virtual Comm", ConnectedStatus(hTripUnit));
 	PrintToScreen(Dots(25, "Trip Unit Type") + TripUnitTypeToString(tripUnitType));
 	PrintConnectionColumns("Arduino_AutoCAL_Lite", "Virtual Comm", ConnectedStatus(hArduino));
-	PrintConnectionColumns("Rigol_DG1000z", "USB-TCM", (RIGOL_DG1000Z_Connected ? "CONNECTED" : "DISCONNECTED"));
-	PrintConnectionColumns("BK Precision-9801", "USB-TCM", (BK_PRECISION_9801_Connected ? "CONNECTED" : "DISCONNECTED"));
+	PrintConnectionColumns("Rigol_DG1000z", (rigolAddress == "USB") ? "USB-TCM" : rigolAddress, (RIGOL_DG1000Z_Connected ? "CONNECTED" : "DISCONNECTED"));
+	PrintConnectionColumns("BK Precision-9801", (bkAddress == "USB") ? "USB-TCM" : bkAddress, (BK_PRECISION_9801_Connected ? "CONNECTED" : "DISCONNECTED"));
 
 	PrintToScreen("");
 
@@ -2026,7 +2073,7 @@ static void menu_ID_CONNECTION_FIND_KEITHLEY()
 
 static void menu_ID_CONNECTION_CONNECT_RIGOL_DG1000Z()
 {
-	RIGOL_DG1000Z_Connected = RIGOL_DG1000Z::OpenVISAInterface();
+	RIGOL_DG1000Z_Connected = RIGOL_DG1000Z::OpenInterface(rigolAddress);
 
 	if (RIGOL_DG1000Z_Connected)
 		RIGOL_DG1000Z_Connected = RIGOL_DG1000Z::Initialize();
@@ -2041,6 +2088,7 @@ static void menu_ID_CONNECTION_CONNECT_RIGOL_DG1000Z()
 
 static void menu_ID_CONNECTION_DISCONNECT_RIGOL_DG1000Z()
 {
+	RIGOL_DG1000Z::CloseInterface();
 
 	RIGOL_DG1000Z_Connected = false;
 	PrintToScreen("RIGOL_DG1000Z AWG Disconnected");
@@ -2084,11 +2132,11 @@ static void menu_ID_CONNECTION_FIND_TRIPUNIT()
 	thread.detach();
 }
 
-// BK_PRECISION_9801 is a VISA device
+// BK_PRECISION_9801 is a VISA device (or on the LAN; see bkAddress)
 static void menu_ID_CONNECTION_CONNECT_BK_PRECISION_9801()
 {
 
-	BK_PRECISION_9801_Connected = BK_PRECISION_9801::OpenVISAInterface();
+	BK_PRECISION_9801_Connected = BK_PRECISION_9801::OpenInterface(bkAddress);
 
 	if (BK_PRECISION_9801_Connected)
 		BK_PRECISION_9801_Connected = BK_PRECISION_9801::Initialize();
@@ -2101,9 +2149,10 @@ static void menu_ID_CONNECTION_CONNECT_BK_PRECISION_9801()
 	PrintConnectionStatus();
 }
 
-// BK_PRECISION_9801 is a VISA device
 static void menu_ID_CONNECTION_DISCONNECT_BK_PRECISION_9801()
 {
+	BK_PRECISION_9801::CloseInterface();
+
 	BK_PRECISION_9801_Connected = false;
 	PrintToScreen("BK_PRECISION_9801 Disconnected");
 	PrintConnectionStatus();
@@ -2242,6 +2291,13 @@ static void menu_ID_DUMP_DB_LT_THRESHOLD()
 		return;
 	}
 
+	// the write went into the queue; wait for it to actually get there
+	if (!DB::Flush(DB::FLUSH_TIMEOUT_MS))
+	{
+		PrintToScreen("Error writing database record");
+		return;
+	}
+
 	record = {0};
 
 	// now re-read the record
@@ -2308,6 +2364,13 @@ void menu_ID_DUMP_DB_PERSONALITY()
 		return;
 	}
 
+	// the write went into the queue; wait for it to actually get there
+	if (!DB::Flush(DB::FLUSH_TIMEOUT_MS))
+	{
+		PrintToScreen("Error writing database record");
+		return;
+	}
+
 	record = {0};
 
 	// now re-read the record
@@ -2335,6 +2398,58 @@ void menu_ID_DUMP_DB_PERSONALITY()
 #endif
 }
 
+// results to use from the store; empty for all of them
+static bool AskForResultKind(std::string &kind)
+{
+	if (!GetInputValue("Results (cal_step, cal_flash, cal_full, lt_trip, st_trip, inst_trip, gf_trip, short_test; blank for all):"))
+		return false;
+
+	kind = ReturnedInputValue_String;
+	return true;
+}
+
+static void menu_ID_RESULTS_EXPORT(bool columnar)
+{
+	std::vector<RESULTS_STORE::ResultRecord> records;
+	std::string kind;
+
+	if (!AskForResultKind(kind))
+		return;
+
+	if (!RESULTS_STORE::Results().Load(records, kind))
+	{
+		PrintToScreen("Error reading results from " + resultsStoreFile);
+		return;
+	}
+
+	std::string filename = columnar ? resultsColumnarFile : resultsCSVFile;
+
+	bool retval = columnar ? RESULTS_STORE::ExportColumnar(filename, records) : RESULTS_STORE::ExportCSV(filename, records);
+
+	if (retval)
+		PrintToScreen("Exported " + std::to_string(records.size()) + " results to " + filename);
+	else
+		PrintToScreen("Error writing " + filename);
+}
+
+static void menu_ID_RESULTS_SUMMARY()
+{
+	std::vector<RESULTS_STORE::ResultRecord> records;
+	std::string kind;
+
+	if (!AskForResultKind(kind))
+		return;
+
+	if (!RESULTS_STORE::Results().Load(records, kind))
+	{
+		PrintToScreen("Error reading results from " + resultsStoreFile);
+		return;
+	}
+
+	PrintToScreen(std::to_string(records.size()) + " results" + (kind.empty() ? "" : " (" + kind + ")") + "; for pass / fail fields, the mean is the yield");
+	RESULTS_STORE::PrintSummary(RESULTS_STORE::Summarize(records));
+}
+
 //////////////////////////////////////////////////////
 // ACPRO2 menu
 //////////////////////////////////////////////////////
@@ -4011,10 +4126,12 @@ void AsyncArduinoTripTest_GF(
 }
 
 void AsyncArduinoTripTest_Multi_LT(
-	std::vector<LT_TRIP_TEST_RC::testParams> params)
+	std::vector<LT_TRIP_TEST_RC::testParams> params, TEST_PLAN::Plan plan)
 {
 	std::vector<LT_TRIP_TEST_RC::testResults> results;
 
+	uint64_t startedMS = SERIAL_RX::NowMS();
+
 	if (LT_TRIP_TEST_RC::CheckTripTime(
 			hTripUnit.handle,
 			hKeithley.handle, hArduino.handle, params, results))
@@ -4027,13 +4144,17 @@ void AsyncArduinoTripTest_Multi_LT(
 		PrintToScreen("Error running Arduino trip test; dumping incomplete test results...");
 		LT_TRIP_TEST_RC::PrintResults(params, results);
 	}
+
+	TEST_PLAN::PrintPredictedVsActual(plan, SERIAL_RX::NowMS() - startedMS);
 }
 
 void AsyncArduinoTripTest_Multi_INST(
-	std::vector<INST_TRIP_TEST_RC::testParams> params)
+	std::vector<INST_TRIP_TEST_RC::testParams> params, TEST_PLAN::Plan plan)
 {
 	std::vector<INST_TRIP_TEST_RC::testResults> results;
 
+	uint64_t startedMS = SERIAL_RX::NowMS();
+
 	if (INST_TRIP_TEST_RC::CheckTripTime(
 			hTripUnit.handle,
 			hKeithley.handle, hArduino.handle, params, results))
@@ -4046,13 +4167,17 @@ void AsyncArduinoTripTest_Multi_INST(
 		PrintToScreen("Error running Arduino trip test; dumping incomplete test results...");
 		INST_TRIP_TEST_RC::PrintResults(params, results);
 	}
+
+	TEST_PLAN::PrintPredictedVsActual(plan, SERIAL_RX::NowMS() - startedMS);
 }
 
 void AsyncArduinoTripTest_Multi_ST(
-	std::vector<ST_TRIP_TEST_RC::testParams> params)
+	std::vector<ST_TRIP_TEST_RC::testParams> params, TEST_PLAN::Plan plan)
 {
 	std::vector<ST_TRIP_TEST_RC::testResults> results;
 
+	uint64_t startedMS = SERIAL_RX::NowMS();
+
 	if (ST_TRIP_TEST_RC::CheckTripTime(
 			hTripUnit.handle,
 			hKeithley.handle, hArduino.handle, params, results))
@@ -4065,6 +4190,98 @@ void AsyncArduinoTripTest_Multi_ST(
 		PrintToScreen("Error running Arduino trip test; dumping incomplete test results...");
 		ST_TRIP_TEST_RC::PrintResults(params, results);
 	}
+
+	TEST_PLAN::PrintPredictedVsActual(plan, SERIAL_RX::NowMS() - startedMS);
+}
+
+// the multipoint trip tests again, but through the trip unit's software test set; only
+// the trip unit needs to be connected (see tests\soft_test_set.hpp)
+void AsyncSoftTestSetTripTest_Multi_LT(
+	std::vector<LT_TRIP_TEST_RC::testParams> params, TEST_PLAN::Plan plan)
+{
+	std::vector<LT_TRIP_TEST_RC::testResults> results;
+
+	uint64_t startedMS = SERIAL_RX::NowMS();
+
+	if (LT_TRIP_TEST_RC::CheckTripTime_SoftTestSet(
+			hTripUnit.handle, params, results))
+	{
+
+		LT_TRIP_TEST_RC::PrintResults(params, results);
+	}
+	else
+	{
+		PrintToScreen("Error running soft test set trip test; dumping incomplete test results...");
+		LT_TRIP_TEST_RC::PrintResults(params, results);
+	}
+
+	TEST_PLAN::PrintPredictedVsActual(plan, SERIAL_RX::NowMS() - startedMS);
+}
+
+void AsyncSoftTestSetTripTest_Multi_ST(
+	std::vector<ST_TRIP_TEST_RC::testParams> params, TEST_PLAN::Plan plan)
+{
+	std::vector<ST_TRIP_TEST_RC::testResults> results;
+
+	uint64_t startedMS = SERIAL_RX::NowMS();
+
+	if (ST_TRIP_TEST_RC::CheckTripTime_SoftTestSet(
+			hTripUnit.handle, params, results))
+	{
+
+		ST_TRIP_TEST_RC::PrintResults(params, results);
+	}
+	else
+	{
+		PrintToScreen("Error running soft test set trip test; dumping incomplete test results...");
+		ST_TRIP_TEST_RC::PrintResults(params, results);
+	}
+
+	TEST_PLAN::PrintPredictedVsActual(plan, SERIAL_RX::NowMS() - startedMS);
+}
+
+void AsyncSoftTestSetTripTest_Multi_INST(
+	std::vector<INST_TRIP_TEST_RC::testParams> params, TEST_PLAN::Plan plan)
+{
+	std::vector<INST_TRIP_TEST_RC::testResults> results;
+
+	uint64_t startedMS = SERIAL_RX::NowMS();
+
+	if (INST_TRIP_TEST_RC::CheckTripTime_SoftTestSet(
+			hTripUnit.handle, params, results))
+	{
+
+		INST_TRIP_TEST_RC::PrintResults(params, results);
+	}
+	else
+	{
+		PrintToScreen("Error running soft test set trip test; dumping incomplete test results...");
+		INST_TRIP_TEST_RC::PrintResults(params, results);
+	}
+
+	TEST_PLAN::PrintPredictedVsActual(plan, SERIAL_RX::NowMS() - startedMS);
+}
+
+void AsyncSoftTestSetTripTest_Multi_GF(
+	std::vector<GF_TRIP_TEST_RC::testParams> params, TEST_PLAN::Plan plan)
+{
+	std::vector<GF_TRIP_TEST_RC::testResults> results;
+
+	uint64_t startedMS = SERIAL_RX::NowMS();
+
+	if (GF_TRIP_TEST_RC::CheckTripTime_SoftTestSet(
+			hTripUnit.handle, params, results))
+	{
+
+		GF_TRIP_TEST_RC::PrintResults(params, results);
+	}
+	else
+	{
+		PrintToScreen("Error running soft test set trip test; dumping incomplete test results...");
+		GF_TRIP_TEST_RC::PrintResults(params, results);
+	}
+
+	TEST_PLAN::PrintPredictedVsActual(plan, SERIAL_RX::NowMS() - startedMS);
 }
 
 // this just lets us use the arduino for generic timing
@@ -4073,7 +4290,6 @@ void AsyncArduinoTripTest_Multi_ST(
 void AsyncArduinoTripTest_Generic()
 {
 
-	ARDUINO::MsgRspTimingTestResults *msgRspTimingTestResults = nullptr;
 	URCMessageUnion rsp = {0};
 	bool retval;
 
@@ -4106,55 +4322,28 @@ void AsyncArduinoTripTest_Generic()
 
 	ArduinoAbortTimingTest = false;
 
-	int retryCount = 0;
+	ARDUINO::TimingTestResults timingTestResults;
 
-	while (!ArduinoAbortTimingTest)
+	switch (ARDUINO::WaitForTimingTestResults(
+		hArduino.handle,
+		0,
+		ARDUINO::WAIT_FOREVER,
+		&ArduinoAbortTimingTest,
+		&timingTestResults))
 	{
-		Sleep(200);
-		SendURCCommand(hArduino.handle, ARDUINO::MSG_GET_TIMING_TEST_RESULTS, ARDUINO::ADDR_AUTOCAL_ARDUINO, ADDR_CAL_APP);
-
-		// get MSG_RSP_TIMING_TEST_RESULTS
-		retval = GetURCResponse(hArduino.handle, &rsp);
-
-		if (!retval)
-		{
-			PrintToScreen("cannot get timing results from the Arduino");
-			return;
-		}
-
-		// arduino will NAK us if the test is still in progress...
-		if (MSG_NAK == rsp.msgHdr.Type)
-			continue;
-
-		retval = VerifyMessageIsOK(&rsp, ARDUINO::MSG_RSP_TIMING_TEST_RESULTS,
-								   sizeof(ARDUINO::MsgRspTimingTestResults) - sizeof(MsgHdr));
-
-		if (retval)
-		{
-			retryCount = 0;
-			// check to see if the timing tests are valid yet...
-			msgRspTimingTestResults = reinterpret_cast<ARDUINO::MsgRspTimingTestResults *>(&rsp);
-			if (msgRspTimingTestResults->timingTestResults.ResultsAreValid)
-				break;
-		}
-		else
-		{
-			PrintToScreen("cannot get timing results from the Arduino");
-			if (retryCount++ == 3)
-			{
-				PrintToScreen("aborting....");
-				return;
-			}
-		}
-	}
+	case ARDUINO::TimingWaitResult::DONE:
+		break;
 
-	if (ArduinoAbortTimingTest)
-	{
+	case ARDUINO::TimingWaitResult::ABORTED:
 		PrintToScreen("Timing test aborted");
 		return;
+
+	default:
+		PrintToScreen("cannot get timing results from the Arduino");
+		return;
 	}
 
-	PrintToScreen("Time To Trip (ms) " + std::to_string(msgRspTimingTestResults->timingTestResults.elapsedTime));
+	PrintToScreen("Time To Trip (ms) " + std::to_string(timingTestResults.elapsedTime));
 }
 
 static void menu_ID_ARDUINO_RUNTEST_LT()
@@ -4505,7 +4694,9 @@ static void menu_ID_ARDUINO_RUNTEST_MULTI_LT()
 		return;
 	}
 
-	std::thread thread(AsyncArduinoTripTest_Multi_LT, params);
+	TEST_PLAN::Plan plan = LT_TRIP_TEST_RC::PlanTests(params, false);
+
+	std::thread thread(AsyncArduinoTripTest_Multi_LT, params, plan);
 	thread.detach();
 }
 
@@ -4552,7 +4743,9 @@ static void menu_ID_ARDUINO_RUNTEST_MULTI_ST()
 		return;
 	}
 
-	std::thread thread(AsyncArduinoTripTest_Multi_ST, params);
+	TEST_PLAN::Plan plan = ST_TRIP_TEST_RC::PlanTests(params, false);
+
+	std::thread thread(AsyncArduinoTripTest_Multi_ST, params, plan);
 	thread.detach();
 }
 
@@ -4604,7 +4797,9 @@ static void menu_ID_ARDUINO_RUNTEST_MULTI_INST()
 	for (auto &param : params)
 		param.tripTimeThresholdMS = 50; // hard-coded value
 
-	std::thread thread(AsyncArduinoTripTest_Multi_INST, params);
+	TEST_PLAN::Plan plan = INST_TRIP_TEST_RC::PlanTests(params, false);
+
+	std::thread thread(AsyncArduinoTripTest_Multi_INST, params, plan);
 	thread.detach();
 }
 
@@ -4676,6 +4871,125 @@ static void menu_ID_ARDUINO_RUNTEST_MULTI_GF()
 	}
 }
 
+static void menu_ID_SOFTTESTSET_RUNTEST_MULTI_LT()
+{
+	if (INVALID_HANDLE_VALUE == GetHandleForTripUnit())
+	{
+		PrintToScreen("Trip Unit not connected");
+		return;
+	}
+
+	auto scriptFile = SelectFileToOpen(hwndMain);
+	if (scriptFile.empty())
+	{
+		PrintToScreen("aborted");
+		return;
+	}
+
+	std::vector<LT_TRIP_TEST_RC::testParams> params;
+
+	if (!LT_TRIP_TEST_RC::ReadTestFile(scriptFile, params))
+	{
+		PrintToScreen("Error reading test file");
+		return;
+	}
+
+	TEST_PLAN::Plan plan = LT_TRIP_TEST_RC::PlanTests(params, true);
+
+	std::thread thread(AsyncSoftTestSetTripTest_Multi_LT, params, plan);
+	thread.detach();
+}
+
+static void menu_ID_SOFTTESTSET_RUNTEST_MULTI_ST()
+{
+	if (INVALID_HANDLE_VALUE == GetHandleForTripUnit())
+	{
+		PrintToScreen("Trip Unit not connected");
+		return;
+	}
+
+	auto scriptFile = SelectFileToOpen(hwndMain);
+	if (scriptFile.empty())
+	{
+		PrintToScreen("aborted");
+		return;
+	}
+
+	std::vector<ST_TRIP_TEST_RC::testParams> params;
+
+	if (!ST_TRIP_TEST_RC::ReadTestFile(scriptFile, params))
+	{
+		PrintToScreen("Error reading test file");
+		return;
+	}
+
+	TEST_PLAN::Plan plan = ST_TRIP_TEST_RC::PlanTests(params, true);
+
+	std::thread thread(AsyncSoftTestSetTripTest_Multi_ST, params, plan);
+	thread.detach();
+}
+
+static void menu_ID_SOFTTESTSET_RUNTEST_MULTI_INST()
+{
+	if (INVALID_HANDLE_VALUE == GetHandleForTripUnit())
+	{
+		PrintToScreen("Trip Unit not connected");
+		return;
+	}
+
+	auto scriptFile = SelectFileToOpen(hwndMain);
+	if (scriptFile.empty())
+	{
+		PrintToScreen("aborted");
+		return;
+	}
+
+	std::vector<INST_TRIP_TEST_RC::testParams> params;
+
+	if (!INST_TRIP_TEST_RC::ReadTestFile(scriptFile, params))
+	{
+		PrintToScreen("Error reading test file");
+		return;
+	}
+
+	for (auto &param : params)
+		param.tripTimeThresholdMS = 50; // hard-coded value
+
+	TEST_PLAN::Plan plan = INST_TRIP_TEST_RC::PlanTests(params, true);
+
+	std::thread thread(AsyncSoftTestSetTripTest_Multi_INST, params, plan);
+	thread.detach();
+}
+
+static void menu_ID_SOFTTESTSET_RUNTEST_MULTI_GF()
+{
+	if (INVALID_HANDLE_VALUE == GetHandleForTripUnit())
+	{
+		PrintToScreen("Trip Unit not connected");
+		return;
+	}
+
+	auto scriptFile = SelectFileToOpen(hwndMain);
+	if (scriptFile.empty())
+	{
+		PrintToScreen("aborted");
+		return;
+	}
+
+	std::vector<GF_TRIP_TEST_RC::testParams> params;
+
+	if (!GF_TRIP_TEST_RC::ReadTestFile(scriptFile, params))
+	{
+		PrintToScreen("Error reading test file");
+		return;
+	}
+
+	TEST_PLAN::Plan plan = GF_TRIP_TEST_RC::PlanTests(params, true);
+
+	std::thread thread(AsyncSoftTestSetTripTest_Multi_GF, params, plan);
+	thread.detach();
+}
+
 // the only thing needed here is the arduino
 static void menu_ID_ARDUINO_GENERIC()
 {
@@ -4972,8 +5286,8 @@ static void menu_ID_ACPRO2_SETTINGS_FROM_TXT()
 
 	if (SettingsUpdatedOnTripUnit)
 	{
-		// Wait 2 seconds for the trip unit to reboot
-		Sleep(2000);
+		PrintToScreen("waiting for trip unit to reboot...");
+		WaitForTripUnitReady(hHandleForTripUnit);
 
 		PrintToScreen("Updated settings:");
 		menu_ID_ACPRO2_DUMP_SETTINGS();
@@ -5590,6 +5904,18 @@ static void processCommands(HWND hwnd, WPARAM wParam)
 		menu_ID_DUMP_DB_PERSONALITY();
 		break;
 
+	case ID_RESULTS_EXPORT_CSV:
+		menu_ID_RESULTS_EXPORT(false);
+		break;
+
+	case ID_RESULTS_EXPORT_COLUMNAR:
+		menu_ID_RESULTS_EXPORT(true);
+		break;
+
+	case ID_RESULTS_SUMMARY:
+		menu_ID_RESULTS_SUMMARY();
+		break;
+
 		//////////////////////////////////////////////////////
 		// AC-PRO-2
 		//////////////////////////////////////////////////////
@@ -5879,6 +6205,22 @@ static void processCommands(HWND hwnd, WPARAM wParam)
 		menu_ID_ARDUINO_ABORT_TIMING();
 		break;
 
+	case ID_SOFTTESTSET_RUNTEST_MULTI_LT:
+		menu_ID_SOFTTESTSET_RUNTEST_MULTI_LT();
+		break;
+
+	case ID_SOFTTESTSET_RUNTEST_MULTI_ST:
+		menu_ID_SOFTTESTSET_RUNTEST_MULTI_ST();
+		break;
+
+	case ID_SOFTTESTSET_RUNTEST_MULTI_INST:
+		menu_ID_SOFTTESTSET_RUNTEST_MULTI_INST();
+		break;
+
+	case ID_SOFTTESTSET_RUNTEST_MULTI_GF:
+		menu_ID_SOFTTESTSET_RUNTEST_MULTI_GF();
+		break;
+
 		//////////////////////////////////////////////////////
 		// FTDI menu
 		//////////////////////////////////////////////////////
@@ -5956,7 +6298,6 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 {
 	HDC hdc;
 	PAINTSTRUCT ps;
-	std::string *message;
 	int statusBarHeight;
 
 	switch (msg)
@@ -5988,6 +6329,9 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 			(HINSTANCE)GetWindowLongPtr(hwnd, GWLP_HINSTANCE),
 			NULL); // pointer not needed
 
+		// (the default limit is only 32K characters; AppendToEditBox() does its own)
+		SendMessageA(hwndEdit, EM_SETLIMITTEXT, 0, 0);
+
 		CreateFontForEditBox();
 
 		hwndStatusBar =
@@ -6028,6 +6372,10 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 			FindTripUnitWhenConnected();
 			isTimerSet = false;
 			break;
+
+		case ID_TIMER_LOG:
+			AppendToEditBox(logPipeline.TakeUIText());
+			break;
 		}
 		break;
 
@@ -6065,10 +6413,6 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 	case WM_CLOSE:
 		DestroyWindow(hwnd);
 		break;
-	case WM_CALIBRATION_UPDATE_MSG:
-		message = reinterpret_cast<std::string *>(lParam);
-		_PrintToScreen(*message);
-		free((char *)lParam);
 	case WM_COMMAND:
 		processCommands(hwnd, wParam);
 		break;
@@ -6155,8 +6499,7 @@ bool OpenLogFile()
 {
 	// TODO: base log file name on current date/time
 	std::string logFileName = "C:\\urc\\apps\\autocal_rc\\autocal_rc.log";
-	log_file.open(logFileName, std::ios::out | std::ios::app);
-	if (!log_file.is_open())
+	if (!logPipeline.OpenFile(logFileName))
 	{
 		PrintToScreen("Error opening log file: " + logFileName);
 		return false;
@@ -6173,11 +6516,14 @@ void Initialize()
 	CheckForRequiredPaths();
 	ReadInConfigurationFile();
 
-	if (DB::Connect(database_file))
+	if (DB::Connect(database_file, dbJournalFile))
 		PrintToScreen("Successfully connected to database: " + database_file);
 	else
 		PrintToScreen("*** ERROR*** cannot open database: " + database_file);
 
+	if (!RESULTS_STORE::Results().Open(resultsStoreFile))
+		PrintToScreen("*** ERROR*** cannot open results store: " + resultsStoreFile);
+
 	if (!OpenLogFile())
 	{
 		PrintToScreen("Error opening log file");
@@ -6253,6 +6599,8 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
 	if (!hwndMain)
 		ExitWithError("Window Registration Failed!");
 
+	logPipeline.Start();
+
 	std::thread init_thread(Initialize);
 	init_thread.detach();
 
@@ -6266,6 +6614,12 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
 			 5000,
 			 NULL);
 
+	// and every LOG_UI_INTERVAL_MS, for whatever has been printed since last time
+	SetTimer(hwndMain,
+			 ID_TIMER_LOG,
+			 LOG_UI_INTERVAL_MS,
+			 NULL);
+
 	SetConnectionStatus(ConnectionEnum::DEVICE_TRIP_UNIT, false);
 	SetConnectionStatus(ConnectionEnum::DEVICE_KEITHLEY, false);
 	SetConnectionStatus(ConnectionEnum::DEVICE_ARDUINO, false);
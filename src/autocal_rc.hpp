@@ -28,16 +28,18 @@
 #include "util\urc_protocol.hpp"
 #include "util\win32_api_comm.hpp"
 #include "util\util.hpp"
+#include "util\screen.hpp"
 #include "devices\ftdi.hpp"
 #include "devices\rigol_DG1000z.hpp"
 #include "devices\bk_precision_9801.hpp"
 #include "util\db.hpp"
+#include "util\instrument_broker.hpp"
+#include "util\scpi_shadow.hpp"
+#include "util\results_store.hpp"
 #include "tests\production_test.hpp"
 
 // function prototypes
 void ExitWithError(const std::string &message);
-void PrintToScreen(const std::string &message);
-void scr_printf(const char *format, ...);
 static void menu_ID_ACPRO2_PRINT_VERSION();
 static void menu_ID_ARDUINO_PRINTVERSION();
 void PrintConnectionStatus();
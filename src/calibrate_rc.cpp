@@ -12,6 +12,7 @@
  *******************************************************************************/
 
 #include "autocal_rc.hpp"
+#include "calibration_sequence.hpp"
 #include <fstream>
 
 extern TripUnitType tripUnitType;
@@ -195,9 +196,8 @@ namespace ACPRO2_RG
 											  });
 
 		// It is possible the trip unit reboots here...
-		// Wait 2 Seconds
-		PrintToScreen("Waiting 2 seconds for trip unit to reboot...");
-		Sleep(2000);
+		PrintToScreen("Waiting for trip unit to reboot...");
+		WaitForTripUnitReady(hTripUnit);
 
 		ACPRO2_RG::SetSystemAndDeviceSettings(hTripUnit,
 											  [](SystemSettings4 *Settings, DeviceSettings4 *DevSettings4)
@@ -207,9 +207,8 @@ namespace ACPRO2_RG
 											  });
 
 		// It is possible the trip unit reboots here...
-		// Wait 2 Seconds
-		PrintToScreen("Waiting 2 seconds for trip unit to reboot...");
-		Sleep(2000);
+		PrintToScreen("Waiting for trip unit to reboot...");
+		WaitForTripUnitReady(hTripUnit);
 	}
 
 	static bool CalibrateChannel(
@@ -225,7 +224,7 @@ namespace ACPRO2_RG
 		cmd.Hdr.Type = MSG_EXE_CALIBRATE_AD;
 		cmd.Hdr.Version = PROTOCOL_VERSION;
 		cmd.Hdr.Length = sizeof(MsgExeCalibrateAD) - sizeof(MsgHdr);
-		cmd.Hdr.Seq = SequenceNumber();
+		cmd.Hdr.Seq = SequenceNumber(hTripUnit);
 		cmd.Hdr.Dst = ADDR_TRIP_UNIT;
 		cmd.Hdr.Src = ADDR_CAL_APP;
 		cmd.CalibrateRequest = calRequest;
@@ -406,10 +405,66 @@ namespace ACPRO2_RG
 		// cal_file.write("\r\n", 2);
 	}
 
+	// serial number of the unit DoFullTripUnitCAL() is working on; for labeling results
+	static std::string unitSerial;
+
+	// one record per MSG_EXE_CALIBRATE_AD; see util\results_store.hpp
+	static void SaveCalibrationResults(
+		const CalibrationResults &calResults, int rms_index, bool Is60hz, double KeithleyReadingVoltsRMS, uint16_t RMSCurrentToCalibrateTo)
+	{
+		RESULTS_STORE::ResultRecord record = {"cal_step", unitSerial, 0, {}};
+
+		record.fields.push_back({"hi_gain_index", rms_index});
+		record.fields.push_back({"hz", Is60hz ? 60 : 50});
+		record.fields.push_back({"keithley_volts_rms", KeithleyReadingVoltsRMS});
+		record.fields.push_back({"real_rms", RMSCurrentToCalibrateTo});
+		record.fields.push_back({"CalibratedChannels", calResults.CalibratedChannels});
+
+		for (int i = 0; i < _NUM_A2D_INPUTS_RAW_CAL; i++)
+		{
+			record.fields.push_back({"Offset_" + std::to_string(i), calResults.Offset[i]});
+			record.fields.push_back({"SwGain_" + std::to_string(i), calResults.SwGain[i]});
+			record.fields.push_back({"RmsVal_" + std::to_string(i), calResults.RmsVal[i]});
+		}
+
+		RESULTS_STORE::Results().Append(record);
+	}
+
+	// what ended up in FLASH, once the whole calibration is done
+	static void SaveFlashCalibration(const MsgRspCalibrRC &calRC)
+	{
+		const char *gainNames[_NUM_HI_GAIN] = {"HI_GAIN_0_5", "HI_GAIN_1_0", "HI_GAIN_1_5", "HI_GAIN_2_0"};
+
+		RESULTS_STORE::ResultRecord record = {"cal_flash", unitSerial, 0, {}};
+
+		record.fields.push_back({"Calibrated", calRC.CalibrationDataInfoD.Calibrated});
+
+		for (int gain = 0; gain < _NUM_HI_GAIN; gain++)
+		{
+			for (int hz = 50; hz <= 60; hz += 10)
+			{
+				const CalibrationDataAtFrequencyRC &cal =
+					(hz == 50) ? calRC.CalibrationDataInfoD.GainHI[gain].Hz50 : calRC.CalibrationDataInfoD.GainHI[gain].Hz60;
+				std::string prefix = std::string(gainNames[gain]) + "_" + std::to_string(hz) + "hz_";
+
+				record.fields.push_back({prefix + "CalibratedChannels", cal.CalibratedChannels});
+
+				for (int i = 0; i < _NUM_TO_CALIBRATE_RC; i++)
+				{
+					record.fields.push_back({prefix + "Offset_" + std::to_string(i), cal.Offset[i]});
+					record.fields.push_back({prefix + "SwGain_" + std::to_string(i), cal.SwGain[i]});
+				}
+			}
+		}
+
+		RESULTS_STORE::Results().Append(record);
+	}
+
 	static bool __CalibrateOneGain(
 		HANDLE hTripUnit,
 		HANDLE hKeithley,
-		int GAIN_CONSTANT, const FullCalibrationParams &params, bool Is60hz)
+		int GAIN_CONSTANT, const FullCalibrationParams &params, bool Is60hz,
+		const INSTRUMENT_BROKER::SourceAndMeter &instruments)
 	{
 
 		CalibrationResults calResults = {0};
@@ -486,6 +541,9 @@ namespace ACPRO2_RG
 				}
 			}
 
+			if (!instruments.Valid())
+				return false;
+
 			if (!KEITHLEY::VoltageOnKeithleyIsStable(hKeithley))
 			{
 				PrintToScreen("Keithley voltage not stable enough to proceed; aborted");
@@ -539,6 +597,9 @@ namespace ACPRO2_RG
 
 			// we check to make sure the Keithley voltage is stable before starting the calibration
 			// additionally: we also monitor it during the calibration
+			if (!instruments.Valid())
+				return false;
+
 			ASYNC_KEITHLEY::StartMonitoringKeithley(hKeithley);
 
 			retval = ACPRO2_RG::Time_CalibrateChannel(hTripUnit, calRequest, calResults, durationMS);
@@ -546,6 +607,10 @@ namespace ACPRO2_RG
 
 			ASYNC_KEITHLEY::StopMonitoringKeithley();
 
+			// (if somebody else had the source while it was calibrating, so is the calibration)
+			if (!instruments.Valid())
+				return false;
+
 			if (retval)
 			{
 				retval &= ASYNC_KEITHLEY::KeithleyIsStable();
@@ -574,6 +639,7 @@ namespace ACPRO2_RG
 			}
 
 			DumpCalibrationResults(&calResults);
+			SaveCalibrationResults(calResults, rms_index, Is60hz, KeithleyReadingVoltsRMS, RMSCurrentToCalibrateTo);
 
 			/*
 			OutputDataPoint(std::to_string(calResults.Offset[0]));
@@ -648,6 +714,9 @@ namespace ACPRO2_RG
 				}
 			}
 
+			if (!instruments.Valid())
+				return false;
+
 			if (!KEITHLEY::VoltageOnKeithleyIsStable(hKeithley))
 			{
 				PrintToScreen("Keithley voltage not stable enough to proceed; aborted");
@@ -703,6 +772,9 @@ namespace ACPRO2_RG
 
 			// we check to make sure the Keithley voltage is stable before starting the calibration
 			// additionally: we also monitor it during the calibration
+			if (!instruments.Valid())
+				return false;
+
 			ASYNC_KEITHLEY::StartMonitoringKeithley(hKeithley);
 
 			retval = ACPRO2_RG::Time_CalibrateChannel(hTripUnit, calRequest, calResults, durationMS);
@@ -710,6 +782,10 @@ namespace ACPRO2_RG
 
 			ASYNC_KEITHLEY::StopMonitoringKeithley();
 
+			// (if somebody else had the source while it was calibrating, so is the calibration)
+			if (!instruments.Valid())
+				return false;
+
 			if (retval)
 			{
 				retval = retval && ASYNC_KEITHLEY::KeithleyIsStable();
@@ -737,6 +813,7 @@ namespace ACPRO2_RG
 			}
 
 			DumpCalibrationResults(&calResults);
+			SaveCalibrationResults(calResults, rms_index, Is60hz, KeithleyReadingVoltsRMS, RMSCurrentToCalibrateTo);
 
 			/*
 
@@ -766,6 +843,10 @@ namespace ACPRO2_RG
 		}
 
 		// calibration is done; make sure to disable the output of the signal generator
+		// (if it is still ours to disable)
+		if (!instruments.Valid())
+			return false;
+
 		if (params.use_rigol_dg1000z)
 		{
 			RIGOL_DG1000Z::DisableOutput();
@@ -784,8 +865,17 @@ namespace ACPRO2_RG
 		HANDLE hKeithley,
 		int GAIN_CONSTANT, const FullCalibrationParams &params, bool Is60hz)
 	{
+		// nobody else gets to touch the source or the meter until this gain is done
+		INSTRUMENT_BROKER::SourceAndMeter instruments = INSTRUMENT_BROKER::Instruments().AcquireSourceAndMeter(
+			params.use_rigol_dg1000z ? INSTRUMENT_BROKER::RIGOL : INSTRUMENT_BROKER::BK_9801,
+			INSTRUMENT_BROKER::PRIORITY_HIGH);
+
 		// call real function
-		bool retval = __CalibrateOneGain(hTripUnit, hKeithley, GAIN_CONSTANT, params, Is60hz);
+		bool retval = __CalibrateOneGain(hTripUnit, hKeithley, GAIN_CONSTANT, params, Is60hz, instruments);
+
+		// the source is somebody else's now; leave it alone, and don't go on to the next gain
+		if (!instruments.Valid())
+			return false;
 
 		// redundant code to turn off voltage, no matter what
 		if (params.use_rigol_dg1000z)
@@ -801,150 +891,6 @@ namespace ACPRO2_RG
 		return true;
 	}
 
-	static bool CalibrateAllChannels_AtFreq(
-		HANDLE hTripUnit, HANDLE hKeithley, bool Do60hz, const FullCalibrationParams &params)
-	{
-		bool retval = true;
-
-		if (Do60hz)
-			retval = SetupTripUnitForCalibration(hTripUnit, false);
-		else
-			retval = SetupTripUnitForCalibration(hTripUnit, true);
-
-		if (!retval)
-		{
-			PrintToScreen("cannot setup trip unit parameters (frequency) for calibration");
-			return false;
-		}
-
-		if (retval)
-		{
-			PrintToScreen("waiting 2 seconds for trip unit to reboot...");
-			Sleep(2000);
-
-			retval = InitCalibration(hTripUnit);
-			if (!retval)
-			{
-				scr_printf("InitCalibration failed");
-			}
-		}
-
-		constexpr int TOTAL_CHANNEL_CAL_ATTEMPTS = 2; // 1 = 1 retry
-		int retryCount;
-
-		//////////////////////////////////////////////////////////////////////////////////////////////
-		// hardware gain at 0.5
-		//////////////////////////////////////////////////////////////////////////////////////////////
-
-		retryCount = 0;
-
-		while (retryCount < TOTAL_CHANNEL_CAL_ATTEMPTS)
-		{
-			retval = CalibrateOneGain(hTripUnit, hKeithley, _CALIBRATION_REQUEST_HI_GAIN_0_5, params, Do60hz);
-			if (retval)
-				break;
-			else
-			{
-				PrintToScreen("error calibrating A/B/C/N @ gain 0.5; retrying...");
-				return false;
-			}
-
-			retryCount++;
-		}
-
-		if (!retval)
-		{
-			PrintToScreen("error calibrating A/B/C/N @ gain 0.5; aborting");
-			return false;
-		}
-
-		//////////////////////////////////////////////////////////////////////////////////////////////
-		// hardware gain at 1.0
-		//////////////////////////////////////////////////////////////////////////////////////////////
-
-		retryCount = 0;
-		while (retryCount < TOTAL_CHANNEL_CAL_ATTEMPTS)
-		{
-			retval = CalibrateOneGain(hTripUnit, hKeithley, _CALIBRATION_REQUEST_HI_GAIN_1_0, params, Do60hz);
-
-			if (retval)
-				break;
-			else
-			{
-				PrintToScreen("error calibrating A/B/C/N @ gain 1.0; retrying...");
-				return false;
-			}
-
-			retryCount++;
-		}
-
-		if (!retval)
-		{
-			PrintToScreen("error calibrating A/B/C/N @ gain 1.0; aborting");
-			return false;
-		}
-
-		//////////////////////////////////////////////////////////////////////////////////////////////
-		// hardware gain at 1.5
-		//////////////////////////////////////////////////////////////////////////////////////////////
-
-		retryCount = 0;
-		while (retryCount < TOTAL_CHANNEL_CAL_ATTEMPTS)
-		{
-			retval = CalibrateOneGain(hTripUnit, hKeithley, _CALIBRATION_REQUEST_HI_GAIN_1_5, params, Do60hz);
-
-			if (retval)
-				break;
-			else
-			{
-				PrintToScreen("error calibrating A/B/C/N @ gain 1.5; retrying...");
-				return false;
-			}
-
-			retryCount++;
-		}
-
-		if (!retval)
-		{
-			PrintToScreen("error calibrating A/B/C/N @ gain 1.5; aborting");
-			return false;
-		}
-
-		//////////////////////////////////////////////////////////////////////////////////////////////
-		// hardware gain at 2.0
-		//////////////////////////////////////////////////////////////////////////////////////////////
-
-		retryCount = 0;
-		while (retryCount < TOTAL_CHANNEL_CAL_ATTEMPTS)
-		{
-			retval = CalibrateOneGain(hTripUnit, hKeithley, _CALIBRATION_REQUEST_HI_GAIN_2_0, params, Do60hz);
-
-			if (retval)
-				break;
-			else
-			{
-				PrintToScreen("error calibrating A/B/C/N @ gain 2.0; retrying...");
-				return false;
-			}
-
-			retryCount++;
-		}
-
-		if (!retval)
-		{
-			PrintToScreen("error calibrating A/B/C/N @ gain 2.0; aborting");
-			return false;
-		}
-
-		if (!WriteCalibrationToFlash(hTripUnit))
-		{
-			PrintToScreen("error writing calibration to flash");
-			return false;
-		}
-
-		return true;
-	}
-
 	static bool CheckCalParams(const FullCalibrationParams &params)
 	{
 		bool retval = true;
@@ -1016,120 +962,132 @@ namespace ACPRO2_RG
 		return retval;
 	}
 
-	// perform a full calibration procedure on a ACPRO2-RC trip unit
-	bool DoFullTripUnitCAL(
-		HANDLE hTripUnit, HANDLE hKeithley, const FullCalibrationParams &params)
+	// does one step of a full calibration; see calibration_sequence.hpp for what order they come in
+	static bool DoCalibrationStep(
+		HANDLE hTripUnit, HANDLE hKeithley, const FullCalibrationParams &params,
+		const CAL_SEQUENCE::CalibrationStep &step)
 	{
 		bool retval = true;
 
-		auto start = std::chrono::high_resolution_clock::now();
-
-		// cal_file.open("c:\\tmp\\cal.tmp", std::ios::out | std::ios::binary);
-
-		if (retval)
-		{
-			retval = CheckCalParams(params);
-			if (!retval)
-			{
-				PrintToScreen("invalid calibration parameters; aborting");
-				return false;
-			}
-		}
-
-		// check trip unit version
-		if (retval)
+		switch (step.type)
 		{
+		case CAL_SEQUENCE::STEP_CHECK_TRIP_UNIT_TYPE:
 			retval = TripUnitisACPro2_RC(hTripUnit);
 			if (!retval)
 				PrintToScreen("cannot calibrate; only AC-PRO-2-RC trip units are supported");
-		}
+			break;
 
-		if (retval)
-		{
-			PrintToScreen("uncalibrating trip unit...");
+		case CAL_SEQUENCE::STEP_UNCALIBRATE:
 			retval = Uncalibrate(hTripUnit);
 			if (!retval)
 				PrintToScreen("trip unit calibration failed");
-		}
+			break;
 
-		/* not needed; we call _CALIBRATION_INITIALIZE after we setup the trip
-		   unit params for the frequency
-		if (retval)
-		{
-			PrintToScreen("SetCalToDefault...");
-			retval = SetCalToDefault(hTripUnit);
+		case CAL_SEQUENCE::STEP_ENABLE_50HZ_PERSONALITY:
+			retval = Enable50hzPersonality(hTripUnit);
 			if (!retval)
-				PrintToScreen("error decommissioning trip unit");
-		}
-		*/
+				PrintToScreen("cannot calibrate; failed to enable 50hz personality");
+			break;
 
-		// if we are going to be calibrating at 50hz, we need to enable the 50hz personality
-		if (retval)
-		{
-			if (params.do50hz)
-			{
-				retval = Enable50hzPersonality(hTripUnit);
-				if (!retval)
-					PrintToScreen("cannot calibrate; failed to enable 50hz personality");
-			}
-		}
+		case CAL_SEQUENCE::STEP_SETUP_FREQUENCY:
+			retval = SetupTripUnitForCalibration(hTripUnit, !step.is60hz);
+			if (!retval)
+				PrintToScreen("cannot setup trip unit parameters (frequency) for calibration");
+			break;
 
-		if (retval)
-		{
-			if (params.do50hz)
-			{
-				PrintToScreen("calibrating trip unit at 50hz");
-				retval = CalibrateAllChannels_AtFreq(hTripUnit, hKeithley, false, params);
+		case CAL_SEQUENCE::STEP_WAIT:
+			retval = WaitForTripUnitReady(hTripUnit, step.delayMS);
+			break;
 
-				if (!retval)
-					PrintToScreen("50hz calibration failed failed");
-			}
+		case CAL_SEQUENCE::STEP_INIT_CALIBRATION:
+			// we have always carried on after this; if it really didn't take,
+			// the trip unit will refuse the channel calibrations that come next
+			if (!InitCalibration(hTripUnit))
+				scr_printf("InitCalibration failed");
+			break;
+
+		case CAL_SEQUENCE::STEP_CALIBRATE_GAIN:
+			retval = CalibrateOneGain(hTripUnit, hKeithley, step.gain, params, step.is60hz);
+			if (!retval)
+				PrintToScreen("error calibrating A/B/C/N @ " + gain_constant_to_string(step.gain) + "; aborting");
+			break;
+
+		case CAL_SEQUENCE::STEP_WRITE_TO_FLASH:
+			retval = WriteCalibrationToFlash(hTripUnit);
+			if (!retval)
+				PrintToScreen("error writing calibration to flash");
+			break;
+
+		case CAL_SEQUENCE::STEP_REBOOT:
+			MakeTripUnitReboot(hTripUnit);
+			break;
+
+		case CAL_SEQUENCE::STEP_CHECK_CALIBRATION:
+			retval = CheckTripUnitCalibration(hTripUnit);
+			if (!retval)
+				PrintToScreen("trip unit does not report being calibrated!");
+			break;
+
+		default:
+			PrintToScreen("unknown calibration step: " + CAL_SEQUENCE::StepTypeToString(step.type));
+			retval = false;
+			break;
 		}
 
+		return retval;
+	}
+
+	// perform a full calibration procedure on a ACPRO2-RC trip unit
+	bool DoFullTripUnitCAL(
+		HANDLE hTripUnit, HANDLE hKeithley, const FullCalibrationParams &params)
+	{
+		bool retval = true;
+
+		auto start = std::chrono::high_resolution_clock::now();
+
+		SCPI_SHADOW::RunStats shadowStats;
+
+		unitSerial = TripUnitSerialNumber(hTripUnit);
+
+		// cal_file.open("c:\\tmp\\cal.tmp", std::ios::out | std::ios::binary);
+
 		if (retval)
 		{
-			if (params.do60hz)
+			retval = CheckCalParams(params);
+			if (!retval)
 			{
-				PrintToScreen("calibrating trip unit at 60hz");
-				retval = CalibrateAllChannels_AtFreq(hTripUnit, hKeithley, true, params);
-
-				if (!retval)
-					PrintToScreen("60hz calibration failed failed");
+				PrintToScreen("invalid calibration parameters; aborting");
+				return false;
 			}
 		}
 
-		// the r.c. trip unit must be rebooted after attempting a calibration
-		// even if the calibration fails.
-		// otherwise the RMS calculations of the trip unit will be incorrect
-		if (!retval)
-		{
-			PrintToScreen("calibration failed; trip unit will still be rebooted...");
-		}
-
-		PrintToScreen("waiting 2 seconds...");
-		Sleep(2000);
-		MakeTripUnitReboot(hTripUnit);
-
-		// check to make sure trip unit reports being calibrated
 		if (retval)
 		{
-			PrintToScreen("waiting 2 seconds...");
-			Sleep(2000);
-			retval = CheckTripUnitCalibration(hTripUnit);
+			std::vector<CAL_SEQUENCE::CalibrationStep> steps = CAL_SEQUENCE::BuildFullCalibration(params.do50hz, params.do60hz);
 
-			if (!retval)
-				PrintToScreen("trip unit does not report being calibrated!");
+			retval = CAL_SEQUENCE::RunSequence(
+				steps,
+				[hTripUnit, hKeithley, &params](const CAL_SEQUENCE::CalibrationStep &step)
+				{
+					return DoCalibrationStep(hTripUnit, hKeithley, params, step);
+				});
 		}
 
 		if (retval)
 		{
 			PrintToScreen("ACPRO2-RC full calibration procedure completed successfully!");
-			GetCalibration(hTripUnit);
+
+			MsgRspCalibrRC calRC = {0};
+
+			if (GetCalibration(hTripUnit, &calRC))
+				SaveFlashCalibration(calRC);
 		}
 
 		auto end = std::chrono::high_resolution_clock::now();
 		auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
 
+		RESULTS_STORE::Results().Append({"cal_full", unitSerial, 0, {{"passed", retval ? 1 : 0}, {"duration_ms", (double)duration}}});
+
 		PrintToScreen("Total Calibration Time (milliseconds): " + std::to_string(duration));
 
 		// cal_file.close();
@@ -1180,7 +1138,7 @@ namespace ACPRO2_RG
 		cmd.Hdr.Type = MSG_EXE_CALIBRATE_AD;
 		cmd.Hdr.Version = PROTOCOL_VERSION;
 		cmd.Hdr.Length = sizeof(MsgExeCalibrateAD) - sizeof(MsgHdr);
-		cmd.Hdr.Seq = SequenceNumber();
+		cmd.Hdr.Seq = SequenceNumber(hTripUnit);
 		cmd.Hdr.Dst = ADDR_TRIP_UNIT;
 		cmd.Hdr.Src = ADDR_CAL_APP;
 
@@ -1273,7 +1231,7 @@ namespace ACPRO2_RG
 		cmd.Hdr.Type = MSG_EXE_CALIBRATE_AD;
 		cmd.Hdr.Version = PROTOCOL_VERSION;
 		cmd.Hdr.Length = sizeof(MsgExeCalibrateAD) - sizeof(MsgHdr);
-		cmd.Hdr.Seq = SequenceNumber();
+		cmd.Hdr.Seq = SequenceNumber(hTripUnit);
 		cmd.Hdr.Dst = ADDR_TRIP_UNIT;
 		cmd.Hdr.Src = ADDR_CAL_APP;
 
@@ -1346,9 +1304,9 @@ namespace ACPRO2_RG
 
 			if (retval)
 			{
-				scr_printf("waiting 2 seconds for trip unit to reboot...");
-				Sleep(2000);
-				retval = DoCalibrationCommand(hTripUnit, _CALIBRATION_SET_TO_DEFAULT + _CALIBRATION_UNCALIBRATE + _CALIBRATION_INITIALIZE + _CALIBRATION_WRITE_TO_FLASH);
+				scr_printf("waiting for trip unit to reboot...");
+				retval = WaitForTripUnitReady(hTripUnit) &&
+						 DoCalibrationCommand(hTripUnit, _CALIBRATION_SET_TO_DEFAULT + _CALIBRATION_UNCALIBRATE + _CALIBRATION_INITIALIZE + _CALIBRATION_WRITE_TO_FLASH);
 			}
 
 			// do next phase
@@ -1418,7 +1376,7 @@ namespace ACPRO2_RG
 		msg.Hdr.Type = MSG_SET_PERSONALITY_4;
 		msg.Hdr.Version = PROTOCOL_VERSION;
 		msg.Hdr.Length = sizeof(MsgSetPersonality4) - sizeof(MsgHdr);
-		msg.Hdr.Seq = SequenceNumber();
+		msg.Hdr.Seq = SequenceNumber(hTripUnit);
 		msg.Hdr.Dst = ADDR_TRIP_UNIT;
 		msg.Hdr.Src = ADDR_CAL_APP;
 		msg.Pers = *pers;
@@ -0,0 +1,154 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+
+#include "calibration_sequence.hpp"
+#include "util/urc_protocol.hpp"
+#include "util/screen.hpp"
+
+namespace CAL_SEQUENCE
+{
+	// the most we give the trip unit to come back after something that makes it reboot
+	// (we carry on as soon as it answers; see WaitForTripUnitReady())
+	constexpr int REBOOT_WAIT_MS = 10000;
+
+	// the hardware gains we calibrate, in the order we do them
+	static const int HI_GAINS[] = {
+		_CALIBRATION_REQUEST_HI_GAIN_0_5,
+		_CALIBRATION_REQUEST_HI_GAIN_1_0,
+		_CALIBRATION_REQUEST_HI_GAIN_1_5,
+		_CALIBRATION_REQUEST_HI_GAIN_2_0,
+	};
+
+	static CalibrationStep Step(StepType type, const std::string &description)
+	{
+		CalibrationStep step = {type, description};
+		return step;
+	}
+
+	static CalibrationStep WaitStep(int delayMS, const std::string &description)
+	{
+		CalibrationStep step = Step(STEP_WAIT, description);
+		step.delayMS = delayMS;
+		return step;
+	}
+
+	static void AddOneFrequency(std::vector<CalibrationStep> &steps, bool is60hz)
+	{
+		CalibrationStep step;
+
+		step = Step(STEP_SETUP_FREQUENCY, is60hz ? "calibrating trip unit at 60hz" : "calibrating trip unit at 50hz");
+		step.is60hz = is60hz;
+		steps.push_back(step);
+
+		steps.push_back(WaitStep(REBOOT_WAIT_MS, "waiting for trip unit to reboot..."));
+		steps.push_back(Step(STEP_INIT_CALIBRATION, ""));
+
+		for (int gain : HI_GAINS)
+		{
+			step = Step(STEP_CALIBRATE_GAIN, "");
+			step.is60hz = is60hz;
+			step.gain = gain;
+			steps.push_back(step);
+		}
+
+		steps.push_back(Step(STEP_WRITE_TO_FLASH, ""));
+	}
+
+	std::vector<CalibrationStep> BuildFullCalibration(bool do50hz, bool do60hz)
+	{
+		std::vector<CalibrationStep> steps;
+		CalibrationStep step;
+
+		steps.push_back(Step(STEP_CHECK_TRIP_UNIT_TYPE, ""));
+		steps.push_back(Step(STEP_UNCALIBRATE, "uncalibrating trip unit..."));
+
+		// if we are going to be calibrating at 50hz, we need to enable the 50hz personality
+		if (do50hz)
+			steps.push_back(Step(STEP_ENABLE_50HZ_PERSONALITY, ""));
+
+		if (do50hz)
+			AddOneFrequency(steps, false);
+
+		if (do60hz)
+			AddOneFrequency(steps, true);
+
+		// the r.c. trip unit must be rebooted after attempting a calibration
+		// even if the calibration fails.
+		// otherwise the RMS calculations of the trip unit will be incorrect
+		step = WaitStep(REBOOT_WAIT_MS, "waiting for trip unit...");
+		step.alwaysRun = true;
+		steps.push_back(step);
+
+		step = Step(STEP_REBOOT, "");
+		step.alwaysRun = true;
+		steps.push_back(step);
+
+		// check to make sure trip unit reports being calibrated
+		steps.push_back(WaitStep(REBOOT_WAIT_MS, "waiting for trip unit..."));
+		steps.push_back(Step(STEP_CHECK_CALIBRATION, ""));
+
+		return steps;
+	}
+
+	bool RunSequence(const std::vector<CalibrationStep> &steps, const DoStepFuncPtr &doStep)
+	{
+		bool retval = true;
+
+		for (const CalibrationStep &step : steps)
+		{
+			if (!retval && !step.alwaysRun)
+				continue;
+
+			if (!step.description.empty())
+				PrintToScreen(step.description);
+
+			if (!doStep(step) && retval)
+			{
+				PrintToScreen("calibration step " + StepTypeToString(step.type) + " failed; only running the steps that have to run anyway...");
+				retval = false;
+			}
+		}
+
+		return retval;
+	}
+
+	std::string StepTypeToString(StepType type)
+	{
+		switch (type)
+		{
+		case STEP_CHECK_TRIP_UNIT_TYPE:
+			return "CHECK_TRIP_UNIT_TYPE";
+		case STEP_UNCALIBRATE:
+			return "UNCALIBRATE";
+		case STEP_ENABLE_50HZ_PERSONALITY:
+			return "ENABLE_50HZ_PERSONALITY";
+		case STEP_SETUP_FREQUENCY:
+			return "SETUP_FREQUENCY";
+		case STEP_WAIT:
+			return "WAIT";
+		case STEP_INIT_CALIBRATION:
+			return "INIT_CALIBRATION";
+		case STEP_CALIBRATE_GAIN:
+			return "CALIBRATE_GAIN";
+		case STEP_WRITE_TO_FLASH:
+			return "WRITE_TO_FLASH";
+		case STEP_REBOOT:
+			return "REBOOT";
+		case STEP_CHECK_CALIBRATION:
+			return "CHECK_CALIBRATION";
+		default:
+			return "unknown";
+		}
+	}
+}
@@ -0,0 +1,69 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// the order we do things in to calibrate an ACPRO2-RC, without any of the doing
+//
+// DoFullTripUnitCAL() (calibrate_rc.cpp) asks us for the list of steps, then hands each
+// one to a function that actually talks to the trip unit and the voltage source.
+// keeping the ordering in here means it builds headless (see CMakeLists.txt), so it can
+// be run against a simulated trip unit, timed, reordered, etc. without any hardware
+
+namespace CAL_SEQUENCE
+{
+	typedef enum _StepType
+	{
+		STEP_CHECK_TRIP_UNIT_TYPE,
+		STEP_UNCALIBRATE,
+		STEP_ENABLE_50HZ_PERSONALITY,
+		STEP_SETUP_FREQUENCY,	// uses is60hz
+		STEP_WAIT,				// trip unit is rebooting; wait until it answers, but no longer than delayMS
+		STEP_INIT_CALIBRATION,
+		STEP_CALIBRATE_GAIN,	// uses is60hz, gain
+		STEP_WRITE_TO_FLASH,
+		STEP_REBOOT,
+		STEP_CHECK_CALIBRATION,
+	} StepType;
+
+	typedef struct _CalibrationStep
+	{
+		StepType type;
+		std::string description; // printed before the step runs (if not empty)
+
+		bool is60hz;
+		int gain; // _CALIBRATION_REQUEST_HI_GAIN_xxx
+		int delayMS;
+
+		// still run this step after an earlier one failed
+		// (the r.c. trip unit has to be rebooted after any calibration attempt)
+		bool alwaysRun;
+	} CalibrationStep;
+
+	// does one step; returns false if it failed
+	typedef std::function<bool(const CalibrationStep &step)> DoStepFuncPtr;
+
+	// steps for a full calibration at 50hz and/or 60hz (50hz first, if both)
+	std::vector<CalibrationStep> BuildFullCalibration(bool do50hz, bool do60hz);
+
+	// runs the steps in order; once one fails, only the alwaysRun steps after it get run
+	// returns true if every step succeeded
+	bool RunSequence(const std::vector<CalibrationStep> &steps, const DoStepFuncPtr &doStep);
+
+	std::string StepTypeToString(StepType type);
+}
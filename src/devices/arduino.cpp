@@ -11,8 +11,15 @@
  *
  *******************************************************************************/
 
-#include "..\autocal_rc.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+#include <set>
+
 #include "arduino.hpp"
+#include "../util/comm.hpp"
+#include "../util/screen.hpp"
+#include "../util/urc_connection.hpp"
 
 namespace ARDUINO
 {
@@ -24,6 +31,10 @@ namespace ARDUINO
 
         retval = InitCommPort(hArduino, port, 19200);
 
+        // (might be a different Arduino than last time we had this HANDLE)
+        if (retval)
+            ForgetTimingNotifications(*hArduino);
+
         if (retval)
             retval = SendConnectMessage(*hArduino);
 
@@ -57,7 +68,7 @@ namespace ARDUINO
         msg.Hdr.Type = ArduinoCommands::MSG_SET_LED;
         msg.Hdr.Version = PROTOCOL_VERSION;
         msg.Hdr.Length = sizeof(msg) - sizeof(msg.Hdr);
-        msg.Hdr.Seq = SequenceNumber();
+        msg.Hdr.Seq = SequenceNumber(hArduino);
         msg.Hdr.Dst = ADDR_AUTOCAL_ARDUINO;
         msg.Hdr.Src = ADDR_CAL_APP;
         msg.Hdr.ChkSum = 0;
@@ -117,4 +128,157 @@ namespace ARDUINO
         return retval;
     }
 
+    // HANDLEs we have gotten a MSG_TIMING_TEST_COMPLETE on
+    static std::set<HANDLE> notifyingArduinos;
+    static std::mutex notifyingArduinosMutex;
+
+    static bool SendsTimingNotifications(HANDLE hArduino)
+    {
+        std::lock_guard<std::mutex> lock(notifyingArduinosMutex);
+        return notifyingArduinos.count(hArduino) != 0;
+    }
+
+    static void RememberTimingNotifications(HANDLE hArduino)
+    {
+        std::lock_guard<std::mutex> lock(notifyingArduinosMutex);
+        notifyingArduinos.insert(hArduino);
+    }
+
+    void ForgetTimingNotifications(HANDLE hArduino)
+    {
+        std::lock_guard<std::mutex> lock(notifyingArduinosMutex);
+        notifyingArduinos.erase(hArduino);
+    }
+
+    // MSG_GET_TIMING_TEST_RESULTS, without purging the port first like SendURCCommand() does;
+    // that would throw away a MSG_TIMING_TEST_COMPLETE that just came in
+    static bool SendGetTimingTestResults(HANDLE hArduino)
+    {
+        MsgGetTimingTestResults msg = {0};
+
+        msg.Hdr.Type = ArduinoCommands::MSG_GET_TIMING_TEST_RESULTS;
+        msg.Hdr.Version = PROTOCOL_VERSION;
+        msg.Hdr.Length = 0;
+        msg.Hdr.Seq = SequenceNumber(hArduino);
+        msg.Hdr.Dst = ADDR_AUTOCAL_ARDUINO;
+        msg.Hdr.Src = ADDR_CAL_APP;
+        msg.Hdr.ChkSum = 0;
+        msg.Hdr.ChkSum = CalcChecksum((uint8_t *)&msg, sizeof(msg.Hdr));
+
+        return WriteToCommPort_NoPurge(hArduino, (uint8_t *)&msg, sizeof(msg.Hdr));
+    }
+
+    // when to ask next: the closer we are to when we think the trip will be (before or
+    // after), the sooner
+    static uint64_t NextPollMS(uint64_t nowMS, uint64_t tripMS, bool notifies, const TimingWaitConfig &config)
+    {
+        if (notifies)
+            return nowMS + config.notifyPollMS;
+
+        int64_t untilTripMS = std::llabs((int64_t)tripMS - (int64_t)nowMS);
+        int64_t intervalMS = std::clamp<int64_t>(untilTripMS / config.pollDivisor, config.minPollMS, config.maxPollMS);
+
+        return nowMS + intervalMS;
+    }
+
+    TimingWaitResult WaitForTimingTestResults(
+        HANDLE hArduino,
+        uint32_t expectedMS,
+        uint64_t deadlineMS,
+        const bool *abort,
+        TimingTestResults *results,
+        TimingWaitStats *stats,
+        const TimingWaitConfig &config)
+    {
+        URCConnection &connection = GetURCConnection(hArduino);
+        TimingWaitStats localStats;
+        URCMessageUnion msg;
+
+        if (!stats)
+            stats = &localStats;
+
+        *stats = {0};
+
+        bool notifies = SendsTimingNotifications(hArduino);
+        uint64_t tripMS = SERIAL_RX::NowMS() + expectedMS;
+        uint64_t nextPollMS = NextPollMS(SERIAL_RX::NowMS(), tripMS, notifies, config);
+
+        // a MSG_GET_TIMING_TEST_RESULTS we haven't heard back about yet
+        bool polling = false;
+        uint64_t pollDeadlineMS = 0;
+
+        while (true)
+        {
+            if (abort && *abort)
+                return TimingWaitResult::ABORTED;
+
+            uint64_t nowMS = SERIAL_RX::NowMS();
+
+            if (nowMS >= deadlineMS)
+                return TimingWaitResult::TIMED_OUT;
+
+            if (polling && nowMS >= pollDeadlineMS)
+            {
+                PrintToScreen("no answer from the Arduino to MSG_GET_TIMING_TEST_RESULTS");
+                return TimingWaitResult::FAILED;
+            }
+
+            if (!polling && nowMS >= nextPollMS)
+            {
+                if (!SendGetTimingTestResults(hArduino))
+                    return TimingWaitResult::FAILED;
+
+                polling = true;
+                pollDeadlineMS = SERIAL_RX::DeadlineFromNow(connection.DefaultTimeoutMS());
+                stats->polls++;
+            }
+
+            // sleep until something comes in, or there is something else to do
+            uint64_t waitUntilMS = (std::min)({deadlineMS, polling ? pollDeadlineMS : nextPollMS, nowMS + config.abortCheckMS});
+
+            if (!connection.Receive(&msg, waitUntilMS, true))
+                continue;
+
+            switch (msg.msgHdr.Type)
+            {
+            case MSG_TIMING_TEST_COMPLETE:
+                if (!VerifyMessageIsOK(&msg, MSG_TIMING_TEST_COMPLETE, sizeof(MsgTimingTestComplete) - sizeof(MsgHdr)))
+                    break; // (if it was garbled, we'll find out the old way)
+
+                RememberTimingNotifications(hArduino);
+                stats->notified = true;
+                *results = reinterpret_cast<MsgTimingTestComplete *>(&msg)->timingTestResults;
+                return TimingWaitResult::DONE;
+
+            case MSG_NAK:
+                // arduino will NAK us if the test is still in progress...
+                if (!polling)
+                    break;
+
+                stats->naks++;
+                polling = false;
+                nextPollMS = NextPollMS(SERIAL_RX::NowMS(), tripMS, notifies, config);
+                break;
+
+            case MSG_RSP_TIMING_TEST_RESULTS:
+                if (!VerifyMessageIsOK(&msg, MSG_RSP_TIMING_TEST_RESULTS, sizeof(MsgRspTimingTestResults) - sizeof(MsgHdr)))
+                    return TimingWaitResult::FAILED;
+
+                // check to see if the timing tests are valid yet...
+                if (reinterpret_cast<MsgRspTimingTestResults *>(&msg)->timingTestResults.ResultsAreValid)
+                {
+                    *results = reinterpret_cast<MsgRspTimingTestResults *>(&msg)->timingTestResults;
+                    return TimingWaitResult::DONE;
+                }
+
+                polling = false;
+                nextPollMS = NextPollMS(SERIAL_RX::NowMS(), tripMS, notifies, config);
+                break;
+
+            default:
+                // not anything we are waiting for
+                break;
+            }
+        }
+    }
 }
\ No newline at end of file
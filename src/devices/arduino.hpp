@@ -13,7 +13,9 @@
 
 #pragma once
 
-#include "..\util\urc_protocol.hpp"
+#include <cstdint>
+
+#include "../util/urc_protocol.hpp"
 
 #pragma pack(1)
 
@@ -32,7 +34,8 @@ namespace ARDUINO
         MSG_RSP_TIMING_TEST_RESULTS = 11,
         MSG_ABORT_TIMING_TEST = 12,
         MSG_ARDUINO_GET_STATUS = 13,
-        MSG_ARDUINO_RSP_STATUS = 14
+        MSG_ARDUINO_RSP_STATUS = 14,
+        MSG_TIMING_TEST_COMPLETE = 15 // not asked for; see MsgTimingTestComplete
     };
 
     enum ArduinoNAKs : uint8_t
@@ -79,6 +82,15 @@ namespace ARDUINO
         TimingTestResults timingTestResults;
     } MsgRspTimingTestResults;
 
+    // newer firmware sends this on its own (to ADDR_CAL_APP) the moment a timing test
+    // finishes, before it would answer anything else; older firmware never does.
+    // the results can still be asked for with MSG_GET_TIMING_TEST_RESULTS afterwards
+    typedef struct _MsgTimingTestComplete
+    {
+        MsgHdr Hdr;
+        TimingTestResults timingTestResults;
+    } MsgTimingTestComplete;
+
     typedef union _ArduinoStatus
     {
         uint8_t buf[64];
@@ -101,11 +113,48 @@ namespace ARDUINO
         MsgSetLEDs msgSetLEDs;
         MsgStartTimingTest msgStartTimingTest;
         MsgGetTimingTestResults msgGetTimingTestResults;
-        MsgRspTimingTestResults MsgRspTimingTestResults;
+        MsgRspTimingTestResults msgRspTimingTestResults;
+        MsgTimingTestComplete msgTimingTestComplete;
         MsgArduinoGetStatus msgArduinoGetStatus;
 
     } AurduinoURCMessageUnion;
 
+#pragma pack()
+
+    // waiting for a timing test to finish; see WaitForTimingTestResults()
+    //
+    // if the Arduino sends MSG_TIMING_TEST_COMPLETE, that wakes us up as soon as it comes in.
+    // if it doesn't (older firmware), we ask with MSG_GET_TIMING_TEST_RESULTS: not very often
+    // while the trip is still a long way off, more and more often as it gets close. once an
+    // Arduino has sent us MSG_TIMING_TEST_COMPLETE, we only ask now and then, in case one
+    // gets lost
+    typedef struct _TimingWaitConfig
+    {
+        int minPollMS = 50;      // never ask more often than this
+        int maxPollMS = 2000;    // or less often than this
+        int pollDivisor = 4;     // in between: (time to the expected trip) / pollDivisor
+        int notifyPollMS = 5000; // how often, for an Arduino that tells us on its own
+        int abortCheckMS = 100;  // longest we go without looking at the abort flag
+    } TimingWaitConfig;
+
+    enum class TimingWaitResult
+    {
+        DONE,
+        TIMED_OUT,
+        ABORTED,
+        FAILED, // the Arduino didn't answer, or said something that made no sense
+    };
+
+    typedef struct _TimingWaitStats
+    {
+        int polls;     // MSG_GET_TIMING_TEST_RESULTS sent
+        int naks;      // ... that got NAK'd (test still going)
+        bool notified; // we found out from MSG_TIMING_TEST_COMPLETE
+    } TimingWaitStats;
+
+    // deadlineMS for a test that can take as long as it likes
+    constexpr uint64_t WAIT_FOREVER = UINT64_MAX;
+
     // prototypes
 
     bool Connect(HANDLE *hArduino, int port);
@@ -114,4 +163,20 @@ namespace ARDUINO
     bool SetLEDs(HANDLE hArduino, bool beOn);
     bool GetVersion(HANDLE hArduino, SoftVer *ArduinoFirmwareVer);
     bool GetStatus(HANDLE hArduino, uint8_t *ArduinoStatus);
+
+    // call once MSG_START_TIMING_TEST has been ACK'd
+    // expectedMS: how long from now we think the trip will take (0 if we have no idea)
+    // deadlineMS: when to give up; see SERIAL_RX::DeadlineFromNow()
+    // abort: looked at every so often; the app's ArduinoAbortTimingTest
+    TimingWaitResult WaitForTimingTestResults(
+        HANDLE hArduino,
+        uint32_t expectedMS,
+        uint64_t deadlineMS,
+        const bool *abort,
+        TimingTestResults *results,
+        TimingWaitStats *stats = nullptr,
+        const TimingWaitConfig &config = TimingWaitConfig());
+
+    // whatever is on hArduino now may not be what sent us MSG_TIMING_TEST_COMPLETE before
+    void ForgetTimingNotifications(HANDLE hArduino);
 }
\ No newline at end of file
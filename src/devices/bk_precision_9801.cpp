@@ -11,166 +11,103 @@
  *
  *******************************************************************************/
 
-#include "..\autocal_rc.hpp"
-#include <vector>
+#include <string>
 
-// note: this includes the file for the VISA Library 5.1 specification, not something
-//       not something from our project. Normally it should be located at:
-//		 C:\Program Files\IVI Foundation\VISA\Win64\Include\visa.h
-#include <C:\Program Files\IVI Foundation\VISA\Win64\Include\visa.h>
+#include "bk_precision_9801.hpp"
+#include "../util/scpi_shadow.hpp"
+#include "../util/screen.hpp"
 
-// VISA =  (Virtual Instrument Software Architecture) library
-// NI-VISA = National Instruments VISA
-// USBTMC = USB Test and Measurement Class
 // SCPI = Standard Commands for Programmable Instruments
 
-/* notes from BKprecision website:
 
-B&K Precision Corporation
-
-USBTMC Driver Readme
-
-USBTMC (USB Test & Measurement Class) is one type of USB protocol that is commonly used for remote communication
-with test and measurement instrumentations.  It's behavior allows for GPIB-like communication over USB interface.
-Additionally, it supports service request, triggers, and other specific GPIB operations.
-
-Unlike most types of USB devices that have specific drivers, USBTMC devices only require VISA installed on the computer.
-VISA will have the driver installed automatically for USBTMC communication.
-
-There are different VISA drivers available.  B&K Precision recommends using NI-VISA.
-
-This can be downloaded here:
-https://www.ni.com/en-us/support/downloads/drivers/download.ni-visa.html#346210
-
-Select the link for "Downloads".  You may download any NI-VISA version 3.0 or above, but the latest version is recommended.  Once NI-VISA is installed,
-connect the USBTMC compliant instrument to the computer and the drivers will install automatically.  The same automatic
-driver installation will occur for all other USBTMC compliant devices.
-
-For remote communication using USBTMC, we recommend using VISA drivers.
-
-Before connecting, please make sure the USBTMC communication setting is enabled on your instrument.
-
-*/
 
 namespace BK_PRECISION_9801
 {
     constexpr int BK_9801_MAX_VOLTS_RMS = 300;
 
-    // default time of 5 seconds to wait for a response from the instrument
-    ViUInt32 timeout_ms = 5000;
+    // what *IDN? starts with
+    static const std::string IDN_MATCH = "BK PRECISION, 9801";
+
+    // however we are talking to it (see SCPI_TRANSPORT); nothing until one of the Open...()
+    static SCPI_TRANSPORT::TransportPtr transport;
 
-    ViSession session;
-    ViSession resource_manager;
-    ViStatus status;
+    // what we last set it to; see SCPI_SHADOW
+    static SCPI_SHADOW::ShadowState shadow("BK_PRECISION_9801");
 
     void PrintError(std::string msg)
     {
         PrintToScreen("BK_PRECISION_9801 Error: " + msg);
     }
 
-    bool OpenVISAInterface()
+    bool OpenTransport(SCPI_TRANSPORT::TransportPtr newTransport)
     {
-        status = viOpenDefaultRM(&resource_manager);
-        if (status < VI_SUCCESS)
-        {
-            PrintError("cannot open VISA resource manager");
-            return false;
-        }
-
-        // find all instruments connected to the computer
-        ViPFindList findList = new unsigned long;
-        ViPUInt32 retcnt = new unsigned long;
-        ViChar instrDesc[1000];
-        ViChar search_expression[] = "?*";
-        status = viFindRsrc(resource_manager, search_expression, findList, retcnt, instrDesc);
-        if (status < VI_SUCCESS)
-        {
-            PrintError("device not found");
-            return false;
-        }
-
-        // first just enumerate all the VISA devices
-
-        std::vector<std::string> deviceNames;
-        while (status != VI_ERROR_RSRC_NFOUND)
-        {
-            deviceNames.push_back(std::string(instrDesc));
-            status = viFindNext(*findList, instrDesc);
-        }
+        CloseInterface();
 
-        if (deviceNames.empty())
+        if (!newTransport)
         {
-            PrintError("no BK_PRECISION_9801 VISA instruments found");
+            PrintError("no BK_PRECISION_9801 instruments found");
             return false;
         }
 
-        // now we are going to go through each one in turn, open it if we can, and ask it
-        // to identify itself...
+        PrintToScreen("BK_PRECISION_9801 on " + newTransport->Name());
+        transport = std::move(newTransport);
 
-        bool instrumentOpenedOK = false;
+        return true;
+    }
 
-        for (const std::string &deviceName : deviceNames)
-        {
-            // only open USB devices
-            if (deviceName.find("USB", 0) != std::string::npos)
-            {
-                status = viOpen(resource_manager, (ViRsrc)deviceName.c_str(), VI_NULL, VI_NULL, &session);
-                if (status == VI_SUCCESS)
-                {
-                    // Set timeout on instrument io
-                    viSetAttribute(session, VI_ATTR_TMO_VALUE, timeout_ms);
-
-                    // ask the device to identify itself
-                    std::string response;
-                    bool retval = WriteCommandReadResponse("*IDN?", response);
-
-                    if (retval)
-                    {
-                        if (response.find("BK PRECISION, 9801") != std::string::npos)
-                        {
-                            instrumentOpenedOK = true;
-                            break;
-                        }
-
-                        viClose(session); // close this device, and move onto next one
-                    }
-                    else
-                        viClose(session); // close this device, and move onto next one
-                }
-            }
-        }
+    // where: "USB", or an address on the LAN (see SCPI_TRANSPORT::Open())
+    bool OpenInterface(const std::string &where)
+    {
+        // the BK wants CR LF on the end of every command, however it gets there
+        return OpenTransport(SCPI_TRANSPORT::Open(where, IDN_MATCH, "\r\n"));
+    }
 
-        if (!instrumentOpenedOK)
-        {
-            PrintError("no BK_PRECISION_9801 VISA instruments found");
-            return false;
-        }
+    bool OpenVISAInterface()
+    {
+        return OpenInterface("USB");
     }
 
     // Close the connection to the instrument
+    void CloseInterface()
+    {
+        transport.reset();
+        shadow.Invalidate();
+    }
+
     void CloseVISAInterface()
     {
-        viClose(session);
-        viClose(resource_manager);
+        CloseInterface();
     }
 
     bool WriteCommand(const std::string &command)
     {
-        // write command to instrument
+        if (!transport)
+        {
+            PrintError("not connected");
+            return false;
+        }
 
-        std::string command_with_terminator = command + "\r\n";
+        if (!transport->Write(command))
+        {
+            // no telling what it got, so no telling what state it is in now
+            shadow.Invalidate();
+            PrintError("cannot write to instrument");
+            return false;
+        }
 
-        ViBuf scpi_command = (ViBuf)command_with_terminator.c_str();
-        ViUInt32 bytes_to_write = (ViUInt32)command_with_terminator.length();
-        ViUInt32 write_count;
+        return true;
+    }
 
-        // we rely on viWrite() to fail if the instrument is not opened
-        status = viWrite(session, scpi_command, bytes_to_write, &write_count);
-        if (status < VI_SUCCESS || write_count != bytes_to_write)
+    // read a response back, waiting at most readTimeoutMS for it
+    static bool ReadResponse(std::string &response, int readTimeoutMS)
+    {
+        if (!transport || !transport->Read(response, readTimeoutMS))
         {
-            PrintError("cannot write to VISA instrument");
+            shadow.Invalidate();
+            PrintError("cannot read from instrument");
             return false;
         }
+
         return true;
     }
 
@@ -179,28 +116,14 @@ namespace BK_PRECISION_9801
         if (!WriteCommand(command))
             return false;
 
-        // read response back
-
-        const ViUInt32 read_buffer_size = 1000;
-        ViChar read_buffer[read_buffer_size];
-        ViUInt32 bytes_read;
-
-        status = viRead(session, (ViBuf)read_buffer, read_buffer_size, &bytes_read);
-        if (status < VI_SUCCESS || bytes_read == 0)
-        {
-            PrintError("cannot read from VISA instrument");
-            return false;
-        }
-
-        // null terminate the string we read back
-        if (bytes_read < read_buffer_size)
-            read_buffer[bytes_read] = '\0';
-        else
-            read_buffer[read_buffer_size - 1] = '\0';
+        return ReadResponse(response, SCPI_TRANSPORT::SCPI_TIMEOUT_MS);
+    }
 
-        // store the response in the output parameter
-        response = read_buffer;
-        return true;
+    // send the command, and wait for the BK to say it has finished it (*OPC?), instead of
+    // sleeping for however long we guess it takes
+    bool WriteCommandAndWait(const std::string &command, int ceilingMS)
+    {
+        return SCPI_SYNC::WriteAndWait(WriteCommand, ReadResponse, command, ceilingMS);
     }
 
     // we are writing the command to the signal generator as a string,
@@ -232,21 +155,15 @@ namespace BK_PRECISION_9801
                 return false;
             }
         }
-        // set frequency
+        // set frequency; it hardly ever changes, so usually this (and waiting for it) gets
+        // skipped
         if (retval)
         {
-            if (use50Hz)
-                cmd_to_apply = ":SOUR:FREQ 50";
-            else
-                cmd_to_apply = ":SOUR:FREQ 60";
-
-            retval = WriteCommand(cmd_to_apply);
-        }
+            std::string frequency = use50Hz ? "50" : "60";
 
-        if (retval)
-        {
-            // maybe we need a certain amount of time between commands??
-            Sleep(1000);
+            // it has to be done changing the frequency before it will take a voltage
+            retval = shadow.Apply(":SOUR:FREQ", frequency, [&]()
+                                  { return WriteCommandAndWait(":SOUR:FREQ " + frequency); });
         }
 
         // set voltage
@@ -255,7 +172,9 @@ namespace BK_PRECISION_9801
             // convert back to string after scaling up
             std::string scaledVoltsRMSAsString = std::to_string(voltsRMS);
             cmd_to_apply = ":SOUR:VOLT " + scaledVoltsRMSAsString;
-            retval = WriteCommand(cmd_to_apply);
+
+            retval = shadow.Apply(":SOUR:VOLT", scaledVoltsRMSAsString, [&]()
+                                  { return WriteCommand(cmd_to_apply); });
         }
 
         // output must be intentionally enabled using EnableOutput()
@@ -268,6 +187,8 @@ namespace BK_PRECISION_9801
     {
         bool retval = true;
 
+        shadow.Invalidate();
+
         if (retval)
             retval = WriteCommand("*RST");
         if (retval)
@@ -278,11 +199,15 @@ namespace BK_PRECISION_9801
 
     bool EnableOutput()
     {
-        return WriteCommand("OUTP ON");
+        return shadow.Apply("OUTP", "ON", []()
+                            { return WriteCommand("OUTP ON"); });
     }
 
+    // always goes out, even if we think it is already off
     bool DisableOutput()
     {
-        return WriteCommand("OUTP OFF");
+        bool retval = WriteCommand("OUTP OFF");
+        shadow.Sent("OUTP", "OFF", retval);
+        return retval;
     }
 }
@@ -13,13 +13,24 @@
 
 #pragma once
 
+#include <string>
+
+#include "../util/scpi_transport.hpp"
+
 namespace BK_PRECISION_9801
 {
 
+    // where: "USB" (VISA), or an address on the LAN; see SCPI_TRANSPORT::Open()
+    bool OpenInterface(const std::string &where);
+    bool OpenTransport(SCPI_TRANSPORT::TransportPtr newTransport);
+    void CloseInterface();
+
+    // OpenInterface("USB")
     bool OpenVISAInterface();
     void CloseVISAInterface();
     bool WriteCommand(const std::string &command);
     bool WriteCommandReadResponse(const std::string &command, std::string &response);
+    bool WriteCommandAndWait(const std::string &command, int ceilingMS = SCPI_SYNC::DEFAULT_OPC_TIMEOUT_MS);
     bool Initialize();
     bool CheckForDevice();
     bool EnableOutput();
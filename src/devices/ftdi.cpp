@@ -46,6 +46,40 @@ namespace FTDI
         return NO_FTDI_INDEX;
     }
 
+    // USB serial number of the FTDI adapter that is CommPort; "" if it isn't one
+    std::string SerialNumberForCommPort(int CommPort)
+    {
+        DWORD numDevs;
+        FT_HANDLE fthandle;
+        LONG COMPORT;
+
+        if (FT_ListDevices(&numDevs, NULL, FT_LIST_NUMBER_ONLY) != FT_OK)
+            return "";
+
+        for (int i = 0; i < numDevs; i++)
+        {
+            if (FT_Open(i, &fthandle) != FT_OK)
+                continue;
+
+            FT_DEVICE type;
+            DWORD id;
+            char SerialNumberBuf[16] = {0};
+            char DescriptionBuf[64] = {0};
+
+            bool match =
+                FT_GetComPortNumber(fthandle, &COMPORT) == FT_OK &&
+                COMPORT == CommPort &&
+                FT_GetDeviceInfo(fthandle, &type, &id, SerialNumberBuf, DescriptionBuf, NULL) == FT_OK;
+
+            FT_Close(fthandle);
+
+            if (match)
+                return SerialNumberBuf;
+        }
+
+        return "";
+    }
+
     void DumpEEProm(FT_HANDLE handle)
     {
         FT_STATUS ftStatus;
@@ -13,6 +13,8 @@
 
 #pragma once
 
+#include <string>
+
 #include "..\ftdi\ftd2xx.h"
 
 namespace FTDI
@@ -24,6 +26,7 @@ namespace FTDI
     void EnumerateFTDI();
     bool ProgramEEPROM(const char *mfg, const char *description, int FTDI_Index);
     int FindTripUnitFTDIIndex(int TripUnitCommPort);
+    std::string SerialNumberForCommPort(int CommPort);
     bool VerifyEEPROM(const char *expected_mfg, const char *expected_description, int FTDI_Index);
 
 }
@@ -11,6 +11,10 @@
  *
  *******************************************************************************/
 
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
 #include "..\autocal_rc.hpp"
 
 namespace KEITHLEY
@@ -18,10 +22,38 @@ namespace KEITHLEY
 
     constexpr int KEITHLEY_TIMEOUT_MS = 200;
 
+    // how long one reading takes at :VOLT:NPLC 10 (see Initialize()); only used to figure
+    // out how long to wait for *OPC?, so it errs on the slow side
+    constexpr int KEITHLEY_MS_PER_READING = 250;
+
+    // VoltageOnKeithleyIsStable() takes readings this far apart (see util\stability.hpp for
+    // how many, and what it does with them); same 1 second as it always was, since the
+    // spread thresholds were worked out for readings 1 second apart
+    constexpr int STABILITY_SPACING_MS = 1000;
+
+    // ...and gives up if the Keithley can't give it a valid one this many times
+    constexpr int MAX_BAD_READINGS = 3;
+
+    // one conversation with the Keithley at a time; ASYNC_KEITHLEY's monitor thread takes
+    // readings while the calibration thread might want one too
+    static std::mutex keithleyMutex;
+
+    // which range we last put it in, so we don't keep telling it to auto-range before
+    // every reading; see SCPI_SHADOW
+    static SCPI_SHADOW::ShadowState shadow("KEITHLEY");
+
+    // decision trace of the last VoltageOnKeithleyIsStable()
+    static std::vector<STABILITY::StabilityStep> lastStabilityCheck;
+    static std::mutex lastStabilityCheckMutex;
+
     bool Connect(HANDLE *hKeithley, int port)
     {
         bool retval = true;
 
+        // a new handle (maybe a different Keithley, or one somebody has been pushing buttons
+        // on); whatever we thought the last one was set to doesn't count
+        shadow.Invalidate();
+
         retval = InitCommPort(hKeithley, port, 19200);
 
         if (retval)
@@ -47,6 +79,8 @@ namespace KEITHLEY
     {
         _ASSERT(hKeithley != INVALID_HANDLE_VALUE);
 
+        shadow.Invalidate();
+
         WriteToCommPort_Str(hKeithley, "*RST;:SYST:BEEP:STAT 0");
         Sleep(400);
         WriteToCommPort_Str(hKeithley, ":FORM:DATA ASCII");
@@ -56,6 +90,7 @@ namespace KEITHLEY
         WriteToCommPort_Str(hKeithley, ":VOLT:NPLC 10"); // set to meduim sample speed: 120 samples takes 120 ms
         Sleep(400);
         WriteToCommPort_Str(hKeithley, ":SENS:VOLT:AC:RANG 0"); // Set Keithley to mVolt range (expected default)
+        shadow.Sent(":SENS:VOLT:AC:RANG", "0", true);
         Sleep(400);
         WriteToCommPort_Str(hKeithley, ":TRIG:COUNT 1");
         Sleep(400);
@@ -64,19 +99,82 @@ namespace KEITHLEY
         WriteToCommPort_Str(hKeithley, ":SENS:VOLT:AC:DET:BAND 30"); // MEDium Rate: bandwidth  30 - 300KHz  @  120 ms rate
     }
 
-    double GetVoltage(HANDLE hKeithley)
+    // take samples readings in one go, and pull them all back with one :FETC?
+    //
+    // spacingMS == 0: the readings are taken back to back (:SAMP:COUNT samples)
+    // spacingMS > 0:  the Keithley paces them itself (:TRIG:COUNT samples, :TRIG:DEL between each one)
+    //
+    // instead of guessing how long that takes with a Sleep(), *OPC? doesn't answer until
+    // the last reading is in the buffer
+    bool GetVoltages(HANDLE hKeithley, int samples, int spacingMS, std::vector<double> &readings)
     {
         _ASSERT(hKeithley != INVALID_HANDLE_VALUE);
+        _ASSERT(samples > 0);
+
+        char cmd[128];
+        char opc[32];
+
+        std::lock_guard<std::mutex> lock(keithleyMutex);
+
+        readings.clear();
+
+        if (spacingMS > 0)
+            snprintf(cmd, sizeof(cmd), ":SAMP:COUNT 1;:TRIG:COUNT %d;:TRIG:DEL %.3f;:INIT;*OPC?", samples, spacingMS / 1000.0);
+        else
+            snprintf(cmd, sizeof(cmd), ":TRIG:COUNT 1;:TRIG:DEL:AUTO ON;:SAMP:COUNT %d;:INIT;*OPC?", samples);
 
-        uint8_t rsp[1024];
+        WriteToCommPort_Str(hKeithley, cmd);
+
+        int timeoutMS = KEITHLEY_TIMEOUT_MS + samples * (KEITHLEY_MS_PER_READING + spacingMS);
+
+        if (!GetResponseLine(hKeithley, opc, sizeof(opc), timeoutMS) || atoi(opc) != 1)
+        {
+            shadow.Invalidate();
+            PrintToScreen("Keithley never finished taking " + std::to_string(samples) + " readings");
+            return false;
+        }
+
+        // each reading comes back as something like "+1.23456789E+00," so this is plenty
+        std::vector<char> rsp(samples * 32 + 32);
 
-        WriteToCommPort_Str(hKeithley, ":INIT");
-        Sleep(200);
         WriteToCommPort_Str(hKeithley, ":FETC?");
 
-        if (GetRawResponse(hKeithley, rsp, KEITHLEY_TIMEOUT_MS, -1))
+        // ~16 characters per reading at 19200 baud is ~8 ms each
+        if (!GetResponseLine(hKeithley, rsp.data(), (int)rsp.size(), KEITHLEY_TIMEOUT_MS + samples * 10))
+        {
+            shadow.Invalidate();
+            return false;
+        }
+
+        const char *p = rsp.data();
+        char *end;
+
+        while (*p)
         {
-            return atof((const char *)rsp);
+            double reading = strtod(p, &end);
+
+            if (end == p)
+                break;
+
+            readings.push_back(reading);
+
+            p = end;
+            if (*p == ',')
+                p++;
+        }
+
+        return (int)readings.size() == samples;
+    }
+
+    double GetVoltage(HANDLE hKeithley)
+    {
+        _ASSERT(hKeithley != INVALID_HANDLE_VALUE);
+
+        std::vector<double> readings;
+
+        if (GetVoltages(hKeithley, 1, 0, readings))
+        {
+            return readings[0];
         }
         else
         {
@@ -88,11 +186,15 @@ namespace KEITHLEY
     {
         _ASSERT(hKeithley != INVALID_HANDLE_VALUE);
 
+        std::vector<double> readings;
         double sum = 0;
 
-        for (int i = 0; i < samples; i++)
+        if (!GetVoltages(hKeithley, samples, 0, readings))
+            return 0;
+
+        for (double reading : readings)
         {
-            sum += GetVoltage(hKeithley);
+            sum += reading;
         }
 
         return sum / samples;
@@ -102,24 +204,48 @@ namespace KEITHLEY
     {
         _ASSERT(hKeithley != INVALID_HANDLE_VALUE);
         WriteToCommPort_Str(hKeithley, ":SENS:VOLT:AC:RANG 0");
+        shadow.Sent(":SENS:VOLT:AC:RANG", "0", true);
     }
 
     void RANGE1(HANDLE hKeithley)
     {
         _ASSERT(hKeithley != INVALID_HANDLE_VALUE);
         WriteToCommPort_Str(hKeithley, ":SENS:VOLT:AC:RANG 1");
+        shadow.Sent(":SENS:VOLT:AC:RANG", "1", true);
     }
 
     void RANGE10(HANDLE hKeithley)
     {
         _ASSERT(hKeithley != INVALID_HANDLE_VALUE);
         WriteToCommPort_Str(hKeithley, ":SENS:VOLT:AC:RANG 10");
+        shadow.Sent(":SENS:VOLT:AC:RANG", "10", true);
     }
 
     void RANGE_AUTO(HANDLE hKeithley)
     {
         _ASSERT(hKeithley != INVALID_HANDLE_VALUE);
         WriteToCommPort_Str(hKeithley, ":SENSE:VOLT:AC:RANG:AUTO ON");
+        shadow.Sent(":SENS:VOLT:AC:RANG", "AUTO", true);
+    }
+
+    // auto-ranging can hand us a reading that is way off (overflow, or 0)
+    static bool ReadingIsValid(double KeithleyVoltageRMS)
+    {
+        return KeithleyVoltageRMS < 1000 && KeithleyVoltageRMS > 0;
+    }
+
+    // turn on auto-ranging, and wait for the Keithley to say it is done doing that; if
+    // it already is auto-ranging, there is nothing to do
+    static bool SelectAutoRange(HANDLE hKeithley)
+    {
+        return shadow.Apply(":SENS:VOLT:AC:RANG", "AUTO", [hKeithley]()
+                            {
+                                char opc[32];
+
+                                std::lock_guard<std::mutex> lock(keithleyMutex);
+
+                                WriteToCommPort_Str(hKeithley, ":SENSE:VOLT:AC:RANG:AUTO ON;*OPC?");
+                                return GetResponseLine(hKeithley, opc, sizeof(opc), KEITHLEY_TIMEOUT_MS) && atoi(opc) == 1; });
     }
 
     double GetVoltageForAutoRange(HANDLE hKeithley)
@@ -127,17 +253,15 @@ namespace KEITHLEY
         _ASSERT(hKeithley != INVALID_HANDLE_VALUE);
 
         // PrintToScreen("taking Keithley voltage reading....");
-        KEITHLEY::RANGE_AUTO(hKeithley);
-        Sleep(400);
+        SelectAutoRange(hKeithley);
         double KeithleyVoltageRMS = KEITHLEY::GetVoltage(hKeithley);
 
         // try to get a good reading... this logic seems required when doing auto-ranging
         for (int i = 0; i < 10; i++)
         {
-            if (KeithleyVoltageRMS >= 1000 || KeithleyVoltageRMS <= 0)
+            if (!ReadingIsValid(KeithleyVoltageRMS))
             {
                 // PrintToScreen("invalid Keithley RMS voltage: " + std::to_string(KeithleyVoltageRMS) + "; retrying");
-                Sleep(200);
                 KeithleyVoltageRMS = KEITHLEY::GetVoltage(hKeithley);
             }
             else
@@ -147,70 +271,83 @@ namespace KEITHLEY
             }
         }
 
+        // something is wrong; make sure it gets set up again next time
+        shadow.Invalidate();
+
         PrintToScreen("Could not get valid Keithley voltage reading within 10 tries; aborting");
         return std::numeric_limits<double>::quiet_NaN();
     }
 
+    static void RecordStabilityCheck(const STABILITY::StabilityDetector &detector)
+    {
+        std::lock_guard<std::mutex> lock(lastStabilityCheckMutex);
+        lastStabilityCheck = detector.Trace();
+    }
+
+    std::vector<STABILITY::StabilityStep> LastStabilityCheck()
+    {
+        std::lock_guard<std::mutex> lock(lastStabilityCheckMutex);
+        return lastStabilityCheck;
+    }
+
     bool VoltageOnKeithleyIsStable(HANDLE hKeithley, bool quietMode)
     {
-        double KeithleyVoltageRMS[5];
+        STABILITY::StabilityDetector detector;
+        std::vector<double> readings;
+        int badReadings = 0;
 
         _ASSERT(hKeithley != INVALID_HANDLE_VALUE);
 
-        // first reading might be needed
-        double IgnoreME = KEITHLEY::GetVoltageForAutoRange(hKeithley);
+        SelectAutoRange(hKeithley);
+
+        // the readings come in paced, buffered acquisitions (see GetVoltages()); the first one
+        // is a thrown away reading (it might still be auto-ranging) plus a full window, which
+        // is the least the detector can say STABLE on. if that doesn't settle it, the rest
+        // (up to maxSamples) come in one more, and we stop looking as soon as it decides
+        const STABILITY::StabilityCriteria &criteria = detector.Criteria();
+        int count = criteria.window + 1;
+        size_t skip = 1;
 
-        for (int i = 0; i < 5; i++)
+        while (detector.Result() == STABILITY::Decision::PENDING && badReadings < MAX_BAD_READINGS)
         {
-            auto loop_iteration_start = std::chrono::high_resolution_clock::now();
-            KeithleyVoltageRMS[i] = KEITHLEY::GetVoltageForAutoRange(hKeithley);
-            auto loop_iteration_end = std::chrono::high_resolution_clock::now();
-            auto loop_iteration_duration = std::chrono::duration_cast<std::chrono::milliseconds>(loop_iteration_end - loop_iteration_start).count();
+            if (!GetVoltages(hKeithley, count, STABILITY_SPACING_MS, readings))
+            {
+                badReadings++;
+                continue;
+            }
 
-            if (1000 - loop_iteration_duration > 0)
-                Sleep(1000 - loop_iteration_duration);
+            for (size_t i = skip; i < readings.size() && detector.Result() == STABILITY::Decision::PENDING; i++)
+            {
+                if (ReadingIsValid(readings[i]))
+                    detector.Add(readings[i]);
+                else
+                    badReadings++;
+            }
 
-            if (!quietMode)
-                PrintToScreen("sample #: " + std::to_string(i) + ", Keithley Voltage RMS: " + std::to_string(KeithleyVoltageRMS[i]));
+            skip = 0;
+            count = (std::max)(1, criteria.maxSamples - detector.Samples());
         }
 
-        // calc min, max, average, and spread between min and max
-        float minValue = KeithleyVoltageRMS[0];
-        float maxValue = KeithleyVoltageRMS[0];
-        float sumValue = 0;
+        if (detector.Result() == STABILITY::Decision::PENDING)
+            PrintToScreen("Could not get valid Keithley voltage readings; aborting");
+
+        RecordStabilityCheck(detector);
 
-        for (int i = 0; i < 5; i++)
+        if (!quietMode && !detector.Trace().empty())
         {
-            if (KeithleyVoltageRMS[i] < minValue)
-                minValue = KeithleyVoltageRMS[i];
-            if (KeithleyVoltageRMS[i] > maxValue)
-                maxValue = KeithleyVoltageRMS[i];
-            sumValue += KeithleyVoltageRMS[i];
-        }
+            const STABILITY::StabilityStep &last = detector.Trace().back();
 
-        float averageValue = sumValue / 5;
-        float spreadValue = maxValue - minValue;
-
-        // Print the calculated values
-        if (!quietMode)
-            PrintToScreen("Min Value: " + std::to_string(minValue));
-        if (!quietMode)
-            PrintToScreen("Max Value: " + std::to_string(maxValue));
-        if (!quietMode)
-            PrintToScreen("Average Value: " + std::to_string(averageValue));
-        if (!quietMode)
-            PrintToScreen("Spread Value: " + std::to_string(spreadValue));
-
-        float thresholdRMS = 0.1;
-
-        // 16-dec-2024
-        // per Joe N. ---> for voltages over 3vRMS, use one threshold...
-        if (averageValue > 3)
-            thresholdRMS = 0.0030;
-        else
-            thresholdRMS = 0.0015; // otherwise, use a tighter window...
+            STABILITY::DumpTrace(detector.Trace());
+
+            PrintToScreen("Min Value: " + std::to_string(last.minValue));
+            PrintToScreen("Max Value: " + std::to_string(last.maxValue));
+            PrintToScreen("Average Value: " + std::to_string(last.mean));
+            PrintToScreen("Spread Value: " + std::to_string(last.spread));
+            PrintToScreen("Threshold: " + std::to_string(last.threshold));
+            PrintToScreen(STABILITY::DecisionToString(detector.Result()) + " after " + std::to_string(detector.Samples()) + " samples");
+        }
 
-        return spreadValue < thresholdRMS;
+        return detector.Result() == STABILITY::Decision::STABLE;
     }
 
     bool VoltageOnKeithleyIsStable(HANDLE hKeithley)
@@ -222,50 +359,152 @@ namespace KEITHLEY
 
 namespace ASYNC_KEITHLEY
 {
-    static bool _keepMonitoringKeithley;
-    static bool _keithleyIsStable;
-    static bool _MonitoringInProgress;
+    KeithleyMonitor::~KeithleyMonitor()
+    {
+        Stop();
+    }
+
+    void KeithleyMonitor::Start(HANDLE hKeithley)
+    {
+        _ASSERT(hKeithley != INVALID_HANDLE_VALUE);
+
+        // only one of us at a time
+        Stop();
+
+        stopRequested = false;
+        stable = true;
+        running = true;
+
+        worker = std::thread(&KeithleyMonitor::Worker, this, hKeithley);
+    }
+
+    void KeithleyMonitor::Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(stopMutex);
+            stopRequested = true;
+        }
+
+        // wakes the worker up right away if it is between readings; if it is in the middle
+        // of one, that only takes as long as the Keithley takes to do one reading
+        stopSignal.notify_all();
+
+        if (worker.joinable())
+            worker.join();
+    }
+
+    int KeithleyMonitor::Subscribe(SampleFuncPtr callback)
+    {
+        std::lock_guard<std::mutex> lock(subscribersMutex);
+
+        int id = nextSubscriberID++;
+        subscribers[id] = callback;
+
+        return id;
+    }
+
+    void KeithleyMonitor::Unsubscribe(int id)
+    {
+        std::lock_guard<std::mutex> lock(subscribersMutex);
+        subscribers.erase(id);
+    }
+
+    void KeithleyMonitor::Publish(const KeithleySample &sample)
+    {
+        std::vector<SampleFuncPtr> callbacks;
+
+        // don't hold the lock while calling them; they might want to (un)subscribe
+        {
+            std::lock_guard<std::mutex> lock(subscribersMutex);
+
+            for (auto &subscriber : subscribers)
+                callbacks.push_back(subscriber.second);
+        }
 
-    static void MonitorKeithleyDuringCAL(HANDLE hKeithley)
+        for (SampleFuncPtr &callback : callbacks)
+            callback(sample);
+    }
+
+    // readings are looked at in blocks; each block has to come out STABLE (just like each
+    // VoltageOnKeithleyIsStable() we used to do back to back had to pass)
+    void KeithleyMonitor::Worker(HANDLE hKeithley)
     {
+        STABILITY::StabilityDetector detector;
+
+        for (;;)
+        {
+            // same auto-ranged, checked reading everybody else takes; one that never came good
+            // (overrange, or the Keithley didn't answer) is NaN, and isn't a sample at all
+            double voltsRMS = KEITHLEY::GetVoltageForAutoRange(hKeithley);
 
-        _MonitoringInProgress = true;
-        _keithleyIsStable = true;
+            if (!std::isnan(voltsRMS))
+            {
+                KeithleySample sample = {SERIAL_RX::NowMS(), voltsRMS};
+
+                Publish(sample);
+
+                switch (detector.Add(sample.voltsRMS))
+                {
+                case STABILITY::Decision::UNSTABLE:
+                    stable = false;
+                    PrintToScreen("Keithley is not stable");
+                    STABILITY::DumpTrace(detector.Trace());
+                    detector.Reset();
+                    break;
+
+                case STABILITY::Decision::STABLE:
+                    detector.Reset();
+                    break;
+
+                default:
+                    break;
+                }
+            }
 
-        // just keep going until somebody tells us to stop
-        while (_keepMonitoringKeithley)
+            std::unique_lock<std::mutex> lock(stopMutex);
+
+            if (stopSignal.wait_for(lock, std::chrono::milliseconds(KEITHLEY::STABILITY_SPACING_MS), [this]
+                                    { return stopRequested; }))
+                break;
+        }
+
+        // whatever we had of the last block still counts, if it is already bad
+        if (!detector.Trace().empty())
         {
-            _keithleyIsStable &= KEITHLEY::VoltageOnKeithleyIsStable(hKeithley, true);
-            if (!_keithleyIsStable)
+            const STABILITY::StabilityStep &last = detector.Trace().back();
+
+            if (last.spread >= last.threshold)
             {
+                stable = false;
                 PrintToScreen("Keithley is not stable");
+                STABILITY::DumpTrace(detector.Trace());
             }
-            Sleep(1000);
         }
 
-        _MonitoringInProgress = false;
+        running = false;
+    }
+
+    // the one the calibration code uses
+    static KeithleyMonitor calibrationMonitor;
+
+    KeithleyMonitor &CalibrationMonitor()
+    {
+        return calibrationMonitor;
     }
 
     void StartMonitoringKeithley(HANDLE hKeithley)
     {
-        _keepMonitoringKeithley = true;
-        std::thread t(MonitorKeithleyDuringCAL, hKeithley);
-        t.detach();
+        calibrationMonitor.Start(hKeithley);
     }
 
     void StopMonitoringKeithley()
     {
-        _keepMonitoringKeithley = false;
-
-        while (_MonitoringInProgress)
-        {
-            Sleep(1000);
-        }
+        calibrationMonitor.Stop();
     }
 
     bool KeithleyIsStable()
     {
-        return _keithleyIsStable;
+        return calibrationMonitor.IsStable();
     }
 
-}
\ No newline at end of file
+}
@@ -13,10 +13,21 @@
 
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "..\util\stability.hpp"
+
 namespace KEITHLEY
 {
     bool Connect(HANDLE *hKeithley, int port);
     void Initialize(HANDLE hKeithley);
+    bool GetVoltages(HANDLE hKeithley, int samples, int spacingMS, std::vector<double> &readings);
     double GetVoltage(HANDLE hKeithley);
     double GetAverageVoltage(HANDLE hKeithley, int samples);
 
@@ -31,10 +42,66 @@ namespace KEITHLEY
     bool VoltageOnKeithleyIsStable(HANDLE hKeithley);
     bool VoltageOnKeithleyIsStable(HANDLE hKeithley, bool quietMode);
 
+    // readings, thresholds and decisions of the last VoltageOnKeithleyIsStable(); see
+    // STABILITY::SaveTrace() to keep it
+    std::vector<STABILITY::StabilityStep> LastStabilityCheck();
+
 }
 
+// keeps an eye on the Keithley while something else is going on (MSG_EXE_CALIBRATE_AD)
+//
+// a worker thread takes a reading every so often and runs it through a
+// STABILITY::StabilityDetector; if any block of readings comes out unstable, IsStable()
+// says so until the next Start(). every reading is also handed to whoever subscribed
+// (from the worker thread, so keep it short)
+//
+// Stop() wakes the worker up and joins it; it never has to wait more than one reading
+// (GetVoltageForAutoRange(), so a few more if the Keithley is handing back bad ones)
 namespace ASYNC_KEITHLEY
 {
+    typedef struct _KeithleySample
+    {
+        uint64_t timeMS; // SERIAL_RX::NowMS() when we got it
+        double voltsRMS;
+    } KeithleySample;
+
+    typedef std::function<void(const KeithleySample &sample)> SampleFuncPtr;
+
+    class KeithleyMonitor
+    {
+    public:
+        ~KeithleyMonitor();
+
+        void Start(HANDLE hKeithley);
+        void Stop();
+
+        bool IsStable() const { return stable; }
+        bool IsRunning() const { return running; }
+
+        // returns an id for Unsubscribe()
+        int Subscribe(SampleFuncPtr callback);
+        void Unsubscribe(int id);
+
+    private:
+        void Worker(HANDLE hKeithley);
+        void Publish(const KeithleySample &sample);
+
+        std::thread worker;
+
+        std::mutex stopMutex;
+        std::condition_variable stopSignal;
+        bool stopRequested = false;
+
+        std::atomic<bool> stable{true};
+        std::atomic<bool> running{false};
+
+        std::mutex subscribersMutex;
+        std::map<int, SampleFuncPtr> subscribers;
+        int nextSubscriberID = 1;
+    };
+
+    KeithleyMonitor &CalibrationMonitor();
+
     void StartMonitoringKeithley(HANDLE hKeithley);
     void StopMonitoringKeithley();
     bool KeithleyIsStable();
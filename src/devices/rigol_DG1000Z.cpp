@@ -11,8 +11,6 @@
  *
  *******************************************************************************/
 
-#include "..\autocal_rc.hpp"
-
 #include <sstream>
 #include <iomanip>
 #include <iostream>
@@ -20,15 +18,10 @@
 #include <string>
 #include <functional>
 
-// note: this includes the file for the VISA Library 5.1 specification, not something
-//       not something from our project. Normally it should be located at:
-//		 C:\Program Files\IVI Foundation\VISA\Win64\Include\visa.h
-#include <C:\Program Files\IVI Foundation\VISA\Win64\Include\visa.h>
-#include <vector>
+#include "rigol_DG1000Z.hpp"
+#include "../util/scpi_shadow.hpp"
+#include "../util/screen.hpp"
 
-// VISA =  (Virtual Instrument Software Architecture) library
-// NI-VISA = National Instruments VISA
-// USBTMC = USB Test and Measurement Class
 // SCPI = Standard Commands for Programmable Instruments
 // AWG = Arbitrary Waveform Generator
 
@@ -41,124 +34,89 @@ namespace RIGOL_DG1000Z
 	// 		I did not implement these functions to be able to deal with the
 	//		function generator in a "general" kind of way
 
-	// default time of 5 seconds to wait for a response from the instrument
-	ViUInt32 timeout_ms = 5000;
+	// what *IDN? starts with
+	static const std::string IDN_MATCH = "Rigol Technologies,DG10";
+
+	// however we are talking to it (see SCPI_TRANSPORT); nothing until one of the Open...()
+	static SCPI_TRANSPORT::TransportPtr transport;
 
-	ViSession session;
-	ViSession resource_manager;
-	ViStatus status;
+	// what we last set the channels to; see SCPI_SHADOW
+	static SCPI_SHADOW::ShadowState shadow("RIGOL_DG1000Z");
 
 	void PrintError(std::string msg)
 	{
 		PrintToScreen("RIGOL_DG1000Z Error: " + msg);
 	}
 
-	bool OpenVISAInterface()
+	bool OpenTransport(SCPI_TRANSPORT::TransportPtr newTransport)
 	{
-		status = viOpenDefaultRM(&resource_manager);
-		if (status < VI_SUCCESS)
-		{
-			PrintError("cannot open VISA resource manager");
-			return false;
-		}
+		CloseInterface();
 
-		// find all instruments connected to the computer
-		ViPFindList findList = new unsigned long;
-		ViPUInt32 retcnt = new unsigned long;
-		ViChar instrDesc[1000];
-		ViChar search_expression[] = "?*";
-		status = viFindRsrc(resource_manager, search_expression, findList, retcnt, instrDesc);
-		if (status < VI_SUCCESS)
+		if (!newTransport)
 		{
-			PrintError("device not found");
+			PrintError("no RIGOL_DG1000Z instruments found");
 			return false;
 		}
 
-		// first just enumerate all the VISA devices
+		PrintToScreen("RIGOL_DG1000Z on " + newTransport->Name());
+		transport = std::move(newTransport);
 
-		std::vector<std::string> deviceNames;
-		while (status != VI_ERROR_RSRC_NFOUND)
-		{
-			deviceNames.push_back(std::string(instrDesc));
-			status = viFindNext(*findList, instrDesc);
-		}
+		return true;
+	}
 
-		if (deviceNames.empty())
-		{
-			PrintError("no RIGOL_DG1000Z VISA instruments found");
-			return false;
-		}
+	// where: "USB", or an address on the LAN (see SCPI_TRANSPORT::Open())
+	bool OpenInterface(const std::string &where)
+	{
+		// over USB, USBTMC marks the end of a command for us; a socket needs a newline
+		return OpenTransport(SCPI_TRANSPORT::Open(where, IDN_MATCH, (where.empty() || where == "USB") ? "" : "\n"));
+	}
+
+	bool OpenVISAInterface()
+	{
+		return OpenInterface("USB");
+	}
 
-		// now we are going to go through each one in turn, open it if we can, and ask it
-		// to identify itself...
+	// Close the connection to the instrument
+	void CloseInterface()
+	{
+		transport.reset();
+		shadow.Invalidate();
+	}
 
-		bool instrumentOpenedOK = false;
+	void CloseVISAInterface()
+	{
+		CloseInterface();
+	}
 
-		for (const std::string &deviceName : deviceNames)
+	bool WriteCommand(const std::string &command)
+	{
+		if (!transport)
 		{
-			// only open USB devices
-			if (deviceName.find("USB", 0) != std::string::npos)
-			{
-				status = viOpen(resource_manager, (ViRsrc)deviceName.c_str(), VI_NULL, VI_NULL, &session);
-				if (status == VI_SUCCESS)
-				{
-					// Set timeout on instrument io
-					viSetAttribute(session, VI_ATTR_TMO_VALUE, timeout_ms);
-
-					// ask the device to identify itself
-					std::string response;
-					bool retval = WriteCommandReadResponse("*IDN?", response);
-
-					PrintToScreen("full *IDN? response: " + response);
-
-					if (retval)
-					{
-						if (response.find("Rigol Technologies,DG10") != std::string::npos)
-						{
-							instrumentOpenedOK = true;
-							break;
-						}
-
-						viClose(session); // close this device, and move onto next one
-					}
-					else
-						viClose(session); // close this device, and move onto next one
-				}
-			}
+			PrintError("not connected");
+			return false;
 		}
 
-		if (!instrumentOpenedOK)
+		if (!transport->Write(command))
 		{
-			PrintError("no RIGOL_DG1000Z VISA instruments found");
+			// no telling what it got, so no telling what state it is in now
+			shadow.Invalidate();
+			PrintError("cannot write to instrument");
 			return false;
 		}
 
 		return true;
 	}
 
-	// Close the connection to the instrument
-	void CloseVISAInterface()
-	{
-		viClose(session);
-		viClose(resource_manager);
-	}
-
-	bool WriteCommand(const std::string &command)
+	// read a response back, waiting at most readTimeoutMS for it
+	static bool ReadResponse(std::string &response, int readTimeoutMS)
 	{
-
-		// write command to instrument
-
-		ViBuf scpi_command = (ViBuf)command.c_str();
-		ViUInt32 bytes_to_write = (ViUInt32)command.length();
-		ViUInt32 write_count;
-
-		// we rely on viWrite() to fail if the instrument is not opened
-		status = viWrite(session, scpi_command, bytes_to_write, &write_count);
-		if (status < VI_SUCCESS || write_count != bytes_to_write)
+		if (!transport || !transport->Read(response, readTimeoutMS))
 		{
-			PrintError("cannot write to VISA instrument");
+			shadow.Invalidate();
+			PrintError("cannot read from instrument");
 			return false;
 		}
+
 		return true;
 	}
 
@@ -168,28 +126,14 @@ namespace RIGOL_DG1000Z
 		if (!WriteCommand(command))
 			return false;
 
-		// read response back
-
-		const ViUInt32 read_buffer_size = 1000;
-		ViChar read_buffer[read_buffer_size];
-		ViUInt32 bytes_read;
-
-		status = viRead(session, (ViBuf)read_buffer, read_buffer_size, &bytes_read);
-		if (status < VI_SUCCESS || bytes_read == 0)
-		{
-			PrintError("cannot read from VISA instrument");
-			return false;
-		}
-
-		// null terminate the string we read back
-		if (bytes_read < read_buffer_size)
-			read_buffer[bytes_read] = '\0';
-		else
-			read_buffer[read_buffer_size - 1] = '\0';
+		return ReadResponse(response, SCPI_TRANSPORT::SCPI_TIMEOUT_MS);
+	}
 
-		// store the response in the output parameter
-		response = read_buffer;
-		return true;
+	// send the command, and wait for the AWG to say it has finished it (*OPC?), instead of
+	// sleeping for however long we guess it takes
+	bool WriteCommandAndWait(const std::string &command, int ceilingMS)
+	{
+		return SCPI_SYNC::WriteAndWait(WriteCommand, ReadResponse, command, ceilingMS);
 	}
 
 	// reset signal generator to default settings
@@ -198,6 +142,8 @@ namespace RIGOL_DG1000Z
 		bool retval = true;
 		std::string response;
 
+		shadow.Invalidate();
+
 		retval = WriteCommand("*RST");
 
 		if (retval)
@@ -229,28 +175,33 @@ namespace RIGOL_DG1000Z
 	{
 		bool retval = true;
 		std::string cmd_to_apply;
-		std::string expected_string_back;
-		std::string actual_string_back;
+		std::string settings;
 
 		// we are trying to make a string like this to send:
 		// :SOUR1:APPL:SIN 50,2.5vrms,0,0
 
-		cmd_to_apply = ":SOUR";
+		std::string source = useChannel2NotONe ? ":SOUR2" : ":SOUR1";
 
-		if (useChannel2NotONe)
-			cmd_to_apply += "2";
+		if (use50Hz)
+			settings = "50,";
 		else
-			cmd_to_apply += "1";
+			settings = "60,";
 
-		cmd_to_apply += ":APPL:SIN ";
+		settings += voltsRMSAsString + "vrms,0,0";
+		cmd_to_apply = source + ":APPL:SIN " + settings;
 
-		if (use50Hz)
-			cmd_to_apply += "50,";
-		else
-			cmd_to_apply += "60,";
+		// the calibration and the trip tests ask for the same wave over and over; only
+		// send it when it is actually different from what the channel is putting out
+		bool changed = false;
 
-		cmd_to_apply += voltsRMSAsString + "vrms,0,0";
-		retval = WriteCommand(cmd_to_apply);
+		retval = shadow.Apply(source + ":APPL:SIN", settings, [&]()
+							  {
+								  changed = true;
+								  return WriteCommand(cmd_to_apply); });
+
+		// the channels aren't in phase with each other anymore
+		if (changed)
+			shadow.Invalidate(":PHAS:SYNC");
 
 		return retval;
 	}
@@ -270,40 +221,51 @@ namespace RIGOL_DG1000Z
 	// channel 1
 	bool EnableOutput()
 	{
-		return WriteCommand(":OUTP1 ON");
+		return shadow.Apply(":OUTP1", "ON", []()
+							{ return WriteCommand(":OUTP1 ON"); });
 	}
 
 	// channel 2
 	bool EnableOutput_2()
 	{
-		return WriteCommand(":OUTP2 ON");
+		return shadow.Apply(":OUTP2", "ON", []()
+							{ return WriteCommand(":OUTP2 ON"); });
 	}
 
 	// channel 1
 	bool DisableOutput()
 	{
-		return WriteCommand(":OUTP1 OFF");
+		// always goes out, even if we think it is already off
+		bool retval = WriteCommand(":OUTP1 OFF");
+		shadow.Sent(":OUTP1", "OFF", retval);
+		return retval;
 	}
 
 	// channel 2
 	bool DisableOutput_2()
 	{
-		return WriteCommand(":OUTP2 OFF");
+		// always goes out, even if we think it is already off
+		bool retval = WriteCommand(":OUTP2 OFF");
+		shadow.Sent(":OUTP2", "OFF", retval);
+		return retval;
 	}
 
 	// channel 2
 	bool SendChannel2Phase180()
 	{
-		return WriteCommand(":SOUR2:PHAS 180");
+		return shadow.Apply(":SOUR2:PHAS", "180", []()
+							{ return WriteCommand(":SOUR2:PHAS 180"); });
 	}
 
+	// nothing to do if neither channel has been changed since the last time we synced them
 	bool SendSyncChannels()
 	{
-		bool retval = true;
-		retval &= WriteCommand(":SOUR1:PHAS:INIT");
-		Sleep(1000);
-		retval &= WriteCommand(":SOUR2:PHAS:SYNC");
-		return retval;
+		return shadow.Apply(":PHAS:SYNC", "SYNCED", []()
+							{
+								bool retval = WriteCommandAndWait(":SOUR1:PHAS:INIT");
+								if (retval)
+									retval = WriteCommand(":SOUR2:PHAS:SYNC");
+								return retval; });
 	}
 
 	// issue the commands needed to turn on the sync output
@@ -403,9 +365,14 @@ namespace RIGOL_DG1000Z
 		}
 		else
 		{
-			// just send the command, don't expect a response
+			// just send the command, don't expect a response; but don't go on to the
+			// next one until the AWG is done with this one
 			PrintToScreen(command);
-			WriteCommand(command);
+
+			if (!WriteCommandAndWait(command))
+			{
+				PrintToScreen("Failed to send command: " + command);
+			}
 		}
 	}
 
@@ -438,10 +405,10 @@ namespace RIGOL_DG1000Z
 		PrintToScreen("Processing SCPI script: " + filename);
 		PrintToScreen("====================================");
 		PrintToScreen("");
+		// the script can change anything
+		shadow.Invalidate();
+
 		ProcessLines(filename, [](const std::string &line)
-					 { 
-						SendSCPICommand(line);
-						PrintToScreen("waiting two seconds between SCPI commands..."); 
-						Sleep(2000); });
+					 { SendSCPICommand(line); });
 	}
 }
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <string>
+
+#include "../util/scpi_transport.hpp"
+
 namespace RIGOL_DG1000Z
 {
 
@@ -12,11 +16,18 @@ namespace RIGOL_DG1000Z
     //      additionally, all the functions only deal with channel 1 of the
     //      function generator.
 
+    // where: "USB" (VISA), or an address on the LAN; see SCPI_TRANSPORT::Open()
+    bool OpenInterface(const std::string &where);
+    bool OpenTransport(SCPI_TRANSPORT::TransportPtr newTransport);
+    void CloseInterface();
+
+    // OpenInterface("USB")
     bool OpenVISAInterface();
     void CloseVISAInterface();
 
     bool WriteCommand(const std::string &command);
     bool WriteCommandReadResponse(const std::string &command, std::string &response);
+    bool WriteCommandAndWait(const std::string &command, int ceilingMS = SCPI_SYNC::DEFAULT_OPC_TIMEOUT_MS);
 
     bool Initialize();
 
@@ -219,6 +219,13 @@
 #define ID_RIGOL_PHASE2_PHASE_180 40156
 #define ID_SETUP_SYNC_CHANNELS 40157
 #define IDC_CHECK_DUAL_RIGOL 40158
+#define ID_RESULTS_EXPORT_CSV 40159
+#define ID_RESULTS_EXPORT_COLUMNAR 40160
+#define ID_RESULTS_SUMMARY 40161
+#define ID_SOFTTESTSET_RUNTEST_MULTI_LT 40162
+#define ID_SOFTTESTSET_RUNTEST_MULTI_ST 40163
+#define ID_SOFTTESTSET_RUNTEST_MULTI_INST 40164
+#define ID_SOFTTESTSET_RUNTEST_MULTI_GF 40165
 
 // Next default values for new objects
 //
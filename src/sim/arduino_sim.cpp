@@ -0,0 +1,278 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include "arduino_sim.hpp"
+#include "util/screen.hpp"
+
+namespace ARDUINO_SIM
+{
+	// how long Run() waits on the port before it goes and checks whether it should stop
+	constexpr int IDLE_SLICE_MS = 100;
+
+	static void SetupResponse(URCMessageUnion *rsp, uint8_t type, size_t size)
+	{
+		rsp->msgHdr.Type = type;
+		rsp->msgHdr.Length = (uint16_t)(size - sizeof(MsgHdr));
+	}
+
+	static void BuildACK(const MsgHdr &req, URCMessageUnion *rsp)
+	{
+		SetupResponse(rsp, MSG_ACK, sizeof(MsgACK));
+		rsp->msgACK.AckSeq = req.Seq;
+	}
+
+	static void BuildNAK(const MsgHdr &req, uint16_t error, URCMessageUnion *rsp)
+	{
+		SetupResponse(rsp, MSG_NAK, sizeof(MsgNAK));
+		rsp->msgNAK.NAKSeq = req.Seq;
+		rsp->msgNAK.Error = error;
+	}
+
+	ArduinoSimulator::ArduinoSimulator(const ArduinoSimConfig &config, SERIAL_RX::ReadSomeFuncPtr readSome, URCWriteFuncPtr writeFunc)
+		: config(config),
+		  rx([this, readSome](uint8_t *buf, int maxLen, int timeoutMS) -> int
+			 {
+				 int bytesRead = readSome(buf, maxLen, timeoutMS);
+
+				 // the Receiver can't tell us the port is gone (it just looks like a timeout)
+				 if (bytesRead < 0)
+					 portDead = true;
+
+				 return bytesRead;
+			 }),
+		  writeFunc(writeFunc),
+		  rng(config.seed)
+	{
+	}
+
+	void ArduinoSimulator::Run()
+	{
+		URCMessageUnion req;
+		URCMessageUnion rsp;
+
+		while (!stopping && !portDead)
+		{
+			uint64_t deadlineMS = SERIAL_RX::DeadlineFromNow(IDLE_SLICE_MS);
+
+			// don't sleep through the end of a test
+			{
+				std::lock_guard<std::mutex> lock(stateMutex);
+
+				if (state == TestState::RUNNING)
+					deadlineMS = (std::min)(deadlineMS, tripAtMS);
+			}
+
+			bool gotRequest = ReceiveRequest(&req, deadlineMS);
+
+			// a test that ended goes out before we answer anything else (the app counts on that)
+			bool tripped;
+			{
+				std::lock_guard<std::mutex> lock(stateMutex);
+				tripped = CheckForTrip(SERIAL_RX::NowMS());
+			}
+
+			if (tripped && config.notify)
+				SendTimingTestComplete();
+
+			if (!gotRequest)
+				continue;
+
+			// somebody else's traffic, or an ACK from the app
+			if (req.msgHdr.Dst != ARDUINO::ADDR_AUTOCAL_ARDUINO)
+				continue;
+
+			if (req.msgHdr.Type == MSG_ACK || req.msgHdr.Type == MSG_NAK)
+				continue;
+
+			memset(&rsp, 0, sizeof(rsp));
+
+			{
+				std::lock_guard<std::mutex> lock(stateMutex);
+
+				stats.requests++;
+				HandleRequest(req, &rsp);
+			}
+
+			if (config.latencyMS > 0)
+				std::this_thread::sleep_for(std::chrono::milliseconds(config.latencyMS));
+
+			Send(&rsp, req.msgHdr.Seq, req.msgHdr.Src);
+		}
+	}
+
+	void ArduinoSimulator::Stop()
+	{
+		stopping = true;
+	}
+
+	void ArduinoSimulator::SetTripAfterMS(int ms)
+	{
+		std::lock_guard<std::mutex> lock(stateMutex);
+		config.tripAfterMS = ms;
+	}
+
+	ArduinoSimStats ArduinoSimulator::Stats()
+	{
+		std::lock_guard<std::mutex> lock(stateMutex);
+		return stats;
+	}
+
+	bool ArduinoSimulator::ReceiveRequest(URCMessageUnion *req, uint64_t deadlineMS)
+	{
+		URC_DECODER::FrameView frame;
+
+		while (!decoder.Next(&frame))
+		{
+			int room;
+			uint8_t *dst = decoder.WritePtr(&room);
+			int bytesRead = rx.ReadSome(dst, room, deadlineMS);
+
+			if (bytesRead == 0)
+				return false;
+
+			decoder.Commit(bytesRead);
+		}
+
+		memcpy(req->buf, frame.data, frame.length);
+
+		if (logData)
+			DumpRawMsgData(req->buf, frame.length, false);
+
+		return true;
+	}
+
+	void ArduinoSimulator::Send(URCMessageUnion *msg, uint16_t seq, uint8_t dst)
+	{
+		int len = sizeof(MsgHdr) + msg->msgHdr.Length;
+
+		msg->msgHdr.Version = PROTOCOL_VERSION;
+		msg->msgHdr.Seq = seq;
+		msg->msgHdr.Dst = dst;
+		msg->msgHdr.Src = ARDUINO::ADDR_AUTOCAL_ARDUINO;
+		msg->msgHdr.ChkSum = 0;
+		msg->msgHdr.ChkSum = CalcChecksum(msg->buf, len);
+
+		if (logData)
+			DumpRawMsgData(msg->buf, len, true);
+
+		writeFunc(msg->buf, len);
+	}
+
+	// called with stateMutex held
+	void ArduinoSimulator::HandleRequest(const URCMessageUnion &req, URCMessageUnion *rsp)
+	{
+		switch (req.msgHdr.Type)
+		{
+		case MSG_CONNECT:
+		case ARDUINO::MSG_SET_LED:
+			BuildACK(req.msgHdr, rsp);
+			break;
+
+		case MSG_GET_SW_VER:
+			// (2.x is the firmware that sends MSG_TIMING_TEST_COMPLETE)
+			SetupResponse(rsp, MSG_RSP_SW_VER, sizeof(MsgRspSwVer));
+			rsp->msgRspSwVer.Version.Major = config.notify ? 2 : 1;
+			break;
+
+		case ARDUINO::MSG_START_TIMING_TEST:
+			if (state == TestState::RUNNING)
+			{
+				BuildNAK(req.msgHdr, ARDUINO::NAK_ERROR_BUSY, rsp);
+				break;
+			}
+
+			state = TestState::RUNNING;
+			startMS = SERIAL_RX::NowMS();
+			tripAtMS = startMS + config.tripAfterMS;
+			results = {0};
+			stats.tests++;
+
+			BuildACK(req.msgHdr, rsp);
+			break;
+
+		case ARDUINO::MSG_ABORT_TIMING_TEST:
+			state = TestState::IDLE;
+			BuildACK(req.msgHdr, rsp);
+			break;
+
+		case ARDUINO::MSG_GET_TIMING_TEST_RESULTS:
+			stats.resultPolls++;
+
+			// still going (or never started)
+			if (state != TestState::DONE)
+			{
+				stats.busyNAKs++;
+				BuildNAK(req.msgHdr, ARDUINO::NAK_ERROR_BUSY, rsp);
+				break;
+			}
+
+			SetupResponse(rsp, ARDUINO::MSG_RSP_TIMING_TEST_RESULTS, sizeof(ARDUINO::MsgRspTimingTestResults));
+			reinterpret_cast<ARDUINO::MsgRspTimingTestResults *>(rsp)->timingTestResults = results;
+			break;
+
+		case ARDUINO::MSG_ARDUINO_GET_STATUS:
+			SetupResponse(rsp, ARDUINO::MSG_ARDUINO_RSP_STATUS, sizeof(ARDUINO::MsgArduinoGetStatus));
+			reinterpret_cast<ARDUINO::MsgArduinoGetStatus *>(rsp)->status.status = (uint8_t)state;
+			break;
+
+		default:
+			BuildNAK(req.msgHdr, NAK_ERROR_UNREC, rsp);
+			break;
+		}
+	}
+
+	// called with stateMutex held
+	bool ArduinoSimulator::CheckForTrip(uint64_t nowMS)
+	{
+		if (state != TestState::RUNNING || nowMS < tripAtMS)
+			return false;
+
+		state = TestState::DONE;
+
+		results.elapsedTime = (uint32_t)(tripAtMS - startMS);
+		results.ResultsAreValid = 1;
+
+		stats.lastTripMS = tripAtMS;
+
+		return true;
+	}
+
+	void ArduinoSimulator::SendTimingTestComplete()
+	{
+		URCMessageUnion msg = {0};
+		uint16_t seq;
+
+		{
+			std::lock_guard<std::mutex> lock(stateMutex);
+
+			if (config.loseNotifyPercent > 0 && std::uniform_int_distribution<int>(0, 99)(rng) < config.loseNotifyPercent)
+			{
+				stats.lostNotifications++;
+				return;
+			}
+
+			SetupResponse(&msg, ARDUINO::MSG_TIMING_TEST_COMPLETE, sizeof(ARDUINO::MsgTimingTestComplete));
+			reinterpret_cast<ARDUINO::MsgTimingTestComplete *>(&msg)->timingTestResults = results;
+
+			seq = notifySeq++;
+			stats.notifications++;
+		}
+
+		Send(&msg, seq, ADDR_CAL_APP);
+	}
+}
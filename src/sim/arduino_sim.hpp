@@ -0,0 +1,116 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <random>
+
+#include "util/urc_protocol.hpp"
+#include "util/urc_decoder.hpp"
+#include "util/urc_pipeline.hpp"
+#include "util/serial_rx.hpp"
+#include "devices/arduino.hpp"
+
+// software stand-in for the AutoCAL Arduino (the thing that times how long the trip
+// unit takes to fire its actuator)
+//
+// answers what the app sends it: connect, LEDs, sw version, status, and start / abort /
+// get results of a timing test. a timing test ends (the actuator "fires") tripAfterMS
+// after MSG_START_TIMING_TEST
+//
+// notify says which firmware we are: with it, we send MSG_TIMING_TEST_COMPLETE the moment
+// a test ends; without it, the app has to keep asking (MSG_GET_TIMING_TEST_RESULTS gets
+// NAK_ERROR_BUSY until the test is over), like the firmware in the field today
+//
+// like TRIP_UNIT_SIM, it doesn't care what it is talking over
+
+namespace ARDUINO_SIM
+{
+	typedef struct _ArduinoSimConfig
+	{
+		bool notify = true;		   // send MSG_TIMING_TEST_COMPLETE
+		int latencyMS = 2;		   // before every response
+		int tripAfterMS = 1000;	   // how long a timing test takes, from MSG_START_TIMING_TEST
+		int loseNotifyPercent = 0; // MSG_TIMING_TEST_COMPLETEs that never make it to the app
+		uint32_t seed = 1;		   // for the above
+	} ArduinoSimConfig;
+
+	typedef struct _ArduinoSimStats
+	{
+		uint32_t requests;		// good messages addressed to us
+		uint32_t resultPolls;	// MSG_GET_TIMING_TEST_RESULTS
+		uint32_t busyNAKs;		// ... answered with NAK_ERROR_BUSY
+		uint32_t tests;			// timing tests started
+		uint32_t notifications; // MSG_TIMING_TEST_COMPLETE sent
+		uint32_t lostNotifications;
+		uint64_t lastTripMS; // SERIAL_RX::NowMS() when the last test ended
+	} ArduinoSimStats;
+
+	class ArduinoSimulator
+	{
+	public:
+		ArduinoSimulator(const ArduinoSimConfig &config, SERIAL_RX::ReadSomeFuncPtr readSome, URCWriteFuncPtr writeFunc);
+
+		// answer requests until Stop() is called, or the port goes away
+		void Run();
+		void Stop();
+
+		// for the next MSG_START_TIMING_TEST (any thread)
+		void SetTripAfterMS(int ms);
+
+		ArduinoSimStats Stats();
+
+	private:
+		enum class TestState
+		{
+			IDLE,
+			RUNNING,
+			DONE,
+		};
+
+		bool ReceiveRequest(URCMessageUnion *req, uint64_t deadlineMS);
+		void Send(URCMessageUnion *msg, uint16_t seq, uint8_t dst);
+
+		// fills in rsp with whatever the real Arduino would have said
+		void HandleRequest(const URCMessageUnion &req, URCMessageUnion *rsp);
+
+		// called with stateMutex held; true if the test just ended
+		bool CheckForTrip(uint64_t nowMS);
+		void SendTimingTestComplete();
+
+		ArduinoSimConfig config;
+
+		SERIAL_RX::Receiver rx;
+		URC_DECODER::FrameDecoder decoder;
+		URCWriteFuncPtr writeFunc;
+
+		std::atomic<bool> stopping{false};
+		std::atomic<bool> portDead{false};
+
+		std::mt19937 rng;
+
+		// everything below is the timing test itself
+		std::mutex stateMutex;
+
+		TestState state = TestState::IDLE;
+		uint64_t startMS = 0;
+		uint64_t tripAtMS = 0; // when a RUNNING test ends
+		ARDUINO::TimingTestResults results = {0};
+		uint16_t notifySeq = 0;
+
+		ArduinoSimStats stats = {0};
+	};
+}
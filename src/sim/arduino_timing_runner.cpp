@@ -0,0 +1,341 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+// arduino_timing_runner: finding out that the Arduino's timing test is over, the old way
+// (Sleep(200), then MSG_GET_TIMING_TEST_RESULTS until it stops NAKing us) vs.
+// ARDUINO::WaitForTimingTestResults(), against an ARDUINO_SIM::ArduinoSimulator
+//
+// runs one timing test for each of --trips, three ways:
+//	-	old:    the loop the trip tests used to have
+//	-	poll:   WaitForTimingTestResults(), firmware that doesn't send MSG_TIMING_TEST_COMPLETE
+//	-	notify: WaitForTimingTestResults(), firmware that does (--lose PCT of them get lost)
+// and prints how long after the trip we found out, and how many times we asked
+//
+// the expected trip time we hand WaitForTimingTestResults() is off by --error percent,
+// like TimeTimeToTripMS() is against a real trip unit
+//
+//	arduino_timing_runner --trips 50,1000,5000,15000 --error 10
+
+#ifndef _WIN32
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "arduino_sim.hpp"
+#include "devices/arduino.hpp"
+#include "util/comm.hpp"
+#include "util/screen.hpp"
+
+// what the trip tests used to Sleep() between asking
+constexpr int OLD_POLL_SLEEP_MS = 200;
+
+typedef struct _RunnerConfig
+{
+	std::vector<int> tripsMS = {50, 1000, 5000, 15000};
+	int errorPercent = 10;
+	int losePercent = 0;
+	int latencyMS = 2;
+} RunnerConfig;
+
+typedef struct _TestResult
+{
+	bool ok;
+	uint64_t lateMS; // from the trip until we knew about it
+	uint32_t polls;	 // MSG_GET_TIMING_TEST_RESULTS the Arduino saw
+} TestResult;
+
+static void Usage()
+{
+	puts("usage: arduino_timing_runner [options]");
+	puts("  --trips MS,MS,...  how long each timing test takes (default 50,1000,5000,15000)");
+	puts("  --error PCT        how far off the expected trip time is (default 10)");
+	puts("  --lose PCT         MSG_TIMING_TEST_COMPLETEs that get lost (default 0)");
+	puts("  --latency MS       delay before every Arduino response (default 2)");
+}
+
+static bool ParseArgs(int argc, char *argv[], RunnerConfig *config)
+{
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string arg = argv[i];
+		std::string value = argv[i + 1];
+
+		if (arg == "--trips")
+		{
+			std::istringstream list(value);
+			std::string item;
+
+			config->tripsMS.clear();
+
+			while (std::getline(list, item, ','))
+				config->tripsMS.push_back(atoi(item.c_str()));
+		}
+		else if (arg == "--error")
+			config->errorPercent = atoi(value.c_str());
+		else if (arg == "--lose")
+			config->losePercent = atoi(value.c_str());
+		else if (arg == "--latency")
+			config->latencyMS = atoi(value.c_str());
+		else
+			return false;
+	}
+
+	return (argc % 2) == 1 && !config->tripsMS.empty();
+}
+
+static bool WriteAll(int fd, const uint8_t *data, int len)
+{
+	int sent = 0;
+
+	while (sent < len)
+	{
+		ssize_t n = write(fd, data + sent, len - sent);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		if (n <= 0)
+			return false;
+
+		sent += (int)n;
+	}
+
+	return true;
+}
+
+// a simulated Arduino on one end of a socketpair, and a HANDLE for the other end
+typedef struct _SimulatedArduino
+{
+	std::unique_ptr<ARDUINO_SIM::ArduinoSimulator> sim;
+	std::thread thread;
+	int simFD;
+	HANDLE handle;
+} SimulatedArduino;
+
+static bool StartSimulatedArduino(const ARDUINO_SIM::ArduinoSimConfig &config, SimulatedArduino *arduino)
+{
+	int fds[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+		return false;
+
+	int appFD = fds[0];
+	arduino->simFD = fds[1];
+
+	int simFD = arduino->simFD;
+
+	arduino->sim = std::make_unique<ARDUINO_SIM::ArduinoSimulator>(
+		config,
+		SERIAL_RX::PosixBackend(simFD),
+		[simFD](const uint8_t *data, int len) -> bool
+		{
+			return WriteAll(simFD, data, len);
+		});
+
+	CommTransport transport;
+
+	transport.readSome = SERIAL_RX::PosixBackend(appFD);
+	transport.write = [appFD](const uint8_t *data, int len) -> bool
+	{
+		return WriteAll(appFD, data, len);
+	};
+	transport.close = [appFD]()
+	{
+		close(appFD);
+	};
+
+	arduino->handle = RegisterCommTransport(transport);
+
+	ARDUINO_SIM::ArduinoSimulator *sim = arduino->sim.get();
+	arduino->thread = std::thread([sim]
+								  { sim->Run(); });
+
+	return true;
+}
+
+static void StopSimulatedArduino(SimulatedArduino *arduino)
+{
+	arduino->sim->Stop();
+	CloseCommPort(&arduino->handle);
+
+	// (closing our end is what gets it out of its read)
+	shutdown(arduino->simFD, SHUT_RDWR);
+
+	arduino->thread.join();
+	close(arduino->simFD);
+}
+
+static bool StartTimingTest(HANDLE hArduino)
+{
+	URCMessageUnion rsp = {0};
+
+	SendURCCommand(hArduino, ARDUINO::MSG_START_TIMING_TEST, ARDUINO::ADDR_AUTOCAL_ARDUINO, ADDR_CAL_APP);
+
+	return GetURCResponse(hArduino, &rsp) && MessageIsACK(&rsp);
+}
+
+// the loop LT_TRIP_TEST_RC::CheckTripTime() (and the other three) used to have
+static bool OldWait(HANDLE hArduino, uint32_t timeoutMS, ARDUINO::TimingTestResults *results)
+{
+	URCMessageUnion rsp = {0};
+	uint64_t deadlineMS = SERIAL_RX::DeadlineFromNow(timeoutMS);
+
+	while (true)
+	{
+		Sleep(OLD_POLL_SLEEP_MS);
+
+		if (SERIAL_RX::NowMS() >= deadlineMS)
+			return false;
+
+		SendURCCommand(hArduino, ARDUINO::MSG_GET_TIMING_TEST_RESULTS, ARDUINO::ADDR_AUTOCAL_ARDUINO, ADDR_CAL_APP);
+
+		if (!GetURCResponse(hArduino, &rsp))
+			return false;
+
+		// arduino will NAK us if the test is still in progress...
+		if (MSG_NAK == rsp.msgHdr.Type)
+			continue;
+
+		if (!VerifyMessageIsOK(&rsp, ARDUINO::MSG_RSP_TIMING_TEST_RESULTS,
+							   sizeof(ARDUINO::MsgRspTimingTestResults) - sizeof(MsgHdr)))
+			return false;
+
+		*results = reinterpret_cast<ARDUINO::MsgRspTimingTestResults *>(&rsp)->timingTestResults;
+
+		if (results->ResultsAreValid)
+			return true;
+	}
+}
+
+// every one of config.tripsMS against one simulated Arduino; newWay false is the old loop
+static std::vector<TestResult> RunTests(const RunnerConfig &config, bool notify, bool newWay)
+{
+	std::vector<TestResult> testResults;
+	ARDUINO_SIM::ArduinoSimConfig simConfig;
+	SimulatedArduino arduino;
+
+	simConfig.notify = notify;
+	simConfig.latencyMS = config.latencyMS;
+	simConfig.loseNotifyPercent = config.losePercent;
+
+	if (!StartSimulatedArduino(simConfig, &arduino))
+	{
+		scr_printf("cannot create socketpair: %s", strerror(errno));
+		return testResults;
+	}
+
+	for (int tripMS : config.tripsMS)
+	{
+		TestResult result = {false, 0, 0};
+		ARDUINO::TimingTestResults timing = {0};
+		uint32_t pollsBefore = arduino.sim->Stats().resultPolls;
+		uint32_t timeoutMS = tripMS * 3 / 2 + 1000;
+
+		arduino.sim->SetTripAfterMS(tripMS);
+
+		if (StartTimingTest(arduino.handle))
+		{
+			if (newWay)
+			{
+				uint32_t expectedMS = tripMS * (100 - config.errorPercent) / 100;
+
+				result.ok = ARDUINO::TimingWaitResult::DONE == ARDUINO::WaitForTimingTestResults(
+																   arduino.handle,
+																   expectedMS,
+																   SERIAL_RX::DeadlineFromNow(timeoutMS),
+																   nullptr,
+																   &timing);
+			}
+			else
+				result.ok = OldWait(arduino.handle, timeoutMS, &timing);
+		}
+
+		ARDUINO_SIM::ArduinoSimStats stats = arduino.sim->Stats();
+
+		// and it has to be what the Arduino measured
+		result.ok = result.ok && timing.elapsedTime == (uint32_t)tripMS;
+		result.lateMS = SERIAL_RX::NowMS() - stats.lastTripMS;
+		result.polls = stats.resultPolls - pollsBefore;
+
+		testResults.push_back(result);
+	}
+
+	StopSimulatedArduino(&arduino);
+
+	return testResults;
+}
+
+int main(int argc, char *argv[])
+{
+	RunnerConfig config;
+
+	if (!ParseArgs(argc, argv, &config))
+	{
+		Usage();
+		return 1;
+	}
+
+	typedef struct _Way
+	{
+		const char *name;
+		bool notify;
+		bool newWay;
+	} Way;
+
+	const Way ways[] = {
+		{"old", false, false},
+		{"poll", false, true},
+		{"notify", true, true},
+	};
+
+	bool allOK = true;
+
+	for (const Way &way : ways)
+	{
+		std::vector<TestResult> results = RunTests(config, way.notify, way.newWay);
+		uint64_t totalLateMS = 0;
+		uint32_t totalPolls = 0;
+
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			const TestResult &r = results[i];
+
+			scr_printf("%-7s trip %6d ms: found out %5llu ms later, asked %4u times %s",
+					   way.name, config.tripsMS[i], (unsigned long long)r.lateMS, r.polls, r.ok ? "" : "FAIL");
+
+			totalLateMS += r.lateMS;
+			totalPolls += r.polls;
+			allOK &= r.ok;
+		}
+
+		allOK &= results.size() == config.tripsMS.size();
+
+		scr_printf("%-7s total: %llu ms late, %u MSG_GET_TIMING_TEST_RESULTS", way.name, (unsigned long long)totalLateMS, totalPolls);
+	}
+
+	scr_printf(allOK ? "PASSED" : "FAILED");
+
+	return allOK ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,436 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+// db_queue_runner: DB_QUEUE::WriteBehindQueue against a SQLite database that somebody
+// else keeps locking, the way the shared production database gets tied up
+//
+// each unit is a test (--test MS) followed by writing its results (an LT threshold row
+// and a personality row, like DB::TLThreshold::Write() / DB::Personality::Write()):
+//
+//	-	direct: straight to the database, the way it used to be; the test waits out the lock
+//	-	write-behind: through the queue; the test doesn't
+//	-	crash: the database is locked the whole time, and we go down with everything still
+//		queued; then we start back up and the journal gets it all in
+//	-	rejected: a row for a unit that isn't in the database, and one with a column that
+//		isn't either, in with the rest; those two go in the dead-letter file, everything
+//		else goes in, Flush() says something didn't, and a restart doesn't try them again
+//
+//	db_queue_runner --units 20 --test 50 --lock 500 --every 1000
+
+#ifndef _WIN32
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+#include "sqlite_backend.hpp"
+#include "util/db_queue.hpp"
+#include "util/screen.hpp"
+
+typedef struct _RunnerConfig
+{
+	int units = 20;
+	int testMS = 50;	// how long each test takes before it writes its results
+	int lockMS = 500;	// the other guy holds the database locked this long...
+	int everyMS = 1000; // ...this often
+	std::string dir;	// where the database and journal go; a new temp directory if not given
+} RunnerConfig;
+
+typedef struct _WriteStats
+{
+	int failed;
+	uint64_t totalUS;
+	uint64_t maxUS;
+	uint64_t wallMS;
+} WriteStats;
+
+static void Usage()
+{
+	puts("usage: db_queue_runner [options]");
+	puts("  --units N     units tested (default 20)");
+	puts("  --test MS     time each test takes, before writing its results (default 50)");
+	puts("  --lock MS     how long the database stays locked each time (default 500)");
+	puts("  --every MS    how often it gets locked (default 1000)");
+	puts("  --dir PATH    where to put the database and journal (default: a new temp directory)");
+}
+
+static bool ParseArgs(int argc, char *argv[], RunnerConfig *config)
+{
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string arg = argv[i];
+		std::string value = argv[i + 1];
+
+		if (arg == "--units")
+			config->units = atoi(value.c_str());
+		else if (arg == "--test")
+			config->testMS = atoi(value.c_str());
+		else if (arg == "--lock")
+			config->lockMS = atoi(value.c_str());
+		else if (arg == "--every")
+			config->everyMS = atoi(value.c_str());
+		else if (arg == "--dir")
+			config->dir = value;
+		else
+			return false;
+	}
+
+	return ((argc % 2) == 1) && (config->units > 0) && (config->lockMS >= 0) && (config->everyMS > config->lockMS);
+}
+
+static uint64_t NowUS()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void SleepMS(int ms)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+// the two rows a unit's results turn into; values depend on the pass, so we can tell
+// afterwards which pass's results ended up in the database
+static DB_QUEUE::RowUpdate ThresholdRow(int id, int pass)
+{
+	int v = pass * 1000 + id;
+
+	return {"AutoTestResults", "ID", id, {{"LTNoPu_A", v}, {"LTPu_A", v}, {"LTNoPu_B", v}, {"LTPu_B", v}, {"LTNoPu_C", v}, {"LTPu_C", v}}};
+}
+
+static DB_QUEUE::RowUpdate PersonalityRow(int id, int pass)
+{
+	int v = (id + pass) % 2;
+
+	return {"AutoTestResults", "ID", id, {{"LT PU On/Off Personalitity", v}, {"LT PU to 120% Personality", v}, {"LT Dly to 50 sec Personality", v}, {"Inst Override Personality", v}, {"Inst Close Personality", v}, {"Inst Block Personality", v}, {"GF Only Personality", v}}};
+}
+
+// how many rows are in the dead-letter file
+static int CountDeadLetters(const std::string &filename)
+{
+	std::ifstream file(filename);
+	std::string line;
+	int count = 0;
+
+	while (std::getline(file, line))
+		count += (line.compare(0, 2, "W\t") == 0);
+
+	return count;
+}
+
+static bool CreateDatabase(DB_QUEUE::SqliteBackend &db, int units)
+{
+	bool retval = db.Exec("DROP TABLE IF EXISTS AutoTestResults");
+
+	if (retval)
+		retval = db.Exec("CREATE TABLE AutoTestResults (ID INTEGER PRIMARY KEY, [Serial Number] TEXT, "
+						 "LTNoPu_A INTEGER, LTPu_A INTEGER, LTNoPu_B INTEGER, LTPu_B INTEGER, LTNoPu_C INTEGER, LTPu_C INTEGER, "
+						 "[LT PU On/Off Personalitity] INTEGER, [LT PU to 120% Personality] INTEGER, [LT Dly to 50 sec Personality] INTEGER, "
+						 "[Inst Override Personality] INTEGER, [Inst Close Personality] INTEGER, [Inst Block Personality] INTEGER, "
+						 "[GF Only Personality] INTEGER)");
+
+	for (int id = 1; retval && id <= units; id++)
+		retval = db.Exec("INSERT INTO AutoTestResults (ID, [Serial Number]) VALUES (" + std::to_string(id) + ", 'RC" + std::to_string(100000 + id) + "')");
+
+	return retval;
+}
+
+// how many units have pass's results in the database
+static int CountPass(const std::string &filename, int pass)
+{
+	sqlite3 *db = nullptr;
+	int count = -1;
+
+	if (sqlite3_open(filename.c_str(), &db) == SQLITE_OK)
+	{
+		std::string sql = "SELECT COUNT(*) FROM AutoTestResults WHERE LTNoPu_A = ID + " + std::to_string(pass * 1000) +
+						  " AND LTPu_C = ID + " + std::to_string(pass * 1000) +
+						  " AND [GF Only Personality] = (ID + " + std::to_string(pass) + ") % 2";
+
+		sqlite3_busy_timeout(db, 1000 * 10);
+		sqlite3_exec(
+			db, sql.c_str(), [](void *p, int, char **values, char **) -> int
+			{
+				*(int *)p = atoi(values[0]);
+				return 0; },
+			&count, nullptr);
+	}
+
+	sqlite3_close(db);
+
+	return count;
+}
+
+// the other guy: keeps the database locked lockMS out of every everyMS
+class Locker
+{
+public:
+	Locker(const std::string &filename, int lockMS, int everyMS) : db(filename, 1000 * 60), lockMS(lockMS), everyMS(everyMS) {}
+
+	void Start()
+	{
+		thread = std::thread([this]
+							 {
+			while (!stopping)
+			{
+				if (db.Exec("BEGIN EXCLUSIVE"))
+				{
+					SleepMS(lockMS);
+					db.Exec("COMMIT");
+				}
+
+				SleepMS(everyMS - lockMS);
+			} });
+	}
+
+	void Stop()
+	{
+		stopping = true;
+
+		if (thread.joinable())
+			thread.join();
+	}
+
+	// lock it, and keep it locked until Unlock()
+	bool Lock() { return db.Exec("BEGIN EXCLUSIVE"); }
+	void Unlock() { db.Exec("COMMIT"); }
+
+private:
+	DB_QUEUE::SqliteBackend db;
+	int lockMS;
+	int everyMS;
+	std::atomic<bool> stopping{false};
+	std::thread thread;
+};
+
+static void Tally(WriteStats *stats, uint64_t startUS, bool ok)
+{
+	uint64_t us = NowUS() - startUS;
+
+	stats->totalUS += us;
+	stats->maxUS = (std::max)(stats->maxUS, us);
+
+	if (!ok)
+		stats->failed++;
+}
+
+static void PrintStats(const char *name, const RunnerConfig &config, const WriteStats &stats)
+{
+	scr_printf("%-13s wall: %6llu ms   test waited on writes: avg %8.1f ms, max %8.1f ms   failed: %d",
+			   name, (unsigned long long)stats.wallMS, stats.totalUS / 1000.0 / config.units, stats.maxUS / 1000.0, stats.failed);
+}
+
+int main(int argc, char *argv[])
+{
+	RunnerConfig config;
+
+	if (!ParseArgs(argc, argv, &config))
+	{
+		Usage();
+		return 1;
+	}
+
+	if (config.dir.empty())
+	{
+		char tmp[] = "/tmp/db_queue_XXXXXX";
+
+		if (!mkdtemp(tmp))
+		{
+			scr_printf("cannot create a temp directory");
+			return 1;
+		}
+
+		config.dir = tmp;
+	}
+
+	std::string dbFile = config.dir + "/results.db";
+	std::string journalFile = config.dir + "/db_journal.txt";
+
+	remove(journalFile.c_str());
+	remove((journalFile + ".failed").c_str());
+
+	{
+		DB_QUEUE::SqliteBackend setup(dbFile, 1000);
+
+		// WAL, so the CountPass() reads don't get in the way
+		if (!setup.IsOpen() || !setup.Exec("PRAGMA journal_mode=WAL") || !CreateDatabase(setup, config.units))
+			return 1;
+	}
+
+	scr_printf("%d units, %d ms test each; database locked %d ms out of every %d ms (%s)", config.units, config.testMS, config.lockMS, config.everyMS, dbFile.c_str());
+
+	bool retval = true;
+
+	// direct: the test writes its own results, and waits for the database to let it
+	{
+		DB_QUEUE::SqliteBackend db(dbFile, 1000 * 60);
+		Locker locker(dbFile, config.lockMS, config.everyMS);
+		WriteStats stats = {0};
+		uint64_t startUS = NowUS();
+
+		locker.Start();
+
+		for (int id = 1; id <= config.units; id++)
+		{
+			SleepMS(config.testMS);
+
+			uint64_t writeUS = NowUS();
+			DB_QUEUE::Rejected rejected = {0};
+			bool ok = (db.WriteBatch({ThresholdRow(id, 1)}, rejected) == DB_QUEUE::WRITE_OK) && (db.WriteBatch({PersonalityRow(id, 1)}, rejected) == DB_QUEUE::WRITE_OK);
+			Tally(&stats, writeUS, ok);
+		}
+
+		stats.wallMS = (NowUS() - startUS) / 1000;
+		locker.Stop();
+
+		int count = CountPass(dbFile, 1);
+		retval &= (count == config.units) && (stats.failed == 0);
+
+		PrintStats("direct", config, stats);
+		scr_printf("              %d / %d units' results in the database", count, config.units);
+	}
+
+	// write-behind: the test just queues them
+	{
+		DB_QUEUE::WriteBehindQueue queue(std::make_unique<DB_QUEUE::SqliteBackend>(dbFile, 1000 * 60), journalFile);
+		Locker locker(dbFile, config.lockMS, config.everyMS);
+		WriteStats stats = {0};
+		uint64_t startUS = NowUS();
+
+		locker.Start();
+		retval &= queue.Start();
+
+		for (int id = 1; id <= config.units; id++)
+		{
+			SleepMS(config.testMS);
+
+			uint64_t writeUS = NowUS();
+			bool ok = queue.Enqueue(ThresholdRow(id, 2)) && queue.Enqueue(PersonalityRow(id, 2));
+			Tally(&stats, writeUS, ok);
+		}
+
+		stats.wallMS = (NowUS() - startUS) / 1000;
+
+		uint64_t flushUS = NowUS();
+		bool flushed = queue.Flush(1000 * 60);
+		uint64_t flushMS = (NowUS() - flushUS) / 1000;
+
+		locker.Stop();
+		queue.Stop();
+
+		int count = CountPass(dbFile, 2);
+		retval &= flushed && (count == config.units) && (stats.failed == 0);
+
+		PrintStats("write-behind", config, stats);
+		scr_printf("              %d / %d units' results in the database, %llu ms after the last test", count, config.units, (unsigned long long)flushMS);
+		queue.PrintStats();
+	}
+
+	// crash: nothing gets in before we go down...
+	{
+		Locker locker(dbFile, 0, 1);
+		DB_QUEUE::QueueConfig queueConfig;
+
+		queueConfig.retryMS = 50;
+
+		retval &= locker.Lock();
+
+		{
+			DB_QUEUE::WriteBehindQueue queue(std::make_unique<DB_QUEUE::SqliteBackend>(dbFile, 50), journalFile, queueConfig);
+
+			retval &= queue.Start();
+
+			for (int id = 1; id <= config.units; id++)
+				retval &= queue.Enqueue(ThresholdRow(id, 3)) && queue.Enqueue(PersonalityRow(id, 3));
+
+			queue.Stop(0);
+			queue.PrintStats();
+		}
+
+		locker.Unlock();
+
+		int before = CountPass(dbFile, 3);
+
+		// ...and it all gets in when we come back up
+		DB_QUEUE::WriteBehindQueue queue(std::make_unique<DB_QUEUE::SqliteBackend>(dbFile, 1000 * 60), journalFile);
+
+		retval &= queue.Start();
+		bool flushed = queue.Flush(1000 * 60);
+		DB_QUEUE::QueueStats stats = queue.Stats();
+		queue.Stop();
+
+		int after = CountPass(dbFile, 3);
+		retval &= flushed && (before == 0) && (after == config.units) && (stats.replayed == (uint64_t)config.units * 2);
+
+		scr_printf("crash         %d / %d units' results in the database before restart; %llu rows replayed from the journal, %d / %d in after",
+				   before, config.units, (unsigned long long)stats.replayed, after, config.units);
+	}
+
+	// rejected: two rows that are never going in, in the middle of everything else
+	{
+		DB_QUEUE::WriteBehindQueue queue(std::make_unique<DB_QUEUE::SqliteBackend>(dbFile, 1000 * 60), journalFile);
+
+		retval &= queue.Start();
+
+		for (int id = 1; id <= config.units; id++)
+		{
+			retval &= queue.Enqueue(ThresholdRow(id, 4));
+
+			if (id == 1)
+				retval &= queue.Enqueue(ThresholdRow(config.units + 1, 4));
+
+			if (id == config.units / 2)
+				retval &= queue.Enqueue({"AutoTestResults", "ID", id, {{"No Such Column", 1}}});
+
+			retval &= queue.Enqueue(PersonalityRow(id, 4));
+		}
+
+		uint64_t flushUS = NowUS();
+		bool flushed = queue.Flush(1000 * 60);
+		uint64_t flushMS = (NowUS() - flushUS) / 1000;
+		DB_QUEUE::QueueStats stats = queue.Stats();
+
+		queue.PrintStats();
+		queue.Stop();
+
+		int count = CountPass(dbFile, 4);
+		int deadLetters = CountDeadLetters(queue.DeadLetterFile());
+
+		// and they don't come back on the next Start()
+		DB_QUEUE::WriteBehindQueue restarted(std::make_unique<DB_QUEUE::SqliteBackend>(dbFile, 1000 * 60), journalFile);
+
+		retval &= restarted.Start();
+		DB_QUEUE::QueueStats restartStats = restarted.Stats();
+		restarted.Stop();
+
+		// Flush() has to say no, but it shouldn't have waited out the timeout to do it
+		retval &= !flushed && (flushMS < 1000 * 10) && (stats.rejected == 2) && (stats.pending == 0) && (count == config.units) &&
+				  (deadLetters == 2) && (restartStats.replayed == 0);
+
+		scr_printf("rejected      %llu rows rejected, %d in %s; %d / %d units' results in the database; Flush() said %s after %llu ms; %llu replayed on restart",
+				   (unsigned long long)stats.rejected, deadLetters, queue.DeadLetterFile().c_str(), count, config.units, flushed ? "yes" : "no",
+				   (unsigned long long)flushMS, (unsigned long long)restartStats.replayed);
+	}
+
+	scr_printf("%s", retval ? "PASSED" : "FAILED");
+
+	return retval ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,392 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+// log_ring_runner: how much printing costs the thread that prints
+//
+// several threads print as fast as they can (lines like the --log hex dumps), through:
+//
+//	-	old: what PrintToScreen() used to do; a new std::string per line handed to the UI
+//		thread (a locked queue stands in for PostMessage()), and the line written to the
+//		log file right there on the printing thread
+//	-	ring: LOG_RING::LogPipeline set up the way the app has it (--capacity slots, drained
+//		every --drain ms); the UI thread takes its text every 50 ms. every line is posted
+//		once, like PrintToScreen() does; if the ring is full, the thread printing empties it
+//
+// prints prints/sec (until everything is in the file), what each print cost its thread,
+// and how often a thread found the ring full. every line has to be in the file, in the
+// order its thread printed it; only the window's text may lose some
+//
+//	log_ring_runner --threads 4 --lines 100000 --capacity 4096 --drain 50
+
+#ifndef _WIN32
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "util/log_ring.hpp"
+#include "util/screen.hpp"
+
+typedef struct _RunnerConfig
+{
+	int threads = 4;
+	int lines = 100000; // per thread
+	LOG_RING::LogConfig log;
+	std::string dir;
+} RunnerConfig;
+
+typedef struct _RunResult
+{
+	double linesPerSec;
+	double avgUS;
+	double p99US;
+	double maxUS;
+	uint64_t fileLines;
+	uint64_t uiBytes;
+} RunResult;
+
+static uint64_t NowNS()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void Usage()
+{
+	puts("usage: log_ring_runner [options]");
+	puts("  --threads N   threads printing at once (default 4)");
+	puts("  --lines N     lines each one prints (default 100000)");
+	puts("  --capacity N  lines in the ring (default 4096, what the app uses)");
+	puts("  --drain MS    how often the ring gets emptied (default 50, what the app uses)");
+	puts("  --dir PATH    where the log files go (default: a new temp directory)");
+}
+
+// something like a --log line: "TX: 01 0d 02 ..."
+static std::string MakeLine(int thread, int i)
+{
+	char line[256];
+	int n = snprintf(line, sizeof(line), "thread %d line %d TX:", thread, i);
+
+	for (int b = 0; b < 24 && n < (int)sizeof(line) - 4; b++)
+		n += snprintf(line + n, sizeof(line) - n, " %02x", (i + b) & 0xFF);
+
+	return std::string(line, n);
+}
+
+static uint64_t CountLines(const std::string &filename)
+{
+	std::ifstream file(filename);
+	std::string line;
+	uint64_t count = 0;
+
+	while (std::getline(file, line))
+		count++;
+
+	return count;
+}
+
+// every line each thread printed is in the file once, in order, and nothing else is
+static bool FileIsComplete(const std::string &filename, const RunnerConfig &config)
+{
+	std::ifstream file(filename);
+	std::string line;
+	std::vector<int> next(config.threads, 0);
+
+	while (std::getline(file, line))
+	{
+		int thread = -1;
+		int i = -1;
+
+		if (sscanf(line.c_str(), "thread %d line %d", &thread, &i) != 2 || thread < 0 || thread >= config.threads ||
+			i != next[thread] || line != MakeLine(thread, i))
+			return false;
+
+		next[thread]++;
+	}
+
+	for (int n : next)
+	{
+		if (n != config.lines)
+			return false;
+	}
+
+	return true;
+}
+
+// runs print on --threads threads, timing every call
+static RunResult RunProducers(const RunnerConfig &config, std::function<void(const std::string &)> print, std::function<void()> finish,
+							  const std::string &logFile, std::function<uint64_t()> uiBytes)
+{
+	std::vector<std::vector<uint32_t>> latencies(config.threads);
+	std::vector<std::thread> threads;
+
+	uint64_t startNS = NowNS();
+
+	for (int t = 0; t < config.threads; t++)
+	{
+		threads.emplace_back([&, t]
+							 {
+			std::vector<uint32_t> &mine = latencies[t];
+			mine.reserve(config.lines);
+
+			for (int i = 0; i < config.lines; i++)
+			{
+				std::string line = MakeLine(t, i);
+
+				uint64_t callNS = NowNS();
+				print(line);
+				mine.push_back((uint32_t)(NowNS() - callNS));
+			} });
+	}
+
+	for (std::thread &t : threads)
+		t.join();
+
+	// everything in the file
+	finish();
+
+	uint64_t elapsedNS = NowNS() - startNS;
+
+	std::vector<uint32_t> all;
+
+	for (const std::vector<uint32_t> &l : latencies)
+		all.insert(all.end(), l.begin(), l.end());
+
+	std::sort(all.begin(), all.end());
+
+	double sum = 0;
+
+	for (uint32_t ns : all)
+		sum += ns;
+
+	RunResult result;
+
+	result.linesPerSec = all.size() / (elapsedNS / 1e9);
+	result.avgUS = sum / all.size() / 1000.0;
+	result.p99US = all[(size_t)(all.size() * 0.99)] / 1000.0;
+	result.maxUS = all.back() / 1000.0;
+	result.fileLines = CountLines(logFile);
+	result.uiBytes = uiBytes();
+
+	return result;
+}
+
+static void PrintResult(const char *name, const RunResult &r)
+{
+	scr_printf("%-5s %10.0f prints/sec   per print: avg %7.2f us, p99 %8.2f us, max %9.2f us   in file: %llu lines",
+			   name, r.linesPerSec, r.avgUS, r.p99US, r.maxUS, (unsigned long long)r.fileLines);
+}
+
+static RunResult RunOld(const RunnerConfig &config, const std::string &logFile)
+{
+	// the UI thread's message queue, and the UI thread itself
+	std::mutex queueMutex;
+	std::deque<std::string *> queue;
+	std::atomic<bool> done{false};
+	uint64_t uiBytes = 0;
+
+	std::thread ui([&]
+				   {
+		for (;;)
+		{
+			std::string *message = nullptr;
+
+			{
+				std::lock_guard<std::mutex> lock(queueMutex);
+
+				if (!queue.empty())
+				{
+					message = queue.front();
+					queue.pop_front();
+				}
+			}
+
+			if (message)
+			{
+				uiBytes += message->size() + 2;
+				delete message;
+			}
+			else if (done)
+				break;
+			else
+				std::this_thread::yield();
+		} });
+
+	std::ofstream log_file(logFile, std::ios::out | std::ios::app);
+	std::mutex fileMutex;
+
+	RunResult result = RunProducers(
+		config,
+		[&](const std::string &msg)
+		{
+			std::string *message = new std::string(msg);
+
+			{
+				std::lock_guard<std::mutex> lock(queueMutex);
+				queue.push_back(message);
+			}
+
+			// (the app didn't lock around this; it should have)
+			std::lock_guard<std::mutex> lock(fileMutex);
+			log_file.write(msg.c_str(), msg.size());
+			log_file.write("\n", 1);
+		},
+		[&]
+		{
+			done = true;
+			ui.join();
+			log_file.flush();
+		},
+		logFile,
+		[&]
+		{ return uiBytes; });
+
+	return result;
+}
+
+static RunResult RunRing(const RunnerConfig &config, const std::string &logFile, LOG_RING::LogStats *stats)
+{
+	LOG_RING::LogPipeline pipeline(config.log);
+	std::atomic<bool> done{false};
+	uint64_t uiBytes = 0;
+
+	pipeline.OpenFile(logFile);
+	pipeline.Start();
+
+	// the app's WM_TIMER
+	std::thread ui([&]
+				   {
+		while (!done)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			uiBytes += pipeline.TakeUIText().size();
+		} });
+
+	RunResult result = RunProducers(
+		config,
+		[&](const std::string &msg)
+		{
+			pipeline.Post(msg);
+		},
+		[&]
+		{
+			pipeline.Stop();
+			done = true;
+			ui.join();
+			uiBytes += pipeline.TakeUIText().size();
+		},
+		logFile,
+		[&]
+		{ return uiBytes; });
+
+	*stats = pipeline.Stats();
+
+	return result;
+}
+
+int main(int argc, char *argv[])
+{
+	RunnerConfig config;
+
+	for (int i = 1; i < argc; i += 2)
+	{
+		std::string arg = argv[i];
+
+		if (i + 1 >= argc)
+		{
+			Usage();
+			return 1;
+		}
+
+		if (arg == "--threads")
+			config.threads = atoi(argv[i + 1]);
+		else if (arg == "--lines")
+			config.lines = atoi(argv[i + 1]);
+		else if (arg == "--capacity")
+			config.log.capacity = (size_t)atoi(argv[i + 1]);
+		else if (arg == "--drain")
+			config.log.flushIntervalMS = atoi(argv[i + 1]);
+		else if (arg == "--dir")
+			config.dir = argv[i + 1];
+		else
+		{
+			Usage();
+			return 1;
+		}
+	}
+
+	if (config.threads <= 0 || config.lines <= 0 || config.log.capacity == 0 || config.log.flushIntervalMS <= 0)
+	{
+		Usage();
+		return 1;
+	}
+
+	if (config.dir.empty())
+	{
+		char tmp[] = "/tmp/log_ring_XXXXXX";
+
+		if (!mkdtemp(tmp))
+		{
+			scr_printf("cannot create a temp directory");
+			return 1;
+		}
+
+		config.dir = tmp;
+	}
+
+	std::string oldFile = config.dir + "/old.log";
+	std::string ringFile = config.dir + "/ring.log";
+
+	remove(oldFile.c_str());
+	remove(ringFile.c_str());
+
+	uint64_t total = (uint64_t)config.threads * config.lines;
+
+	scr_printf("%d thread(s) x %d lines; ring of %zu lines, drained every %d ms (%s)", config.threads, config.lines, config.log.capacity,
+			   config.log.flushIntervalMS, config.dir.c_str());
+
+	RunResult oldResult = RunOld(config, oldFile);
+	PrintResult("old", oldResult);
+
+	LOG_RING::LogStats stats;
+	RunResult ringResult = RunRing(config, ringFile, &stats);
+	PrintResult("ring", ringResult);
+
+	bool complete = FileIsComplete(ringFile, config);
+
+	scr_printf("ring: %llu batches, ring found full %llu time(s); %llu of %llu lines in the file%s; "
+			   "%llu bytes to the window, %llu thrown away",
+			   (unsigned long long)stats.batches, (unsigned long long)stats.waited,
+			   (unsigned long long)ringResult.fileLines, (unsigned long long)total, complete ? ", all in order" : " (NOT all there, in order)",
+			   (unsigned long long)ringResult.uiBytes, (unsigned long long)stats.uiDropped);
+
+	// the window may lose text; the file may not lose a line
+	bool retval = (oldResult.fileLines == total) && (stats.posted == total) && (stats.written == total) &&
+				  (ringResult.fileLines == total) && complete;
+
+	scr_printf("%s", retval ? "PASSED" : "FAILED");
+
+	return retval ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,204 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+// results_store_runner: RESULTS_STORE with a lot of (made up) units in it
+//
+// fills a store with --units units' worth of calibration and LT trip results, then
+// exports it to .csv and columnar, reads one column back out of the columnar file, and
+// checks that everything made the trip; prints how long each step took
+//
+//	results_store_runner --units 5000
+
+#ifndef _WIN32
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+#include <unistd.h>
+
+#include "util/results_store.hpp"
+#include "util/screen.hpp"
+
+static uint64_t NowMS()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void Usage()
+{
+	puts("usage: results_store_runner [options]");
+	puts("  --units N     units to make up results for (default 5000)");
+	puts("  --dir PATH    where to put the store and exports (default: a new temp directory)");
+}
+
+int main(int argc, char *argv[])
+{
+	int units = 5000;
+	std::string dir;
+
+	for (int i = 1; i < argc; i += 2)
+	{
+		std::string arg = argv[i];
+
+		if (i + 1 >= argc)
+		{
+			Usage();
+			return 1;
+		}
+
+		if (arg == "--units")
+			units = atoi(argv[i + 1]);
+		else if (arg == "--dir")
+			dir = argv[i + 1];
+		else
+		{
+			Usage();
+			return 1;
+		}
+	}
+
+	if (dir.empty())
+	{
+		char tmp[] = "/tmp/results_store_XXXXXX";
+
+		if (!mkdtemp(tmp))
+		{
+			scr_printf("cannot create a temp directory");
+			return 1;
+		}
+
+		dir = tmp;
+	}
+
+	std::string storeFile = dir + "/results.txt";
+	std::string csvFile = dir + "/results.csv";
+	std::string columnarFile = dir + "/results.col";
+
+	remove(storeFile.c_str());
+
+	RESULTS_STORE::ResultsStore store;
+
+	if (!store.Open(storeFile))
+	{
+		scr_printf("cannot open %s", storeFile.c_str());
+		return 1;
+	}
+
+	// every unit: a calibration step at each gain, then an LT trip test; the LT error
+	// drifts a little over the run, and about 2% of units fail it
+	std::mt19937 rng(1);
+	std::normal_distribution<double> noise(0, 1);
+	double errorSum = 0;
+	int passed = 0;
+
+	uint64_t startMS = NowMS();
+
+	for (int unit = 0; unit < units; unit++)
+	{
+		std::string serial = "RC" + std::to_string(1000000 + unit);
+
+		for (int gain = 0; gain < 4; gain++)
+		{
+			RESULTS_STORE::ResultRecord record = {"cal_step", serial, 0, {{"hi_gain_index", gain}, {"hz", 60}}};
+
+			for (int i = 0; i < 12; i++)
+			{
+				record.fields.push_back({"Offset_" + std::to_string(i), std::round(2048 + 20 * noise(rng))});
+				record.fields.push_back({"SwGain_" + std::to_string(i), std::round(32768 + 300 * noise(rng))});
+			}
+
+			store.Append(record);
+		}
+
+		double errorPercent = 0.5 + 1.0 * unit / units + 0.3 * noise(rng);
+		bool ok = (std::fabs(errorPercent) < 2.0) && (rng() % 50 != 0);
+
+		errorSum += errorPercent;
+		passed += ok ? 1 : 0;
+
+		store.Append({"lt_trip", serial, 0, {{"point", 1}, {"LTPickupAMPS", 415}, {"errorPercent", errorPercent}, {"passed", ok}}});
+	}
+
+	uint64_t appendMS = NowMS() - startMS;
+
+	std::vector<RESULTS_STORE::ResultRecord> all;
+	std::vector<RESULTS_STORE::ResultRecord> trips;
+
+	startMS = NowMS();
+	bool retval = store.Load(all) && store.Load(trips, "lt_trip");
+	uint64_t loadMS = NowMS() - startMS;
+
+	retval &= (all.size() == (size_t)units * 5) && (trips.size() == (size_t)units);
+
+	startMS = NowMS();
+	retval &= RESULTS_STORE::ExportCSV(csvFile, all);
+	uint64_t csvMS = NowMS() - startMS;
+
+	startMS = NowMS();
+	retval &= RESULTS_STORE::ExportColumnar(columnarFile, all);
+	uint64_t columnarMS = NowMS() - startMS;
+
+	// one column back out, for all the units
+	std::vector<RESULTS_STORE::Column> columns;
+
+	startMS = NowMS();
+	retval &= RESULTS_STORE::LoadColumnar(columnarFile, columns, {"errorPercent"});
+	uint64_t columnMS = NowMS() - startMS;
+
+	double columnSum = 0;
+	int columnCount = 0;
+
+	retval &= (columns.size() == 1) && (columns[0].numbers.size() == all.size());
+
+	if (retval)
+	{
+		for (double d : columns[0].numbers)
+		{
+			if (!std::isnan(d))
+			{
+				columnSum += d;
+				columnCount++;
+			}
+		}
+	}
+
+	std::vector<RESULTS_STORE::FieldSummary> summary = RESULTS_STORE::Summarize(trips);
+
+	scr_printf("%d units, %d records (%s)", units, (int)all.size(), dir.c_str());
+	scr_printf("append: %llu ms   load: %llu ms   .csv: %llu ms   columnar: %llu ms   one column back: %llu ms",
+			   (unsigned long long)appendMS, (unsigned long long)loadMS, (unsigned long long)csvMS,
+			   (unsigned long long)columnarMS, (unsigned long long)columnMS);
+
+	RESULTS_STORE::PrintSummary(summary);
+
+	// what we put in is what comes back out
+	for (const RESULTS_STORE::FieldSummary &s : summary)
+	{
+		if (s.name == "passed")
+			retval &= (s.count == units) && (std::fabs(s.mean - (double)passed / units) < 1e-9);
+		else if (s.name == "errorPercent")
+			retval &= (s.count == units) && (std::fabs(s.mean - errorSum / units) < 1e-6);
+	}
+
+	retval &= (columnCount == units) && (std::fabs(columnSum / units - errorSum / units) < 1e-6);
+
+	scr_printf("%s", retval ? "PASSED" : "FAILED");
+
+	return retval ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,243 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+// scpi_driver_runner: RIGOL_DG1000Z and BK_PRECISION_9801 themselves, against simulated
+// instruments (SCPI_INSTRUMENT_SIM), over a real socket on 127.0.0.1 or in-process
+//
+// each iteration goes through what a trip test point does with the source: set up the
+// sine wave(s), turn the output(s) on, sync the channels, check what it's putting out,
+// turn everything off. the voltage changes every iteration, the rest doesn't
+//
+//	scpi_driver_runner --transport tcp --iterations 20 --latency 1
+
+#ifndef _WIN32
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "scpi_instrument_sim.hpp"
+#include "devices/rigol_DG1000Z.hpp"
+#include "devices/bk_precision_9801.hpp"
+#include "util/scpi_shadow.hpp"
+#include "util/screen.hpp"
+
+typedef struct _RunnerConfig
+{
+	bool tcp = true;
+	int iterations = 20;
+	int latencyMS = 1;
+	int busyMS = 5;
+} RunnerConfig;
+
+typedef struct _CallStats
+{
+	std::string name;
+	int calls;
+	int failed;
+	uint64_t totalUS;
+	uint64_t maxUS;
+} CallStats;
+
+static std::vector<CallStats> callStats;
+
+static void Usage()
+{
+	puts("usage: scpi_driver_runner [options]");
+	puts("  --transport tcp|inproc  socket on 127.0.0.1 (default), or straight to the simulator");
+	puts("  --iterations N          test points per instrument (default 20)");
+	puts("  --latency MS            delay before the instrument starts on each write (default 1)");
+	puts("  --busy MS               time a command takes (default 5; PHAS:INIT / FREQ take longer)");
+}
+
+static bool ParseArgs(int argc, char *argv[], RunnerConfig *config)
+{
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string arg = argv[i];
+		std::string value = argv[i + 1];
+
+		if (arg == "--transport" && (value == "tcp" || value == "inproc"))
+			config->tcp = (value == "tcp");
+		else if (arg == "--iterations")
+			config->iterations = atoi(value.c_str());
+		else if (arg == "--latency")
+			config->latencyMS = atoi(value.c_str());
+		else if (arg == "--busy")
+			config->busyMS = atoi(value.c_str());
+		else
+			return false;
+	}
+
+	return (argc % 2) == 1 && config->iterations > 0;
+}
+
+static bool Time(const std::string &name, const std::function<bool()> &call)
+{
+	auto start = std::chrono::steady_clock::now();
+	bool ok = call();
+	uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+	auto it = callStats.begin();
+	while (it != callStats.end() && it->name != name)
+		it++;
+
+	if (it == callStats.end())
+		it = callStats.insert(callStats.end(), {name, 0, 0, 0, 0});
+
+	it->calls++;
+	it->failed += ok ? 0 : 1;
+	it->totalUS += us;
+	if (us > it->maxUS)
+		it->maxUS = us;
+
+	return ok;
+}
+
+// a socket server in front of sim, or sim itself
+static SCPI_TRANSPORT::TransportPtr Connect(
+	const RunnerConfig &config, SCPI_INSTRUMENT_SIM::ScpiInstrumentSim &sim,
+	SCPI_INSTRUMENT_SIM::ScpiSocketServer &server, const std::string &idnMatch, const std::string &terminator)
+{
+	if (config.tcp)
+	{
+		if (!server.Listen(0))
+			return nullptr;
+
+		return SCPI_TRANSPORT::Open("127.0.0.1:" + std::to_string(server.Port()), idnMatch, terminator);
+	}
+
+	return SCPI_TRANSPORT::TransportPtr(new SCPI_TRANSPORT::InProcessTransport(
+		"in-process",
+		[&sim](const std::string &command)
+		{ return sim.Write(command); },
+		[&sim](std::string &response, int timeoutMS)
+		{ return sim.Read(response, timeoutMS); }));
+}
+
+static std::string VoltsFor(int iteration)
+{
+	char volts[32];
+	snprintf(volts, sizeof(volts), "%.3f", 0.5 + (iteration % 10) * 0.25);
+	return volts;
+}
+
+static bool RunRigol(const RunnerConfig &config)
+{
+	SCPI_INSTRUMENT_SIM::ScpiSimConfig simConfig = SCPI_INSTRUMENT_SIM::RigolConfig();
+	simConfig.latencyMS = config.latencyMS;
+	simConfig.defaultBusyMS = config.busyMS;
+
+	SCPI_INSTRUMENT_SIM::ScpiInstrumentSim sim(simConfig);
+	SCPI_INSTRUMENT_SIM::ScpiSocketServer server(sim);
+
+	bool retval = RIGOL_DG1000Z::OpenTransport(Connect(config, sim, server, "Rigol Technologies,DG10", "\n"));
+
+	if (retval)
+		retval = Time("RIGOL Initialize", RIGOL_DG1000Z::Initialize);
+
+	for (int i = 0; retval && i < config.iterations; i++)
+	{
+		std::string volts = VoltsFor(i);
+		std::string response;
+
+		retval &= Time("RIGOL SetupToApplySINWave", [&]()
+					   { return RIGOL_DG1000Z::SetupToApplySINWave(false, volts) && RIGOL_DG1000Z::SetupToApplySINWave_2(false, volts); });
+		retval &= Time("RIGOL SendChannel2Phase180", RIGOL_DG1000Z::SendChannel2Phase180);
+		retval &= Time("RIGOL EnableOutput", []()
+					   { return RIGOL_DG1000Z::EnableOutput() && RIGOL_DG1000Z::EnableOutput_2(); });
+		retval &= Time("RIGOL SendSyncChannels", RIGOL_DG1000Z::SendSyncChannels);
+		retval &= Time("RIGOL :SOUR1:APPL?", [&]()
+					   { return RIGOL_DG1000Z::WriteCommandReadResponse(":SOUR1:APPL?", response); });
+		retval &= Time("RIGOL DisableOutput", []()
+					   { return RIGOL_DG1000Z::DisableOutput() && RIGOL_DG1000Z::DisableOutput_2(); });
+
+		// and it really was set up like we asked
+		retval &= (sim.Setting(":SOUR1:APPL:SIN") == "60," + volts + "vrms,0,0");
+	}
+
+	RIGOL_DG1000Z::CloseInterface();
+
+	return retval;
+}
+
+static bool RunBK(const RunnerConfig &config)
+{
+	SCPI_INSTRUMENT_SIM::ScpiSimConfig simConfig = SCPI_INSTRUMENT_SIM::BKConfig();
+	simConfig.latencyMS = config.latencyMS;
+	simConfig.defaultBusyMS = config.busyMS;
+
+	SCPI_INSTRUMENT_SIM::ScpiInstrumentSim sim(simConfig);
+	SCPI_INSTRUMENT_SIM::ScpiSocketServer server(sim);
+
+	bool retval = BK_PRECISION_9801::OpenTransport(Connect(config, sim, server, "BK PRECISION, 9801", "\r\n"));
+
+	if (retval)
+		retval = Time("BK Initialize", BK_PRECISION_9801::Initialize);
+
+	for (int i = 0; retval && i < config.iterations; i++)
+	{
+		std::string volts = VoltsFor(i);
+
+		retval &= Time("BK SetupToApplySINWave", [&]()
+					   { return BK_PRECISION_9801::SetupToApplySINWave(false, volts); });
+		retval &= Time("BK EnableOutput", BK_PRECISION_9801::EnableOutput);
+		retval &= Time("BK DisableOutput", BK_PRECISION_9801::DisableOutput);
+	}
+
+	// make sure the last command is done before we look; the BK scales the voltage up
+	// (see BK_PRECISION_9801::SetupToApplySINWave())
+	if (retval)
+		retval = BK_PRECISION_9801::WriteCommandAndWait("");
+
+	retval &= (sim.Setting(":SOUR:FREQ") == "60");
+	retval &= (sim.Setting(":SOUR:VOLT") == std::to_string(std::stod(VoltsFor(config.iterations - 1)) * 7.930951));
+
+	BK_PRECISION_9801::CloseInterface();
+
+	return retval;
+}
+
+int main(int argc, char *argv[])
+{
+	RunnerConfig config;
+
+	if (!ParseArgs(argc, argv, &config))
+	{
+		Usage();
+		return 1;
+	}
+
+	bool rigolOK = RunRigol(config);
+	bool bkOK = RunBK(config);
+
+	scr_printf("%d iterations over %s", config.iterations, config.tcp ? "TCP (127.0.0.1)" : "in-process transport");
+	scr_printf("%-28s %6s %6s %10s %10s", "", "calls", "failed", "avg ms", "max ms");
+
+	for (const CallStats &s : callStats)
+	{
+		scr_printf("%-28s %6d %6d %10.3f %10.3f", s.name.c_str(), s.calls, s.failed,
+				   s.totalUS / 1000.0 / s.calls, s.maxUS / 1000.0);
+	}
+
+	SCPI_SHADOW::PrintAllStats();
+
+	scr_printf("RIGOL_DG1000Z: %s  BK_PRECISION_9801: %s", rigolOK ? "OK" : "FAILED", bkOK ? "OK" : "FAILED");
+
+	return (rigolOK && bkOK) ? 0 : 1;
+}
+
+#endif
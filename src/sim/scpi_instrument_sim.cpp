@@ -0,0 +1,375 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "scpi_instrument_sim.hpp"
+#include "util/scpi_sync.hpp"
+
+namespace SCPI_INSTRUMENT_SIM
+{
+	// how long the socket server waits on anything before it checks whether it should stop
+	constexpr int IDLE_SLICE_MS = 100;
+
+	static std::string Trim(const std::string &s)
+	{
+		size_t first = s.find_first_not_of(" \t\r\n");
+		size_t last = s.find_last_not_of(" \t\r\n");
+
+		return (first == std::string::npos) ? "" : s.substr(first, last - first + 1);
+	}
+
+	// headers aren't case sensitive
+	static std::string Upper(std::string s)
+	{
+		std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c)
+					   { return (char)toupper(c); });
+		return s;
+	}
+
+	ScpiSimConfig RigolConfig()
+	{
+		ScpiSimConfig config;
+
+		// RIGOL_DG1000Z::Initialize() checks for exactly this after *RST
+		config.defaults[":SOUR1:APPL"] = "\"SIN,1.000000E+03,5.000000E+00,0.000000E+00,0.000000E+00\"";
+		config.defaults[":SOUR2:APPL"] = "\"SIN,1.000000E+03,5.000000E+00,0.000000E+00,0.000000E+00\"";
+		config.busyMS[":SOUR1:PHAS:INIT"] = 150;
+
+		return config;
+	}
+
+	ScpiSimConfig BKConfig()
+	{
+		ScpiSimConfig config;
+
+		config.idn = "BK PRECISION, 9801, SIM0000001, 1.20";
+		config.busyMS[":SOUR:FREQ"] = 300;
+
+		return config;
+	}
+
+	ScpiInstrumentSim::ScpiInstrumentSim(const ScpiSimConfig &config) : config(config)
+	{
+		for (const auto &setting : config.defaults)
+			settings[Upper(setting.first)] = setting.second;
+
+		worker = std::thread(&ScpiInstrumentSim::Worker, this);
+	}
+
+	ScpiInstrumentSim::~ScpiInstrumentSim()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+
+		inputReady.notify_all();
+		worker.join();
+	}
+
+	bool ScpiInstrumentSim::Write(const std::string &command)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (stopping)
+			return false;
+
+		stats.writes++;
+		input.push_back(command);
+		inputReady.notify_one();
+
+		return true;
+	}
+
+	bool ScpiInstrumentSim::Read(std::string &response, int timeoutMS)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+
+		if (!outputReady.wait_for(lock, std::chrono::milliseconds(timeoutMS), [this]()
+								  { return !output.empty(); }))
+		{
+			stats.readTimeouts++;
+			return false;
+		}
+
+		response = output.front();
+		output.pop_front();
+
+		return true;
+	}
+
+	std::string ScpiInstrumentSim::Setting(const std::string &header)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto it = settings.find(Upper(header));
+		return (it != settings.end()) ? it->second : "";
+	}
+
+	ScpiSimStats ScpiInstrumentSim::Stats()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return stats;
+	}
+
+	int ScpiInstrumentSim::BusyMS(const std::string &header)
+	{
+		for (const auto &busy : config.busyMS)
+		{
+			if (Upper(busy.first) == header)
+				return busy.second;
+		}
+
+		return config.defaultBusyMS;
+	}
+
+	void ScpiInstrumentSim::Output(const std::string &response)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		output.push_back(response);
+		outputReady.notify_all();
+	}
+
+	void ScpiInstrumentSim::Execute(const std::string &command)
+	{
+		size_t space = command.find(' ');
+		std::string header = Upper(command.substr(0, space));
+		std::string value = (space == std::string::npos) ? "" : Trim(command.substr(space + 1));
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stats.commands++;
+		}
+
+		// everything written before this is done by now, since we only do one thing at a
+		// time; so *OPC and *OPC? don't have to wait for anything
+		if (header == "*OPC?")
+			Output("1");
+		else if (header == "*OPC")
+			esr |= SCPI_SYNC::ESR_OPC;
+		else if (header == "*ESR?")
+		{
+			Output(std::to_string(esr));
+			esr = 0;
+		}
+		else if (header == "*CLS")
+			esr = 0;
+		else if (header == "*IDN?")
+			Output(config.idn);
+		else if (header == "*RST")
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(BusyMS(header)));
+
+			std::lock_guard<std::mutex> lock(mutex);
+			settings.clear();
+
+			for (const auto &setting : config.defaults)
+				settings[Upper(setting.first)] = setting.second;
+		}
+		else if (!header.empty() && header.back() == '?')
+		{
+			std::string setting = Setting(header.substr(0, header.size() - 1));
+
+			if (setting.empty())
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stats.errors++;
+				esr |= SCPI_SYNC::ESR_QUERY_ERROR;
+			}
+			else
+				Output(setting);
+		}
+		else if (!header.empty())
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(BusyMS(header)));
+
+			std::lock_guard<std::mutex> lock(mutex);
+			settings[header] = value;
+		}
+	}
+
+	void ScpiInstrumentSim::Worker()
+	{
+		while (true)
+		{
+			std::string message;
+
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+
+				inputReady.wait(lock, [this]()
+								{ return stopping || !input.empty(); });
+
+				if (stopping)
+					return;
+
+				message = input.front();
+				input.pop_front();
+			}
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(config.latencyMS));
+
+			// "cmd1;cmd2;*OPC?" is three commands, done in order
+			size_t start = 0;
+
+			while (start <= message.size())
+			{
+				size_t semicolon = message.find(';', start);
+
+				if (semicolon == std::string::npos)
+					semicolon = message.size();
+
+				Execute(Trim(message.substr(start, semicolon - start)));
+				start = semicolon + 1;
+			}
+		}
+	}
+
+	ScpiSocketServer::ScpiSocketServer(ScpiInstrumentSim &sim) : sim(sim)
+	{
+	}
+
+	ScpiSocketServer::~ScpiSocketServer()
+	{
+		Stop();
+	}
+
+	bool ScpiSocketServer::Listen(int listenPort)
+	{
+		listenSock = socket(AF_INET, SOCK_STREAM, 0);
+
+		if (listenSock < 0)
+			return false;
+
+		int reuse = 1;
+		setsockopt(listenSock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+		sockaddr_in addr = {0};
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr.sin_port = htons((uint16_t)listenPort);
+
+		socklen_t len = sizeof(addr);
+
+		if (bind(listenSock, (sockaddr *)&addr, sizeof(addr)) != 0 ||
+			listen(listenSock, 1) != 0 ||
+			getsockname(listenSock, (sockaddr *)&addr, &len) != 0)
+		{
+			close(listenSock);
+			listenSock = -1;
+			return false;
+		}
+
+		port = ntohs(addr.sin_port);
+		server = std::thread(&ScpiSocketServer::Serve, this);
+
+		return true;
+	}
+
+	void ScpiSocketServer::Stop()
+	{
+		stopping = true;
+
+		if (server.joinable())
+			server.join();
+
+		if (listenSock >= 0)
+		{
+			close(listenSock);
+			listenSock = -1;
+		}
+	}
+
+	void ScpiSocketServer::Serve()
+	{
+		while (!stopping)
+		{
+			pollfd pfd = {listenSock, POLLIN, 0};
+
+			if (poll(&pfd, 1, IDLE_SLICE_MS) <= 0)
+				continue;
+
+			int sock = accept(listenSock, nullptr, nullptr);
+
+			if (sock >= 0)
+			{
+				ServeConnection(sock);
+				close(sock);
+			}
+		}
+	}
+
+	void ScpiSocketServer::ServeConnection(int sock)
+	{
+		std::atomic<bool> connected{true};
+
+		// whatever the instrument has to say goes back out as soon as it says it
+		std::thread answers([this, sock, &connected]()
+							{
+								std::string response;
+
+								while (connected && !stopping)
+								{
+									if (!sim.Read(response, IDLE_SLICE_MS))
+										continue;
+
+									response += "\n";
+
+									if (send(sock, response.data(), response.size(), MSG_NOSIGNAL) != (ssize_t)response.size())
+										connected = false;
+								} });
+
+		std::string pending;
+
+		while (connected && !stopping)
+		{
+			pollfd pfd = {sock, POLLIN, 0};
+
+			if (poll(&pfd, 1, IDLE_SLICE_MS) <= 0)
+				continue;
+
+			char buffer[1024];
+			ssize_t n = recv(sock, buffer, sizeof(buffer), 0);
+
+			if (n <= 0)
+				break;
+
+			pending.append(buffer, n);
+
+			size_t newline;
+
+			while ((newline = pending.find('\n')) != std::string::npos)
+			{
+				std::string command = pending.substr(0, newline);
+				pending.erase(0, newline + 1);
+
+				if (!command.empty() && command.back() == '\r')
+					command.pop_back();
+
+				sim.Write(command);
+			}
+		}
+
+		connected = false;
+		answers.join();
+	}
+}
@@ -0,0 +1,125 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// software stand-in for a SCPI instrument (the Rigol, the BK), as seen through VISA
+//
+// Write() is viWrite(): the command gets queued, and we come right back. Read() is viRead()
+// with VI_ATTR_TMO_VALUE: it waits (up to the timeout) for the instrument to have something
+// to say. in between, the "instrument" works through what it was sent, in order, one
+// command at a time, and each command takes a while (busyMS); just like the real ones,
+// which is why *OPC? works at all
+//
+// it understands *IDN?, *RST, *CLS, *OPC, *OPC?, *ESR?; anything else is "HEADER value",
+// which it remembers, or "HEADER?", which answers with what HEADER was last set to
+//
+// ScpiSocketServer puts one on a TCP port, like the real ones are on 5025
+
+namespace SCPI_INSTRUMENT_SIM
+{
+	typedef struct _ScpiSimConfig
+	{
+		std::string idn = "Rigol Technologies,DG1032Z,SIM0000001,00.01.14";
+		int latencyMS = 1;				  // before it starts on each thing written to it
+		int defaultBusyMS = 5;			  // how long a command takes...
+		std::map<std::string, int> busyMS; // ...unless its header is in here (e.g. ":SOUR1:PHAS:INIT")
+		std::map<std::string, std::string> defaults; // what things are set to at power up / after *RST
+	} ScpiSimConfig;
+
+	// enough of a Rigol DG1000Z / a BK 9801 for RIGOL_DG1000Z and BK_PRECISION_9801 to be
+	// happy with it
+	ScpiSimConfig RigolConfig();
+	ScpiSimConfig BKConfig();
+
+	typedef struct _ScpiSimStats
+	{
+		uint32_t writes;	   // Write() calls
+		uint32_t commands;	   // individual commands in those (split on ';')
+		uint32_t readTimeouts; // Read() calls that gave up
+		uint32_t errors;	   // queries we had no answer for
+	} ScpiSimStats;
+
+	class ScpiInstrumentSim
+	{
+	public:
+		explicit ScpiInstrumentSim(const ScpiSimConfig &config);
+		~ScpiInstrumentSim();
+
+		bool Write(const std::string &command);
+		bool Read(std::string &response, int timeoutMS);
+
+		// what header is set to right now (empty if it never was); for checking up on a
+		// test, not something the real instrument would tell you
+		std::string Setting(const std::string &header);
+
+		ScpiSimStats Stats();
+
+	private:
+		void Worker();
+		void Execute(const std::string &command);
+		int BusyMS(const std::string &header);
+		void Output(const std::string &response);
+
+		ScpiSimConfig config;
+
+		std::mutex mutex;
+		std::condition_variable inputReady;
+		std::condition_variable outputReady;
+		std::deque<std::string> input;
+		std::deque<std::string> output;
+		bool stopping = false;
+
+		// the instrument itself; only the worker touches these (apart from Setting())
+		std::map<std::string, std::string> settings;
+		int esr = 0;
+
+		ScpiSimStats stats = {0};
+
+		std::thread worker;
+	};
+
+	// takes one connection at a time on a TCP port (on 127.0.0.1); every line that comes in
+	// gets written to the instrument, and everything it says goes back out, one line each
+	class ScpiSocketServer
+	{
+	public:
+		explicit ScpiSocketServer(ScpiInstrumentSim &sim);
+		~ScpiSocketServer();
+
+		// port 0: whatever port is free (see Port())
+		bool Listen(int port);
+		int Port() const { return port; }
+
+		void Stop();
+
+	private:
+		void Serve();
+		void ServeConnection(int sock);
+
+		ScpiInstrumentSim &sim;
+		int listenSock = -1;
+		int port = 0;
+		std::atomic<bool> stopping{false};
+		std::thread server;
+	};
+}
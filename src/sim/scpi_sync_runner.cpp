@@ -0,0 +1,223 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+// scpi_sync_runner: the fixed Sleep()s we used to have around the Rigol and the BK, vs.
+// waiting for *OPC? (SCPI_SYNC), against a SCPI_INSTRUMENT_SIM::ScpiInstrumentSim
+//
+// goes through the same commands the drivers send:
+//	-	RIGOL_DG1000Z::SendSyncChannels(): :SOUR1:PHAS:INIT, (wait), :SOUR2:PHAS:SYNC
+//	-	BK_PRECISION_9801::SetupToApplySINWave(): :SOUR:FREQ, (wait), :SOUR:VOLT
+//	-	RIGOL_DG1000Z::ProcessSCPIScript(): --lines commands, (wait) after each one
+//	-	and one command that takes longer than --ceiling, which has to come back false
+//
+//	scpi_sync_runner --phase 150 --freq 300 --lines 5 --method esr
+
+#ifndef _WIN32
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include "scpi_instrument_sim.hpp"
+#include "util/scpi_sync.hpp"
+#include "util/serial_rx.hpp"
+#include "util/screen.hpp"
+
+// what the drivers used to Sleep()
+constexpr int OLD_SYNC_CHANNELS_SLEEP_MS = 1000;
+constexpr int OLD_BK_FREQUENCY_SLEEP_MS = 1000;
+constexpr int OLD_SCRIPT_LINE_SLEEP_MS = 2000;
+
+typedef struct _RunnerConfig
+{
+	int lines = 5;
+	int ceilingMS = SCPI_SYNC::DEFAULT_OPC_TIMEOUT_MS;
+	SCPI_SYNC::SyncMethod method = SCPI_SYNC::SyncMethod::OPC_QUERY;
+	SCPI_INSTRUMENT_SIM::ScpiSimConfig sim;
+} RunnerConfig;
+
+static void Usage()
+{
+	puts("usage: scpi_sync_runner [options]");
+	puts("  --phase MS        time :SOUR1:PHAS:INIT takes (default 150)");
+	puts("  --freq MS         time :SOUR:FREQ takes on the BK (default 300)");
+	puts("  --busy MS         time any other command takes (default 5)");
+	puts("  --latency MS      delay before the instrument starts on each write (default 1)");
+	puts("  --lines N         commands in the SCPI script (default 5)");
+	puts("  --ceiling MS      longest to wait for operation complete (default 5000)");
+	puts("  --method opc|esr  *OPC? (default) or polling *ESR?");
+}
+
+static bool ParseArgs(int argc, char *argv[], RunnerConfig *config)
+{
+	config->sim.busyMS[":SOUR1:PHAS:INIT"] = 150;
+	config->sim.busyMS[":SOUR:FREQ"] = 300;
+
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string arg = argv[i];
+		std::string value = argv[i + 1];
+
+		if (arg == "--phase")
+			config->sim.busyMS[":SOUR1:PHAS:INIT"] = atoi(value.c_str());
+		else if (arg == "--freq")
+			config->sim.busyMS[":SOUR:FREQ"] = atoi(value.c_str());
+		else if (arg == "--busy")
+			config->sim.defaultBusyMS = atoi(value.c_str());
+		else if (arg == "--latency")
+			config->sim.latencyMS = atoi(value.c_str());
+		else if (arg == "--lines")
+			config->lines = atoi(value.c_str());
+		else if (arg == "--ceiling")
+			config->ceilingMS = atoi(value.c_str());
+		else if (arg == "--method" && (value == "opc" || value == "esr"))
+			config->method = (value == "esr") ? SCPI_SYNC::SyncMethod::ESR_POLL : SCPI_SYNC::SyncMethod::OPC_QUERY;
+		else
+			return false;
+	}
+
+	return (argc % 2) == 1;
+}
+
+static void Sleep(int ms)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+// runs the old way and the new way, each against a fresh instrument, and times them
+static void Compare(
+	const RunnerConfig &config, const char *name,
+	const std::function<bool(SCPI_INSTRUMENT_SIM::ScpiInstrumentSim &)> &oldWay,
+	const std::function<bool(SCPI_INSTRUMENT_SIM::ScpiInstrumentSim &, const SCPI_SYNC::SCPIWriteFuncPtr &, const SCPI_SYNC::SCPIReadFuncPtr &)> &newWay)
+{
+	uint64_t oldMS, newMS;
+	bool oldOK, newOK;
+
+	{
+		SCPI_INSTRUMENT_SIM::ScpiInstrumentSim sim(config.sim);
+		uint64_t startMS = SERIAL_RX::NowMS();
+
+		oldOK = oldWay(sim);
+		oldMS = SERIAL_RX::NowMS() - startMS;
+	}
+
+	{
+		SCPI_INSTRUMENT_SIM::ScpiInstrumentSim sim(config.sim);
+		SCPI_SYNC::SCPIWriteFuncPtr writeFunc = [&sim](const std::string &command)
+		{ return sim.Write(command); };
+		SCPI_SYNC::SCPIReadFuncPtr readFunc = [&sim](std::string &response, int timeoutMS)
+		{ return sim.Read(response, timeoutMS); };
+
+		uint64_t startMS = SERIAL_RX::NowMS();
+
+		newOK = newWay(sim, writeFunc, readFunc);
+		newMS = SERIAL_RX::NowMS() - startMS;
+	}
+
+	scr_printf("%-22s fixed sleep: %6llu ms %-6s  operation complete: %6llu ms %s",
+			   name, (unsigned long long)oldMS, oldOK ? "" : "FAIL", (unsigned long long)newMS, newOK ? "" : "FAIL");
+}
+
+int main(int argc, char *argv[])
+{
+	RunnerConfig config;
+
+	if (!ParseArgs(argc, argv, &config))
+	{
+		Usage();
+		return 1;
+	}
+
+	int ceilingMS = config.ceilingMS;
+	SCPI_SYNC::SyncMethod method = config.method;
+
+	Compare(
+		config, "Rigol sync channels",
+		[](SCPI_INSTRUMENT_SIM::ScpiInstrumentSim &sim)
+		{
+			bool ok = sim.Write(":SOUR1:PHAS:INIT");
+			Sleep(OLD_SYNC_CHANNELS_SLEEP_MS);
+			return ok && sim.Write(":SOUR2:PHAS:SYNC");
+		},
+		[=](SCPI_INSTRUMENT_SIM::ScpiInstrumentSim &sim, const SCPI_SYNC::SCPIWriteFuncPtr &writeFunc, const SCPI_SYNC::SCPIReadFuncPtr &readFunc)
+		{
+			return SCPI_SYNC::WriteAndWait(writeFunc, readFunc, ":SOUR1:PHAS:INIT", ceilingMS, method) &&
+				   sim.Write(":SOUR2:PHAS:SYNC");
+		});
+
+	Compare(
+		config, "BK apply sine wave",
+		[](SCPI_INSTRUMENT_SIM::ScpiInstrumentSim &sim)
+		{
+			bool ok = sim.Write(":SOUR:FREQ 60");
+			Sleep(OLD_BK_FREQUENCY_SLEEP_MS);
+			return ok && sim.Write(":SOUR:VOLT 9.516");
+		},
+		[=](SCPI_INSTRUMENT_SIM::ScpiInstrumentSim &sim, const SCPI_SYNC::SCPIWriteFuncPtr &writeFunc, const SCPI_SYNC::SCPIReadFuncPtr &readFunc)
+		{
+			return SCPI_SYNC::WriteAndWait(writeFunc, readFunc, ":SOUR:FREQ 60", ceilingMS, method) &&
+				   sim.Write(":SOUR:VOLT 9.516");
+		});
+
+	int lines = config.lines;
+
+	Compare(
+		config, "SCPI script",
+		[lines](SCPI_INSTRUMENT_SIM::ScpiInstrumentSim &sim)
+		{
+			bool ok = true;
+
+			for (int i = 0; i < lines; i++)
+			{
+				ok &= sim.Write(":SOUR1:VOLT " + std::to_string(i + 1));
+				Sleep(OLD_SCRIPT_LINE_SLEEP_MS);
+			}
+
+			return ok;
+		},
+		[=](SCPI_INSTRUMENT_SIM::ScpiInstrumentSim &sim, const SCPI_SYNC::SCPIWriteFuncPtr &writeFunc, const SCPI_SYNC::SCPIReadFuncPtr &readFunc)
+		{
+			bool ok = true;
+
+			for (int i = 0; i < lines; i++)
+				ok &= SCPI_SYNC::WriteAndWait(writeFunc, readFunc, ":SOUR1:VOLT " + std::to_string(i + 1), ceilingMS, method);
+
+			// and it really did get all of them
+			return ok && sim.Setting(":SOUR1:VOLT") == std::to_string(lines);
+		});
+
+	// something that takes longer than the ceiling has to fail, at about the ceiling
+	{
+		RunnerConfig slow = config;
+		slow.sim.busyMS[":SOUR1:PHAS:INIT"] = ceilingMS + 500;
+
+		SCPI_INSTRUMENT_SIM::ScpiInstrumentSim sim(slow.sim);
+		int waitedMS = 0;
+
+		bool ok = SCPI_SYNC::WriteAndWait(
+			[&sim](const std::string &command)
+			{ return sim.Write(command); },
+			[&sim](std::string &response, int timeoutMS)
+			{ return sim.Read(response, timeoutMS); },
+			":SOUR1:PHAS:INIT", ceilingMS, method, &waitedMS);
+
+		scr_printf("%-22s %s after %d ms (ceiling %d ms)", "past the ceiling", ok ? "completed (WRONG)" : "gave up", waitedMS, ceilingMS);
+	}
+
+	return 0;
+}
+
+#endif
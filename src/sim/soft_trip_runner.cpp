@@ -0,0 +1,378 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+
+// soft_trip_runner: LT / ST / INST / GF trip tests through the software test set
+// (SOFT_TEST_SET::RunTest()), on several simulated trip units at once
+//
+// every unit gets its own TRIP_UNIT_SIM::TripUnitSimulator (on a socketpair, in this
+// process) and its own thread; each one goes through the same test points: settings,
+// reboot, clear trip history, waveforms, and wait for the results. the expected trip time
+// is worked out from the current the unit says it saw, the same way the trip tests do it
+//
+// --scale is how much real time a ms of test set time takes (0.01: a 16 second LT trip
+// is over in 160ms); --scale 1 runs them as long as a real unit would
+//
+//	soft_trip_runner --units 8 --scale 0.01 --reboot 200
+
+#ifndef _WIN32
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "trip_unit_sim.hpp"
+#include "trip4.hpp"
+#include "tests/soft_test_set.hpp"
+#include "tests/trip_time_rc.hpp"
+#include "util/comm.hpp"
+#include "util/screen.hpp"
+#include "util/util.hpp"
+
+// every test point is on an 800A CT at 60hz
+constexpr int CT_RATING = 800;
+
+// how far off the trip time can be, for everything but INST
+constexpr float MAX_ERROR_PERCENT = 10.0f;
+
+// INST just has to be fast enough; see INST_TRIP_TEST_RC::testParams
+constexpr int INST_THRESHOLD_MS = 50;
+
+typedef struct _RunnerConfig
+{
+	int units = 4;
+	TRIP_UNIT_SIM::SimConfig sim;
+} RunnerConfig;
+
+typedef struct _TestPoint
+{
+	const char *name;
+	uint8_t tripType; // what it should trip on
+	int LTPickupAmps;
+	float LTDelaySeconds;
+	int STPickupAmps; // 0 = ST off
+	float STDelaySeconds;
+	bool STI2T;
+	int InstPickupAmps; // 0 = INST off
+	int GFPickupAmps;	// 0 = GF off
+	float GFDelaySeconds;
+	int GFSlope;
+	float amps; // RMS, balanced three phase; or on phase A only, for GF
+} TestPoint;
+
+static const TestPoint testPoints[] = {
+	{"LT 3x", _TRIP_TYPE_LT, 800, 4.0f, 0, 0, false, 0, 0, 0, 0, 2400},
+	{"LT 6x", _TRIP_TYPE_LT, 800, 10.0f, 0, 0, false, 0, 0, 0, 0, 4800},
+	{"ST", _TRIP_TYPE_ST, 800, 4.0f, 4000, 0.3f, false, 0, 0, 0, 0, 5000},
+	{"ST I2T", _TRIP_TYPE_ST, 800, 4.0f, 2400, 0.2f, true, 0, 0, 0, 0, 3200},
+	{"INST", _TRIP_TYPE_INST_DIGITAL, 800, 4.0f, 0, 0, false, 8000, 0, 0, 0, 9000},
+	{"GF", _TRIP_TYPE_GF, 800, 4.0f, 0, 0, false, 0, 400, 0.5f, 0, 600},
+	{"GF I2T", _TRIP_TYPE_GF, 800, 4.0f, 0, 0, false, 0, 200, 0.3f, 1, 400},
+};
+
+typedef struct _PointResult
+{
+	bool ran;
+	uint32_t measuredAmps;
+	int expectedMS;
+	int measuredMS;
+	uint8_t tripType;
+	bool ok;
+	SOFT_TEST_SET::TestSetStats stats;
+} PointResult;
+
+static void Usage()
+{
+	puts("usage: soft_trip_runner [options]");
+	puts("  --units N         how many simulated trip units, tested at the same time (default 4)");
+	puts("  --scale X         real ms per soft test set ms (default 0.01)");
+	puts("  --reboot MS       how long a trip unit is gone after a settings change (default 200)");
+	puts("  --latency MS      delay before every trip unit response (default 5)");
+}
+
+static bool ParseArgs(int argc, char *argv[], RunnerConfig *config)
+{
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string arg = argv[i];
+		const char *value = argv[i + 1];
+
+		if (arg == "--units")
+			config->units = atoi(value);
+		else if (arg == "--scale")
+			config->sim.testSetTimeScale = atof(value);
+		else if (arg == "--reboot")
+			config->sim.rebootMS = atoi(value);
+		else if (arg == "--latency")
+			config->sim.latencyMS = atoi(value);
+		else
+			return false;
+	}
+
+	return (argc % 2) == 1 && config->units > 0 && config->sim.testSetTimeScale > 0;
+}
+
+static bool WriteAll(int fd, const uint8_t *data, int len)
+{
+	int sent = 0;
+
+	while (sent < len)
+	{
+		ssize_t n = write(fd, data + sent, len - sent);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		if (n <= 0)
+			return false;
+
+		sent += (int)n;
+	}
+
+	return true;
+}
+
+// a simulated trip unit on one end of a socketpair, and a HANDLE for the other end
+typedef struct _SimulatedTripUnit
+{
+	std::unique_ptr<TRIP_UNIT_SIM::TripUnitSimulator> sim;
+	std::thread thread;
+	int simFD;
+	HANDLE handle;
+} SimulatedTripUnit;
+
+static bool StartSimulatedTripUnit(const TRIP_UNIT_SIM::SimConfig &config, SimulatedTripUnit *unit)
+{
+	int fds[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+		return false;
+
+	int appFD = fds[0];
+	unit->simFD = fds[1];
+
+	int simFD = unit->simFD;
+
+	unit->sim = std::make_unique<TRIP_UNIT_SIM::TripUnitSimulator>(
+		config,
+		SERIAL_RX::PosixBackend(simFD),
+		[simFD](const uint8_t *data, int len) -> bool
+		{
+			return WriteAll(simFD, data, len);
+		});
+
+	CommTransport transport;
+
+	transport.readSome = SERIAL_RX::PosixBackend(appFD);
+	transport.write = [appFD](const uint8_t *data, int len) -> bool
+	{
+		return WriteAll(appFD, data, len);
+	};
+	transport.close = [appFD]()
+	{
+		close(appFD);
+	};
+
+	unit->handle = RegisterCommTransport(transport);
+
+	TRIP_UNIT_SIM::TripUnitSimulator *sim = unit->sim.get();
+	unit->thread = std::thread([sim]
+							   { sim->Run(); });
+
+	return true;
+}
+
+static void StopSimulatedTripUnit(SimulatedTripUnit *unit)
+{
+	unit->sim->Stop();
+	CloseCommPort(&unit->handle);
+
+	// (closing our end is what gets it out of its read)
+	shutdown(unit->simFD, SHUT_RDWR);
+
+	unit->thread.join();
+	close(unit->simFD);
+}
+
+static bool SetupTripUnit(HANDLE hTripUnit, const TestPoint &point)
+{
+	return SetSystemAndDeviceSettings(hTripUnit,
+									  [&point](SystemSettings4 *Settings, DeviceSettings4 *DevSettings4)
+									  {
+										  Settings->CTRating = CT_RATING;
+										  Settings->Frequency = 60;
+
+										  DevSettings4->LTEnabled = true;
+										  DevSettings4->LTPickup = point.LTPickupAmps * 10;
+										  DevSettings4->LTDelay = std::lround(point.LTDelaySeconds * 10);
+
+										  DevSettings4->STEnabled = point.STPickupAmps != 0;
+										  DevSettings4->STPickup = point.STPickupAmps;
+										  DevSettings4->STDelay = std::lround(point.STDelaySeconds * 100);
+										  DevSettings4->STI2T = point.STI2T;
+
+										  DevSettings4->InstantEnabled = point.InstPickupAmps != 0;
+										  DevSettings4->InstantPickup = point.InstPickupAmps;
+
+										  DevSettings4->GFPickup = point.GFPickupAmps;
+										  DevSettings4->GFDelay = std::lround(point.GFDelaySeconds * 100);
+										  DevSettings4->GFI2T = point.GFSlope;
+
+										  return true;
+									  });
+}
+
+// what the trip tests would expect, given the current the unit saw
+static int ExpectedTripMS(const TestPoint &point, int amps)
+{
+	switch (point.tripType)
+	{
+	case _TRIP_TYPE_LT:
+		return LT_TRIP_TEST_RC::TimeTimeToTripMS(point.LTPickupAmps, point.LTDelaySeconds, amps);
+
+	case _TRIP_TYPE_ST:
+		return ST_TRIP_TEST_RC::TimeTimeToTripMS(point.STPickupAmps, point.STDelaySeconds, point.STI2T, point.LTPickupAmps, amps);
+
+	case _TRIP_TYPE_GF:
+		return GF_TRIP_TEST_RC::TimeTimeToTripMS(CT_RATING, point.GFPickupAmps, point.GFDelaySeconds, point.GFSlope, amps);
+
+	default:
+		return 0;
+	}
+}
+
+static PointResult RunPoint(HANDLE hTripUnit, const TestPoint &point, double timeScale)
+{
+	PointResult r = {0};
+	bool groundFault = point.tripType == _TRIP_TYPE_GF;
+
+	if (!SetupTripUnit(hTripUnit, point) || !WaitForTripUnitReady(hTripUnit) || !SendClearTripHistory(hTripUnit))
+		return r;
+
+	// (from what we ask for; good enough to decide how often to ask for results)
+	int guessMS = ExpectedTripMS(point, (int)point.amps);
+	uint32_t realMS = (uint32_t)(guessMS * timeScale);
+
+	SOFT_TEST_SET::Injection injection = groundFault ? SOFT_TEST_SET::GroundFault(point.amps, realMS) : SOFT_TEST_SET::ThreePhase(point.amps, realMS);
+
+	// the timeout is in test set time, though
+	injection.timeoutMS = guessMS * 2 + 1000;
+	SoftTestSetResults4 results;
+
+	if (!SOFT_TEST_SET::RunTest(hTripUnit, injection, &results, &r.stats))
+		return r;
+
+	r.ran = true;
+	r.measuredAmps = SOFT_TEST_SET::MeasuredAmps(results, groundFault);
+	r.expectedMS = ExpectedTripMS(point, r.measuredAmps);
+	r.measuredMS = results.pickupUntilTripTIMEms;
+	r.tripType = results.tripType;
+
+	r.ok = results.tripped && r.tripType == point.tripType;
+
+	if (point.tripType == _TRIP_TYPE_INST_DIGITAL)
+		r.ok &= r.measuredMS < INST_THRESHOLD_MS;
+	else
+		r.ok &= std::fabs(PercentDifference(r.expectedMS, r.measuredMS)) <= MAX_ERROR_PERCENT;
+
+	return r;
+}
+
+int main(int argc, char *argv[])
+{
+	RunnerConfig config;
+
+	config.sim.rebootMS = 200;
+	config.sim.testSetTimeScale = 0.01;
+
+	if (!ParseArgs(argc, argv, &config))
+	{
+		Usage();
+		return 1;
+	}
+
+	const int numPoints = sizeof(testPoints) / sizeof(testPoints[0]);
+
+	std::vector<SimulatedTripUnit> units(config.units);
+	std::vector<std::vector<PointResult>> results(config.units);
+	std::vector<std::thread> threads;
+
+	for (int i = 0; i < config.units; i++)
+	{
+		config.sim.seed = i + 1;
+
+		if (!StartSimulatedTripUnit(config.sim, &units[i]))
+		{
+			scr_printf("cannot create socketpair: %s", strerror(errno));
+			return 1;
+		}
+	}
+
+	uint64_t startMS = SERIAL_RX::NowMS();
+
+	for (int i = 0; i < config.units; i++)
+	{
+		threads.emplace_back([&config, &units, &results, i]
+							 {
+								 for (const TestPoint &point : testPoints)
+									 results[i].push_back(RunPoint(units[i].handle, point, config.sim.testSetTimeScale)); });
+	}
+
+	for (std::thread &thread : threads)
+		thread.join();
+
+	uint64_t elapsedMS = SERIAL_RX::NowMS() - startMS;
+
+	for (SimulatedTripUnit &unit : units)
+		StopSimulatedTripUnit(&unit);
+
+	bool allOK = true;
+	uint64_t tripMS = 0;
+	int polls = 0;
+
+	for (int i = 0; i < config.units; i++)
+	{
+		for (int p = 0; p < numPoints; p++)
+		{
+			const TestPoint &point = testPoints[p];
+			const PointResult &r = results[i][p];
+
+			scr_printf("unit %2d %-7s asked %5.0f A, saw %5u A: expected %6d ms, tripped in %6d ms (type %2d), %2d polls %s",
+					   i + 1, point.name, point.amps, r.measuredAmps, r.expectedMS, r.measuredMS, r.tripType, r.stats.polls,
+					   r.ok ? "" : "FAIL");
+
+			allOK &= r.ok;
+			tripMS += r.measuredMS;
+			polls += r.stats.polls;
+		}
+	}
+
+	scr_printf("%d units x %d points in %llu ms (%llu ms of trips, test set time); %d MSG_GET_RESPONSE_4",
+			   config.units, numPoints, (unsigned long long)elapsedMS, (unsigned long long)tripMS, polls);
+
+	scr_printf(allOK ? "PASSED" : "FAILED");
+
+	return allOK ? 0 : 1;
+}
+
+#endif
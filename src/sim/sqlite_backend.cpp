@@ -0,0 +1,155 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#include "sqlite_backend.hpp"
+#include "util/screen.hpp"
+
+namespace DB_QUEUE
+{
+	SqliteBackend::SqliteBackend(const std::string &filename, int busyTimeoutMS) : name("SQLite " + filename)
+	{
+		if (sqlite3_open(filename.c_str(), &db) != SQLITE_OK)
+		{
+			scr_printf("%s: %s", name.c_str(), db ? sqlite3_errmsg(db) : "cannot open");
+			sqlite3_close(db);
+			db = nullptr;
+			return;
+		}
+
+		sqlite3_busy_timeout(db, busyTimeoutMS);
+	}
+
+	SqliteBackend::~SqliteBackend()
+	{
+		for (const std::pair<const std::string, sqlite3_stmt *> &s : statements)
+			sqlite3_finalize(s.second);
+
+		if (db)
+			sqlite3_close(db);
+	}
+
+	bool SqliteBackend::Exec(const std::string &sql)
+	{
+		if (!db)
+			return false;
+
+		char *error = nullptr;
+		int result = sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &error);
+
+		if (result == SQLITE_BUSY)
+			busyCount++;
+		else if (result != SQLITE_OK)
+			scr_printf("%s: %s (%s)", name.c_str(), error ? error : sqlite3_errstr(result), sql.c_str());
+
+		sqlite3_free(error);
+
+		return (result == SQLITE_OK);
+	}
+
+	// the database being busy, or out of reach, is worth trying again; anything else, the
+	// row itself is wrong
+	static bool IsRetryable(int error)
+	{
+		switch (error & 0xff)
+		{
+		case SQLITE_BUSY:
+		case SQLITE_LOCKED:
+		case SQLITE_IOERR:
+		case SQLITE_CANTOPEN:
+		case SQLITE_FULL:
+		case SQLITE_NOMEM:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	// NULL (and error) if the SQL can't be prepared
+	sqlite3_stmt *SqliteBackend::Prepare(const std::string &sql, int *error)
+	{
+		std::map<std::string, sqlite3_stmt *>::iterator it = statements.find(sql);
+
+		if (it != statements.end())
+			return it->second;
+
+		sqlite3_stmt *stmt = nullptr;
+
+		*error = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+
+		if (*error != SQLITE_OK)
+		{
+			scr_printf("%s: %s (%s)", name.c_str(), sqlite3_errmsg(db), sql.c_str());
+			return nullptr;
+		}
+
+		statements[sql] = stmt;
+
+		return stmt;
+	}
+
+	WriteResult SqliteBackend::WriteBatch(const std::vector<RowUpdate> &rows, Rejected &rejected)
+	{
+		// IMMEDIATE: take the write lock now, rather than finding out halfway through
+		if (!Exec("BEGIN IMMEDIATE"))
+			return WRITE_RETRY;
+
+		WriteResult retval = WRITE_OK;
+
+		for (size_t i = 0; retval == WRITE_OK && i < rows.size(); i++)
+		{
+			int error = SQLITE_OK;
+			sqlite3_stmt *stmt = Prepare(UpdateStatement(rows[i]), &error);
+			int p = 1;
+
+			// the values, then the key
+			for (size_t v = 0; stmt && error == SQLITE_OK && v < rows[i].values.size(); v++)
+				error = sqlite3_bind_int(stmt, p++, rows[i].values[v].second);
+
+			if (stmt && error == SQLITE_OK)
+				error = sqlite3_bind_int(stmt, p, rows[i].key);
+
+			if (stmt && error == SQLITE_OK)
+			{
+				error = sqlite3_step(stmt);
+
+				if (error == SQLITE_BUSY)
+					busyCount++;
+
+				if (error == SQLITE_DONE)
+					error = (sqlite3_changes(db) > 0) ? SQLITE_OK : SQLITE_NOTFOUND;
+			}
+
+			if (error == SQLITE_NOTFOUND)
+			{
+				rejected = {i, "no row with " + rows[i].keyColumn + " = " + std::to_string(rows[i].key)};
+				retval = WRITE_REJECTED;
+			}
+			else if (error != SQLITE_OK)
+			{
+				rejected = {i, sqlite3_errmsg(db)};
+				retval = IsRetryable(error) ? WRITE_RETRY : WRITE_REJECTED;
+			}
+
+			if (stmt)
+				sqlite3_reset(stmt);
+		}
+
+		if (retval == WRITE_OK && !Exec("COMMIT"))
+			retval = WRITE_RETRY;
+
+		if (retval != WRITE_OK)
+			Exec("ROLLBACK");
+
+		return retval;
+	}
+}
@@ -0,0 +1,60 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "util/db_queue.hpp"
+
+// a DB_QUEUE::Backend on a SQLite file, so the write-behind queue can be tried out without
+// Access / ODBC (see db_queue_runner.cpp)
+//
+// SQLite lets one writer in at a time; somebody else holding the file locked looks a lot
+// like the production database being busy. busyTimeoutMS is how long we wait on that
+// before calling the batch failed (WRITE_RETRY). a bad column, or an UPDATE that finds no
+// row, is WRITE_REJECTED; the ODBC side does the same for the Access driver (see DB::Classify())
+
+namespace DB_QUEUE
+{
+	class SqliteBackend : public Backend
+	{
+	public:
+		SqliteBackend(const std::string &filename, int busyTimeoutMS);
+		~SqliteBackend() override;
+
+		bool IsOpen() const { return db != nullptr; }
+
+		// for setting up tables, and such; false (and prints why) if it didn't work
+		bool Exec(const std::string &sql);
+
+		WriteResult WriteBatch(const std::vector<RowUpdate> &rows, Rejected &rejected) override;
+		std::string Name() const override { return name; }
+
+		// how many batches we got SQLITE_BUSY on
+		int BusyCount() const { return busyCount; }
+
+	private:
+		// prepared once per UPDATE shape, like the ODBC side (see DB::Prepare())
+		sqlite3_stmt *Prepare(const std::string &sql, int *error);
+
+		sqlite3 *db = nullptr;
+		std::map<std::string, sqlite3_stmt *> statements;
+		std::string name;
+		int busyCount = 0;
+	};
+}
@@ -0,0 +1,363 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+
+// stability_runner: STABILITY::StabilityDetector on recorded (or made up) Keithley readings
+//
+// every trace goes through the old check (the first 5 readings; spread under the threshold
+// or not) and through the detector with a few different criteria, and we print how often
+// each one agrees with the old check, how many readings it looked at before it decided,
+// and how many VoltageOnKeithleyIsStable() would have had the Keithley take for that (it
+// takes them in two buffered acquisitions: a full window, then the rest up to maxSamples
+// if it still hasn't decided); they are 1 second apart, so that is also seconds
+//
+// recorded traces are what STABILITY::SaveTrace() writes (KEITHLEY::LastStabilityCheck()),
+// or just one reading per line; without any, we make up --synthetic of them: settled,
+// still settling, ramping, and stepping, at voltages both above and below highVoltsAbove
+//
+// it fails if any of the criteria says STABLE without a full window under the threshold
+// (that would make it easier to pass than the old check), or if the default criteria, or
+// the detector with the window and maxSamples both 5, don't agree with the old check every
+// time. the sets that slide on to 10 readings are there to show what that would change:
+// --show N prints the first N traces one of them passes that the old check turned down
+//
+//	stability_runner --synthetic 1000 --noise 0.0003 --seed 1 --show 3
+//	stability_runner --trace keithley1.csv --trace keithley2.csv
+
+#ifndef _WIN32
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "util/stability.hpp"
+#include "util/screen.hpp"
+
+typedef struct _RunnerConfig
+{
+	std::vector<std::string> traceFiles;
+	int synthetic = 1000;
+	double noise = 0.0003; // volts, peak
+	uint32_t seed = 1;
+	int show = 3;
+} RunnerConfig;
+
+typedef struct _Trace
+{
+	std::string name;
+	std::vector<double> readings;
+} Trace;
+
+// one set of criteria we are trying out, and how it did
+typedef struct _Candidate
+{
+	const char *name;
+	STABILITY::StabilityCriteria criteria;
+
+	int stable;
+	int unstable;
+	int pending;	// ran out of readings before it decided
+	int agree;		// same answer as the old check
+	int laterStable; // STABLE after the old check said UNSTABLE (a later window settled)
+	int weaker;		// STABLE without a full window under the threshold
+	long readings;	// it looked at to decide, all traces
+	long taken;		// the Keithley would have taken, all traces
+
+	std::vector<const struct _Trace *> laterStableTraces;
+} Candidate;
+
+static void Usage()
+{
+	puts("usage: stability_runner [options]");
+	puts("  --trace FILE      a recorded trace (STABILITY::SaveTrace(), or one reading per line); more than one is OK");
+	puts("  --synthetic N     made up traces, if there aren't any recorded ones (default 1000)");
+	puts("  --noise V         peak noise on the made up traces, in volts (default 0.0003)");
+	puts("  --seed N          for the made up traces");
+	puts("  --show N          print up to N traces that pass on a later window only (default 3)");
+}
+
+static bool ParseArgs(int argc, char *argv[], RunnerConfig *config)
+{
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string arg = argv[i];
+		const char *value = argv[i + 1];
+
+		if (arg == "--trace")
+			config->traceFiles.push_back(value);
+		else if (arg == "--synthetic")
+			config->synthetic = atoi(value);
+		else if (arg == "--noise")
+			config->noise = atof(value);
+		else if (arg == "--seed")
+			config->seed = (uint32_t)strtoul(value, nullptr, 10);
+		else if (arg == "--show")
+			config->show = atoi(value);
+		else
+			return false;
+	}
+
+	return (argc % 2) == 1 && config->synthetic >= 0 && config->noise >= 0;
+}
+
+// the same test VoltageOnKeithleyIsStable() did before there was a detector
+static bool OldCheckIsStable(const std::vector<double> &readings, const STABILITY::StabilityCriteria &criteria, int samples)
+{
+	if ((int)readings.size() < samples)
+		return false;
+
+	double minValue = *std::min_element(readings.begin(), readings.begin() + samples);
+	double maxValue = *std::max_element(readings.begin(), readings.begin() + samples);
+	double sum = 0;
+
+	for (int i = 0; i < samples; i++)
+		sum += readings[i];
+
+	double threshold = (sum / samples > criteria.highVoltsAbove) ? criteria.thresholdHigh : criteria.thresholdLow;
+
+	return (maxValue - minValue) < threshold;
+}
+
+// how a Keithley reading looks while the source is doing whatever it is doing
+static std::vector<Trace> MakeTraces(const RunnerConfig &config, int maxSamples)
+{
+	std::mt19937 rng(config.seed);
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+	std::vector<Trace> traces;
+
+	const char *kinds[] = {"settled", "settling", "ramp", "step"};
+
+	for (int t = 0; t < config.synthetic; t++)
+	{
+		int kind = t % 4;
+		double volts = 0.2 + unit(rng) * 9.8;
+		double offset = (unit(rng) < 0.5 ? -1 : 1) * (0.002 + unit(rng) * 0.03);
+		double tau = 0.5 + unit(rng) * 3.0;						   // readings, for "settling"
+		double slope = (unit(rng) < 0.5 ? -1 : 1) * (0.0002 + unit(rng) * 0.003); // volts per reading, for "ramp"
+		int stepAt = 1 + (int)(rng() % (maxSamples - 1));
+
+		Trace trace;
+		trace.name = std::string(kinds[kind]) + " #" + std::to_string(t);
+
+		for (int i = 0; i < maxSamples; i++)
+		{
+			double v = volts;
+
+			switch (kind)
+			{
+			case 1:
+				v += offset * std::exp(-i / tau);
+				break;
+			case 2:
+				v += slope * i;
+				break;
+			case 3:
+				v += (i >= stepAt) ? offset : 0;
+				break;
+			default:
+				break;
+			}
+
+			trace.readings.push_back(v + (unit(rng) * 2 - 1) * config.noise);
+		}
+
+		traces.push_back(trace);
+	}
+
+	return traces;
+}
+
+// see VoltageOnKeithleyIsStable(); the thrown away first reading isn't counted (the old
+// check had one of those too)
+static int ReadingsTaken(const STABILITY::StabilityCriteria &criteria, int decidedAfter)
+{
+	return (decidedAfter <= criteria.window) ? criteria.window : criteria.maxSamples;
+}
+
+static void Run(Candidate *candidate, const Trace &trace, bool oldStable)
+{
+	std::vector<STABILITY::StabilityStep> steps;
+	STABILITY::Decision decision = STABILITY::Evaluate(trace.readings, candidate->criteria, &steps);
+
+	candidate->readings += (long)steps.size();
+	candidate->taken += ReadingsTaken(candidate->criteria, (int)steps.size());
+
+	switch (decision)
+	{
+	case STABILITY::Decision::STABLE:
+	{
+		const STABILITY::StabilityStep &last = steps.back();
+		int n = (std::min)((int)steps.size(), candidate->criteria.window);
+
+		candidate->stable++;
+
+		// a full window of 1 second readings (as many as the old check looked at), under the threshold
+		if (n < 5 || last.spread >= last.threshold)
+			candidate->weaker++;
+
+		if (!oldStable)
+		{
+			candidate->laterStable++;
+			candidate->laterStableTraces.push_back(&trace);
+		}
+		break;
+	}
+
+	case STABILITY::Decision::UNSTABLE:
+		candidate->unstable++;
+		break;
+
+	default:
+		candidate->pending++;
+		break;
+	}
+
+	if ((decision == STABILITY::Decision::STABLE) == oldStable)
+		candidate->agree++;
+}
+
+int main(int argc, char *argv[])
+{
+	RunnerConfig config;
+
+	if (!ParseArgs(argc, argv, &config))
+	{
+		Usage();
+		return 1;
+	}
+
+	STABILITY::StabilityCriteria defaults;
+	std::vector<Candidate> candidates;
+
+	// what VoltageOnKeithleyIsStable() uses: the first window decides, ramps turned down early
+	candidates.push_back({"default", defaults});
+
+	// exactly the old check: decide on the first window, no matter what
+	candidates.push_back({"old (5 / 5)", defaults});
+	candidates.back().criteria.maxSamples = 5;
+	candidates.back().criteria.rampFactor = 1e9;
+
+	// keep sliding the window along, up to 10 readings
+	candidates.push_back({"slide to 10", defaults});
+	candidates.back().criteria.maxSamples = 10;
+
+	// same, without the ramp check
+	candidates.push_back({"10, no ramps", defaults});
+	candidates.back().criteria.maxSamples = 10;
+	candidates.back().criteria.rampFactor = 1e9;
+
+	// same, quicker to turn down ramps
+	candidates.push_back({"10, ramp x2", defaults});
+	candidates.back().criteria.maxSamples = 10;
+	candidates.back().criteria.rampFactor = 2.0;
+
+	int longest = 0;
+
+	for (const Candidate &c : candidates)
+		longest = (std::max)(longest, c.criteria.maxSamples);
+
+	std::vector<Trace> traces;
+
+	for (const std::string &filename : config.traceFiles)
+	{
+		Trace trace;
+		trace.name = filename;
+
+		if (!STABILITY::LoadReadings(filename, trace.readings))
+		{
+			scr_printf("cannot read %s", filename.c_str());
+			return 1;
+		}
+
+		traces.push_back(trace);
+	}
+
+	if (traces.empty())
+		traces = MakeTraces(config, longest);
+
+	if (traces.empty())
+	{
+		scr_printf("no traces");
+		return 1;
+	}
+
+	int oldStableCount = 0;
+
+	for (const Trace &trace : traces)
+	{
+		bool oldStable = OldCheckIsStable(trace.readings, defaults, 5);
+
+		oldStableCount += oldStable;
+
+		for (Candidate &candidate : candidates)
+			Run(&candidate, trace, oldStable);
+	}
+
+	bool allOK = true;
+
+	scr_printf("%d traces; the old check (first 5 readings) says %d STABLE, %d UNSTABLE, 5.0 readings each",
+			   (int)traces.size(), oldStableCount, (int)traces.size() - oldStableCount);
+	scr_printf("");
+	scr_printf("%-14s %7s %9s %8s %7s %13s %7s %8s %7s", "criteria", "stable", "unstable", "pending", "agree", "later stable", "weaker", "looked", "taken");
+
+	for (Candidate &c : candidates)
+	{
+		bool ok = c.weaker == 0;
+
+		// the ones that decide on the first window have to be the old check
+		if (c.criteria.maxSamples == c.criteria.window)
+			ok &= c.agree == (int)traces.size();
+
+		scr_printf("%-14s %7d %9d %8d %7d %13d %7d %8.2f %7.2f %s",
+				   c.name, c.stable, c.unstable, c.pending, c.agree, c.laterStable, c.weaker,
+				   (double)c.readings / traces.size(), (double)c.taken / traces.size(), ok ? "" : "<--");
+
+		allOK &= ok;
+	}
+
+	scr_printf("");
+	scr_printf("(later stable: STABLE on a later window, after the first 5 readings didn't make it;");
+	scr_printf(" looked / taken: readings per trace the detector looked at / the Keithley would have taken)");
+
+	// what sliding the window along lets through, that the old check didn't
+	for (const Candidate &c : candidates)
+	{
+		if (c.criteria.maxSamples == c.criteria.window || c.laterStableTraces.empty())
+			continue;
+
+		scr_printf("");
+		scr_printf("%s passes %d the old check turned down, e.g.:", c.name, c.laterStable);
+
+		for (int i = 0; i < config.show && i < (int)c.laterStableTraces.size(); i++)
+		{
+			std::vector<STABILITY::StabilityStep> steps;
+
+			STABILITY::Evaluate(c.laterStableTraces[i]->readings, c.criteria, &steps);
+			scr_printf("  %s, STABLE on readings %d .. %d:", c.laterStableTraces[i]->name.c_str(),
+					   steps.back().sample - c.criteria.window + 1, steps.back().sample);
+			STABILITY::DumpTrace(steps);
+		}
+
+		break;
+	}
+
+	scr_printf(allOK ? "PASSED" : "FAILED");
+
+	return allOK ? 0 : 1;
+}
+
+#endif
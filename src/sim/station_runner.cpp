@@ -0,0 +1,345 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+// station_runner: a STATION::Scheduler driving several simulated trip units at once
+//
+// every station gets its own TRIP_UNIT_SIM::TripUnitSimulator (on a socketpair, in this
+// process), and they all share one simulated Keithley. each unit goes through the same
+// steps as a real full calibration (CAL_SEQUENCE::BuildFullCalibration(), 60hz only):
+// settings, reboots, MSG_EXE_CALIBRATE_AD for every gain, check calibration
+//
+// before every gain, the station holds the meter for --measure ms (standing in for setting
+// the source and checking it on the Keithley; none of the real source / meter code runs
+// here, see the note in station.hpp); the trip unit then calibrates on its own
+//
+//	station_runner --stations 3 --units 2 --calibrate 1000 --reboot 2000 --measure 500
+
+#ifndef _WIN32
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "trip_unit_sim.hpp"
+#include "station.hpp"
+#include "trip4.hpp"
+#include "calibration_sequence.hpp"
+#include "misc_defines.hpp"
+#include "util/comm.hpp"
+#include "util/screen.hpp"
+
+// MSG_EXE_CALIBRATE_AD on a simulated unit never takes longer than --calibrate
+constexpr int CALIBRATE_TIMEOUT_MS = 1000 * 60;
+
+typedef struct _RunnerConfig
+{
+	int stations = 2;
+	int units = 3;	   // per station
+	int measureMS = 500; // meter time per gain
+	TRIP_UNIT_SIM::SimConfig sim;
+} RunnerConfig;
+
+static void Usage()
+{
+	puts("usage: station_runner [options]");
+	puts("  --stations N      how many stations (default 2)");
+	puts("  --units N         units each station does (default 3)");
+	puts("  --measure MS      time a station holds the shared meter per gain (default 500)");
+	puts("  --calibrate MS    time a MSG_EXE_CALIBRATE_AD channel request takes (default 1000)");
+	puts("  --reboot MS       how long a trip unit is gone after a settings change (default 2000)");
+	puts("  --latency MS      delay before every trip unit response (default 5)");
+}
+
+static bool ParseArgs(int argc, char *argv[], RunnerConfig *config)
+{
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string arg = argv[i];
+		int value = atoi(argv[i + 1]);
+
+		if (arg == "--stations")
+			config->stations = value;
+		else if (arg == "--units")
+			config->units = value;
+		else if (arg == "--measure")
+			config->measureMS = value;
+		else if (arg == "--calibrate")
+			config->sim.calibrateMS = value;
+		else if (arg == "--reboot")
+			config->sim.rebootMS = value;
+		else if (arg == "--latency")
+			config->sim.latencyMS = value;
+		else
+			return false;
+	}
+
+	return (argc % 2) == 1 && config->stations > 0;
+}
+
+static bool WriteAll(int fd, const uint8_t *data, int len)
+{
+	int sent = 0;
+
+	while (sent < len)
+	{
+		ssize_t n = write(fd, data + sent, len - sent);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		if (n <= 0)
+			return false;
+
+		sent += (int)n;
+	}
+
+	return true;
+}
+
+// a simulated trip unit on one end of a socketpair, and a HANDLE for the other end
+typedef struct _SimulatedTripUnit
+{
+	std::unique_ptr<TRIP_UNIT_SIM::TripUnitSimulator> sim;
+	std::thread thread;
+	int simFD;
+	HANDLE handle;
+} SimulatedTripUnit;
+
+static bool StartSimulatedTripUnit(const TRIP_UNIT_SIM::SimConfig &config, SimulatedTripUnit *unit)
+{
+	int fds[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+		return false;
+
+	int appFD = fds[0];
+	unit->simFD = fds[1];
+
+	int simFD = unit->simFD;
+
+	unit->sim = std::make_unique<TRIP_UNIT_SIM::TripUnitSimulator>(
+		config,
+		SERIAL_RX::PosixBackend(simFD),
+		[simFD](const uint8_t *data, int len) -> bool
+		{
+			return WriteAll(simFD, data, len);
+		});
+
+	CommTransport transport;
+
+	transport.readSome = SERIAL_RX::PosixBackend(appFD);
+	transport.write = [appFD](const uint8_t *data, int len) -> bool
+	{
+		return WriteAll(appFD, data, len);
+	};
+	transport.close = [appFD]()
+	{
+		close(appFD);
+	};
+
+	unit->handle = RegisterCommTransport(transport);
+
+	TRIP_UNIT_SIM::TripUnitSimulator *sim = unit->sim.get();
+	unit->thread = std::thread([sim]
+							   { sim->Run(); });
+
+	return true;
+}
+
+static void StopSimulatedTripUnit(SimulatedTripUnit *unit)
+{
+	unit->sim->Stop();
+	CloseCommPort(&unit->handle);
+
+	// (closing our end is what gets it out of its read)
+	shutdown(unit->simFD, SHUT_RDWR);
+
+	unit->thread.join();
+	close(unit->simFD);
+}
+
+// one MSG_EXE_CALIBRATE_AD; the simulated unit doesn't check RealRMS, but fill it in anyway
+static bool Calibrate(HANDLE hTripUnit, uint16_t commands)
+{
+	URCMessageUnion msg = {0};
+
+	msg.msgHdr.Type = MSG_EXE_CALIBRATE_AD;
+	msg.msgHdr.Version = PROTOCOL_VERSION;
+	msg.msgHdr.Length = sizeof(MsgExeCalibrateAD) - sizeof(MsgHdr);
+	msg.msgHdr.Dst = ADDR_TRIP_UNIT;
+	msg.msgHdr.Src = ADDR_CAL_APP;
+
+	msg.msgExeCalibrateAD.CalibrateRequest.Commands = commands;
+	for (int i = 0; i < _NUM_A2D_INPUTS_RAW_CAL; i++)
+		msg.msgExeCalibrateAD.CalibrateRequest.RealRMS[i] = 3800;
+
+	URCReply reply = SendURCMessageAsync(hTripUnit, &msg, MSG_RSP_CALIBRATE_AD, CALIBRATE_TIMEOUT_MS).get();
+
+	return reply.ok && reply.msg.msgHdr.Type == MSG_RSP_CALIBRATE_AD;
+}
+
+// what calibrate_rc.cpp's MakeTripUnitReboot() does: change a setting, and put it back
+static bool Reboot(HANDLE hTripUnit)
+{
+	for (bool enabled : {true, false})
+	{
+		bool ok = SetSystemAndDeviceSettings(hTripUnit,
+											 [enabled](SystemSettings4 *Settings, DeviceSettings4 *DevSettings4)
+											 {
+												 DevSettings4->ModbusForcedTripEnabled = enabled;
+												 return true;
+											 });
+
+		if (!ok || !WaitForTripUnitReady(hTripUnit))
+			return false;
+	}
+
+	return true;
+}
+
+static bool CheckCalibration(HANDLE hTripUnit)
+{
+	URCReply reply = SendURCCommandAsync(hTripUnit, MSG_GET_STATUS, ADDR_TRIP_UNIT, ADDR_CAL_APP, MSG_RSP_STATUS_2).get();
+
+	return reply.ok && (reply.msg.msgRspStatus2.Status & STS_CALIBRATED) == STS_CALIBRATED;
+}
+
+static bool DoUnit(const RunnerConfig &config, STATION::Station &station, INSTRUMENT_BROKER::Broker &instruments)
+{
+	HANDLE h = station.hTripUnit;
+
+	auto doStep = [&](const CAL_SEQUENCE::CalibrationStep &step) -> bool
+	{
+		switch (step.type)
+		{
+		case CAL_SEQUENCE::STEP_CHECK_TRIP_UNIT_TYPE:
+		{
+			URCReply reply = SendURCCommandAsync(h, MSG_CONNECT, ADDR_TRIP_UNIT, ADDR_CAL_APP, MSG_ACK).get();
+			return reply.ok && reply.msg.msgHdr.Src == ADDR_AC_PRO_RC;
+		}
+
+		case CAL_SEQUENCE::STEP_UNCALIBRATE:
+			return Calibrate(h, _CALIBRATION_UNCALIBRATE);
+
+		case CAL_SEQUENCE::STEP_SETUP_FREQUENCY:
+			return SetupTripUnitForCalibration(h, !step.is60hz);
+
+		case CAL_SEQUENCE::STEP_WAIT:
+			return WaitForTripUnitReady(h, step.delayMS);
+
+		case CAL_SEQUENCE::STEP_INIT_CALIBRATION:
+			return Calibrate(h, _CALIBRATION_INITIALIZE);
+
+		case CAL_SEQUENCE::STEP_CALIBRATE_GAIN:
+		{
+			// the part that needs the meter
+			{
+				INSTRUMENT_BROKER::Lease meter = instruments.Acquire(station.meterName, INSTRUMENT_BROKER::PRIORITY_HIGH);
+				Sleep(config.measureMS);
+
+				// (taken back while we were measuring: the reading is no good; see SourceAndMeter)
+				if (!meter.Valid())
+				{
+					scr_printf("%s: lost the lease on %s; aborting", station.name.c_str(), meter.Resource().c_str());
+					return false;
+				}
+			}
+
+			// the part that doesn't
+			uint16_t hi = _CALIBRATION_REQUEST_IA_HI | _CALIBRATION_REQUEST_IB_HI | _CALIBRATION_REQUEST_IC_HI | _CALIBRATION_REQUEST_IN_HI;
+			uint16_t lo = _CALIBRATION_REQUEST_IA_LO | _CALIBRATION_REQUEST_IB_LO | _CALIBRATION_REQUEST_IC_LO | _CALIBRATION_REQUEST_IN_LO;
+
+			return Calibrate(h, step.gain | hi) && Calibrate(h, step.gain | lo);
+		}
+
+		case CAL_SEQUENCE::STEP_WRITE_TO_FLASH:
+			return Calibrate(h, _CALIBRATION_WRITE_TO_FLASH);
+
+		case CAL_SEQUENCE::STEP_REBOOT:
+			return Reboot(h);
+
+		case CAL_SEQUENCE::STEP_CHECK_CALIBRATION:
+			return CheckCalibration(h);
+
+		default:
+			return false;
+		}
+	};
+
+	return CAL_SEQUENCE::RunSequence(CAL_SEQUENCE::BuildFullCalibration(false, true), doStep);
+}
+
+int main(int argc, char *argv[])
+{
+	RunnerConfig config;
+
+	if (!ParseArgs(argc, argv, &config))
+	{
+		Usage();
+		return 1;
+	}
+
+	std::vector<SimulatedTripUnit> units(config.stations);
+	STATION::Scheduler scheduler;
+
+	for (int i = 0; i < config.stations; i++)
+	{
+		config.sim.seed = i + 1;
+
+		if (!StartSimulatedTripUnit(config.sim, &units[i]))
+		{
+			scr_printf("cannot create socketpair: %s", strerror(errno));
+			return 1;
+		}
+
+		STATION::Station station;
+
+		station.id = i + 1;
+		station.name = "station " + std::to_string(i + 1);
+		station.hTripUnit = units[i].handle;
+		station.meterName = INSTRUMENT_BROKER::KEITHLEY;
+
+		scheduler.AddStation(station);
+	}
+
+	std::vector<int> unitsLeft(config.stations + 1, config.units);
+
+	scheduler.Run(
+		[&unitsLeft](STATION::Station &station) -> bool
+		{
+			// (each station only ever touches its own count)
+			return unitsLeft[station.id]-- > 0;
+		},
+		[&config](STATION::Station &station, INSTRUMENT_BROKER::Broker &instruments) -> bool
+		{
+			return DoUnit(config, station, instruments);
+		});
+
+	scheduler.PrintStats();
+	scheduler.Instruments().PrintStats();
+
+	for (SimulatedTripUnit &unit : units)
+		StopSimulatedTripUnit(&unit);
+
+	return 0;
+}
+
+#endif
@@ -0,0 +1,288 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+
+// test_plan_runner: TEST_PLAN on a trip test file, offline
+//
+// reads an LT / ST / INST / GF test file (the same format each test's ReadTestFile()
+// takes), and prints the plan and how long it should take, against the file's own
+// order. the costs can be changed from the command line; with --actual (what the app
+// said the run took), it also says how far off the prediction was, so the costs can be
+// tuned until it isn't. with no --file, it plans a made up file
+//
+// checks that the plan runs every point exactly once, and never takes longer than the
+// file's order; if it changes the order, it writes each set of settings only once, and is
+// faster; if not, it is the file's order
+//
+//	test_plan_runner --kind st --file st_points.txt --before-cooldown 250 --after-cooldown 3750 --actual 412
+
+#ifndef _WIN32
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "tests/test_plan.hpp"
+#include "util/screen.hpp"
+
+// what ST_TRIP_TEST_RC sets LT to
+constexpr int ST_TEST_LT_PICKUP_AMPS = 800;
+
+// interleaved on purpose, so there is something to plan
+static const char *SAMPLE_LT[] = {"415, 3.5, 2250", "625, 24.0, 2250", "415, 3.5, 3000", "625, 24.0, 3000", "415, 3.5, 4000"};
+static const char *SAMPLE_ST[] = {"2400, 0.1, 1, 3000", "3200, 0.2, 0, 4000", "2400, 0.1, 1, 4000", "3200, 0.2, 0, 5000", "2400, 0.1, 1, 5000", "4000, 0.4, 1, 6000"};
+static const char *SAMPLE_INST[] = {"1500, 1500, 0, 2500", "1500, 1500, 1, 2500", "1500, 1500, 0, 3000", "1500, 1500, 1, 3000"};
+static const char *SAMPLE_GF[] = {"800, 200, 0.5, 1, 0, 300", "800, 400, 0.3, 2, 0, 600", "800, 200, 0.5, 1, 0, 400", "800, 400, 0.3, 2, 0, 900"};
+
+typedef struct _RunnerConfig
+{
+	TEST_PLAN::TestKind kind = TEST_PLAN::TestKind::ST;
+	std::string file;
+	bool soft = false;
+	bool costsGiven[5] = {false};
+	TEST_PLAN::PlanCosts costs = {0};
+	double actualSeconds = 0;
+} RunnerConfig;
+
+static void Usage()
+{
+	puts("usage: test_plan_runner [options]");
+	puts("  --kind lt|st|inst|gf   what kind of test file (default st)");
+	puts("  --file PATH            the test file (default: a made up one)");
+	puts("  --soft 0|1             plan for the soft test set (default 0)");
+	puts("  --settings MS          cost of a settings write and reboot");
+	puts("  --before-cooldown MS   what a point does before it waits out the cool-down (clear history, QT)");
+	puts("  --after-cooldown MS    what a point does after the cool-down, other than the trip");
+	puts("  --after MS             wait after a trip");
+	puts("  --cooldown MS          from one point to current on for the next");
+	puts("  --actual SECONDS       what the run really took");
+}
+
+static bool ParseKind(const std::string &s, TEST_PLAN::TestKind *kind)
+{
+	if (s == "lt")
+		*kind = TEST_PLAN::TestKind::LT;
+	else if (s == "st")
+		*kind = TEST_PLAN::TestKind::ST;
+	else if (s == "inst")
+		*kind = TEST_PLAN::TestKind::INST;
+	else if (s == "gf")
+		*kind = TEST_PLAN::TestKind::GF;
+	else
+		return false;
+
+	return true;
+}
+
+static bool ParseArgs(int argc, char *argv[], RunnerConfig *config)
+{
+	uint32_t *costs[] = {&config->costs.settingsMS, &config->costs.beforeCoolDownMS, &config->costs.afterCoolDownMS, &config->costs.afterTripMS, &config->costs.coolDownMS};
+	const char *costArgs[] = {"--settings", "--before-cooldown", "--after-cooldown", "--after", "--cooldown"};
+
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string arg = argv[i];
+		const char *value = argv[i + 1];
+		bool found = false;
+
+		for (int c = 0; c < 5; c++)
+		{
+			if (arg == costArgs[c])
+			{
+				*costs[c] = (uint32_t)strtoul(value, nullptr, 10);
+				config->costsGiven[c] = found = true;
+			}
+		}
+
+		if (found)
+			continue;
+
+		if (arg == "--kind")
+		{
+			if (!ParseKind(value, &config->kind))
+				return false;
+		}
+		else if (arg == "--file")
+			config->file = value;
+		else if (arg == "--soft")
+			config->soft = atoi(value) != 0;
+		else if (arg == "--actual")
+			config->actualSeconds = atof(value);
+		else
+			return false;
+	}
+
+	return (argc % 2) == 1;
+}
+
+// one line of a test file; false if it doesn't have enough fields (blank lines etc.)
+static bool ParseLine(TEST_PLAN::TestKind kind, int index, const std::string &line, TEST_PLAN::PlanPoint *point)
+{
+	std::istringstream fields(line);
+	std::string field;
+	std::vector<double> v;
+
+	while (std::getline(fields, field, ','))
+		v.push_back(atof(field.c_str()));
+
+	switch (kind)
+	{
+	case TEST_PLAN::TestKind::LT:
+		if (v.size() < 3)
+			return false;
+		*point = TEST_PLAN::LTPoint(index, (int)v[0], (float)v[1], (float)v[2]);
+		return true;
+
+	case TEST_PLAN::TestKind::ST:
+		if (v.size() < 4)
+			return false;
+		*point = TEST_PLAN::STPoint(index, (int)v[0], (float)v[1], v[2] != 0, ST_TEST_LT_PICKUP_AMPS, (float)v[3]);
+		return true;
+
+	case TEST_PLAN::TestKind::INST:
+		if (v.size() < 4)
+			return false;
+		*point = TEST_PLAN::INSTPoint(index, (int)v[0], (int)v[1], v[2] != 0, (float)v[3]);
+		return true;
+
+	default:
+		if (v.size() < 6)
+			return false;
+		*point = TEST_PLAN::GFPoint(index, (int)v[0], (int)v[4], (int)v[1], (float)v[2], (int)v[3], (float)v[5]);
+		return true;
+	}
+}
+
+static std::vector<std::string> SampleLines(TEST_PLAN::TestKind kind)
+{
+	switch (kind)
+	{
+	case TEST_PLAN::TestKind::LT:
+		return {std::begin(SAMPLE_LT), std::end(SAMPLE_LT)};
+	case TEST_PLAN::TestKind::ST:
+		return {std::begin(SAMPLE_ST), std::end(SAMPLE_ST)};
+	case TEST_PLAN::TestKind::INST:
+		return {std::begin(SAMPLE_INST), std::end(SAMPLE_INST)};
+	default:
+		return {std::begin(SAMPLE_GF), std::end(SAMPLE_GF)};
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	RunnerConfig config;
+
+	if (!ParseArgs(argc, argv, &config))
+	{
+		Usage();
+		return 1;
+	}
+
+	std::vector<std::string> lines;
+
+	if (config.file.empty())
+		lines = SampleLines(config.kind);
+	else
+	{
+		std::ifstream file(config.file);
+		std::string line;
+
+		if (!file)
+		{
+			scr_printf("cannot open %s", config.file.c_str());
+			return 1;
+		}
+
+		while (std::getline(file, line))
+			lines.push_back(line);
+	}
+
+	std::vector<TEST_PLAN::PlanPoint> points;
+
+	for (size_t i = 0; i < lines.size(); i++)
+	{
+		TEST_PLAN::PlanPoint point;
+
+		// (index is the point's, not the line's; same as ReadTestFile() skipping blank lines)
+		if (ParseLine(config.kind, (int)points.size(), lines[i], &point))
+		{
+			point.line = (int)i + 1;
+			points.push_back(point);
+		}
+	}
+
+	// whatever wasn't given on the command line is the default
+	TEST_PLAN::PlanCosts costs = TEST_PLAN::DefaultCosts(config.kind, config.soft);
+	uint32_t *given[] = {&config.costs.settingsMS, &config.costs.beforeCoolDownMS, &config.costs.afterCoolDownMS, &config.costs.afterTripMS, &config.costs.coolDownMS};
+	uint32_t *used[] = {&costs.settingsMS, &costs.beforeCoolDownMS, &costs.afterCoolDownMS, &costs.afterTripMS, &costs.coolDownMS};
+
+	for (int c = 0; c < 5; c++)
+	{
+		if (config.costsGiven[c])
+			*used[c] = *given[c];
+	}
+
+	scr_printf("costs: settings %u ms, before cool-down %u ms, after cool-down %u ms, after trip %u ms, cool-down %u ms", costs.settingsMS,
+			   costs.beforeCoolDownMS, costs.afterCoolDownMS, costs.afterTripMS, costs.coolDownMS);
+
+	for (const TEST_PLAN::PlanPoint &point : points)
+		scr_printf("  line %2d: %s, trips in %u ms", point.line, point.settings.c_str(), point.expectedTripMS);
+
+	TEST_PLAN::Plan plan = TEST_PLAN::MakePlan(points, costs);
+	TEST_PLAN::PrintPlan(plan);
+
+	if (config.actualSeconds > 0)
+		TEST_PLAN::PrintPredictedVsActual(plan, (uint64_t)(config.actualSeconds * 1000));
+
+	// every point once
+	std::vector<int> indexes;
+
+	for (const TEST_PLAN::PlanStep &step : plan.steps)
+		indexes.push_back(step.index);
+
+	std::sort(indexes.begin(), indexes.end());
+
+	bool allOK = !points.empty() && indexes.size() == points.size();
+
+	for (size_t i = 0; allOK && i < indexes.size(); i++)
+		allOK = indexes[i] == (int)i;
+
+	// every set of settings once
+	std::set<std::string> distinct;
+
+	for (const TEST_PLAN::PlanPoint &point : points)
+		distinct.insert(point.settings);
+
+	allOK &= plan.predictedMS <= plan.fileOrderMS;
+
+	if (plan.reordered)
+		allOK &= plan.settingsWrites == (int)distinct.size() && plan.predictedMS < plan.fileOrderMS;
+	else
+	{
+		allOK &= plan.settingsWrites == plan.fileOrderSettingsWrites && plan.predictedMS == plan.fileOrderMS;
+
+		for (size_t i = 0; allOK && i < plan.steps.size(); i++)
+			allOK = plan.steps[i].index == (int)i;
+	}
+
+	scr_printf(allOK ? "PASSED" : "FAILED");
+
+	return allOK ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,354 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+
+// trip_curve_runner: TRIP_CURVE against the formulas, and against what we used to do
+//
+// builds a set of LT / ST / GF settings (every delay the trip unit has, I2T on and off,
+// I2T and I5T for GF) and runs each one over --points currents between just over pickup
+// and 12x pickup. checks that:
+//	-	TimesMS() (the batch) gives exactly what TimeMS() does, one at a time
+//	-	both are within 1ms of the manual's formulas, worked out in long double
+// and prints how often (and by how much) the old per-test functions were off, and how
+// long a point takes the old way vs. the batch
+//
+// build with -DCMAKE_BUILD_TYPE=Release for the timings to mean anything
+//
+//	trip_curve_runner --points 2000
+
+#ifndef _WIN32
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "tests/trip_time_rc.hpp"
+#include "util/screen.hpp"
+
+constexpr int CT_RATING = 800;
+
+typedef struct _RunnerConfig
+{
+	int points = 2000;
+} RunnerConfig;
+
+// one setting, as the old functions want it
+typedef struct _SettingCase
+{
+	TRIP_CURVE::Element element;
+	int pickupAmps;
+	float delaySeconds;
+	int slope;
+	int LTPickupAmps;
+} SettingCase;
+
+static void Usage()
+{
+	puts("usage: trip_curve_runner [options]");
+	puts("  --points N        currents per setting (default 2000)");
+}
+
+static bool ParseArgs(int argc, char *argv[], RunnerConfig *config)
+{
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string arg = argv[i];
+
+		if (arg == "--points")
+			config->points = atoi(argv[i + 1]);
+		else
+			return false;
+	}
+
+	return (argc % 2) == 1 && config->points > 1;
+}
+
+// what LT_TRIP_TEST_RC / ST_TRIP_TEST_RC / GF_TRIP_TEST_RC::TimeTimeToTripMS() used to be
+static int OldLT(int LT_Pickup_AmpsRMS, float LT_Delay_Seconds, int AppliedCurrentAmpsRMS)
+{
+	float X = (float)AppliedCurrentAmpsRMS / LT_Pickup_AmpsRMS;
+	int TBLC_lt = 36 * LT_Delay_Seconds;
+	float T = TBLC_lt / (X * X);
+	return T * 1000;
+}
+
+static int OldST(float ST_Delay_Seconds, bool I2TEnabled, int LT_Pickup_AmpsRMS, int AppliedCurrentAmpsRMS)
+{
+	if (!I2TEnabled || (AppliedCurrentAmpsRMS > 10 * LT_Pickup_AmpsRMS))
+		return ST_Delay_Seconds * 1000;
+
+	int STTimeBandConstant = ST_Delay_Seconds * 100;
+	float X = (float)AppliedCurrentAmpsRMS / LT_Pickup_AmpsRMS;
+	float second = STTimeBandConstant / (X * X);
+	return second * 1000;
+}
+
+static uint32_t OldGF(int CTRating, int GFPickup, float GFDelay, int GFSlope, int GFCurrent)
+{
+	auto same = [](float a, float b)
+	{ return std::abs(a - b) < 0.0001; };
+
+	if (0 == GFDelay)
+		return 0;
+
+	if (GFSlope == 0 || (GFSlope == 1 && GFCurrent > 0.6 * CTRating) || (GFSlope == 2 && GFCurrent > 4 * GFPickup))
+		return GFDelay * 1000;
+
+	if (GFSlope == 1)
+	{
+		float TB2C = same(GFDelay, 0.5) ? 0.5 : same(GFDelay, 0.4) ? 0.4 : same(GFDelay, 0.3) ? 0.3 : same(GFDelay, 0.2) ? 0.2 : same(GFDelay, 0.1) ? 0.01 : 0.0;
+		float xGF = (float)GFCurrent / CTRating;
+		return TB2C / (xGF * xGF) * 1000;
+	}
+
+	float TB5C = same(GFDelay, 0.5) ? 512 : same(GFDelay, 0.4) ? 409.6f : 307.2f;
+	float x5GF = (float)GFCurrent / GFPickup;
+	return TB5C / (x5GF * x5GF * x5GF * x5GF * x5GF) * 1000;
+}
+
+static uint32_t OldTimeMS(const SettingCase &setting, int amps)
+{
+	switch (setting.element)
+	{
+	case TRIP_CURVE::Element::LT:
+		return OldLT(setting.pickupAmps, setting.delaySeconds, amps);
+	case TRIP_CURVE::Element::ST:
+		return OldST(setting.delaySeconds, setting.slope != 0, setting.LTPickupAmps, amps);
+	default:
+		return OldGF(CT_RATING, setting.pickupAmps, setting.delaySeconds, setting.slope, amps);
+	}
+}
+
+// straight out of the manual, with nothing rounded until the end
+static long double ManualMS(const SettingCase &setting, long double amps)
+{
+	long double delay = setting.delaySeconds;
+
+	switch (setting.element)
+	{
+	case TRIP_CURVE::Element::LT:
+	{
+		long double X = amps / setting.pickupAmps;
+		return 36 * std::round(delay * 10) / 10 / (X * X) * 1000;
+	}
+
+	case TRIP_CURVE::Element::ST:
+	{
+		long double X = amps / setting.LTPickupAmps;
+		long double seconds = std::round(delay * 100) / 100;
+
+		if (setting.slope == 0 || amps > 10.0L * setting.LTPickupAmps)
+			return seconds * 1000;
+
+		return seconds * 100 / (X * X) * 1000;
+	}
+
+	default:
+	{
+		int hundredths = (int)std::lround(delay * 100);
+		long double seconds = hundredths / 100.0L;
+
+		if (setting.slope == 0 || (setting.slope == 1 && amps > 0.6L * CT_RATING) || (setting.slope == 2 && amps > 4.0L * setting.pickupAmps))
+			return seconds * 1000;
+
+		if (setting.slope == 1)
+		{
+			long double TB2C = (hundredths == 10) ? 0.01L : (hundredths == 5) ? 0 : seconds;
+			long double X = amps / CT_RATING;
+			return TB2C / (X * X) * 1000;
+		}
+
+		long double TB5C = 1024 * seconds;
+		long double X = amps / setting.pickupAmps;
+		return TB5C / (X * X * X * X * X) * 1000;
+	}
+	}
+}
+
+static std::vector<SettingCase> BuildSettings()
+{
+	std::vector<SettingCase> settings;
+
+	for (int pickup : {400, 640, 800})
+	{
+		for (float delay : {0.5f, 1.0f, 2.0f, 2.4f, 4.0f, 7.0f, 10.0f, 12.0f, 15.0f, 20.0f, 24.0f, 30.0f})
+			settings.push_back({TRIP_CURVE::Element::LT, pickup, delay, 0, pickup});
+
+		for (float delay : {0.07f, 0.10f, 0.15f, 0.20f, 0.30f, 0.40f})
+		{
+			for (int slope : {0, 1})
+				settings.push_back({TRIP_CURVE::Element::ST, 2 * pickup, delay, slope, pickup});
+		}
+	}
+
+	for (int pickup : {200, 400, 600})
+	{
+		for (float delay : {0.05f, 0.10f, 0.20f, 0.30f, 0.40f, 0.50f})
+		{
+			for (int slope : {0, 1})
+				settings.push_back({TRIP_CURVE::Element::GF, pickup, delay, slope, 0});
+		}
+
+		for (float delay : {0.30f, 0.40f, 0.50f})
+			settings.push_back({TRIP_CURVE::Element::GF, pickup, delay, 2, 0});
+	}
+
+	return settings;
+}
+
+static bool Compile(const SettingCase &s, TRIP_CURVE::Curve *curve)
+{
+	TRIP_CURVE::CurveSetting setting = {s.element};
+
+	setting.pickupAmps = s.pickupAmps;
+	setting.delay = (int)std::lround(s.delaySeconds * ((s.element == TRIP_CURVE::Element::LT) ? 10 : 100));
+	setting.slope = s.slope;
+	setting.LTPickupAmps = s.LTPickupAmps;
+	setting.CTRating = CT_RATING;
+
+	return TRIP_CURVE::Compile(setting, curve);
+}
+
+static double NowNS()
+{
+	return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// LT, ST, GF
+static const char *ELEMENT_NAMES[] = {"LT", "ST", "GF"};
+
+static int ElementIndex(TRIP_CURVE::Element element)
+{
+	switch (element)
+	{
+	case TRIP_CURVE::Element::LT:
+		return 0;
+	case TRIP_CURVE::Element::ST:
+		return 1;
+	default:
+		return 2;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	RunnerConfig config;
+
+	if (!ParseArgs(argc, argv, &config))
+	{
+		Usage();
+		return 1;
+	}
+
+	std::vector<SettingCase> settings = BuildSettings();
+	std::vector<TRIP_CURVE::Curve> curves(settings.size());
+
+	bool allOK = true;
+
+	for (size_t s = 0; s < settings.size(); s++)
+		allOK &= Compile(settings[s], &curves[s]);
+
+	if (!allOK)
+	{
+		scr_printf("FAILED: a setting did not compile");
+		return 1;
+	}
+
+	// whole amps, so the old functions see the same thing
+	std::vector<std::vector<float>> amps(settings.size());
+
+	for (size_t s = 0; s < settings.size(); s++)
+	{
+		for (int i = 0; i < config.points; i++)
+			amps[s].push_back(std::floor(settings[s].pickupAmps * (1.05f + 11.0f * i / (config.points - 1))));
+	}
+
+	size_t total = settings.size() * config.points;
+	std::vector<uint32_t> batch(config.points);
+	uint64_t checksum = 0;
+
+	// the old way, one at a time
+	double start = NowNS();
+	for (size_t s = 0; s < settings.size(); s++)
+	{
+		for (float a : amps[s])
+			checksum += OldTimeMS(settings[s], (int)a);
+	}
+	double oldNS = (NowNS() - start) / total;
+
+	// the batch
+	start = NowNS();
+	for (size_t s = 0; s < settings.size(); s++)
+	{
+		TRIP_CURVE::TimesMS(curves[s], amps[s].data(), batch.data(), amps[s].size());
+		checksum += batch[0];
+	}
+	double batchNS = (NowNS() - start) / total;
+
+	int mismatches = 0;
+	int offManual = 0;
+	long double worstManual = 0;
+
+	// per element: points the old functions were more than 1ms off, and the worst of them
+	int oldOff[3] = {0};
+	long double oldWorst[3] = {0};
+
+	for (size_t s = 0; s < settings.size(); s++)
+	{
+		int e = ElementIndex(settings[s].element);
+
+		TRIP_CURVE::TimesMS(curves[s], amps[s].data(), batch.data(), amps[s].size());
+
+		for (int i = 0; i < config.points; i++)
+		{
+			float a = amps[s][i];
+			long double manual = ManualMS(settings[s], a);
+			long double diff = std::fabs(batch[i] - manual);
+			long double oldDiff = std::fabs((long double)OldTimeMS(settings[s], (int)a) - manual);
+
+			if (batch[i] != TRIP_CURVE::TimeMS(curves[s], a))
+				mismatches++;
+
+			if (diff > 1)
+				offManual++;
+
+			worstManual = (std::max)(worstManual, diff);
+
+			if (oldDiff > 1)
+			{
+				oldOff[e]++;
+				oldWorst[e] = (std::max)(oldWorst[e], oldDiff);
+			}
+		}
+	}
+
+	allOK &= mismatches == 0 && offManual == 0;
+
+	scr_printf("%zu settings x %d currents = %zu points (checksum %llu)", settings.size(), config.points, total, (unsigned long long)checksum);
+	scr_printf("old functions: %6.2f ns per point", oldNS);
+	scr_printf("batch:         %6.2f ns per point (%.1fx)", batchNS, oldNS / batchNS);
+	scr_printf("batch vs. one at a time: %d different; vs. the manual: %d off by more than 1ms (worst %.3Lf ms)", mismatches, offManual, worstManual);
+
+	for (int e = 0; e < 3; e++)
+		scr_printf("old %s: %d points off by more than 1ms (worst %.1Lf ms)", ELEMENT_NAMES[e], oldOff[e], oldWorst[e]);
+
+	scr_printf(allOK ? "PASSED" : "FAILED");
+
+	return allOK ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,859 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <thread>
+
+#include "trip_unit_sim.hpp"
+#include "util/screen.hpp"
+#include "tests/soft_test_set.hpp"
+#include "tests/trip_time_rc.hpp"
+#include "misc_defines.hpp"
+
+namespace TRIP_UNIT_SIM
+{
+	// how long Run() waits on the port before it goes and checks whether it should stop
+	constexpr int IDLE_SLICE_MS = 100;
+
+	// _BIT_Frequency50Hz in calibrate_rc.cpp
+	constexpr uint32_t FREQUENCY_50HZ_ALLOWED = 0x00000100ul;
+
+	// we don't know what the real firmware puts in CalibrationDataFLASH.Calibrated, or what
+	// its default offsets / gains are; the app only ever looks at CalibratedChannels and
+	// STS_CALIBRATED, so these just have to be consistent with themselves
+	constexpr uint32_t CALIBRATED_KEYWORD = 0xCA11B8A7;
+	constexpr uint16_t DEFAULT_OFFSET = 0x0800;
+	constexpr uint16_t DEFAULT_SW_GAIN = 0x4000;
+
+	static bool LengthIs(const URCMessageUnion &msg, size_t size)
+	{
+		return msg.msgHdr.Length == size - sizeof(MsgHdr);
+	}
+
+	static void SetupResponse(URCMessageUnion *rsp, uint8_t type, size_t size)
+	{
+		rsp->msgHdr.Type = type;
+		rsp->msgHdr.Length = (uint16_t)(size - sizeof(MsgHdr));
+	}
+
+	static TimeDate4 Now()
+	{
+		TimeDate4 td = {0};
+
+		auto now = std::chrono::system_clock::now();
+		std::time_t t = std::chrono::system_clock::to_time_t(now);
+		std::tm *tm = std::localtime(&t);
+
+		td.Year = tm->tm_year % 100;
+		td.Month = tm->tm_mon + 1;
+		td.Day = tm->tm_mday;
+		td.Hour = tm->tm_hour;
+		td.Minute = tm->tm_min;
+		td.Second = tm->tm_sec;
+		td.MilliSec = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000;
+
+		return td;
+	}
+
+	// which CalibrationDataFLASH.GainHI[] a MSG_EXE_CALIBRATE_AD is talking about
+	// (same order as rms_index in calibrate_rc.cpp)
+	static int GainIndex(uint16_t commands)
+	{
+		switch (commands & _CALIBRATION_REQUEST_HI_GAIN_MASK)
+		{
+		case _CALIBRATION_REQUEST_HI_GAIN_0_5:
+			return 0;
+		case _CALIBRATION_REQUEST_HI_GAIN_1_0:
+			return 1;
+		case _CALIBRATION_REQUEST_HI_GAIN_1_5:
+			return 2;
+		case _CALIBRATION_REQUEST_HI_GAIN_2_0:
+			return 3;
+		default:
+			return -1;
+		}
+	}
+
+	static void DefaultCalibration(CalibrationDataFLASH *cal)
+	{
+		*cal = {0};
+
+		for (CalibrationDataRC &gain : cal->GainHI)
+		{
+			for (CalibrationDataAtFrequencyRC *freq : {&gain.Hz60, &gain.Hz50})
+			{
+				for (int i = 0; i < _NUM_TO_CALIBRATE_RC; i++)
+				{
+					freq->Offset[i] = DEFAULT_OFFSET;
+					freq->SwGain[i] = DEFAULT_SW_GAIN;
+				}
+			}
+		}
+	}
+
+	TripUnitSimulator::TripUnitSimulator(const SimConfig &config, SERIAL_RX::ReadSomeFuncPtr readSome, URCWriteFuncPtr writeFunc)
+		: config(config),
+		  rx([this, readSome](uint8_t *buf, int maxLen, int timeoutMS) -> int
+			 {
+				 int bytesRead = readSome(buf, maxLen, timeoutMS);
+
+				 // the Receiver can't tell us the port is gone (it just looks like a timeout)
+				 if (bytesRead < 0)
+					 portDead = true;
+
+				 return bytesRead;
+			 }),
+		  writeFunc(writeFunc),
+		  rng(config.seed)
+	{
+		// out of the box: a 1000A 60hz ACPro2-RC that has never been calibrated
+		sysSettings.CTRating = 1000;
+		sysSettings.CTSecondary = 100;
+		sysSettings.CTNeutralRating = 1000;
+		sysSettings.CTNeutralSecondary = 100;
+		sysSettings.RatioPT = 480;
+		sysSettings.Frequency = 60;
+
+		devSettings.LTPickup = 9000;
+		devSettings.LTDelay = 40;
+		devSettings.LTEnabled = true;
+		devSettings.STPickup = 15000;
+		devSettings.STDelay = 40;
+		devSettings.STEnabled = true;
+		devSettings.GFPickup = 300;
+		devSettings.GFDelay = 20;
+		devSettings.InstantPickup = 10000;
+		devSettings.InstantEnabled = true;
+		devSettings.SystemRotation = 1;
+
+		personality.structID = 4;
+		personality.maxRMS = 120;
+
+		strcpy_s(serialNumber, "SIM00000001");
+
+		hwVersion.boardID = 0;
+		hwVersion.boardRev = 1;
+		hwVersion.batchID = 1;
+		hwVersion.msgAddr = config.address;
+
+		swVersion.Major = 4;
+		swVersion.Minor = 2;
+
+		DefaultCalibration(&calFlash);
+		calEdit = calFlash;
+
+		// every channel of every simulated trip unit is off by a little bit; that's what
+		// calibration is supposed to take out
+		std::uniform_real_distribution<float> error(-0.03f, 0.03f);
+		for (float &e : hardwareGainError)
+			e = error(rng);
+	}
+
+	void TripUnitSimulator::Run()
+	{
+		URCMessageUnion req;
+		URCMessageUnion rsp;
+
+		while (!stopping && !portDead)
+		{
+			// still rebooting; whatever shows up in the meantime falls on the floor
+			if (SERIAL_RX::NowMS() < rebootUntilMS)
+			{
+				uint8_t junk[256];
+				int bytesRead = rx.ReadSome(junk, sizeof(junk), (std::min)(rebootUntilMS, SERIAL_RX::DeadlineFromNow(IDLE_SLICE_MS)));
+
+				if (bytesRead > 0)
+				{
+					std::lock_guard<std::mutex> lock(stateMutex);
+					stats.ignoredRebooting += bytesRead;
+				}
+
+				if (SERIAL_RX::NowMS() >= rebootUntilMS)
+				{
+					decoder.Reset();
+					PrintToScreen("sim: trip unit is back up");
+				}
+
+				continue;
+			}
+
+			if (!ReceiveRequest(&req, SERIAL_RX::DeadlineFromNow(IDLE_SLICE_MS)))
+				continue;
+
+			// somebody else's traffic (local display, etc.), or an ACK from the app
+			if (req.msgHdr.Dst != ADDR_TRIP_UNIT && req.msgHdr.Dst != config.address)
+				continue;
+
+			if (req.msgHdr.Type == MSG_ACK || req.msgHdr.Type == MSG_NAK)
+				continue;
+
+			bool answer = true;
+			bool reboot = false;
+
+			memset(&rsp, 0, sizeof(rsp));
+
+			{
+				std::lock_guard<std::mutex> lock(stateMutex);
+
+				stats.requests++;
+
+				if (Chance(config.dropPercent))
+				{
+					stats.dropped++;
+					answer = false;
+				}
+				else if (Chance(config.nakPercent))
+				{
+					stats.naked++;
+					BuildNAK(req.msgHdr, NAK_ERROR_NOT_READY, &rsp);
+				}
+				else
+				{
+					HandleRequest(req, &rsp);
+					reboot = rebootPending;
+					rebootPending = false;
+				}
+			}
+
+			if (!answer)
+			{
+				if (logData)
+					scr_printf("sim: not answering msg type %d (seq %u)", req.msgHdr.Type, req.msgHdr.Seq);
+
+				continue;
+			}
+
+			// the real one takes its time actually calibrating
+			if (rsp.msgHdr.Type == MSG_RSP_CALIBRATE_AD &&
+				(req.msgExeCalibrateAD.CalibrateRequest.Commands & _CALIBRATION_REQUEST_ALL) != 0)
+			{
+				Delay(config.calibrateMS);
+			}
+
+			int latencyMS = config.latencyMS;
+			if (config.latencyJitterMS > 0)
+			{
+				std::lock_guard<std::mutex> lock(stateMutex);
+				latencyMS += std::uniform_int_distribution<int>(0, config.latencyJitterMS)(rng);
+			}
+
+			Delay(latencyMS);
+			SendResponse(&rsp, req.msgHdr);
+
+			if (reboot)
+				StartReboot();
+		}
+	}
+
+	void TripUnitSimulator::Stop()
+	{
+		stopping = true;
+	}
+
+	void TripUnitSimulator::RecordTrip(uint8_t tripType, uint32_t peakAmps)
+	{
+		std::lock_guard<std::mutex> lock(stateMutex);
+		AddTrip(tripType, peakAmps);
+	}
+
+	void TripUnitSimulator::SetCurrents(uint32_t ia, uint32_t ib, uint32_t ic, uint32_t in)
+	{
+		std::lock_guard<std::mutex> lock(stateMutex);
+
+		currents[0] = ia;
+		currents[1] = ib;
+		currents[2] = ic;
+		currents[3] = in;
+	}
+
+	SimStats TripUnitSimulator::Stats()
+	{
+		std::lock_guard<std::mutex> lock(stateMutex);
+		return stats;
+	}
+
+	bool TripUnitSimulator::ReceiveRequest(URCMessageUnion *req, uint64_t deadlineMS)
+	{
+		URC_DECODER::FrameView frame;
+
+		while (!decoder.Next(&frame))
+		{
+			int room;
+			uint8_t *dst = decoder.WritePtr(&room);
+			int bytesRead = rx.ReadSome(dst, room, deadlineMS);
+
+			if (bytesRead == 0)
+				return false;
+
+			decoder.Commit(bytesRead);
+		}
+
+		memcpy(req->buf, frame.data, frame.length);
+
+		if (logData)
+			DumpRawMsgData(req->buf, frame.length, false);
+
+		return true;
+	}
+
+	void TripUnitSimulator::SendResponse(URCMessageUnion *rsp, const MsgHdr &req)
+	{
+		int len = sizeof(MsgHdr) + rsp->msgHdr.Length;
+
+		// echo their sequence number, so pipelined requests can be matched up (see urc_pipeline.hpp)
+		rsp->msgHdr.Version = PROTOCOL_VERSION;
+		rsp->msgHdr.Seq = req.Seq;
+		rsp->msgHdr.Dst = req.Src;
+		rsp->msgHdr.Src = config.address;
+		rsp->msgHdr.ChkSum = 0;
+		rsp->msgHdr.ChkSum = CalcChecksum(rsp->buf, len);
+
+		{
+			std::lock_guard<std::mutex> lock(stateMutex);
+
+			if (Chance(config.corruptPercent))
+			{
+				stats.corrupted++;
+				rsp->msgHdr.ChkSum ^= 0xA5A5;
+			}
+
+			stats.responses++;
+		}
+
+		if (logData)
+			DumpRawMsgData(rsp->buf, len, true);
+
+		writeFunc(rsp->buf, len);
+	}
+
+	// called with stateMutex held
+	void TripUnitSimulator::HandleRequest(const URCMessageUnion &req, URCMessageUnion *rsp)
+	{
+		switch (req.msgHdr.Type)
+		{
+		case MSG_CONNECT:
+		case MSG_DECOMMISSION:
+			BuildACK(req.msgHdr, rsp);
+			break;
+
+		case MSG_SET_QT_SWITCH_4:
+			quickTripOn = (req.msgSetSwitchQT4.State == _QT_SWITCH_STATE_ON);
+			BuildACK(req.msgHdr, rsp);
+			break;
+
+		case MSG_GET_SW_VER:
+			SetupResponse(rsp, MSG_RSP_SW_VER, sizeof(MsgRspSoftVer));
+			rsp->msgRspSoftVer.ver = swVersion;
+			break;
+
+		case MSG_GET_HW_REV:
+			SetupResponse(rsp, MSG_RSP_HW_REV, sizeof(MsgRspHwRev));
+			rsp->msgRspHwRev.HW = hwVersion;
+			break;
+
+		case MSG_GET_SER_NUM:
+			SetupResponse(rsp, MSG_RSP_SER_NUM, sizeof(MsgRspSerNum));
+			memcpy(rsp->msgRspSerNum.Number, serialNumber, sizeof(serialNumber));
+			break;
+
+		case MSG_SET_SER_NUM_4:
+			if (!LengthIs(req, sizeof(MsgSetSerNum4)))
+			{
+				BuildNAK(req.msgHdr, NAK_ERROR_INVALID_LENGTH, rsp);
+				break;
+			}
+
+			memcpy(serialNumber, req.msgSetSerNum4.Number, sizeof(serialNumber));
+			hwVersion = req.msgSetSerNum4.HWversion;
+			BuildACK(req.msgHdr, rsp);
+			break;
+
+		case MSG_GET_STATUS:
+			SetupResponse(rsp, MSG_RSP_STATUS_2, sizeof(MsgRspStatus2));
+			rsp->msgRspStatus2.Status = IsCalibrated() ? STS_CALIBRATED : 0;
+			rsp->msgRspStatus2.Mask = STS_CALIBRATED;
+			break;
+
+		case MSG_GET_SYS_SETTINGS:
+			SetupResponse(rsp, MSG_RSP_SYS_SETTINGS_4, sizeof(MsgRspSysSet4));
+			rsp->msgRspSysSet4.Settings = sysSettings;
+			break;
+
+		case MSG_GET_DEV_SETTINGS:
+			SetupResponse(rsp, MSG_RSP_DEV_SETTINGS_4, sizeof(MsgRspDevSet4));
+			rsp->msgRspDevSet4.Settings = devSettings;
+			break;
+
+		case MSG_SET_USR_SETTINGS_4:
+			SetUserSettings(req, rsp);
+			break;
+
+		case MSG_GET_PERSONALITY_4:
+			SetupResponse(rsp, MSG_RSP_PERSONALITY_4, sizeof(MsgRspPersonality4));
+			rsp->msgRspPersonality4.Pers = personality;
+			break;
+
+		case MSG_SET_PERSONALITY_4:
+			if (!LengthIs(req, sizeof(MsgSetPersonality4)))
+			{
+				BuildNAK(req.msgHdr, NAK_ERROR_INVALID_LENGTH, rsp);
+				break;
+			}
+
+			personality = req.msgSetPersonality4.Pers;
+			BuildACK(req.msgHdr, rsp);
+			break;
+
+		case MSG_GET_DYNAMICS:
+			SetupResponse(rsp, MSG_RSP_DYNAMICS_4, sizeof(MsgRspDynamics4));
+			FillDynamics(&rsp->msgRspDynamics4.Dynamics);
+			break;
+
+		case MSG_GET_CALIBRATION:
+			SetupResponse(rsp, MSG_RSP_CALIBRATION_RC, sizeof(MsgRspCalibrRC));
+			rsp->msgRspCalibrRC.CalibrationDataInfoD = calFlash;
+			break;
+
+		case MSG_EXE_CALIBRATE_AD:
+			Calibrate(req, rsp);
+			break;
+
+		case MSG_GET_TRIP_HIST:
+			SetupResponse(rsp, MSG_RSP_TRIP_HIST_4, sizeof(MsgRspTripHist4));
+			rsp->msgRspTripHist4.Trips = tripHistory;
+			break;
+
+		case MSG_CLR_TRIP_HIST:
+			tripHistory = {0};
+			BuildACK(req.msgHdr, rsp);
+			break;
+
+		case MSG_SET_TESTSET_AMPS_4:
+			SetTestSetAmps(req, rsp);
+			break;
+
+		case MSG_EXE_TESTSET_SETUP_4:
+			StartTestSet(req, rsp);
+			break;
+
+		case MSG_GET_RESPONSE_4:
+			GetTestSetResults(req, rsp);
+			break;
+
+		default:
+			BuildNAK(req.msgHdr, NAK_ERROR_UNREC, rsp);
+			break;
+		}
+	}
+
+	void TripUnitSimulator::BuildACK(const MsgHdr &req, URCMessageUnion *rsp)
+	{
+		SetupResponse(rsp, MSG_ACK, sizeof(MsgACK));
+		rsp->msgACK.AckSeq = req.Seq;
+	}
+
+	void TripUnitSimulator::BuildNAK(const MsgHdr &req, uint16_t error, URCMessageUnion *rsp)
+	{
+		SetupResponse(rsp, MSG_NAK, sizeof(MsgNAK));
+		rsp->msgNAK.NAKSeq = req.Seq;
+		rsp->msgNAK.Error = error;
+	}
+
+	// called with stateMutex held
+	void TripUnitSimulator::SetUserSettings(const URCMessageUnion &req, URCMessageUnion *rsp)
+	{
+		if (!LengthIs(req, sizeof(MsgSetUserSet4)))
+		{
+			BuildNAK(req.msgHdr, NAK_ERROR_INVALID_LENGTH, rsp);
+			return;
+		}
+
+		SystemSettings4 sys = req.msgSetUserSet4.SysSettings;
+		DeviceSettings4 dev = req.msgSetUserSet4.DevSettings;
+
+		// 50hz only works if the personality allows it (see Enable50hzPersonality())
+		if ((sys.Frequency != 50 && sys.Frequency != 60) ||
+			(sys.Frequency == 50 && (personality.options32 & FREQUENCY_50HZ_ALLOWED) == 0))
+		{
+			BuildNAK(req.msgHdr, NAK_SS_FREQUENCY, rsp);
+			return;
+		}
+
+		// who changed them, and when, doesn't count as a change
+		sys.ChangeSource = sysSettings.ChangeSource;
+		sys.LastChanged = sysSettings.LastChanged;
+		dev.ChangeSource = devSettings.ChangeSource;
+		dev.LastChanged = devSettings.LastChanged;
+
+		if (memcmp(&sys, &sysSettings, sizeof(sys)) == 0 && memcmp(&dev, &devSettings, sizeof(dev)) == 0)
+		{
+			BuildNAK(req.msgHdr, NAK_NO_CHANGES, rsp);
+			return;
+		}
+
+		sysSettings = sys;
+		devSettings = dev;
+
+		sysSettings.ChangeSource = devSettings.ChangeSource = req.msgHdr.Src;
+		sysSettings.LastChanged = devSettings.LastChanged = Now();
+
+		BuildACK(req.msgHdr, rsp);
+
+		// new settings take effect on the way back up
+		rebootPending = true;
+	}
+
+	// called with stateMutex held
+	void TripUnitSimulator::Calibrate(const URCMessageUnion &req, URCMessageUnion *rsp)
+	{
+		if (!LengthIs(req, sizeof(MsgExeCalibrateAD)))
+		{
+			BuildNAK(req.msgHdr, NAK_ERROR_INVALID_LENGTH, rsp);
+			return;
+		}
+
+		const CalibrationRequest &request = req.msgExeCalibrateAD.CalibrateRequest;
+		int gain = GainIndex(request.Commands);
+
+		if (gain < 0)
+		{
+			BuildNAK(req.msgHdr, NAK_ERROR_INVALID_PARAMETER, rsp);
+			return;
+		}
+
+		// VirginizeTripUnit() sends all of these at once, so the order matters:
+		// start from what's in FLASH, forget it was ever calibrated, then go back to defaults
+		if (request.Commands & _CALIBRATION_INITIALIZE)
+			calEdit = calFlash;
+
+		if (request.Commands & _CALIBRATION_UNCALIBRATE)
+		{
+			for (CalibrationDataFLASH *cal : {&calFlash, &calEdit})
+			{
+				cal->Calibrated = 0;
+
+				for (CalibrationDataRC &g : cal->GainHI)
+					g.Hz60.CalibratedChannels = g.Hz50.CalibratedChannels = 0;
+			}
+		}
+
+		if (request.Commands & _CALIBRATION_SET_TO_DEFAULT)
+			DefaultCalibration(&calEdit);
+
+		CalibrationDataAtFrequencyRC &edit = (sysSettings.Frequency == 50) ? calEdit.GainHI[gain].Hz50 : calEdit.GainHI[gain].Hz60;
+		CalibrationResults &results = rsp->msgRspCalibrateAD.CalibrateResults;
+
+		SetupResponse(rsp, MSG_RSP_CALIBRATE_AD, sizeof(MsgRspCalibrateAD));
+
+		for (int i = 0; i < _NUM_TO_CALIBRATE_RC; i++)
+		{
+			// a channel with nothing to calibrate to doesn't get calibrated
+			if ((request.Commands & (1 << i)) == 0 || request.RealRMS[i] == 0)
+				continue;
+
+			edit.SwGain[i] = (uint16_t)(DEFAULT_SW_GAIN / (1.0f + hardwareGainError[i]));
+			edit.CalibratedChannels |= (1 << i);
+
+			results.RmsVal[i] = request.RealRMS[i];
+		}
+
+		if (request.Commands & _CALIBRATION_WRITE_TO_FLASH)
+		{
+			calFlash = calEdit;
+			calFlash.Calibrated = calEdit.Calibrated = AllChannelsCalibrated(calFlash) ? CALIBRATED_KEYWORD : 0;
+		}
+
+		results.CalibratedChannels = edit.CalibratedChannels;
+
+		for (int i = 0; i < _NUM_TO_CALIBRATE_RC; i++)
+		{
+			results.Offset[i] = edit.Offset[i];
+			results.SwGain[i] = edit.SwGain[i];
+		}
+	}
+
+	// called with stateMutex held
+	void TripUnitSimulator::FillDynamics(Dynamics4 *dynamics)
+	{
+		Measurements4 &m = dynamics->Measurements;
+
+		m.Ia = currents[0];
+		m.Ib = currents[1];
+		m.Ic = currents[2];
+		m.In = currents[3];
+		m.NSOV = 65535;
+		m.FrequencyX100 = sysSettings.Frequency * 100;
+
+		dynamics->Status = IsCalibrated() ? STS_CALIBRATED : 0;
+		dynamics->StatusMask = STS_CALIBRATED;
+		dynamics->TemperatureDegreesCx10 = 250;
+
+		for (uint16_t count : tripHistory.Counter.trip)
+			dynamics->TripCount += count;
+	}
+
+	// called with stateMutex held
+	void TripUnitSimulator::AddTrip(uint8_t tripType, uint32_t peakAmps)
+	{
+		if (tripType >= _TRIP_TYPE_MAX)
+			return;
+
+		tripHistory.Counter.trip[tripType]++;
+
+		// newest trip goes first; the oldest one falls off the end
+		memmove(&tripHistory.Data[1], &tripHistory.Data[0], sizeof(TripData4) * (_TRIP_HISTORY_MAX_TRIPS - 1));
+
+		TripData4 &trip = tripHistory.Data[0];
+
+		trip = {0};
+		trip.TimeStamp = Now();
+		trip.Spare0xFFFF = 0xFFFF;
+		trip.TripType = tripType;
+		trip.PeakRMS = peakAmps;
+		trip.Frequency = sysSettings.Frequency;
+		trip.CTRating = sysSettings.CTRating;
+		trip.CTSecondary = sysSettings.CTSecondary;
+		trip.CTNeutralSec = sysSettings.CTNeutralSecondary;
+		trip.ThresholdSB = devSettings.SBThreshold;
+
+		for (int i = 0; i < _NUM_PHASES_ABCN; i++)
+			trip.I[i] = currents[i];
+
+		tripHistory.NumBufs = (std::min)(tripHistory.NumBufs + 1, _TRIP_HISTORY_MAX_TRIPS);
+	}
+
+	// called with stateMutex held
+	void TripUnitSimulator::SetTestSetAmps(const URCMessageUnion &req, URCMessageUnion *rsp)
+	{
+		const MsgSetTestSetAmps4 &msg = req.msgSetTestSetAmps4;
+
+		if (!LengthIs(req, sizeof(MsgSetTestSetAmps4)))
+		{
+			BuildNAK(req.msgHdr, NAK_ERROR_INVALID_LENGTH, rsp);
+			return;
+		}
+
+		if (msg.Type > 1 || msg.Phase >= _NUM_PHASES_ABCN)
+		{
+			BuildNAK(req.msgHdr, NAK_ERROR_INVALID_PARAMETER, rsp);
+			return;
+		}
+
+		// we only ever play the foreground; background is taken and forgotten
+		if (msg.Type == 1)
+			memcpy(testSetAmps[msg.Phase], msg.A2D, sizeof(msg.A2D));
+
+		BuildACK(req.msgHdr, rsp);
+	}
+
+	// called with stateMutex held
+	//
+	// works the whole simulation out up front; the results just aren't handed out until the
+	// time it would have taken has gone by
+	void TripUnitSimulator::StartTestSet(const URCMessageUnion &req, URCMessageUnion *rsp)
+	{
+		if (!LengthIs(req, sizeof(MsgExeTestSet4)))
+		{
+			BuildNAK(req.msgHdr, NAK_ERROR_INVALID_LENGTH, rsp);
+			return;
+		}
+
+		const SoftTestSetSimulation4 &setup = req.msgExeTestSet4.Setup;
+		double countsPerAmp = SOFT_TEST_SET::CountsPerAmp(sysSettings.CTRating);
+
+		if (countsPerAmp == 0 || sysSettings.Frequency == 0)
+		{
+			BuildNAK(req.msgHdr, NAK_ERROR_NOT_READY, rsp);
+			return;
+		}
+
+		// RMS of each phase we were told to play, and of all of them added together (GF)
+		float amps[_NUM_PHASES_ABCN] = {0};
+		int32_t residual[_SAMPLES_PER_CYCLE] = {0};
+
+		for (int phase = 0; phase < _NUM_PHASES_ABCN; phase++)
+		{
+			const TimingA2D4 &timing = setup.foregroundAmpsTiming[phase];
+
+			if ((setup.inputsA2D & (1 << phase)) == 0 || timing.cycleOFF <= timing.cycleON)
+				continue;
+
+			amps[phase] = (float)(SOFT_TEST_SET::CycleRMS(testSetAmps[phase]) / countsPerAmp);
+
+			for (int i = 0; i < _SAMPLES_PER_CYCLE; i++)
+				residual[i] += testSetAmps[phase][i];
+		}
+
+		float groundAmps = (float)(SOFT_TEST_SET::CycleRMS(residual) / countsPerAmp);
+
+		uint8_t tripType;
+		uint32_t tripMS;
+
+		TestSetTrip(amps, groundAmps, &tripType, &tripMS);
+
+		uint32_t timeoutMS = setup.cycleNumberTimeOut * 1000u / sysSettings.Frequency;
+		SoftTestSetResults4 &results = testSetResults;
+
+		results = {0};
+		results.timeDateStamp = Now();
+
+		for (int phase = 0; phase < _NUM_PHASES_ABC; phase++)
+		{
+			uint32_t rounded = (uint32_t)std::lround(amps[phase]);
+
+			results.phase[phase].CalcI = results.phase[phase].ValueI = rounded;
+			results.phase[phase].PeakI = results.phase[phase].TripI = rounded;
+		}
+
+		results.calcIn = results.valueIn = results.peakIn = results.tripIn = (uint32_t)std::lround(amps[3]);
+		results.calcIgf = (uint32_t)std::lround(groundAmps);
+		results.temperatureDegreesCx10 = 250;
+
+		if (tripType != _TRIP_TYPE_UNKNOWN && tripMS <= timeoutMS)
+		{
+			results.tripped = true;
+			results.tripType = tripType;
+			results.pickupUntilTripTIMEms = (uint16_t)(std::min)(tripMS, 0xFFFFu);
+
+			AddTrip(tripType, (uint32_t)std::lround(*std::max_element(amps, amps + _NUM_PHASES_ABC)));
+		}
+		else
+		{
+			results.timedOut = true;
+			tripMS = timeoutMS;
+		}
+
+		testSetRan = true;
+		testSetDoneMS = SERIAL_RX::NowMS() + (uint64_t)(tripMS * config.testSetTimeScale);
+		stats.testSets++;
+
+		BuildACK(req.msgHdr, rsp);
+	}
+
+	// called with stateMutex held
+	void TripUnitSimulator::GetTestSetResults(const URCMessageUnion &req, URCMessageUnion *rsp)
+	{
+		if (!LengthIs(req, sizeof(MsgGetRsp4)))
+		{
+			BuildNAK(req.msgHdr, NAK_ERROR_INVALID_LENGTH, rsp);
+			return;
+		}
+
+		if (req.msgGetRsp4.Response != MSG_RSP_TESTSET_RESULTS_4)
+		{
+			BuildNAK(req.msgHdr, NAK_ERROR_NOT_SUPPORTED, rsp);
+			return;
+		}
+
+		if (!testSetRan)
+		{
+			BuildNAK(req.msgHdr, NAK_ERROR_NO_DATA, rsp);
+			return;
+		}
+
+		if (SERIAL_RX::NowMS() < testSetDoneMS)
+		{
+			BuildNAK(req.msgHdr, NAK_ERROR_NOT_READY, rsp);
+			return;
+		}
+
+		SetupResponse(rsp, MSG_RSP_TESTSET_RESULTS_4, sizeof(MsgRspTestSetResults4));
+		rsp->msgRspTestSetResults4.Results = testSetResults;
+	}
+
+	// called with stateMutex held
+	//
+	// whichever enabled protection would get there first; *tripType is _TRIP_TYPE_UNKNOWN
+	// if none of them picks up
+	void TripUnitSimulator::TestSetTrip(const float amps[_NUM_PHASES_ABCN], float groundAmps, uint8_t *tripType, uint32_t *tripMS)
+	{
+		const DeviceSettings4 &dev = devSettings;
+
+		int phaseAmps = (int)std::lround(*std::max_element(amps, amps + _NUM_PHASES_ABC));
+		int GFAmps = (int)std::lround(groundAmps);
+
+		*tripType = _TRIP_TYPE_UNKNOWN;
+		*tripMS = UINT32_MAX;
+
+		auto consider = [this, tripType, tripMS](bool enabled, TRIP_CURVE::Element element, uint8_t type, int amps)
+		{
+			TRIP_CURVE::Curve curve;
+
+			if (!enabled || !TRIP_CURVE::Compile(devSettings, sysSettings, element, &curve))
+				return;
+
+			// (NO_TRIP if it didn't pick up, which never wins)
+			uint32_t ms = TRIP_CURVE::TimeMS(curve, amps);
+
+			if (ms < *tripMS)
+			{
+				*tripType = type;
+				*tripMS = ms;
+			}
+		};
+
+		consider(dev.LTEnabled && dev.LTPickup > 0, TRIP_CURVE::Element::LT, _TRIP_TYPE_LT, phaseAmps);
+		consider(dev.STEnabled && dev.STPickup > 0, TRIP_CURVE::Element::ST, _TRIP_TYPE_ST, phaseAmps);
+		consider(quickTripOn && dev.QTInstPickup > 0, TRIP_CURVE::Element::QT_INST, _TRIP_TYPE_QT_I_DIGITAL, phaseAmps);
+		consider(dev.InstantEnabled && dev.InstantPickup > 0, TRIP_CURVE::Element::INST, _TRIP_TYPE_INST_DIGITAL, phaseAmps);
+		consider(dev.GFPickup > 0, TRIP_CURVE::Element::GF, _TRIP_TYPE_GF, GFAmps);
+	}
+
+	bool TripUnitSimulator::IsCalibrated()
+	{
+		return calFlash.Calibrated == CALIBRATED_KEYWORD;
+	}
+
+	// every channel at every gain, at 60hz, and at 50hz too if we are allowed to run at 50hz
+	bool TripUnitSimulator::AllChannelsCalibrated(const CalibrationDataFLASH &cal)
+	{
+		for (const CalibrationDataRC &gain : cal.GainHI)
+		{
+			if (gain.Hz60.CalibratedChannels != _CALIBRATION_REQUEST_ALL)
+				return false;
+
+			if ((personality.options32 & FREQUENCY_50HZ_ALLOWED) && gain.Hz50.CalibratedChannels != _CALIBRATION_REQUEST_ALL)
+				return false;
+		}
+
+		return true;
+	}
+
+	void TripUnitSimulator::StartReboot()
+	{
+		PrintToScreen("sim: settings changed; rebooting for " + std::to_string(config.rebootMS) + " ms");
+
+		{
+			std::lock_guard<std::mutex> lock(stateMutex);
+			stats.reboots++;
+		}
+
+		rebootUntilMS = SERIAL_RX::DeadlineFromNow(config.rebootMS);
+	}
+
+	// called with stateMutex held
+	bool TripUnitSimulator::Chance(int percent)
+	{
+		return percent > 0 && std::uniform_int_distribution<int>(0, 99)(rng) < percent;
+	}
+
+	void TripUnitSimulator::Delay(int ms)
+	{
+		if (ms > 0)
+			std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+	}
+}
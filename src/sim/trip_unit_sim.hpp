@@ -0,0 +1,155 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <random>
+
+#include "util/urc_protocol.hpp"
+#include "util/urc_decoder.hpp"
+#include "util/urc_pipeline.hpp"
+#include "util/serial_rx.hpp"
+
+// software stand-in for an ACPro2-RC trip unit
+//
+// answers the trip unit side of the URC messages that AutoCAL_RC actually sends:
+// connect, system / device settings, personality, dynamics, status, calibration
+// (MSG_EXE_CALIBRATE_AD), trip history, serial number, hw / sw version, and the
+// software test set (see tests/soft_test_set.hpp)
+//
+// it doesn't care what it is talking over; hand it a function that reads bytes and one
+// that writes them (trip_unit_sim_main.cpp puts it on the master side of a pty, so the
+// app can open the slave side like any other serial port)
+//
+// things it does on purpose, so we can see how the app copes:
+//	-	every response is held back by latencyMS (+ up to latencyJitterMS)
+//	-	a calibration request for a channel takes calibrateMS
+//	-	after settings actually change, it goes deaf for rebootMS (like the real one reboots)
+//	-	drop / corrupt / NAK a percentage of the traffic
+//
+// the soft test set trips per the formulas in tests/trip_time_rc.hpp, on whatever current
+// the waveforms work out to; testSetTimeScale lets a 30 second LT trip take 300ms
+
+namespace TRIP_UNIT_SIM
+{
+	typedef struct _SimConfig
+	{
+		uint8_t address = ADDR_AC_PRO_RC; // Src of everything we send; the app uses this to tell what kind of trip unit we are
+		int latencyMS = 5;				  // before every response
+		int latencyJitterMS = 0;		  // plus a random amount up to this
+		int calibrateMS = 1000;			  // extra time for a MSG_EXE_CALIBRATE_AD that calibrates channels
+		int rebootMS = 2000;			  // how long we are gone after a settings change
+		int dropPercent = 0;			  // requests we just never answer
+		int corruptPercent = 0;			  // responses that go out with a bad checksum
+		int nakPercent = 0;				  // requests that get NAK_ERROR_NOT_READY instead of an answer
+		double testSetTimeScale = 1.0;	  // real ms per soft test set ms
+		uint32_t seed = 1;				  // for the above; same seed, same faults
+	} SimConfig;
+
+	typedef struct _SimStats
+	{
+		uint32_t requests;		   // good messages addressed to us
+		uint32_t responses;		   // messages we sent back
+		uint32_t dropped;		   // fault injection: not answered
+		uint32_t corrupted;		   // fault injection: sent with a bad checksum
+		uint32_t naked;			   // fault injection: NAK'd
+		uint32_t reboots;		   // times we rebooted
+		uint32_t ignoredRebooting; // bytes that showed up while we were rebooting
+		uint32_t testSets;		   // MSG_EXE_TESTSET_SETUP_4s run
+	} SimStats;
+
+	class TripUnitSimulator
+	{
+	public:
+		TripUnitSimulator(const SimConfig &config, SERIAL_RX::ReadSomeFuncPtr readSome, URCWriteFuncPtr writeFunc);
+
+		// answer requests until Stop() is called, or the port goes away
+		void Run();
+		void Stop();
+
+		// things a test harness can do to us from another thread while Run() is going
+		void RecordTrip(uint8_t tripType, uint32_t peakAmps);
+		void SetCurrents(uint32_t ia, uint32_t ib, uint32_t ic, uint32_t in);
+
+		SimStats Stats();
+
+	private:
+		bool ReceiveRequest(URCMessageUnion *req, uint64_t deadlineMS);
+		void SendResponse(URCMessageUnion *rsp, const MsgHdr &req);
+
+		// fills in rsp with whatever the real trip unit would have said
+		void HandleRequest(const URCMessageUnion &req, URCMessageUnion *rsp);
+
+		void BuildACK(const MsgHdr &req, URCMessageUnion *rsp);
+		void BuildNAK(const MsgHdr &req, uint16_t error, URCMessageUnion *rsp);
+		void SetUserSettings(const URCMessageUnion &req, URCMessageUnion *rsp);
+		void Calibrate(const URCMessageUnion &req, URCMessageUnion *rsp);
+		void FillDynamics(Dynamics4 *dynamics);
+		void AddTrip(uint8_t tripType, uint32_t peakAmps);
+
+		// the soft test set
+		void SetTestSetAmps(const URCMessageUnion &req, URCMessageUnion *rsp);
+		void StartTestSet(const URCMessageUnion &req, URCMessageUnion *rsp);
+		void GetTestSetResults(const URCMessageUnion &req, URCMessageUnion *rsp);
+		void TestSetTrip(const float amps[_NUM_PHASES_ABCN], float groundAmps, uint8_t *tripType, uint32_t *tripMS);
+
+		bool IsCalibrated();
+		bool AllChannelsCalibrated(const CalibrationDataFLASH &cal);
+		void StartReboot();
+		bool Chance(int percent);
+		void Delay(int ms);
+
+		SimConfig config;
+
+		SERIAL_RX::Receiver rx;
+		URC_DECODER::FrameDecoder decoder;
+		URCWriteFuncPtr writeFunc;
+
+		std::atomic<bool> stopping{false};
+		std::atomic<bool> portDead{false};
+
+		bool rebootPending = false; // set by HandleRequest(); we go once the ACK is out
+		uint64_t rebootUntilMS = 0;
+
+		std::mt19937 rng;
+
+		// everything below is the trip unit itself
+		std::mutex stateMutex;
+
+		SystemSettings4 sysSettings = {0};
+		DeviceSettings4 devSettings = {0};
+		Personality4 personality = {0};
+		TripHist4 tripHistory = {0};
+		char serialNumber[_SER_NUM_LENGTH] = {0};
+		HardVer hwVersion = {0};
+		SoftVer swVersion = {0};
+		uint32_t currents[_NUM_PHASES_ABCN] = {0};
+		bool quickTripOn = false;
+
+		// soft test set: foreground waveforms, and the simulation in progress (or last done)
+		int32_t testSetAmps[_NUM_PHASES_ABCN][_SAMPLES_PER_CYCLE] = {0};
+		bool testSetRan = false;
+		uint64_t testSetDoneMS = 0; // results aren't ready until then
+		SoftTestSetResults4 testSetResults = {0};
+
+		// calibration: what's in FLASH, and the RAM copy MSG_EXE_CALIBRATE_AD works on
+		CalibrationDataFLASH calFlash = {0};
+		CalibrationDataFLASH calEdit = {0};
+		float hardwareGainError[_NUM_TO_CALIBRATE_RC] = {0};
+
+		SimStats stats = {0};
+	};
+}
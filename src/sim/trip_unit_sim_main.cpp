@@ -0,0 +1,215 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+// trip_unit_sim: puts a TRIP_UNIT_SIM::TripUnitSimulator on a pty
+//
+// prints the path of the slave side; point the app at it with SetCommPortPath()
+// (or use --link to get a fixed name for it), then talk to it like a trip unit
+//
+//	trip_unit_sim --link /tmp/ttyTRIP --latency 20 --reboot 2000 --drop 5
+
+#ifndef _WIN32
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <string>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "trip_unit_sim.hpp"
+#include "util/screen.hpp"
+
+static TRIP_UNIT_SIM::TripUnitSimulator *theSim = nullptr;
+
+static void OnSignal(int)
+{
+	if (theSim)
+		theSim->Stop();
+}
+
+static void Usage()
+{
+	puts("usage: trip_unit_sim [options]");
+	puts("  --link PATH       make PATH a symlink to the pty");
+	puts("  --address N       URC address we answer as (default 13, ADDR_AC_PRO_RC)");
+	puts("  --latency MS      delay before every response (default 5)");
+	puts("  --jitter MS       plus up to this much more, at random (default 0)");
+	puts("  --calibrate MS    time a MSG_EXE_CALIBRATE_AD channel request takes (default 1000)");
+	puts("  --reboot MS       how long we are gone after a settings change (default 2000)");
+	puts("  --drop PCT        percent of requests never answered");
+	puts("  --corrupt PCT     percent of responses sent with a bad checksum");
+	puts("  --nak PCT         percent of requests NAK'd with NAK_ERROR_NOT_READY");
+	puts("  --seed N          seed for the above");
+	puts("  --amps N          current reported on every phase by MSG_GET_DYNAMICS");
+	puts("  --log             dump every message in and out");
+}
+
+static bool ParseArgs(int argc, char *argv[], TRIP_UNIT_SIM::SimConfig *config, std::string *link, int *amps)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+
+		if (arg == "--log")
+		{
+			logData = true;
+			continue;
+		}
+
+		// everything else takes a value
+		if (i + 1 >= argc)
+			return false;
+
+		const char *value = argv[++i];
+
+		if (arg == "--link")
+			*link = value;
+		else if (arg == "--address")
+			config->address = (uint8_t)atoi(value);
+		else if (arg == "--latency")
+			config->latencyMS = atoi(value);
+		else if (arg == "--jitter")
+			config->latencyJitterMS = atoi(value);
+		else if (arg == "--calibrate")
+			config->calibrateMS = atoi(value);
+		else if (arg == "--reboot")
+			config->rebootMS = atoi(value);
+		else if (arg == "--drop")
+			config->dropPercent = atoi(value);
+		else if (arg == "--corrupt")
+			config->corruptPercent = atoi(value);
+		else if (arg == "--nak")
+			config->nakPercent = atoi(value);
+		else if (arg == "--seed")
+			config->seed = (uint32_t)strtoul(value, nullptr, 10);
+		else if (arg == "--amps")
+			*amps = atoi(value);
+		else
+			return false;
+	}
+
+	return true;
+}
+
+static bool WriteAll(int fd, const uint8_t *data, int len)
+{
+	int sent = 0;
+
+	while (sent < len)
+	{
+		ssize_t n = write(fd, data + sent, len - sent);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		if (n <= 0)
+			return false;
+
+		sent += (int)n;
+	}
+
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	TRIP_UNIT_SIM::SimConfig config;
+	std::string link;
+	int amps = 0;
+
+	if (!ParseArgs(argc, argv, &config, &link, &amps))
+	{
+		Usage();
+		return 1;
+	}
+
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+
+	if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+	{
+		scr_printf("cannot create pty: %s", strerror(errno));
+		return 1;
+	}
+
+	std::string slavePath = ptsname(master);
+
+	// we hang on to the slave side ourselves too; otherwise every time the app closes
+	// the port, we see a hangup on the master side
+	int slave = open(slavePath.c_str(), O_RDWR | O_NOCTTY);
+
+	if (slave < 0)
+	{
+		scr_printf("cannot open %s: %s", slavePath.c_str(), strerror(errno));
+		return 1;
+	}
+
+	// no echo, no line editing, no CR/LF games; URC messages are binary
+	struct termios tio;
+	if (tcgetattr(slave, &tio) == 0)
+	{
+		cfmakeraw(&tio);
+		tcsetattr(slave, TCSANOW, &tio);
+	}
+
+	if (!link.empty())
+	{
+		unlink(link.c_str());
+
+		if (symlink(slavePath.c_str(), link.c_str()) != 0)
+		{
+			scr_printf("cannot link %s to %s: %s", link.c_str(), slavePath.c_str(), strerror(errno));
+			return 1;
+		}
+	}
+
+	TRIP_UNIT_SIM::TripUnitSimulator sim(
+		config,
+		SERIAL_RX::PosixBackend(master),
+		[master](const uint8_t *data, int len) -> bool
+		{
+			return WriteAll(master, data, len);
+		});
+
+	sim.SetCurrents(amps, amps, amps, 0);
+
+	theSim = &sim;
+	signal(SIGINT, OnSignal);
+	signal(SIGTERM, OnSignal);
+
+	scr_printf("simulated trip unit (address %d) on %s%s%s", config.address, slavePath.c_str(),
+			   link.empty() ? "" : " -> ", link.c_str());
+
+	sim.Run();
+
+	theSim = nullptr;
+
+	TRIP_UNIT_SIM::SimStats stats = sim.Stats();
+
+	scr_printf("requests: %u  responses: %u  dropped: %u  corrupted: %u  NAK'd: %u  reboots: %u",
+			   stats.requests, stats.responses, stats.dropped, stats.corrupted, stats.naked, stats.reboots);
+
+	if (!link.empty())
+		unlink(link.c_str());
+
+	close(slave);
+	close(master);
+
+	return 0;
+}
+
+#endif
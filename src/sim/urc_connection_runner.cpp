@@ -0,0 +1,382 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+
+// urc_connection_runner: lots of threads talking URC at the same time, to make sure
+// nobody gets somebody else's answer (see urc_connection.hpp)
+//
+// every unit is its own TRIP_UNIT_SIM::TripUnitSimulator (on a socketpair, in this process),
+// and reports its own currents in MSG_GET_DYNAMICS, so we can tell whose answer we got:
+//
+//	-	on the "async" units, --threads threads each fire off --requests requests through the
+//		pipeline (SendURCMessageAsync()) on the same HANDLE; every answer has to come from that
+//		unit and carry the Seq of the request it is answering, and no two requests can go out
+//		with the same Seq
+//	-	on the "sync" units, one thread each does SendURCCommand() / GetURCResponse_Long() with
+//		its own timeouts, and its own default timeout; nobody else's timeouts can leak into it
+//
+//	urc_connection_runner --units 4 --sync 2 --threads 8 --requests 500 --latency 1
+
+#ifndef _WIN32
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "trip_unit_sim.hpp"
+#include "util/comm.hpp"
+#include "util/screen.hpp"
+#include "util/urc_connection.hpp"
+
+typedef struct _RunnerConfig
+{
+	int units = 4; // pipelined, several threads each
+	int syncUnits = 2; // plain send / receive, one thread each
+	int threads = 8; // per async unit
+	int requests = 500; // per thread
+	TRIP_UNIT_SIM::SimConfig sim;
+} RunnerConfig;
+
+// what one unit saw, added up over all of its threads
+typedef struct _UnitResult
+{
+	std::atomic<uint32_t> ok{0};
+	std::atomic<uint32_t> failed{0}; // timed out, or not a MSG_RSP_DYNAMICS_4
+	std::atomic<uint32_t> wrongUnit{0}; // the currents belong to some other unit
+	std::atomic<uint32_t> wrongSeq{0}; // answered a different request
+	std::atomic<uint32_t> wrongTimeout{0}; // default timeout isn't what this unit set
+	uint32_t duplicateSeqs = 0;
+
+	std::vector<uint16_t> seqs; // every Seq we sent
+	std::mutex seqMutex;
+} UnitResult;
+
+static void Usage()
+{
+	puts("usage: urc_connection_runner [options]");
+	puts("  --units N         simulated trip units talked to through the pipeline (default 4)");
+	puts("  --sync N          simulated trip units talked to with plain send / receive (default 2)");
+	puts("  --threads N       threads per pipelined unit (default 8)");
+	puts("  --requests N      requests per thread (default 500)");
+	puts("  --latency MS      delay before every trip unit response (default 1)");
+}
+
+static bool ParseArgs(int argc, char *argv[], RunnerConfig *config)
+{
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string arg = argv[i];
+		const char *value = argv[i + 1];
+
+		if (arg == "--units")
+			config->units = atoi(value);
+		else if (arg == "--sync")
+			config->syncUnits = atoi(value);
+		else if (arg == "--threads")
+			config->threads = atoi(value);
+		else if (arg == "--requests")
+			config->requests = atoi(value);
+		else if (arg == "--latency")
+			config->sim.latencyMS = atoi(value);
+		else
+			return false;
+	}
+
+	return (argc % 2) == 1 && config->units >= 0 && config->syncUnits >= 0 && (config->units + config->syncUnits) > 0 &&
+		   config->threads > 0 && config->requests > 0;
+}
+
+static bool WriteAll(int fd, const uint8_t *data, int len)
+{
+	int sent = 0;
+
+	while (sent < len)
+	{
+		ssize_t n = write(fd, data + sent, len - sent);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		if (n <= 0)
+			return false;
+
+		sent += (int)n;
+	}
+
+	return true;
+}
+
+// a simulated trip unit on one end of a socketpair, and a HANDLE for the other end
+typedef struct _SimulatedTripUnit
+{
+	std::unique_ptr<TRIP_UNIT_SIM::TripUnitSimulator> sim;
+	std::thread thread;
+	int simFD;
+	HANDLE handle;
+} SimulatedTripUnit;
+
+static bool StartSimulatedTripUnit(const TRIP_UNIT_SIM::SimConfig &config, SimulatedTripUnit *unit)
+{
+	int fds[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+		return false;
+
+	int appFD = fds[0];
+	unit->simFD = fds[1];
+
+	int simFD = unit->simFD;
+
+	unit->sim = std::make_unique<TRIP_UNIT_SIM::TripUnitSimulator>(
+		config,
+		SERIAL_RX::PosixBackend(simFD),
+		[simFD](const uint8_t *data, int len) -> bool
+		{
+			return WriteAll(simFD, data, len);
+		});
+
+	CommTransport transport;
+
+	transport.readSome = SERIAL_RX::PosixBackend(appFD);
+	transport.write = [appFD](const uint8_t *data, int len) -> bool
+	{
+		return WriteAll(appFD, data, len);
+	};
+	transport.close = [appFD]()
+	{
+		close(appFD);
+	};
+
+	unit->handle = RegisterCommTransport(transport);
+
+	TRIP_UNIT_SIM::TripUnitSimulator *sim = unit->sim.get();
+	unit->thread = std::thread([sim]
+							   { sim->Run(); });
+
+	return true;
+}
+
+static void StopSimulatedTripUnit(SimulatedTripUnit *unit)
+{
+	unit->sim->Stop();
+	CloseCommPort(&unit->handle);
+
+	// (closing our end is what gets it out of its read)
+	shutdown(unit->simFD, SHUT_RDWR);
+
+	unit->thread.join();
+	close(unit->simFD);
+}
+
+// every unit reports different currents, so an answer says which unit it came from
+static uint32_t UnitAmps(int unit, int phase)
+{
+	return (unit + 1) * 1000 + phase;
+}
+
+static void CheckDynamics(const URCMessageUnion &rsp, int unit, UnitResult *result)
+{
+	if (!VerifyMessageIsOK((URCMessageUnion *)&rsp, MSG_RSP_DYNAMICS_4, sizeof(MsgRspDynamics4) - sizeof(MsgHdr)))
+	{
+		result->failed++;
+		return;
+	}
+
+	const Measurements4 &m = rsp.msgRspDynamics4.Dynamics.Measurements;
+
+	if (m.Ia != UnitAmps(unit, 0) || m.Ib != UnitAmps(unit, 1) || m.Ic != UnitAmps(unit, 2) || m.In != UnitAmps(unit, 3))
+		result->wrongUnit++;
+	else
+		result->ok++;
+}
+
+// one of several threads sharing the pipeline on hTripUnit
+static void AsyncWorker(HANDLE hTripUnit, int unit, int requests, UnitResult *result)
+{
+	std::vector<uint16_t> seqs;
+
+	for (int i = 0; i < requests; i++)
+	{
+		URCMessageUnion msg = {0};
+
+		msg.msgHdr.Type = MSG_GET_DYNAMICS;
+		msg.msgHdr.Version = PROTOCOL_VERSION;
+		msg.msgHdr.Dst = ADDR_TRIP_UNIT;
+		msg.msgHdr.Src = ADDR_CAL_APP;
+
+		// (SendAsync() fills in Seq for us)
+		std::future<URCReply> future = SendURCMessageAsync(hTripUnit, &msg, MSG_RSP_DYNAMICS_4);
+		seqs.push_back(msg.msgHdr.Seq);
+
+		URCReply reply = future.get();
+
+		if (!reply.ok)
+		{
+			result->failed++;
+			continue;
+		}
+
+		if (reply.msg.msgHdr.Seq != msg.msgHdr.Seq)
+			result->wrongSeq++;
+
+		CheckDynamics(reply.msg, unit, result);
+	}
+
+	std::lock_guard<std::mutex> lock(result->seqMutex);
+	result->seqs.insert(result->seqs.end(), seqs.begin(), seqs.end());
+}
+
+// the only thread on hTripUnit; the timeouts are all its own
+static void SyncWorker(HANDLE hTripUnit, int unit, int requests, UnitResult *result)
+{
+	URCConnection &connection = GetURCConnection(hTripUnit);
+	int myDefaultTimeoutMS = 1000 + unit;
+
+	connection.SetDefaultTimeoutMS(myDefaultTimeoutMS);
+
+	for (int i = 0; i < requests; i++)
+	{
+		URCMessageUnion rsp;
+		bool ok = SendURCCommand(hTripUnit, MSG_GET_DYNAMICS, ADDR_TRIP_UNIT, ADDR_CAL_APP);
+
+		// every other one with a long timeout of its own, like the calibration code does
+		if (ok)
+			ok = (i & 1) ? GetURCResponse_Long(hTripUnit, &rsp, 5000 + unit) : GetURCResponse(hTripUnit, &rsp);
+
+		if (connection.DefaultTimeoutMS() != myDefaultTimeoutMS)
+			result->wrongTimeout++;
+
+		if (!ok)
+		{
+			result->failed++;
+			continue;
+		}
+
+		CheckDynamics(rsp, unit, result);
+	}
+}
+
+static uint32_t CountDuplicates(std::vector<uint16_t> seqs)
+{
+	std::sort(seqs.begin(), seqs.end());
+	return (uint32_t)(seqs.size() - (std::unique(seqs.begin(), seqs.end()) - seqs.begin()));
+}
+
+int main(int argc, char *argv[])
+{
+	RunnerConfig config;
+
+	config.sim.latencyMS = 1;
+
+	if (!ParseArgs(argc, argv, &config))
+	{
+		Usage();
+		return 1;
+	}
+
+	const int numUnits = config.units + config.syncUnits;
+
+	std::vector<SimulatedTripUnit> units(numUnits);
+	std::vector<UnitResult> results(numUnits);
+	std::vector<std::thread> threads;
+
+	for (int i = 0; i < numUnits; i++)
+	{
+		config.sim.seed = i + 1;
+
+		if (!StartSimulatedTripUnit(config.sim, &units[i]))
+		{
+			scr_printf("cannot create socketpair: %s", strerror(errno));
+			return 1;
+		}
+
+		units[i].sim->SetCurrents(UnitAmps(i, 0), UnitAmps(i, 1), UnitAmps(i, 2), UnitAmps(i, 3));
+	}
+
+	uint64_t startMS = SERIAL_RX::NowMS();
+
+	for (int i = 0; i < numUnits; i++)
+	{
+		HANDLE h = units[i].handle;
+		UnitResult *result = &results[i];
+
+		if (i < config.units)
+		{
+			for (int t = 0; t < config.threads; t++)
+				threads.emplace_back(AsyncWorker, h, i, config.requests, result);
+		}
+		else
+		{
+			threads.emplace_back(SyncWorker, h, i, config.requests, result);
+		}
+	}
+
+	for (std::thread &thread : threads)
+		thread.join();
+
+	uint64_t elapsedMS = SERIAL_RX::NowMS() - startMS;
+
+	std::vector<TRIP_UNIT_SIM::SimStats> simStats;
+
+	for (SimulatedTripUnit &unit : units)
+	{
+		simStats.push_back(unit.sim->Stats());
+		StopSimulatedTripUnit(&unit);
+	}
+
+	bool allOK = true;
+	uint64_t total = 0;
+
+	for (int i = 0; i < numUnits; i++)
+	{
+		UnitResult &r = results[i];
+		bool async = i < config.units;
+		uint32_t expected = async ? config.threads * config.requests : config.requests;
+
+		// (the Seq wraps at 65536, so after that we'll see repeats no matter what)
+		if (async && expected <= 65536)
+			r.duplicateSeqs = CountDuplicates(r.seqs);
+
+		bool ok = r.ok == expected && r.wrongUnit == 0 && r.wrongSeq == 0 && r.wrongTimeout == 0 && r.duplicateSeqs == 0 &&
+				  simStats[i].requests == expected && simStats[i].responses == expected;
+
+		scr_printf("unit %2d %-5s %6u ok, %u failed, %u from another unit, %u wrong seq, %u duplicate seq, %u wrong timeout; sim saw %u, answered %u %s",
+				   i, async ? "async" : "sync", r.ok.load(), r.failed.load(), r.wrongUnit.load(), r.wrongSeq.load(), r.duplicateSeqs,
+				   r.wrongTimeout.load(), simStats[i].requests, simStats[i].responses, ok ? "" : "<--");
+
+		allOK &= ok;
+		total += r.ok;
+	}
+
+	scr_printf("");
+	scr_printf("%d threads, %llu requests in %llu ms: %.0f requests / second",
+			   (int)threads.size(), (unsigned long long)total, (unsigned long long)elapsedMS,
+			   elapsedMS ? total * 1000.0 / elapsedMS : 0.0);
+
+	scr_printf(allOK ? "PASSED" : "FAILED");
+
+	return allOK ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,363 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+
+// urc_decoder_runner: URC_DECODER::FrameDecoder, clean and with corruption injected
+//
+// makes --frames made up messages (sequence numbers 0, 1, 2 ...), and pushes them through
+// a decoder in random sized chunks, like a serial port hands them over:
+//	-	clean: how fast it decodes (MB/s)
+//	-	corrupted: --corrupt percent of the messages get a flipped byte, a header whose
+//		length claims more than is there, or garbage in front of them; every message
+//		that wasn't touched has to come out, once, in order, and nothing else
+//	-	noise: random bytes where every other offset has a believable length; how fast
+//		the decoder gets through them (this is where looking ahead used to go quadratic)
+// and two by hand: a corrupted header with a believable length, then a good message,
+// and nothing after that; the good one has to come out without waiting for more bytes.
+// and a message with a good one inside its payload and a bad checksum, then a good
+// message; only the last one is allowed out
+//
+//	urc_decoder_runner --frames 200000 --corrupt 5 --seed 1
+
+#ifndef _WIN32
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "util/urc_decoder.hpp"
+#include "util/screen.hpp"
+
+// sequence number offset in MsgHdr
+constexpr int SEQ_OFFSET = 4;
+
+typedef struct _RunnerConfig
+{
+	int frames = 200000;
+	int corruptPercent = 5;
+	uint32_t seed = 1;
+} RunnerConfig;
+
+static void Usage()
+{
+	puts("usage: urc_decoder_runner [options]");
+	puts("  --frames N        messages in each stream (default 200000)");
+	puts("  --corrupt PCT     percent of messages corrupted (default 5)");
+	puts("  --seed N          for the message contents, corruption and chunk sizes");
+}
+
+static bool ParseArgs(int argc, char *argv[], RunnerConfig *config)
+{
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string arg = argv[i];
+		const char *value = argv[i + 1];
+
+		if (arg == "--frames")
+			config->frames = atoi(value);
+		else if (arg == "--corrupt")
+			config->corruptPercent = atoi(value);
+		else if (arg == "--seed")
+			config->seed = (uint32_t)strtoul(value, nullptr, 10);
+		else
+			return false;
+	}
+
+	return (argc % 2) == 1 && config->frames > 0;
+}
+
+static void WriteU16(uint8_t *p, uint16_t value)
+{
+	p[0] = (uint8_t)value;
+	p[1] = (uint8_t)(value >> 8);
+}
+
+static uint16_t ReadU16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+// a good message, with seq in it
+static std::vector<uint8_t> MakeFrame(std::mt19937 &rng, uint16_t seq)
+{
+	// mostly short, like the real traffic; now and then a big one
+	int payload = (rng() % 20 == 0) ? (int)(rng() % (URC_DECODER::MAX_FRAME_SIZE - URC_DECODER::HEADER_SIZE)) : (int)(rng() % 64);
+	std::vector<uint8_t> frame(URC_DECODER::HEADER_SIZE + payload);
+
+	for (uint8_t &b : frame)
+		b = (uint8_t)rng();
+
+	WriteU16(&frame[URC_DECODER::LENGTH_OFFSET], (uint16_t)payload);
+	WriteU16(&frame[SEQ_OFFSET], seq);
+	WriteU16(&frame[URC_DECODER::CHKSUM_OFFSET], URC_DECODER::FrameChecksum(frame.data(), (int)frame.size()));
+
+	return frame;
+}
+
+// what went in, and which sequence numbers should come out
+typedef struct _Stream
+{
+	std::vector<uint8_t> bytes;
+	std::vector<uint16_t> expected;
+	int corrupted;
+} Stream;
+
+static Stream MakeStream(const RunnerConfig &config, int corruptPercent)
+{
+	std::mt19937 rng(config.seed);
+	Stream stream = {{}, {}, 0};
+
+	for (int i = 0; i < config.frames; i++)
+	{
+		uint16_t seq = (uint16_t)i;
+		std::vector<uint8_t> frame = MakeFrame(rng, seq);
+
+		if ((int)(rng() % 100) >= corruptPercent)
+		{
+			stream.expected.push_back(seq);
+			stream.bytes.insert(stream.bytes.end(), frame.begin(), frame.end());
+			continue;
+		}
+
+		stream.corrupted++;
+
+		switch (rng() % 3)
+		{
+		case 0:
+		{
+			// a flipped byte somewhere; this one is lost
+			size_t at = rng() % frame.size();
+			frame[at] ^= (uint8_t)(1 + rng() % 255);
+			break;
+		}
+
+		case 1:
+		{
+			// a length longer than what's there, but not impossibly long; this one is lost
+			uint16_t length = ReadU16(&frame[URC_DECODER::LENGTH_OFFSET]);
+			WriteU16(&frame[URC_DECODER::LENGTH_OFFSET], (uint16_t)(length + 1 + rng() % (URC_DECODER::MAX_FRAME_SIZE - URC_DECODER::HEADER_SIZE - length)));
+			break;
+		}
+
+		default:
+		{
+			// garbage in front; the message itself is fine
+			int garbage = 1 + rng() % 40;
+
+			for (int g = 0; g < garbage; g++)
+				stream.bytes.push_back((uint8_t)rng());
+
+			stream.expected.push_back(seq);
+			break;
+		}
+		}
+
+		stream.bytes.insert(stream.bytes.end(), frame.begin(), frame.end());
+	}
+
+	return stream;
+}
+
+// push the whole stream through, in chunks of 1 .. 256 bytes; returns the sequence
+// numbers of what came out
+static std::vector<uint16_t> Decode(const std::vector<uint8_t> &bytes, uint32_t seed, URC_DECODER::DecoderStats *stats)
+{
+	URC_DECODER::FrameDecoder decoder;
+	URC_DECODER::FrameView frame;
+	std::mt19937 rng(seed);
+	std::vector<uint16_t> seqs;
+	size_t fed = 0;
+
+	seqs.reserve(bytes.size() / URC_DECODER::HEADER_SIZE);
+
+	while (fed < bytes.size())
+	{
+		int chunk = 1 + rng() % 256;
+		int room;
+		uint8_t *dst = decoder.WritePtr(&room);
+
+		chunk = (int)std::min<size_t>({(size_t)chunk, (size_t)room, bytes.size() - fed});
+		memcpy(dst, bytes.data() + fed, chunk);
+		decoder.Commit(chunk);
+		fed += chunk;
+
+		while (decoder.Next(&frame))
+			seqs.push_back(ReadU16(frame.data + SEQ_OFFSET));
+	}
+
+	*stats = decoder.Stats();
+	return seqs;
+}
+
+static double NowSeconds()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// how many of expected didn't come out (in order), and how many things came out that weren't expected
+static void Compare(const std::vector<uint16_t> &expected, const std::vector<uint16_t> &got, int *missing, int *extra)
+{
+	size_t e = 0;
+
+	*missing = *extra = 0;
+
+	for (uint16_t seq : got)
+	{
+		size_t at = e;
+
+		while (at < expected.size() && expected[at] != seq)
+			at++;
+
+		if (at == expected.size())
+		{
+			(*extra)++;
+			continue;
+		}
+
+		*missing += (int)(at - e);
+		e = at + 1;
+	}
+
+	*missing += (int)(expected.size() - e);
+}
+
+// bytes that keep the decoder looking ahead: the length at every even offset is believable
+static std::vector<uint8_t> MakeNoise(const RunnerConfig &config)
+{
+	std::mt19937 rng(config.seed);
+	std::vector<uint8_t> bytes(config.frames * 4);
+
+	for (size_t i = 0; i < bytes.size(); i++)
+		bytes[i] = (uint8_t)((i & 1) ? rng() % 3 : rng());
+
+	return bytes;
+}
+
+// the case that used to stall: bad header, believable length, then one good message
+static bool LookaheadCase()
+{
+	std::mt19937 rng(7);
+	std::vector<uint8_t> bad = MakeFrame(rng, 1);
+	std::vector<uint8_t> good = MakeFrame(rng, 2);
+
+	WriteU16(&bad[URC_DECODER::LENGTH_OFFSET], 900);
+
+	URC_DECODER::FrameDecoder decoder;
+	URC_DECODER::FrameView frame;
+
+	decoder.Feed(bad.data(), (int)bad.size());
+	decoder.Feed(good.data(), (int)good.size());
+
+	return decoder.Next(&frame) && ReadU16(frame.data + SEQ_OFFSET) == 2 && decoder.Stats().lookaheads == 1;
+}
+
+// a bad message with a good one in its payload, then a good message
+static bool PayloadCase()
+{
+	std::mt19937 rng(9);
+	std::vector<uint8_t> inner = MakeFrame(rng, 1);
+	std::vector<uint8_t> bad(URC_DECODER::HEADER_SIZE + 8);
+	std::vector<uint8_t> good = MakeFrame(rng, 3);
+
+	bad.insert(bad.end(), inner.begin(), inner.end());
+	bad.resize(bad.size() + 8);
+	WriteU16(&bad[URC_DECODER::LENGTH_OFFSET], (uint16_t)(bad.size() - URC_DECODER::HEADER_SIZE));
+	WriteU16(&bad[SEQ_OFFSET], 2);
+	WriteU16(&bad[URC_DECODER::CHKSUM_OFFSET], (uint16_t)(URC_DECODER::FrameChecksum(bad.data(), (int)bad.size()) + 1));
+
+	URC_DECODER::FrameDecoder decoder;
+	URC_DECODER::FrameView frame;
+	std::vector<uint16_t> seqs;
+
+	decoder.Feed(bad.data(), (int)bad.size());
+	decoder.Feed(good.data(), (int)good.size());
+
+	while (decoder.Next(&frame))
+		seqs.push_back(ReadU16(frame.data + SEQ_OFFSET));
+
+	return seqs == std::vector<uint16_t>{3};
+}
+
+int main(int argc, char *argv[])
+{
+	RunnerConfig config;
+
+	if (!ParseArgs(argc, argv, &config))
+	{
+		Usage();
+		return 1;
+	}
+
+	bool allOK = true;
+	URC_DECODER::DecoderStats stats;
+	int missing;
+	int extra;
+
+	// clean
+	Stream clean = MakeStream(config, 0);
+
+	double start = NowSeconds();
+	std::vector<uint16_t> got = Decode(clean.bytes, config.seed, &stats);
+	double seconds = NowSeconds() - start;
+
+	Compare(clean.expected, got, &missing, &extra);
+	allOK &= missing == 0 && extra == 0;
+
+	scr_printf("clean:     %d messages, %.1f MB in %.3f s (%.0f MB/s); %d missing, %d extra",
+			   config.frames, clean.bytes.size() / 1e6, seconds, clean.bytes.size() / 1e6 / seconds, missing, extra);
+
+	// corrupted
+	Stream corrupted = MakeStream(config, config.corruptPercent);
+
+	start = NowSeconds();
+	got = Decode(corrupted.bytes, config.seed, &stats);
+	seconds = NowSeconds() - start;
+
+	Compare(corrupted.expected, got, &missing, &extra);
+	allOK &= missing == 0 && extra == 0;
+
+	scr_printf("corrupted: %d of %d messages, %.1f MB in %.3f s (%.0f MB/s); %d missing, %d extra",
+			   corrupted.corrupted, config.frames, corrupted.bytes.size() / 1e6, seconds, corrupted.bytes.size() / 1e6 / seconds, missing, extra);
+	scr_printf("           checksum errors: %u, bad lengths: %u, lookaheads: %u, bytes skipped: %u",
+			   stats.checksumErrors, stats.badLengths, stats.lookaheads, stats.bytesSkipped);
+
+	// noise
+	std::vector<uint8_t> noise = MakeNoise(config);
+
+	start = NowSeconds();
+	got = Decode(noise, config.seed, &stats);
+	seconds = NowSeconds() - start;
+
+	scr_printf("noise:     %.1f MB in %.3f s (%.0f MB/s); checksum errors: %u, lookaheads: %u",
+			   noise.size() / 1e6, seconds, noise.size() / 1e6 / seconds, stats.checksumErrors, stats.lookaheads);
+
+	bool lookahead = LookaheadCase();
+	allOK &= lookahead;
+
+	scr_printf("bad header with a believable length, then a good message: %s", lookahead ? "good one came out" : "STALLED");
+
+	bool payload = PayloadCase();
+	allOK &= payload;
+
+	scr_printf("bad message with a good one in its payload, then a good message: %s", payload ? "only the last one came out" : "WRONG MESSAGES");
+	scr_printf(allOK ? "PASSED" : "FAILED");
+
+	return allOK ? 0 : 1;
+}
+
+#endif
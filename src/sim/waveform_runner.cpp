@@ -0,0 +1,220 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+
+// waveform_runner: making MSG_SET_TESTSET_AMPS_4 cycles for a sweep of current levels
+//
+// the same sweep (--levels amps from 100A to 9000A, on each of the 4 phases, with a 3rd and
+// 5th harmonic if --harmonics 1), three ways:
+//	-	naive:  std::sin() for every harmonic of every sample
+//	-	tables: WAVEFORM::Generate()
+//	-	cache:  WAVEFORM::WaveformCache::Get(), --passes times over (the 1st pass fills it)
+// and prints how long a cycle takes each way. checks that tables and naive are within a
+// count of each other everywhere, that the cache hands back exactly what Generate() made,
+// and that the fault shapes come out with the RMS they should
+//
+// build with -DCMAKE_BUILD_TYPE=Release, or none of this means much
+//
+//	waveform_runner --levels 500 --passes 20 --harmonics 1
+
+#ifndef _WIN32
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "tests/waveform.hpp"
+#include "tests/soft_test_set.hpp"
+#include "util/screen.hpp"
+
+// every cycle is on an 800A CT
+constexpr int CT_RATING = 800;
+
+typedef struct _RunnerConfig
+{
+	int levels = 500;
+	int passes = 20;
+	bool harmonics = true;
+} RunnerConfig;
+
+static void Usage()
+{
+	puts("usage: waveform_runner [options]");
+	puts("  --levels N        current levels in the sweep (default 500)");
+	puts("  --passes N        times the cache goes over the sweep (default 20)");
+	puts("  --harmonics 0|1   add a 3rd and 5th harmonic (default 1)");
+}
+
+static bool ParseArgs(int argc, char *argv[], RunnerConfig *config)
+{
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string arg = argv[i];
+		int value = atoi(argv[i + 1]);
+
+		if (arg == "--levels")
+			config->levels = value;
+		else if (arg == "--passes")
+			config->passes = value;
+		else if (arg == "--harmonics")
+			config->harmonics = value != 0;
+		else
+			return false;
+	}
+
+	return (argc % 2) == 1 && config->levels > 0 && config->passes > 0;
+}
+
+// the way you would write it if you weren't thinking about it
+static void NaiveCycle(const WAVEFORM::WaveSpec &spec, double countsPerAmp, int32_t A2D[_SAMPLES_PER_CYCLE])
+{
+	const double PI = 3.14159265358979323846;
+	double peak = spec.ampsRMS * countsPerAmp * std::sqrt(2.0);
+
+	for (int i = 0; i < _SAMPLES_PER_CYCLE; i++)
+	{
+		double angle = 2 * PI * i / _SAMPLES_PER_CYCLE;
+		double x = spec.offsetAmps * countsPerAmp + peak * std::sin(angle + spec.degrees * PI / 180);
+
+		for (int h = 0; h < spec.numHarmonics; h++)
+		{
+			const WAVEFORM::Harmonic &harmonic = spec.harmonics[h];
+			x += peak * harmonic.percent / 100 * std::sin(harmonic.order * angle + harmonic.degrees * PI / 180);
+		}
+
+		A2D[i] = (int32_t)std::clamp(std::round(x), (double)-WAVEFORM::A2D_FULL_SCALE, (double)WAVEFORM::A2D_FULL_SCALE);
+	}
+}
+
+static std::vector<WAVEFORM::WaveSpec> BuildSweep(const RunnerConfig &config)
+{
+	std::vector<WAVEFORM::WaveSpec> sweep;
+	const float degrees[] = {0, -120, 120, 0};
+
+	for (int level = 0; level < config.levels; level++)
+	{
+		float amps = 100 + (9000 - 100) * (float)level / (std::max)(1, config.levels - 1);
+
+		for (float angle : degrees)
+		{
+			WAVEFORM::WaveSpec spec = WAVEFORM::Sine(amps, angle);
+
+			if (config.harmonics)
+			{
+				spec.numHarmonics = 2;
+				spec.harmonics[0] = {3, 10, angle * 3};
+				spec.harmonics[1] = {5, 5, angle * 5};
+			}
+
+			sweep.push_back(spec);
+		}
+	}
+
+	return sweep;
+}
+
+static double NowNS()
+{
+	return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// RMS of shape, relative to the same fundamental as a plain sine
+static double ShapeRatio(WAVEFORM::Shape shape, float clipPercent, double countsPerAmp)
+{
+	int32_t sine[_SAMPLES_PER_CYCLE];
+	int32_t shaped[_SAMPLES_PER_CYCLE];
+
+	WAVEFORM::WaveSpec spec = WAVEFORM::Sine(1000, 0);
+	WAVEFORM::Generate(spec, countsPerAmp, sine);
+
+	spec.shape = shape;
+	spec.clipPercent = clipPercent;
+	WAVEFORM::Generate(spec, countsPerAmp, shaped);
+
+	return SOFT_TEST_SET::CycleRMS(shaped) / SOFT_TEST_SET::CycleRMS(sine);
+}
+
+int main(int argc, char *argv[])
+{
+	RunnerConfig config;
+
+	if (!ParseArgs(argc, argv, &config))
+	{
+		Usage();
+		return 1;
+	}
+
+	double countsPerAmp = SOFT_TEST_SET::CountsPerAmp(CT_RATING);
+	std::vector<WAVEFORM::WaveSpec> sweep = BuildSweep(config);
+
+	std::vector<int32_t> naive(sweep.size() * _SAMPLES_PER_CYCLE);
+	std::vector<int32_t> tables(sweep.size() * _SAMPLES_PER_CYCLE);
+	std::vector<int32_t> cached(sweep.size() * _SAMPLES_PER_CYCLE);
+
+	bool allOK = true;
+
+	double start = NowNS();
+	for (size_t i = 0; i < sweep.size(); i++)
+		NaiveCycle(sweep[i], countsPerAmp, &naive[i * _SAMPLES_PER_CYCLE]);
+	double naiveNS = (NowNS() - start) / sweep.size();
+
+	start = NowNS();
+	for (size_t i = 0; i < sweep.size(); i++)
+		allOK &= WAVEFORM::Generate(sweep[i], countsPerAmp, &tables[i * _SAMPLES_PER_CYCLE]);
+	double tablesNS = (NowNS() - start) / sweep.size();
+
+	WAVEFORM::WaveformCache cache(sweep.size());
+
+	start = NowNS();
+	for (int pass = 0; pass < config.passes; pass++)
+	{
+		for (size_t i = 0; i < sweep.size(); i++)
+			allOK &= cache.Get(sweep[i], countsPerAmp, &cached[i * _SAMPLES_PER_CYCLE]);
+	}
+	double cachedNS = (NowNS() - start) / (sweep.size() * config.passes);
+
+	int32_t worst = 0;
+
+	for (size_t i = 0; i < naive.size(); i++)
+		worst = (std::max)(worst, std::abs(naive[i] - tables[i]));
+
+	allOK &= worst <= 1;
+	allOK &= cached == tables;
+
+	scr_printf("%zu cycles (%d levels x 4 phases%s)", sweep.size(), config.levels, config.harmonics ? ", 3rd and 5th harmonics" : "");
+	scr_printf("naive:  %8.1f ns per cycle", naiveNS);
+	scr_printf("tables: %8.1f ns per cycle (%.1fx)", tablesNS, naiveNS / tablesNS);
+	scr_printf("cache:  %8.1f ns per cycle (%.1fx), over %d passes", cachedNS, naiveNS / cachedNS, config.passes);
+	scr_printf("largest difference tables vs. naive: %d counts; cache %s Generate()", worst, (cached == tables) ? "matches" : "DOES NOT MATCH");
+
+	cache.PrintStats();
+
+	// half wave: Ipk/2 vs. Ipk/sqrt(2); clipped at 50%: worked out by hand
+	double halfWave = ShapeRatio(WAVEFORM::Shape::HALF_WAVE, 100, countsPerAmp);
+	double clipped = ShapeRatio(WAVEFORM::Shape::CLIPPED, 50, countsPerAmp);
+
+	scr_printf("half wave RMS: %.4f of sine (expect 0.7071); clipped at 50%%: %.4f (expect 0.6253)", halfWave, clipped);
+
+	allOK &= std::fabs(halfWave - 0.7071) < 0.005;
+	allOK &= std::fabs(clipped - 0.6253) < 0.005;
+
+	scr_printf(allOK ? "PASSED" : "FAILED");
+
+	return allOK ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,137 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#include <thread>
+
+#include "station.hpp"
+#include "util/serial_rx.hpp"
+#include "util/screen.hpp"
+
+namespace STATION
+{
+	void Scheduler::AddStation(const Station &station)
+	{
+		std::lock_guard<std::mutex> lock(statsMutex);
+
+		stations.push_back(station);
+		stats.push_back({0});
+	}
+
+	void Scheduler::RunStation(size_t index, const NextUnitFuncPtr &nextUnit, const DoUnitFuncPtr &doUnit)
+	{
+		Station &station = stations[index];
+
+		while (!stopping && nextUnit(station))
+		{
+			uint64_t unitStartMS = SERIAL_RX::NowMS();
+			bool passed = doUnit(station, instruments);
+			uint64_t tookMS = SERIAL_RX::NowMS() - unitStartMS;
+
+			{
+				std::lock_guard<std::mutex> lock(statsMutex);
+
+				if (passed)
+					stats[index].unitsPassed++;
+				else
+					stats[index].unitsFailed++;
+
+				stats[index].busyMS += tookMS;
+			}
+
+			scr_printf("%s: unit %s in %.1f seconds", station.name.c_str(), passed ? "passed" : "FAILED", tookMS / 1000.0);
+		}
+	}
+
+	void Scheduler::Run(const NextUnitFuncPtr &nextUnit, const DoUnitFuncPtr &doUnit)
+	{
+		std::vector<std::thread> threads;
+
+		stopping = false;
+
+		{
+			std::lock_guard<std::mutex> lock(statsMutex);
+
+			for (StationStats &s : stats)
+				s = {0};
+
+			startMS = SERIAL_RX::NowMS();
+			endMS = 0;
+		}
+
+		for (size_t i = 0; i < stations.size(); i++)
+			threads.emplace_back(&Scheduler::RunStation, this, i, std::cref(nextUnit), std::cref(doUnit));
+
+		for (std::thread &thread : threads)
+			thread.join();
+
+		std::lock_guard<std::mutex> lock(statsMutex);
+		endMS = SERIAL_RX::NowMS();
+	}
+
+	// (statsMutex must be held)
+	StationStats Scheduler::WithRate(StationStats s)
+	{
+		s.elapsedMS = (endMS ? endMS : SERIAL_RX::NowMS()) - startMS;
+
+		int units = s.unitsPassed + s.unitsFailed;
+		s.unitsPerHour = (s.elapsedMS > 0) ? units * 3600000.0 / s.elapsedMS : 0;
+
+		return s;
+	}
+
+	StationStats Scheduler::Stats(int stationId)
+	{
+		std::lock_guard<std::mutex> lock(statsMutex);
+
+		for (size_t i = 0; i < stations.size(); i++)
+		{
+			if (stations[i].id == stationId)
+				return WithRate(stats[i]);
+		}
+
+		StationStats none = {0};
+		return none;
+	}
+
+	StationStats Scheduler::TotalStats()
+	{
+		std::lock_guard<std::mutex> lock(statsMutex);
+
+		StationStats total = {0};
+
+		for (StationStats &s : stats)
+		{
+			total.unitsPassed += s.unitsPassed;
+			total.unitsFailed += s.unitsFailed;
+			total.busyMS += s.busyMS;
+		}
+
+		return WithRate(total);
+	}
+
+	void Scheduler::PrintStats()
+	{
+		for (Station &station : stations)
+		{
+			StationStats s = Stats(station.id);
+
+			scr_printf("%-12s passed: %3d  failed: %3d  busy: %6.1f s  units/hour: %6.1f",
+					   station.name.c_str(), s.unitsPassed, s.unitsFailed, s.busyMS / 1000.0, s.unitsPerHour);
+		}
+
+		StationStats total = TotalStats();
+
+		scr_printf("%-12s passed: %3d  failed: %3d  elapsed: %6.1f s  units/hour: %6.1f",
+				   "all", total.unitsPassed, total.unitsFailed, total.elapsedMS / 1000.0, total.unitsPerHour);
+	}
+}
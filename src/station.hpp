@@ -0,0 +1,121 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "util/platform.hpp"
+#include "util/instrument_broker.hpp"
+
+// running more than one test fixture (station) from one PC
+//
+// everything used to assume one trip unit (the global hTripUnit), and one unit at a time.
+// but most of the time on a unit is spent waiting on it (MSG_EXE_CALIBRATE_AD can take
+// minutes, plus all the reboots), and the instruments are sitting idle while that happens;
+// so a second fixture could be doing its own unit in the meantime
+//
+// a Station is what one fixture is wired to. a Scheduler runs each station on its own
+// thread, one unit after another, and keeps count of how fast they are going. instruments
+// that more than one station is wired to (like a single Keithley switched between
+// fixtures) go through an INSTRUMENT_BROKER::Broker, so only one station has one at a time
+//
+// this only does the scheduling; what "doing a unit" means is up to whoever calls Run()
+// (see src/sim/station_runner.cpp for one against simulated trip units)
+//
+// note: the app doesn't use this yet (it isn't even in the VS project), and can't until
+// the calibration code stops assuming there is one of everything:
+//	-	tripUnitType (autocal_rc.cpp) is one global, and calibrate_rc.cpp looks at it
+//	-	KEITHLEY keeps its range shadow and keithleyMutex in statics, for whatever Keithley
+//		is plugged in, and ASYNC_KEITHLEY has the one calibrationMonitor
+//	-	RIGOL_DG1000Z / BK_PRECISION_9801 each have one static transport
+//	-	DoProductionLoop() uses the global hTripUnit / hKeithley / hArduino
+// until then, it runs the trip unit side of things in station_runner, which is enough to
+// show what running fixtures side by side would buy us
+
+namespace STATION
+{
+	typedef struct _Station
+	{
+		int id;
+		std::string name;
+
+		// whatever this fixture doesn't have is INVALID_HANDLE_VALUE
+		HANDLE hTripUnit = INVALID_HANDLE_VALUE;
+		HANDLE hArduino = INVALID_HANDLE_VALUE;
+		HANDLE hSource = INVALID_HANDLE_VALUE; // BK 9801 (the Rigol is a VISA session, not a HANDLE)
+		HANDLE hKeithley = INVALID_HANDLE_VALUE;
+
+		// what to ask the broker for before using the source / meter (INSTRUMENT_BROKER::RIGOL,
+		// INSTRUMENT_BROKER::KEITHLEY, ...); stations wired to the same one use the same name
+		std::string sourceName;
+		std::string meterName;
+	} Station;
+
+	// true if there is another unit on this station's fixture to do
+	// (this is where a real station would wait for the operator to swap units)
+	typedef std::function<bool(Station &station)> NextUnitFuncPtr;
+
+	// does one unit; returns false if the unit failed (the station keeps going either way)
+	typedef std::function<bool(Station &station, INSTRUMENT_BROKER::Broker &instruments)> DoUnitFuncPtr;
+
+	typedef struct _StationStats
+	{
+		int unitsPassed;
+		int unitsFailed;
+		uint64_t busyMS;	// time spent in DoUnitFuncPtr
+		uint64_t elapsedMS; // since Run() started
+		double unitsPerHour;
+	} StationStats;
+
+	class Scheduler
+	{
+	public:
+		void AddStation(const Station &station);
+
+		// runs every station on its own thread, until nextUnit() says there are no more
+		// units for it (or Stop() is called); returns once they are all done
+		void Run(const NextUnitFuncPtr &nextUnit, const DoUnitFuncPtr &doUnit);
+
+		// stations finish the unit they are on, and then stop
+		void Stop() { stopping = true; }
+
+		StationStats Stats(int stationId);
+
+		// every station added together; units per hour is over the whole run, so it shows
+		// what running them side by side bought us
+		StationStats TotalStats();
+
+		void PrintStats();
+
+		INSTRUMENT_BROKER::Broker &Instruments() { return instruments; }
+
+	private:
+		void RunStation(size_t index, const NextUnitFuncPtr &nextUnit, const DoUnitFuncPtr &doUnit);
+		StationStats WithRate(StationStats stats);
+
+		std::vector<Station> stations;
+		std::vector<StationStats> stats;
+		std::mutex statsMutex;
+
+		INSTRUMENT_BROKER::Broker instruments;
+		std::atomic<bool> stopping{false};
+		uint64_t startMS = 0;
+		uint64_t endMS = 0; // 0 while running
+	};
+}
@@ -12,12 +12,13 @@
 *******************************************************************************/
 
 #include <windows.h>
-#include <chrono>
+#include <cmath>
 
 #include "..\autocal_rc.hpp"
 #include "..\util\settings.hpp"
 #include "..\devices\arduino.hpp"
 #include "gf_trip_test_rc.hpp"
+#include "soft_test_set.hpp"
 
 extern bool ArduinoAbortTimingTest;
 
@@ -65,118 +66,6 @@ namespace GF_TRIP_TEST_RC
         return SetSystemAndDeviceSettings(hTripUnit, funcptr);
     }
 
-    bool FloatCompare(float a, float b)
-    {
-        return std::abs(a - b) < 0.0001;
-    }
-
-    // Ground Fault:                                                      //  12
-    // uint32_t GFPickup;	 // Ground Fault Pickup
-    // uint16_t GFDelay;	 // Ground Fault Delay * 100
-    // uint8_t GFI2T;		 // Ground Fault 1=I2T or 2=I5T Ramp
-    // uint8_t GFType;		 // Ground Fault Pickup Type
-    // uint8_t GFI2TAmps;	 // GF I2T transition to "definite time".
-
-    // GFSlope 1=I2T or 2=I5T Ramp
-    //
-    uint32_t TimeTimeToTripMS(
-        int CTRating, int GFPickup, float GFDelay, int GFSlope, int GFCurrent)
-    {
-
-        // special case
-        if (0 == GFDelay)
-        {
-            return 0;
-        }
-
-        if (GFSlope < 0 || GFSlope > 2)
-        {
-            PrintToScreen("GF_TRIP_TEST_RC::TimeTimeToTripMS() - Invalid GFSlope: " + std::to_string(GFSlope));
-            return 0;
-        }
-
-        // apply definitions
-        if (GFSlope == 0)
-        {
-            return GFDelay * 1000; // convert to MS
-        }
-
-        if (GFSlope == 1)
-        {
-            if (GFCurrent > 0.6 * CTRating)
-            {
-                return GFDelay * 1000; // convert to MS
-            }
-        }
-
-        if (GFSlope == 2)
-        {
-            if (GFCurrent > 4 * GFPickup)
-            {
-                return GFDelay * 1000; // convert to MS
-            }
-        }
-
-        // otherwise, use formulas
-        float TB2C;
-        float TB5C;
-        float TimeToTripSeconds;
-
-        if (GFSlope == 1) // I^2T
-        {
-            if (FloatCompare(GFDelay, 0.5))
-                TB2C = 0.5;
-            else if (FloatCompare(GFDelay, 0.4))
-                TB2C = 0.4;
-            else if (FloatCompare(GFDelay, 0.3))
-                TB2C = 0.3;
-            else if (FloatCompare(GFDelay, 0.2))
-                TB2C = 0.2;
-            else if (FloatCompare(GFDelay, 0.1))
-                TB2C = 0.01;
-            else if (FloatCompare(GFDelay, 0.05))
-                TB2C = 0.0;
-
-            else
-            {
-                PrintToScreen("GF_TRIP_TEST_RC::TimeTimeToTripMS() - Invalid GFDelay: " + std::to_string(GFDelay));
-                return 0;
-            }
-
-            // use formula from ACPro2 manual
-            float xGF = static_cast<float>(GFCurrent) / static_cast<float>(CTRating);
-            TimeToTripSeconds = static_cast<float>(TB2C) / static_cast<float>(xGF * xGF);
-
-            // convert to MS
-            return TimeToTripSeconds * 1000;
-        }
-        // I^5T
-        {
-
-            if (FloatCompare(GFDelay, 0.5))
-                TB5C = 512;
-            else if (FloatCompare(GFDelay, 0.4))
-                TB5C = 409.6;
-            else if (FloatCompare(GFDelay, 0.3))
-                TB5C = 307.2;
-            else
-            {
-                PrintToScreen("GF_TRIP_TEST_RC::TimeTimeToTripMS() - Invalid GFDelay: " + std::to_string(GFDelay));
-                return 0;
-            }
-
-            // use formula from ACPro2 manual
-            float x5GF = static_cast<float>(GFCurrent) / static_cast<float>(GFPickup);
-            TimeToTripSeconds = static_cast<float>(TB5C) / static_cast<float>(x5GF * x5GF * x5GF * x5GF * x5GF);
-
-            // convert to MS
-            return TimeToTripSeconds * 1000;
-        }
-
-        PrintToScreen("GF_TRIP_TEST_RC::TimeTimeToTripMS() - Logic Error");
-        return 0;
-    }
-
     // returns true if all tests were successfully run
     static bool CheckTripTime_Internal(
         HANDLE hTripUnit, HANDLE hKeithley, HANDLE hArduino,
@@ -185,9 +74,6 @@ namespace GF_TRIP_TEST_RC
     {
         int SensitivityAmpsPerVolt = 3800;
 
-        // (MsgRspTimingTestResults is not in URCMessageUnion)
-        ARDUINO::MsgRspTimingTestResults *msgRspTimingTestResults;
-
         URCMessageUnion rsp = {0};
         bool retval;
 
@@ -213,10 +99,10 @@ namespace GF_TRIP_TEST_RC
             if (TestPoint > 1)
             {
                 PrintToScreen("waiting for trip unit to reboot after last trip ...");
-                Sleep(2000);
+                WaitForTripUnitReady(hTripUnit);
             }
 
-            PrintToScreen("Running test point " + std::to_string(TestPoint++));
+            PrintToScreen("Running test point " + std::to_string(TestPoint++) + TEST_PLAN::FileLineNote(testParam.fileLine));
 
             if (!SetupTripUnit(hTripUnit, testParam))
             {
@@ -224,8 +110,12 @@ namespace GF_TRIP_TEST_RC
                 return false;
             }
 
-            PrintToScreen("waiting 2 seconds for trip unit to reboot after sending MSG_SET_USR_SETTINGS_4 ...");
-            Sleep(2000);
+            PrintToScreen("waiting for trip unit to reboot after sending MSG_SET_USR_SETTINGS_4 ...");
+            if (!WaitForTripUnitReady(hTripUnit))
+            {
+                PrintToScreen("Error waiting for trip unit to reboot");
+                return false;
+            }
 
             // clear the trip history
             if (!SendClearTripHistory(hTripUnit))
@@ -234,7 +124,16 @@ namespace GF_TRIP_TEST_RC
                 return false;
             }
 
-            // tell the Arduino to start timing
+            // the Rigol and the Keithley are ours for this test point; in between points
+            // (reboots, cool-downs) whoever needs them more gets them first
+            INSTRUMENT_BROKER::SourceAndMeter instruments =
+                INSTRUMENT_BROKER::Instruments().AcquireSourceAndMeter(INSTRUMENT_BROKER::RIGOL);
+
+            if (!instruments.Valid())
+                return false;
+
+            // tell the Arduino to start timing (once the Rigol is ours; not while we were
+            // still waiting in line for it)
             SendURCCommand(hArduino, ARDUINO::MSG_START_TIMING_TEST, ARDUINO::ADDR_AUTOCAL_ARDUINO, ADDR_CAL_APP);
             retval = GetURCResponse(hArduino, &rsp) && MessageIsACK(&rsp);
 
@@ -253,14 +152,24 @@ namespace GF_TRIP_TEST_RC
             PrintToScreen("Amps To Apply: " + FloatToString(testParam.AmpsRMSToApply, 2));
             PrintToScreen("Commanding Rigol to output " + std::to_string(RigolVoltage) + " volts RMS");
 
+            if (!instruments.Valid())
+                return false;
+
             RIGOL_DG1000Z::SetupToApplySINWave(false, std::to_string(RigolVoltage));
             RIGOL_DG1000Z::EnableOutput();
 
             PrintToScreen("Taking Keithley voltage reading ...");
+            if (!instruments.Valid())
+                return false;
+
             double KeithleyReadingVoltsRMS = KEITHLEY::GetVoltageForAutoRange(hKeithley);
-            if (KeithleyReadingVoltsRMS == std::numeric_limits<double>::quiet_NaN())
+            if (std::isnan(KeithleyReadingVoltsRMS))
             {
                 PrintToScreen("Keithley voltage reading failed; aborted");
+
+                if (instruments.Valid())
+                    RIGOL_DG1000Z::DisableOutput();
+
                 return false;
             }
 
@@ -269,7 +178,6 @@ namespace GF_TRIP_TEST_RC
             PrintToScreen("Waiting for test results to become valid....");
 
             ArduinoAbortTimingTest = false;
-            msgRspTimingTestResults = nullptr;
 
             auto expectedTripTimeMS = TimeTimeToTripMS(
                 testParam.CTRating,
@@ -278,7 +186,7 @@ namespace GF_TRIP_TEST_RC
                 testParam.GFSlope,
                 CalculatedCurrentAmps);
 
-            uint32_t TimeToWaitMS = 1.5 * expectedTripTimeMS;
+            uint32_t TimeToWaitMS = expectedTripTimeMS * 3 / 2;
 
             // if we are dealing with a short trip time, make sure our loop
             // runs for at least 10 seconds
@@ -289,75 +197,47 @@ namespace GF_TRIP_TEST_RC
             PrintToScreen("Max loop time (ms): " + std::to_string(TimeToWaitMS));
             PrintToScreen("Use menu item 'Abort Timing Test' under Arduino menu to abort...");
 
-            // this timing is just so we can time out if the trip doesn't occur.
-            // so we can just start counting from this point, even though
-            // actually voltage has already been turned on a while ago.
-            auto start = std::chrono::high_resolution_clock::now();
-            auto elapsed = std::chrono::milliseconds(0);
+            // the timeout is just so we don't wait forever if the trip doesn't occur;
+            // we start counting from this point, even though the voltage has already
+            // been turned on a while ago. (the actual timing is done by the Arduino)
+            ARDUINO::TimingTestResults timingTestResults;
 
-            // TODO:
-            // FIXME:
-            // use MSG_ARDUINO_GET_STATUS
+            ARDUINO::TimingWaitResult waitResult = ARDUINO::WaitForTimingTestResults(
+                hArduino,
+                expectedTripTimeMS,
+                SERIAL_RX::DeadlineFromNow(TimeToWaitMS),
+                &ArduinoAbortTimingTest,
+                &timingTestResults);
 
-            while (!ArduinoAbortTimingTest)
+            switch (waitResult)
             {
-                Sleep(200);
+            case ARDUINO::TimingWaitResult::DONE:
+                break;
 
-                // did we time out waiting for the trip to occur?
-                auto now = std::chrono::high_resolution_clock::now();
-                elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - start);
-
-                if (elapsed.count() >= TimeToWaitMS)
-                {
-                    PrintToScreen("Timed out waiting for trip after " + std::to_string(elapsed.count()) + " ms");
-                    PrintToScreen("Expected trip time was " + std::to_string(expectedTripTimeMS) + " ms");
-
-                    RIGOL_DG1000Z::DisableOutput();
-                    return false;
-                }
+            case ARDUINO::TimingWaitResult::TIMED_OUT:
+                PrintToScreen("Timed out waiting for trip after " + std::to_string(TimeToWaitMS) + " ms");
+                PrintToScreen("Expected trip time was " + std::to_string(expectedTripTimeMS) + " ms");
+                break;
 
-                // send message to the arduino, asking for the timing test results
-
-                SendURCCommand(hArduino, ARDUINO::MSG_GET_TIMING_TEST_RESULTS, ARDUINO::ADDR_AUTOCAL_ARDUINO, ADDR_CAL_APP);
-
-                // get MSG_RSP_TIMING_TEST_RESULTS
-                retval = GetURCResponse(hArduino, &rsp);
-
-                if (!retval)
-                {
-                    RIGOL_DG1000Z::DisableOutput();
-                    PrintToScreen("cannot get timing results from the Arduino");
-                    return false;
-                }
-
-                // arduino will NAK us if the test is still in progress...
-                if (MSG_NAK == rsp.msgHdr.Type)
-                    continue;
-
-                retval = VerifyMessageIsOK(&rsp, ARDUINO::MSG_RSP_TIMING_TEST_RESULTS,
-                                           sizeof(ARDUINO::MsgRspTimingTestResults) - sizeof(MsgHdr));
+            case ARDUINO::TimingWaitResult::ABORTED:
+                PrintToScreen("Timing test aborted");
+                break;
 
-                if (!retval)
-                {
-                    RIGOL_DG1000Z::DisableOutput();
-                    PrintToScreen("cannot get timing results from the Arduino");
-                    return false;
-                }
-
-                // check to see if the timing tests are valid yet...
-                msgRspTimingTestResults = reinterpret_cast<ARDUINO::MsgRspTimingTestResults *>(&rsp);
-                if (msgRspTimingTestResults->timingTestResults.ResultsAreValid)
-                    break;
+            default:
+                PrintToScreen("cannot get timing results from the Arduino");
+                break;
             }
 
-            if (ArduinoAbortTimingTest)
-            {
-                PrintToScreen("Timing test aborted");
-                RIGOL_DG1000Z::DisableOutput();
+            // the Rigol goes off through our lease, tripped or not; if somebody else had it while
+            // we were waiting, it is theirs now (leave it alone), and the trip time is no good
+            if (!instruments.Valid())
                 return false;
-            }
 
             RIGOL_DG1000Z::DisableOutput();
+            instruments.Release();
+
+            if (waitResult != ARDUINO::TimingWaitResult::DONE)
+                return false;
 
             PrintToScreen("waiting 5 seconds after trip ...");
             Sleep(5000);
@@ -383,14 +263,144 @@ namespace GF_TRIP_TEST_RC
             r.testRan = true;
             r.expectedTimeToTripMS = expectedTripTimeMS;
             r.CalculatedCurrentAmps = CalculatedCurrentAmps;
-            r.measuredTimeToTripMS = msgRspTimingTestResults->timingTestResults.elapsedTime;
+            r.measuredTimeToTripMS = timingTestResults.elapsedTime;
             r.expectedTripType = _TRIP_TYPE_GF;
             r.tripTypeIsAsExpected = tripTypeIsAsExpected;
 
             r.errorPercent =
                 PercentDifference(
                     r.expectedTimeToTripMS,
-                    msgRspTimingTestResults->timingTestResults.elapsedTime);
+                    timingTestResults.elapsedTime);
+
+            results.push_back(r);
+        }
+
+        // we return true if all the tests were ran and completed
+        bool allTestRan = params.size() == results.size();
+        if (allTestRan)
+            for (const auto &r : results)
+                allTestRan &= r.testRan;
+
+        return allTestRan;
+    }
+
+    // results store fields for a point; a GF point also has to trip on GF
+    static std::vector<std::pair<std::string, double>> PointFields(const testParams &param, const testResults &result, bool &passed)
+    {
+        passed &= result.tripTypeIsAsExpected;
+
+        return {
+            {"CTRating", param.CTRating},
+            {"GFType", param.GFType},
+            {"GFPickup", param.GFPickup},
+            {"GFDelay", param.GFDelay},
+            {"GFSlope", param.GFSlope},
+            {"expectedTimeToTripMS", result.expectedTimeToTripMS},
+            {"errorPercent", result.errorPercent},
+            {"expectedTripType", result.expectedTripType},
+            {"tripTypeIsAsExpected", result.tripTypeIsAsExpected},
+        };
+    }
+
+    // the same test points, through the trip unit's own software test set instead of the
+    // Rigol, Keithley and Arduino (see soft_test_set.hpp)
+    static bool CheckTripTime_SoftTestSet_Internal(
+        HANDLE hTripUnit,
+        const std::vector<testParams> &params,
+        std::vector<testResults> &results)
+    {
+        int TestPoint = 1;
+
+        for (auto testParam : params)
+        {
+
+            if (TestPoint > 1)
+            {
+                PrintToScreen("waiting for trip unit to reboot after last trip ...");
+                WaitForTripUnitReady(hTripUnit);
+            }
+
+            PrintToScreen("Running test point " + std::to_string(TestPoint++) + TEST_PLAN::FileLineNote(testParam.fileLine) + " (soft test set)");
+
+            if (!SetupTripUnit(hTripUnit, testParam))
+            {
+                PrintToScreen("Error setting up trip unit");
+                return false;
+            }
+
+            PrintToScreen("waiting for trip unit to reboot after sending MSG_SET_USR_SETTINGS_4 ...");
+            if (!WaitForTripUnitReady(hTripUnit))
+            {
+                PrintToScreen("Error waiting for trip unit to reboot");
+                return false;
+            }
+
+            // clear the trip history
+            if (!SendClearTripHistory(hTripUnit))
+            {
+                PrintToScreen("Error clearing trip history on trip unit");
+                return false;
+            }
+
+            PrintToScreen("GFPickup: " + std::to_string(testParam.GFPickup));
+            PrintToScreen("GFDelay: " + FloatToString(testParam.GFDelay, 2));
+            PrintToScreen("GFSlope: " + std::to_string(testParam.GFSlope));
+            PrintToScreen("Amps To Simulate: " + FloatToString(testParam.AmpsRMSToApply, 2));
+
+            // (from what we asked for; only used to decide how often to ask for results)
+            auto guessTripTimeMS = TimeTimeToTripMS(
+                testParam.CTRating,
+                testParam.GFPickup,
+                testParam.GFDelay,
+                testParam.GFSlope,
+                testParam.AmpsRMSToApply);
+
+            if (guessTripTimeMS > SOFT_TEST_SET::MAX_TRIP_MS)
+            {
+                PrintToScreen("expected trip time of " + std::to_string(guessTripTimeMS) + " ms is too long for the soft test set; skipped");
+                results.push_back({false});
+                continue;
+            }
+
+            SoftTestSetResults4 softResults;
+
+            if (!SOFT_TEST_SET::RunTest(hTripUnit, SOFT_TEST_SET::GroundFault(testParam.AmpsRMSToApply, guessTripTimeMS), &softResults))
+            {
+                PrintToScreen("cannot get soft test set results from the trip unit");
+                return false;
+            }
+
+            if (!softResults.tripped)
+            {
+                PrintToScreen("trip unit did not trip before the soft test set timed out");
+                return false;
+            }
+
+            // what the trip unit says it saw is what the trip time has to be right for
+            int CalculatedCurrentAmps = SOFT_TEST_SET::MeasuredAmps(softResults, true);
+
+            if (softResults.tripType != _TRIP_TYPE_GF)
+                PrintToScreen("unexpected trip type: " + std::to_string(softResults.tripType));
+
+            auto expectedTripTimeMS = TimeTimeToTripMS(
+                testParam.CTRating,
+                testParam.GFPickup,
+                testParam.GFDelay,
+                testParam.GFSlope,
+                CalculatedCurrentAmps);
+
+            testResults r;
+
+            r.testRan = true;
+            r.CalculatedCurrentAmps = CalculatedCurrentAmps;
+            r.expectedTimeToTripMS = expectedTripTimeMS;
+            r.measuredTimeToTripMS = softResults.pickupUntilTripTIMEms;
+            r.errorPercent =
+                PercentDifference(
+                    r.expectedTimeToTripMS,
+                    r.measuredTimeToTripMS);
+            r.expectedTripType = _TRIP_TYPE_GF;
+            r.tripTypeIsAsExpected = softResults.tripType == _TRIP_TYPE_GF;
 
             results.push_back(r);
         }
@@ -412,10 +422,36 @@ namespace GF_TRIP_TEST_RC
         _ASSERT(hKeithley != INVALID_HANDLE_VALUE);
         _ASSERT(hArduino != INVALID_HANDLE_VALUE);
 
-        bool retval = CheckTripTime_Internal(hTripUnit, hKeithley, hArduino, params, results);
+        bool retval;
 
-        // extral level of protection, to guarantee that the rigol is not left on
-        RIGOL_DG1000Z::DisableOutput();
+        {
+            SCPI_SHADOW::RunStats shadowStats;
+
+            retval = CheckTripTime_Internal(hTripUnit, hKeithley, hArduino, params, results);
+
+            // extral level of protection, to guarantee that the rigol is not left on; through a
+            // lease like everything else, so only if nobody else has it (then it is theirs)
+            INSTRUMENT_BROKER::Lease rigol = INSTRUMENT_BROKER::Instruments().AcquireIfIdle(INSTRUMENT_BROKER::RIGOL);
+
+            if (rigol.Valid())
+                RIGOL_DG1000Z::DisableOutput();
+        }
+
+        RESULTS_STORE::AppendTripPoints("gf_trip", TripUnitSerialNumber(hTripUnit), params, results, PointFields);
+
+        return retval;
+    }
+
+    bool CheckTripTime_SoftTestSet(
+        HANDLE hTripUnit,
+        const std::vector<testParams> &params, std::vector<testResults> &results)
+    {
+        _ASSERT(hTripUnit != INVALID_HANDLE_VALUE);
+
+        bool retval = CheckTripTime_SoftTestSet_Internal(hTripUnit, params, results);
+
+        if (SOFT_TEST_SET::ResultsCount())
+            RESULTS_STORE::AppendTripPoints("gf_trip_soft", TripUnitSerialNumber(hTripUnit), params, results, PointFields);
 
         return retval;
     }
@@ -439,7 +475,7 @@ namespace GF_TRIP_TEST_RC
             const auto &result = results[i];
 
             PrintToScreen("--------------------------------------------------------------");
-            PrintToScreen(Tab(0) + "Test " + std::to_string(i + 1) + ":");
+            PrintToScreen(Tab(0) + "Test " + std::to_string(i + 1) + TEST_PLAN::FileLineNote(param.fileLine) + ":");
             PrintToScreen("--------------------------------------------------------------");
             PrintToScreen(Tab(1) + "Parameters:");
             PrintToScreen(Tab(2) + Dots(35, "(Hard-coded)LT_PICKUP_AMPS") + std::to_string(param.CTRating));
@@ -466,6 +502,12 @@ namespace GF_TRIP_TEST_RC
         }
     }
 
+    TEST_PLAN::Plan PlanTests(std::vector<testParams> &params, bool softTestSet)
+    {
+        return TEST_PLAN::PlanTests(params, TEST_PLAN::TestKind::GF, softTestSet, [](int i, const testParams &p)
+                                    { return TEST_PLAN::GFPoint(i, p.CTRating, p.GFType, p.GFPickup, p.GFDelay, p.GFSlope, p.AmpsRMSToApply); });
+    }
+
     // reads in a file like this:
     //  1500, 1500, OFF, 2500
     // and puts results into params
@@ -479,8 +521,12 @@ namespace GF_TRIP_TEST_RC
         }
 
         std::string line;
+        int lineNumber = 0;
+
         while (std::getline(file, line))
         {
+            lineNumber++;
+
             std::istringstream iss(line);
             std::string token;
             testParams p;
@@ -522,6 +568,7 @@ namespace GF_TRIP_TEST_RC
             p.AmpsRMSToApply = std::stof(token);
 
             // Add the parsed parameters to the vector
+            p.fileLine = lineNumber;
             params.push_back(p);
         }
 
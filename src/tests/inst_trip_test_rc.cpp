@@ -12,12 +12,13 @@
 *******************************************************************************/
 
 #include <windows.h>
-#include <chrono>
+#include <cmath>
 
 #include "..\autocal_rc.hpp"
 #include "..\util\settings.hpp"
 #include "..\devices\arduino.hpp"
 #include "inst_trip_test_rc.hpp"
+#include "soft_test_set.hpp"
 
 extern bool ArduinoAbortTimingTest;
 
@@ -98,9 +99,6 @@ namespace INST_TRIP_TEST_RC
     {
         int SensitivityAmpsPerVolt = 3800;
 
-        // (MsgRspTimingTestResults is not in URCMessageUnion)
-        ARDUINO::MsgRspTimingTestResults *msgRspTimingTestResults;
-
         URCMessageUnion rsp = {0};
         bool retval;
 
@@ -121,16 +119,13 @@ namespace INST_TRIP_TEST_RC
 
         int TestPoint = 1;
 
+        // the trip unit's thermal memory gets TEST_PLAN::COOL_DOWN_MS between tests; setting
+        // up for the next one happens during it
+        uint64_t coolDownUntilMS = 0;
+
         for (auto testParam : params)
         {
-
-            if (TestPoint > 1)
-            {
-                PrintToScreen("delaying 30 seconds between tests ...");
-                Sleep(1000 * 30);
-            }
-
-            PrintToScreen("Running test point " + std::to_string(TestPoint++));
+            PrintToScreen("Running test point " + std::to_string(TestPoint++) + TEST_PLAN::FileLineNote(testParam.fileLine));
 
             if (!SetupTripUnit(hTripUnit, testParam))
             {
@@ -138,8 +133,12 @@ namespace INST_TRIP_TEST_RC
                 return false;
             }
 
-            PrintToScreen("waiting 2 seconds for trip unit to reboot after sending MSG_SET_USR_SETTINGS_4 ...");
-            Sleep(2000);
+            PrintToScreen("waiting for trip unit to reboot after sending MSG_SET_USR_SETTINGS_4 ...");
+            if (!WaitForTripUnitReady(hTripUnit))
+            {
+                PrintToScreen("Error waiting for trip unit to reboot");
+                return false;
+            }
 
             // setup the QT status, based on the test parameters
 
@@ -156,7 +155,18 @@ namespace INST_TRIP_TEST_RC
                 return false;
             }
 
-            // tell the Arduino to start timing
+            TEST_PLAN::WaitForCoolDown(coolDownUntilMS);
+
+            // the Rigol and the Keithley are ours for this test point; in between points
+            // (reboots, cool-downs) whoever needs them more gets them first
+            INSTRUMENT_BROKER::SourceAndMeter instruments =
+                INSTRUMENT_BROKER::Instruments().AcquireSourceAndMeter(INSTRUMENT_BROKER::RIGOL);
+
+            if (!instruments.Valid())
+                return false;
+
+            // tell the Arduino to start timing (once the Rigol is ours; not while we were
+            // still waiting in line for it)
             SendURCCommand(hArduino, ARDUINO::MSG_START_TIMING_TEST, ARDUINO::ADDR_AUTOCAL_ARDUINO, ADDR_CAL_APP);
             retval = GetURCResponse(hArduino, &rsp) && MessageIsACK(&rsp);
 
@@ -181,13 +191,23 @@ namespace INST_TRIP_TEST_RC
             PrintToScreen("Amps To Apply: " + FloatToString(testParam.AmpsRMSToApply, 2));
             PrintToScreen("Commanding Rigol to output " + std::to_string(RigolVoltage) + " volts RMS");
 
+            if (!instruments.Valid())
+                return false;
+
             RIGOL_DG1000Z::SetupToApplySINWave(false, std::to_string(RigolVoltage));
             RIGOL_DG1000Z::EnableOutput();
 
+            if (!instruments.Valid())
+                return false;
+
             double KeithleyReadingVoltsRMS = KEITHLEY::GetVoltageForAutoRange(hKeithley);
-            if (KeithleyReadingVoltsRMS == std::numeric_limits<double>::quiet_NaN())
+            if (std::isnan(KeithleyReadingVoltsRMS))
             {
                 PrintToScreen("Keithley voltage reading failed; aborted");
+
+                if (instruments.Valid())
+                    RIGOL_DG1000Z::DisableOutput();
+
                 return false;
             }
 
@@ -197,75 +217,55 @@ namespace INST_TRIP_TEST_RC
             PrintToScreen("This may take a few minutes; use menu item 'Abort Timing Test' under Arduino menu to abort...");
 
             ArduinoAbortTimingTest = false;
-            msgRspTimingTestResults = nullptr; // just to prevent compiler warning
-
-            auto start = std::chrono::high_resolution_clock::now();
-            auto elapsed = std::chrono::milliseconds(0);
-
-            // TODO:
-            // FIXME:
-            // use MSG_ARDUINO_GET_STATUS
-
-            while (!ArduinoAbortTimingTest)
-            {
-                Sleep(200);
-
-                auto now = std::chrono::high_resolution_clock::now();
-                elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - start);
-
-                if (elapsed.count() >= 1000)
-                {
-                    PrintToScreen("Timed out after 1 second waiting for instantanious trip");
-                    RIGOL_DG1000Z::DisableOutput();
-                    return false;
-                }
 
-                // send message to the arduino, asking for the timing test results
+            uint32_t TimeToWaitMS = 1000;
 
-                SendURCCommand(hArduino, ARDUINO::MSG_GET_TIMING_TEST_RESULTS, ARDUINO::ADDR_AUTOCAL_ARDUINO, ADDR_CAL_APP);
+            // the timeout is just so we don't wait forever if the trip doesn't occur;
+            // we start counting from this point, even though the voltage has already
+            // been turned on a while ago. (the actual timing is done by the Arduino)
+            ARDUINO::TimingTestResults timingTestResults;
 
-                // get MSG_RSP_TIMING_TEST_RESULTS
-                retval = GetURCResponse(hArduino, &rsp);
+            ARDUINO::TimingWaitResult waitResult = ARDUINO::WaitForTimingTestResults(
+                hArduino,
+                0,
+                SERIAL_RX::DeadlineFromNow(TimeToWaitMS),
+                &ArduinoAbortTimingTest,
+                &timingTestResults);
 
-                if (!retval)
-                {
-                    RIGOL_DG1000Z::DisableOutput();
-                    PrintToScreen("cannot get timing results from the Arduino");
-                    return false;
-                }
+            switch (waitResult)
+            {
+            case ARDUINO::TimingWaitResult::DONE:
+                break;
 
-                // arduino will NAK us if the test is still in progress...
-                if (MSG_NAK == rsp.msgHdr.Type)
-                    continue;
+            case ARDUINO::TimingWaitResult::TIMED_OUT:
+                PrintToScreen("Timed out after 1 second waiting for instantanious trip");
+                break;
 
-                retval = VerifyMessageIsOK(&rsp, ARDUINO::MSG_RSP_TIMING_TEST_RESULTS,
-                                           sizeof(ARDUINO::MsgRspTimingTestResults) - sizeof(MsgHdr));
+            case ARDUINO::TimingWaitResult::ABORTED:
+                PrintToScreen("Timing test aborted");
+                break;
 
-                if (!retval)
-                {
-                    RIGOL_DG1000Z::DisableOutput();
-                    PrintToScreen("cannot get timing results from the Arduino");
-                    return false;
-                }
-
-                // check to see if the timing tests are valid yet...
-                msgRspTimingTestResults = reinterpret_cast<ARDUINO::MsgRspTimingTestResults *>(&rsp);
-                if (msgRspTimingTestResults->timingTestResults.ResultsAreValid)
-                    break;
+            default:
+                PrintToScreen("cannot get timing results from the Arduino");
+                break;
             }
 
-            if (ArduinoAbortTimingTest)
-            {
-                PrintToScreen("Timing test aborted");
-                RIGOL_DG1000Z::DisableOutput();
+            // the Rigol goes off through our lease, tripped or not; if somebody else had it while
+            // we were waiting, it is theirs now (leave it alone), and the trip time is no good
+            if (!instruments.Valid())
                 return false;
-            }
 
             RIGOL_DG1000Z::DisableOutput();
+            instruments.Release();
+
+            if (waitResult != ARDUINO::TimingWaitResult::DONE)
+                return false;
 
             PrintToScreen("waiting 5 seconds after trip ...");
             Sleep(5000);
 
+            coolDownUntilMS = SERIAL_RX::DeadlineFromNow(TEST_PLAN::COOL_DOWN_MS);
+
             bool tripTypeIsAsExpected;
 
             if (!CheckForCorrectTrip(
@@ -284,7 +284,7 @@ namespace INST_TRIP_TEST_RC
 
             r.testRan = true;
             r.CalculatedCurrentAmps = CalculatedCurrentAmps;
-            r.measuredTimeToTripMS = msgRspTimingTestResults->timingTestResults.elapsedTime;
+            r.measuredTimeToTripMS = timingTestResults.elapsedTime;
             r.expectedTripType = testParam.QTEnabled ? _TRIP_TYPE_QT_I_DIGITAL : _TRIP_TYPE_INST_DIGITAL;
             r.tripTypeIsAsExpected = tripTypeIsAsExpected;
             r.TripTimeIsBelowThreshold = r.measuredTimeToTripMS < testParam.tripTimeThresholdMS;
@@ -301,6 +301,122 @@ namespace INST_TRIP_TEST_RC
         return allTestRan;
     }
 
+    // results store fields for a point; it has to trip on the right protection, and in time
+    static std::vector<std::pair<std::string, double>> PointFields(const testParams &param, const testResults &result, bool &passed)
+    {
+        passed &= result.tripTypeIsAsExpected && result.TripTimeIsBelowThreshold;
+
+        return {
+            {"InstPickup", param.InstPickup},
+            {"QTInstPickup", param.QTInstPickup},
+            {"QTEnabled", param.QTEnabled},
+            {"tripTimeThresholdMS", param.tripTimeThresholdMS},
+            {"expectedTripType", result.expectedTripType},
+            {"tripTypeIsAsExpected", result.tripTypeIsAsExpected},
+            {"TripTimeIsBelowThreshold", result.TripTimeIsBelowThreshold},
+        };
+    }
+
+    // the same test points, through the trip unit's own software test set instead of the
+    // Rigol, Keithley and Arduino (see soft_test_set.hpp)
+    static bool CheckTripTime_SoftTestSet_Internal(
+        HANDLE hTripUnit,
+        const std::vector<testParams> &params,
+        std::vector<testResults> &results)
+    {
+        int TestPoint = 1;
+
+        // the soft test set heats up the thermal memory the same as real current does, so
+        // the same cool-down as CheckTripTime_Internal()
+        uint64_t coolDownUntilMS = 0;
+
+        for (auto testParam : params)
+        {
+
+            if (TestPoint > 1)
+            {
+                PrintToScreen("waiting for trip unit to reboot after last trip ...");
+                WaitForTripUnitReady(hTripUnit);
+            }
+
+            PrintToScreen("Running test point " + std::to_string(TestPoint++) + TEST_PLAN::FileLineNote(testParam.fileLine) + " (soft test set)");
+
+            if (!SetupTripUnit(hTripUnit, testParam))
+            {
+                PrintToScreen("Error setting up trip unit");
+                return false;
+            }
+
+            PrintToScreen("waiting for trip unit to reboot after sending MSG_SET_USR_SETTINGS_4 ...");
+            if (!WaitForTripUnitReady(hTripUnit))
+            {
+                PrintToScreen("Error waiting for trip unit to reboot");
+                return false;
+            }
+
+            // setup the QT status, based on the test parameters
+
+            if (!SetupQuickTrip(hTripUnit, testParam.QTEnabled))
+            {
+                PrintToScreen("Error setting QT status on trip unit");
+                return false;
+            }
+
+            // clear the trip history
+            if (!SendClearTripHistory(hTripUnit))
+            {
+                PrintToScreen("Error clearing trip history on trip unit");
+                return false;
+            }
+
+            TEST_PLAN::WaitForCoolDown(coolDownUntilMS);
+
+            PrintToScreen("InstPickup: " + std::to_string(testParam.InstPickup));
+            PrintToScreen("QTInstPickup: " + std::to_string(testParam.QTInstPickup));
+            PrintToScreen("QTEnabled: " + std::to_string(testParam.QTEnabled));
+            PrintToScreen("tripTimeThresholdMS: " + std::to_string(testParam.tripTimeThresholdMS));
+            PrintToScreen("Amps To Simulate: " + FloatToString(testParam.AmpsRMSToApply, 2));
+
+            SoftTestSetResults4 softResults;
+
+            if (!SOFT_TEST_SET::RunTest(hTripUnit, SOFT_TEST_SET::ThreePhase(testParam.AmpsRMSToApply, 0), &softResults))
+            {
+                PrintToScreen("cannot get soft test set results from the trip unit");
+                return false;
+            }
+
+            if (!softResults.tripped)
+            {
+                PrintToScreen("trip unit did not trip before the soft test set timed out");
+                return false;
+            }
+
+            coolDownUntilMS = SERIAL_RX::DeadlineFromNow(TEST_PLAN::COOL_DOWN_MS);
+
+            // what the trip unit says it saw is what the trip time has to be right for
+            int CalculatedCurrentAmps = SOFT_TEST_SET::MeasuredAmps(softResults, false);
+
+            testResults r;
+
+            r.testRan = true;
+            r.CalculatedCurrentAmps = CalculatedCurrentAmps;
+            r.measuredTimeToTripMS = softResults.pickupUntilTripTIMEms;
+            r.expectedTripType = testParam.QTEnabled ? _TRIP_TYPE_QT_I_DIGITAL : _TRIP_TYPE_INST_DIGITAL;
+            r.tripTypeIsAsExpected = softResults.tripType == r.expectedTripType;
+            r.TripTimeIsBelowThreshold = r.measuredTimeToTripMS < testParam.tripTimeThresholdMS;
+
+            results.push_back(r);
+        }
+
+        // we return true if all the tests were ran and completed
+        bool allTestRan = params.size() == results.size();
+        if (allTestRan)
+            for (const auto &r : results)
+                allTestRan &= r.testRan;
+
+        return allTestRan;
+    }
+
     bool CheckTripTime(
         HANDLE hTripUnit, HANDLE hKeithley, HANDLE hArduino,
         const std::vector<testParams> &params, std::vector<testResults> &results)
@@ -309,10 +425,22 @@ namespace INST_TRIP_TEST_RC
         _ASSERT(hKeithley != INVALID_HANDLE_VALUE);
         _ASSERT(hArduino != INVALID_HANDLE_VALUE);
 
-        bool retval = CheckTripTime_Internal(hTripUnit, hKeithley, hArduino, params, results);
+        bool retval;
 
-        // extral level of protection, to guarantee that the rigol is not left on
-        RIGOL_DG1000Z::DisableOutput();
+        {
+            SCPI_SHADOW::RunStats shadowStats;
+
+            retval = CheckTripTime_Internal(hTripUnit, hKeithley, hArduino, params, results);
+
+            // extral level of protection, to guarantee that the rigol is not left on; through a
+            // lease like everything else, so only if nobody else has it (then it is theirs)
+            INSTRUMENT_BROKER::Lease rigol = INSTRUMENT_BROKER::Instruments().AcquireIfIdle(INSTRUMENT_BROKER::RIGOL);
+
+            if (rigol.Valid())
+                RIGOL_DG1000Z::DisableOutput();
+        }
+
+        RESULTS_STORE::AppendTripPoints("inst_trip", TripUnitSerialNumber(hTripUnit), params, results, PointFields);
 
         return retval;
     }
@@ -334,6 +462,20 @@ namespace INST_TRIP_TEST_RC
         }
     }
 
+    bool CheckTripTime_SoftTestSet(
+        HANDLE hTripUnit,
+        const std::vector<testParams> &params, std::vector<testResults> &results)
+    {
+        _ASSERT(hTripUnit != INVALID_HANDLE_VALUE);
+
+        bool retval = CheckTripTime_SoftTestSet_Internal(hTripUnit, params, results);
+
+        if (SOFT_TEST_SET::ResultsCount())
+            RESULTS_STORE::AppendTripPoints("inst_trip_soft", TripUnitSerialNumber(hTripUnit), params, results, PointFields);
+
+        return retval;
+    }
+
     void PrintResults(
         const std::vector<testParams> &params,
         const std::vector<testResults> &results)
@@ -355,7 +497,7 @@ namespace INST_TRIP_TEST_RC
             const auto &result = results[i];
 
             PrintToScreen("--------------------------------------------------------------");
-            PrintToScreen(Tab(0) + "Test " + std::to_string(i + 1) + ":");
+            PrintToScreen(Tab(0) + "Test " + std::to_string(i + 1) + TEST_PLAN::FileLineNote(param.fileLine) + ":");
             PrintToScreen("--------------------------------------------------------------");
             PrintToScreen(Tab(1) + "Parameters:");
             PrintToScreen(Tab(2) + Dots(35, "(Hard-coded)LT_PICKUP_AMPS") + std::to_string(LT_PICKUP_AMPS));
@@ -378,6 +520,12 @@ namespace INST_TRIP_TEST_RC
         }
     }
 
+    TEST_PLAN::Plan PlanTests(std::vector<testParams> &params, bool softTestSet)
+    {
+        return TEST_PLAN::PlanTests(params, TEST_PLAN::TestKind::INST, softTestSet, [](int i, const testParams &p)
+                                    { return TEST_PLAN::INSTPoint(i, p.InstPickup, p.QTInstPickup, p.QTEnabled, p.AmpsRMSToApply); });
+    }
+
     // reads in a file like this:
     //  1500, 1500, OFF, 2500
     // and puts results into params
@@ -391,8 +539,12 @@ namespace INST_TRIP_TEST_RC
         }
 
         std::string line;
+        int lineNumber = 0;
+
         while (std::getline(file, line))
         {
+            lineNumber++;
+
             std::istringstream iss(line);
             std::string token;
             testParams p;
@@ -424,6 +576,7 @@ namespace INST_TRIP_TEST_RC
             p.AmpsRMSToApply = std::stof(token);
 
             // Add the parsed parameters to the vector
+            p.fileLine = lineNumber;
             params.push_back(p);
         }
 
@@ -12,12 +12,13 @@
  *******************************************************************************/
 
 #include <windows.h>
-#include <chrono>
+#include <cmath>
 
 #include "..\autocal_rc.hpp"
 #include "..\util\settings.hpp"
 #include "..\devices\arduino.hpp"
 #include "lt_trip_test_rc.hpp"
+#include "soft_test_set.hpp"
 
 extern bool ArduinoAbortTimingTest;
 
@@ -50,14 +51,6 @@ namespace LT_TRIP_TEST_RC
         return SetSystemAndDeviceSettings(hTripUnit, funcptr);
     }
 
-    int TimeTimeToTripMS(int LT_Pickup_AmpsRMS, float LT_Delay_Seconds, int AppliedCurrentAmpsRMS)
-    {
-        float X = (float)AppliedCurrentAmpsRMS / LT_Pickup_AmpsRMS;
-        int TBLC_lt = 36 * LT_Delay_Seconds;
-        float T = TBLC_lt / (X * X);
-        return T * 1000;
-    }
-
     // returns true if all tests were successfully run
     static bool CheckTripTime_Internal(
         HANDLE hTripUnit, HANDLE hKeithley, HANDLE hArduino,
@@ -66,9 +59,6 @@ namespace LT_TRIP_TEST_RC
     {
         int SensitivityAmpsPerVolt = 3800;
 
-        // (MsgRspTimingTestResults is not in URCMessageUnion)
-        ARDUINO::MsgRspTimingTestResults *msgRspTimingTestResults;
-
         URCMessageUnion rsp = {0};
         bool retval;
 
@@ -95,10 +85,10 @@ namespace LT_TRIP_TEST_RC
             if (TestPoint > 1)
             {
                 PrintToScreen("waiting for trip unit to reboot after last trip ...");
-                Sleep(2000);
+                WaitForTripUnitReady(hTripUnit);
             }
 
-            PrintToScreen("Running test point " + std::to_string(TestPoint++));
+            PrintToScreen("Running test point " + std::to_string(TestPoint++) + TEST_PLAN::FileLineNote(testParam.fileLine));
 
             if (!SetupTripUnit(hTripUnit, testParam))
             {
@@ -106,8 +96,12 @@ namespace LT_TRIP_TEST_RC
                 return false;
             }
 
-            PrintToScreen("waiting 2 seconds for trip unit to reboot after sending MSG_SET_USR_SETTINGS_4 ...");
-            Sleep(2000);
+            PrintToScreen("waiting for trip unit to reboot after sending MSG_SET_USR_SETTINGS_4 ...");
+            if (!WaitForTripUnitReady(hTripUnit))
+            {
+                PrintToScreen("Error waiting for trip unit to reboot");
+                return false;
+            }
 
             // clear the trip history
             if (!SendClearTripHistory(hTripUnit))
@@ -116,7 +110,16 @@ namespace LT_TRIP_TEST_RC
                 return false;
             }
 
-            // tell the Arduino to start timing
+            // the Rigol and the Keithley are ours for this test point; in between points
+            // (reboots, cool-downs) whoever needs them more gets them first
+            INSTRUMENT_BROKER::SourceAndMeter instruments =
+                INSTRUMENT_BROKER::Instruments().AcquireSourceAndMeter(INSTRUMENT_BROKER::RIGOL);
+
+            if (!instruments.Valid())
+                return false;
+
+            // tell the Arduino to start timing (once the Rigol is ours; not while we were
+            // still waiting in line for it)
             SendURCCommand(hArduino, ARDUINO::MSG_START_TIMING_TEST, ARDUINO::ADDR_AUTOCAL_ARDUINO, ADDR_CAL_APP);
             retval = GetURCResponse(hArduino, &rsp) && MessageIsACK(&rsp);
 
@@ -137,13 +140,23 @@ namespace LT_TRIP_TEST_RC
             PrintToScreen("Amps To Apply: " + FloatToString(testParam.AmpsRMSToApply, 2));
             PrintToScreen("Commanding Rigol to output " + std::to_string(RigolVoltage) + " volts RMS");
 
+            if (!instruments.Valid())
+                return false;
+
             RIGOL_DG1000Z::SetupToApplySINWave(false, std::to_string(RigolVoltage));
             RIGOL_DG1000Z::EnableOutput();
 
+            if (!instruments.Valid())
+                return false;
+
             double KeithleyReadingVoltsRMS = KEITHLEY::GetVoltageForAutoRange(hKeithley);
-            if (KeithleyReadingVoltsRMS == std::numeric_limits<double>::quiet_NaN())
+            if (std::isnan(KeithleyReadingVoltsRMS))
             {
                 PrintToScreen("Keithley voltage reading failed; aborted");
+
+                if (instruments.Valid())
+                    RIGOL_DG1000Z::DisableOutput();
+
                 return false;
             }
 
@@ -153,84 +166,55 @@ namespace LT_TRIP_TEST_RC
             PrintToScreen("This may take a few minutes; use menu item 'Abort Timing Test' under Arduino menu to abort...");
 
             ArduinoAbortTimingTest = false;
-            msgRspTimingTestResults = nullptr;
 
             auto expectedTripTimeMS = TimeTimeToTripMS(
                 testParam.LTPickupAMPS,
                 testParam.LT_Delay_Seconds,
                 CalculatedCurrentAmps);
 
-            // this timing is just so we can time out if the trip doesn't occur.
-            // so we can just start counting from this point, even though
-            // actually voltage has already been turned on a while ago.
-            auto start = std::chrono::high_resolution_clock::now();
-            auto elapsed = std::chrono::milliseconds(0);
-
-            // TODO:
-            // FIXME:
-            // use MSG_ARDUINO_GET_STATUS
+            uint32_t TimeToWaitMS = expectedTripTimeMS * 3 / 2;
 
-            while (!ArduinoAbortTimingTest)
-            {
-                Sleep(200);
-
-                // did we time out waiting for the trip to occur?
-                // (we wait 1.5 times the expected trip time)
-
-                auto now = std::chrono::high_resolution_clock::now();
-                elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - start);
+            // the timeout is just so we don't wait forever if the trip doesn't occur;
+            // we start counting from this point, even though the voltage has already
+            // been turned on a while ago. (the actual timing is done by the Arduino)
+            ARDUINO::TimingTestResults timingTestResults;
 
-                if (elapsed.count() >= 1.5 * expectedTripTimeMS)
-                {
-                    PrintToScreen("Timed out waiting for trip after " + std::to_string(elapsed.count()) + " ms");
-                    PrintToScreen("Expected trip time was " + std::to_string(expectedTripTimeMS) + " ms");
-
-                    RIGOL_DG1000Z::DisableOutput();
-                    return false;
-                }
+            ARDUINO::TimingWaitResult waitResult = ARDUINO::WaitForTimingTestResults(
+                hArduino,
+                expectedTripTimeMS,
+                SERIAL_RX::DeadlineFromNow(TimeToWaitMS),
+                &ArduinoAbortTimingTest,
+                &timingTestResults);
 
-                // send message to the arduino, asking for the timing test results
-
-                SendURCCommand(hArduino, ARDUINO::MSG_GET_TIMING_TEST_RESULTS, ARDUINO::ADDR_AUTOCAL_ARDUINO, ADDR_CAL_APP);
-
-                // get MSG_RSP_TIMING_TEST_RESULTS
-                retval = GetURCResponse(hArduino, &rsp);
-
-                if (!retval)
-                {
-                    RIGOL_DG1000Z::DisableOutput();
-                    PrintToScreen("cannot get timing results from the Arduino");
-                    return false;
-                }
+            switch (waitResult)
+            {
+            case ARDUINO::TimingWaitResult::DONE:
+                break;
 
-                // arduino will NAK us if the test is still in progress...
-                if (MSG_NAK == rsp.msgHdr.Type)
-                    continue;
+            case ARDUINO::TimingWaitResult::TIMED_OUT:
+                PrintToScreen("Timed out waiting for trip after " + std::to_string(TimeToWaitMS) + " ms");
+                PrintToScreen("Expected trip time was " + std::to_string(expectedTripTimeMS) + " ms");
+                break;
 
-                retval = VerifyMessageIsOK(&rsp, ARDUINO::MSG_RSP_TIMING_TEST_RESULTS,
-                                           sizeof(ARDUINO::MsgRspTimingTestResults) - sizeof(MsgHdr));
+            case ARDUINO::TimingWaitResult::ABORTED:
+                PrintToScreen("Timing test aborted");
+                break;
 
-                if (!retval)
-                {
-                    RIGOL_DG1000Z::DisableOutput();
-                    PrintToScreen("cannot get timing results from the Arduino");
-                    return false;
-                }
-
-                // check to see if the timing tests are valid yet...
-                msgRspTimingTestResults = reinterpret_cast<ARDUINO::MsgRspTimingTestResults *>(&rsp);
-                if (msgRspTimingTestResults->timingTestResults.ResultsAreValid)
-                    break;
+            default:
+                PrintToScreen("cannot get timing results from the Arduino");
+                break;
             }
 
-            if (ArduinoAbortTimingTest)
-            {
-                PrintToScreen("Timing test aborted");
-                RIGOL_DG1000Z::DisableOutput();
+            // the Rigol goes off through our lease, tripped or not; if somebody else had it while
+            // we were waiting, it is theirs now (leave it alone), and the trip time is no good
+            if (!instruments.Valid())
                 return false;
-            }
 
             RIGOL_DG1000Z::DisableOutput();
+            instruments.Release();
+
+            if (waitResult != ARDUINO::TimingWaitResult::DONE)
+                return false;
 
             PrintToScreen("waiting 5 seconds after trip ...");
             Sleep(5000);
@@ -254,11 +238,133 @@ namespace LT_TRIP_TEST_RC
             r.testRan = true;
             r.CalculatedCurrentAmps = CalculatedCurrentAmps;
             r.expectedTimeToTripMS = expectedTripTimeMS;
-            r.measuredTimeToTripMS = msgRspTimingTestResults->timingTestResults.elapsedTime;
+            r.measuredTimeToTripMS = timingTestResults.elapsedTime;
             r.errorPercent =
                 PercentDifference(
                     r.expectedTimeToTripMS,
-                    msgRspTimingTestResults->timingTestResults.elapsedTime);
+                    timingTestResults.elapsedTime);
+
+            results.push_back(r);
+        }
+
+        // we return true if all the tests were ran and completed
+        bool allTestRan = params.size() == results.size();
+        if (allTestRan)
+            for (const auto &r : results)
+                allTestRan &= r.testRan;
+
+        return allTestRan;
+    }
+
+    // what goes in the results store for a point, after what every trip test saves (see
+    // util\results_store.hpp); LT has no limit on the error, so a point passes if it ran
+    static std::vector<std::pair<std::string, double>> PointFields(const testParams &param, const testResults &result, bool & /* passed */)
+    {
+        return {
+            {"LTPickupAMPS", param.LTPickupAMPS},
+            {"LT_Delay_Seconds", param.LT_Delay_Seconds},
+            {"expectedTimeToTripMS", result.expectedTimeToTripMS},
+            {"errorPercent", result.errorPercent},
+        };
+    }
+
+    // the same test points, through the trip unit's own software test set instead of the
+    // Rigol, Keithley and Arduino (see soft_test_set.hpp)
+    static bool CheckTripTime_SoftTestSet_Internal(
+        HANDLE hTripUnit,
+        const std::vector<testParams> &params,
+        std::vector<testResults> &results)
+    {
+        int TestPoint = 1;
+
+        for (auto testParam : params)
+        {
+
+            if (TestPoint > 1)
+            {
+                PrintToScreen("waiting for trip unit to reboot after last trip ...");
+                WaitForTripUnitReady(hTripUnit);
+            }
+
+            PrintToScreen("Running test point " + std::to_string(TestPoint++) + TEST_PLAN::FileLineNote(testParam.fileLine) + " (soft test set)");
+
+            if (!SetupTripUnit(hTripUnit, testParam))
+            {
+                PrintToScreen("Error setting up trip unit");
+                return false;
+            }
+
+            PrintToScreen("waiting for trip unit to reboot after sending MSG_SET_USR_SETTINGS_4 ...");
+            if (!WaitForTripUnitReady(hTripUnit))
+            {
+                PrintToScreen("Error waiting for trip unit to reboot");
+                return false;
+            }
+
+            // clear the trip history
+            if (!SendClearTripHistory(hTripUnit))
+            {
+                PrintToScreen("Error clearing trip history on trip unit");
+                return false;
+            }
+
+            PrintToScreen("LTPickupAMPS: " + std::to_string(testParam.LTPickupAMPS));
+            PrintToScreen("LT_Delay_Seconds: " + FloatToString(testParam.LT_Delay_Seconds, 2));
+            PrintToScreen("Amps To Simulate: " + FloatToString(testParam.AmpsRMSToApply, 2));
+
+            // (from what we asked for; only used to decide how often to ask for results)
+            auto guessTripTimeMS = TimeTimeToTripMS(
+                testParam.LTPickupAMPS,
+                testParam.LT_Delay_Seconds,
+                testParam.AmpsRMSToApply);
+
+            if (guessTripTimeMS > SOFT_TEST_SET::MAX_TRIP_MS)
+            {
+                PrintToScreen("expected trip time of " + std::to_string(guessTripTimeMS) + " ms is too long for the soft test set; skipped");
+                results.push_back({false});
+                continue;
+            }
+
+            SoftTestSetResults4 softResults;
+
+            if (!SOFT_TEST_SET::RunTest(hTripUnit, SOFT_TEST_SET::ThreePhase(testParam.AmpsRMSToApply, guessTripTimeMS), &softResults))
+            {
+                PrintToScreen("cannot get soft test set results from the trip unit");
+                return false;
+            }
+
+            if (!softResults.tripped)
+            {
+                PrintToScreen("trip unit did not trip before the soft test set timed out");
+                return false;
+            }
+
+            // some other kind of trip says nothing about the LT delay; fail (like soft ST),
+            // so the point isn't recorded, and can't count as passed
+            if (softResults.tripType != _TRIP_TYPE_LT)
+            {
+                PrintToScreen("unexpected trip type: " + std::to_string(softResults.tripType));
+                return false;
+            }
+
+            // what the trip unit says it saw is what the trip time has to be right for
+            int CalculatedCurrentAmps = SOFT_TEST_SET::MeasuredAmps(softResults, false);
+
+            auto expectedTripTimeMS = TimeTimeToTripMS(
+                testParam.LTPickupAMPS,
+                testParam.LT_Delay_Seconds,
+                CalculatedCurrentAmps);
+
+            testResults r;
+
+            r.testRan = true;
+            r.CalculatedCurrentAmps = CalculatedCurrentAmps;
+            r.expectedTimeToTripMS = expectedTripTimeMS;
+            r.measuredTimeToTripMS = softResults.pickupUntilTripTIMEms;
+            r.errorPercent =
+                PercentDifference(
+                    r.expectedTimeToTripMS,
+                    r.measuredTimeToTripMS);
 
             results.push_back(r);
         }
@@ -280,10 +386,36 @@ namespace LT_TRIP_TEST_RC
         _ASSERT(hKeithley != INVALID_HANDLE_VALUE);
         _ASSERT(hArduino != INVALID_HANDLE_VALUE);
 
-        bool retval = CheckTripTime_Internal(hTripUnit, hKeithley, hArduino, params, results);
+        bool retval;
 
-        // extral level of protection, to guarantee that the rigol is not left on
-        RIGOL_DG1000Z::DisableOutput();
+        {
+            SCPI_SHADOW::RunStats shadowStats;
+
+            retval = CheckTripTime_Internal(hTripUnit, hKeithley, hArduino, params, results);
+
+            // extral level of protection, to guarantee that the rigol is not left on; through a
+            // lease like everything else, so only if nobody else has it (then it is theirs)
+            INSTRUMENT_BROKER::Lease rigol = INSTRUMENT_BROKER::Instruments().AcquireIfIdle(INSTRUMENT_BROKER::RIGOL);
+
+            if (rigol.Valid())
+                RIGOL_DG1000Z::DisableOutput();
+        }
+
+        RESULTS_STORE::AppendTripPoints("lt_trip", TripUnitSerialNumber(hTripUnit), params, results, PointFields);
+
+        return retval;
+    }
+
+    bool CheckTripTime_SoftTestSet(
+        HANDLE hTripUnit,
+        const std::vector<testParams> &params, std::vector<testResults> &results)
+    {
+        _ASSERT(hTripUnit != INVALID_HANDLE_VALUE);
+
+        bool retval = CheckTripTime_SoftTestSet_Internal(hTripUnit, params, results);
+
+        if (SOFT_TEST_SET::ResultsCount())
+            RESULTS_STORE::AppendTripPoints("lt_trip_soft", TripUnitSerialNumber(hTripUnit), params, results, PointFields);
 
         return retval;
     }
@@ -310,7 +442,7 @@ namespace LT_TRIP_TEST_RC
             const auto &result = results[i];
 
             PrintToScreen("--------------------------------------------------------------");
-            PrintToScreen(Tab(0) + "Test " + std::to_string(i + 1) + ":");
+            PrintToScreen(Tab(0) + "Test " + std::to_string(i + 1) + TEST_PLAN::FileLineNote(param.fileLine) + ":");
             PrintToScreen("--------------------------------------------------------------");
             PrintToScreen(Tab(1) + "Parameters:");
             PrintToScreen(Tab(2) + Dots(35, "LTPickupAMPS") + std::to_string(param.LTPickupAMPS));
@@ -329,6 +461,12 @@ namespace LT_TRIP_TEST_RC
         }
     }
 
+    TEST_PLAN::Plan PlanTests(std::vector<testParams> &params, bool softTestSet)
+    {
+        return TEST_PLAN::PlanTests(params, TEST_PLAN::TestKind::LT, softTestSet, [](int i, const testParams &p)
+                                    { return TEST_PLAN::LTPoint(i, p.LTPickupAMPS, p.LT_Delay_Seconds, p.AmpsRMSToApply); });
+    }
+
     // reads in a file like this:
     //  415, 3.5, 2250
     //  625, 24.0, 2250
@@ -344,8 +482,12 @@ namespace LT_TRIP_TEST_RC
         }
 
         std::string line;
+        int lineNumber = 0;
+
         while (std::getline(file, line))
         {
+            lineNumber++;
+
             std::istringstream iss(line);
             std::string token;
             testParams p;
@@ -372,6 +514,7 @@ namespace LT_TRIP_TEST_RC
             p.AmpsRMSToApply = std::stof(token);
 
             // Add the parsed parameters to the vector
+            p.fileLine = lineNumber;
             params.push_back(p);
         }
 
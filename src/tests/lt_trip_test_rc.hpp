@@ -16,6 +16,9 @@
 #include <windows.h>
 #include <vector>
 
+#include "trip_time_rc.hpp"
+#include "test_plan.hpp"
+
 namespace LT_TRIP_TEST_RC
 {
     struct testParams
@@ -23,6 +26,7 @@ namespace LT_TRIP_TEST_RC
         int LTPickupAMPS;
         float LT_Delay_Seconds;
         float AmpsRMSToApply;
+        int fileLine; // where ReadTestFile() found it; 0 if it didn't come from a file
     };
 
     struct testResults
@@ -38,10 +42,19 @@ namespace LT_TRIP_TEST_RC
         HANDLE hTripUnit, HANDLE hKeithley, HANDLE hArduino,
         const std::vector<testParams> &params, std::vector<testResults> &results);
 
+    // same as above, with no Rigol, Keithley or Arduino; see soft_test_set.hpp
+    bool CheckTripTime_SoftTestSet(
+        HANDLE hTripUnit,
+        const std::vector<testParams> &params, std::vector<testResults> &results);
+
     void PrintResults(
         const std::vector<testParams> &params,
         const std::vector<testResults> &results);
 
     bool ReadTestFile(std::string scriptFile, std::vector<testParams> &params);
 
+    // puts params (as read by ReadTestFile()) into the order TEST_PLAN says to run them
+    // in, and prints the plan
+    TEST_PLAN::Plan PlanTests(std::vector<testParams> &params, bool softTestSet);
+
 }
\ No newline at end of file
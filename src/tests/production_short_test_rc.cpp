@@ -74,12 +74,48 @@ namespace PRODUCTION_SHORT_TEST_RC
             return "invalid index passed to PointToAmpString()";
     }
 
-    static void SaveTestResults()
+    // results go in the results store (see util\results_store.hpp) as one "short_test"
+    // record per run; fields are named like "point1_percentError_B"
+    static std::string FieldName(int point_index, const std::string &name, int phase = -1)
     {
+        const char *phaseNames[] = {"A", "B", "C", "N"};
+
+        std::string fieldName = "point" + std::to_string(point_index + 1) + "_" + name;
+
+        if (phase >= 0 && phase < NUM_PHASES)
+            fieldName += "_" + std::string(phaseNames[phase]);
+
+        return fieldName;
     }
 
-    static void LoadTestResults()
+    static void SaveTestResults(
+        const std::string &serial, const TestResults &testResults, const TestParams &testParams)
     {
+        RESULTS_STORE::ResultRecord record = {"short_test", serial, 0, {}};
+
+        record.fields.push_back({"passed", testResults.passed});
+
+        for (int point_index = 0; point_index < NUM_TEST_POINTS; ++point_index)
+        {
+            const ResultsAtPoint &resultsAtPoint = testResults.resultsAtPoint[point_index];
+
+            record.fields.push_back({FieldName(point_index, "setPoint"), testParams.setPointRMSCurrent[point_index]});
+            record.fields.push_back({FieldName(point_index, "idealCurrent"), resultsAtPoint.idealCurrent_AmpsRMS});
+            record.fields.push_back({FieldName(point_index, "outputCurrent"), resultsAtPoint.outputCurrent_AmpsRMS});
+            record.fields.push_back({FieldName(point_index, "upperLimit"), resultsAtPoint.upperLimit_AmpsRMS});
+            record.fields.push_back({FieldName(point_index, "lowerLimit"), resultsAtPoint.lowerLimit_AmpsRMS});
+            record.fields.push_back({FieldName(point_index, "pointPassed"), resultsAtPoint.pointPassed});
+
+            for (int phase = 0; phase < NUM_PHASES; ++phase)
+            {
+                record.fields.push_back({FieldName(point_index, "tripUnitCurrent", phase), resultsAtPoint.tripUnitCurrent_AmpsRMS[phase]});
+                record.fields.push_back({FieldName(point_index, "percentError", phase), resultsAtPoint.percentError[phase]});
+                record.fields.push_back({FieldName(point_index, "passed", phase), resultsAtPoint.passed[phase]});
+            }
+        }
+
+        if (!RESULTS_STORE::Results().Append(record))
+            PrintToScreen("Error saving short test results");
     }
 
     static void PrintTestResults(
@@ -291,8 +327,12 @@ namespace PRODUCTION_SHORT_TEST_RC
             return;
         }
 
-        scr_printf("waiting 2 seconds for trip unit to reboot...");
-        Sleep(2000);
+        scr_printf("waiting for trip unit to reboot...");
+        if (!WaitForTripUnitReady(hTripUnit))
+        {
+            scr_printf("trip unit did not come back after setting it up; aborting short tests");
+            return;
+        }
 
         PrintToScreen("Clearing trip history....");
 
@@ -333,6 +373,7 @@ namespace PRODUCTION_SHORT_TEST_RC
         CheckForTrip(hTripUnit, testResults);
 
         PrintTestResults(testResults, testParams);
+        SaveTestResults(TripUnitSerialNumber(hTripUnit), testResults, testParams);
 
         PrintToScreen("Short Tests completed in " +
                       std::to_string(NumSecondsElapsed(StartTime)) + " seconds");
@@ -0,0 +1,284 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "soft_test_set.hpp"
+#include "../trip4.hpp"
+#include "../util/comm.hpp"
+#include "../util/screen.hpp"
+#include "../util/serial_rx.hpp"
+
+namespace SOFT_TEST_SET
+{
+    // how often we ask for results; same idea as ARDUINO::NextPollMS(): a quarter of the
+    // way to when we think it trips, but never more often than MIN or less than MAX
+    constexpr uint32_t MIN_POLL_MS = 50;
+    constexpr uint32_t MAX_POLL_MS = 2000;
+    constexpr uint32_t POLL_DIVISOR = 4;
+
+    double CountsPerAmp(int CTRating)
+    {
+        if (CTRating <= 0)
+            return 0;
+
+        return WAVEFORM::A2D_FULL_SCALE / (FULL_SCALE_CT_MULTIPLE * CTRating * std::sqrt(2.0));
+    }
+
+    double CycleRMS(const int32_t A2D[_SAMPLES_PER_CYCLE])
+    {
+        double sum = 0;
+
+        for (int i = 0; i < _SAMPLES_PER_CYCLE; i++)
+            sum += (double)A2D[i] * A2D[i];
+
+        return std::sqrt(sum / _SAMPLES_PER_CYCLE);
+    }
+
+    Injection ThreePhase(float ampsRMS, uint32_t expectedMS)
+    {
+        return {{WAVEFORM::Sine(ampsRMS, 0), WAVEFORM::Sine(ampsRMS, -120), WAVEFORM::Sine(ampsRMS, 120), WAVEFORM::Sine(0, 0)}, expectedMS, 0};
+    }
+
+    Injection GroundFault(float ampsRMS, uint32_t expectedMS)
+    {
+        return {{WAVEFORM::Sine(ampsRMS, 0), WAVEFORM::Sine(0, 0), WAVEFORM::Sine(0, 0), WAVEFORM::Sine(0, 0)}, expectedMS, 0};
+    }
+
+    bool SetAmpsWaveform(HANDLE hTripUnit, int phase, const int32_t A2D[_SAMPLES_PER_CYCLE])
+    {
+        _ASSERT(hTripUnit != INVALID_HANDLE_VALUE);
+
+        MsgSetTestSetAmps4 cmd = {0};
+        URCMessageUnion rsp = {0};
+
+        cmd.Hdr.Type = MSG_SET_TESTSET_AMPS_4;
+        cmd.Hdr.Version = PROTOCOL_VERSION;
+        cmd.Hdr.Length = sizeof(MsgSetTestSetAmps4) - sizeof(MsgHdr);
+        cmd.Hdr.Seq = SequenceNumber(hTripUnit);
+        cmd.Hdr.Dst = ADDR_TRIP_UNIT;
+        cmd.Hdr.Src = ADDR_CAL_APP;
+
+        cmd.Type = 1; // foreground
+        cmd.Phase = phase;
+        memcpy(cmd.A2D, A2D, sizeof(cmd.A2D));
+
+        cmd.Hdr.ChkSum = CalcChecksum((uint8_t *)&cmd, sizeof(cmd));
+
+        bool retval = WriteToCommPort(hTripUnit, (uint8_t *)&cmd, sizeof(cmd)) &&
+                      GetURCResponse(hTripUnit, &rsp) && MessageIsACK(&rsp);
+
+        if (!retval)
+            PrintToScreen("error sending MSG_SET_TESTSET_AMPS_4 for phase " + std::to_string(phase));
+
+        return retval;
+    }
+
+    bool StartSimulation(HANDLE hTripUnit, const SoftTestSetSimulation4 &setup)
+    {
+        _ASSERT(hTripUnit != INVALID_HANDLE_VALUE);
+
+        MsgExeTestSet4 cmd = {0};
+        URCMessageUnion rsp = {0};
+
+        cmd.Hdr.Type = MSG_EXE_TESTSET_SETUP_4;
+        cmd.Hdr.Version = PROTOCOL_VERSION;
+        cmd.Hdr.Length = sizeof(MsgExeTestSet4) - sizeof(MsgHdr);
+        cmd.Hdr.Seq = SequenceNumber(hTripUnit);
+        cmd.Hdr.Dst = ADDR_TRIP_UNIT;
+        cmd.Hdr.Src = ADDR_CAL_APP;
+
+        cmd.Setup = setup;
+
+        cmd.Hdr.ChkSum = CalcChecksum((uint8_t *)&cmd, sizeof(cmd));
+
+        bool retval = WriteToCommPort(hTripUnit, (uint8_t *)&cmd, sizeof(cmd)) &&
+                      GetURCResponse(hTripUnit, &rsp) && MessageIsACK(&rsp);
+
+        if (!retval)
+            PrintToScreen("error sending MSG_EXE_TESTSET_SETUP_4");
+
+        return retval;
+    }
+
+    bool GetResults(HANDLE hTripUnit, SoftTestSetResults4 *results, bool *stillRunning)
+    {
+        _ASSERT(hTripUnit != INVALID_HANDLE_VALUE);
+
+        MsgGetRsp4 cmd = {0};
+        URCMessageUnion rsp = {0};
+
+        *stillRunning = false;
+
+        cmd.Hdr.Type = MSG_GET_RESPONSE_4;
+        cmd.Hdr.Version = PROTOCOL_VERSION;
+        cmd.Hdr.Length = sizeof(MsgGetRsp4) - sizeof(MsgHdr);
+        cmd.Hdr.Seq = SequenceNumber(hTripUnit);
+        cmd.Hdr.Dst = ADDR_TRIP_UNIT;
+        cmd.Hdr.Src = ADDR_CAL_APP;
+
+        cmd.Response = MSG_RSP_TESTSET_RESULTS_4;
+
+        cmd.Hdr.ChkSum = CalcChecksum((uint8_t *)&cmd, sizeof(cmd));
+
+        if (!(WriteToCommPort(hTripUnit, (uint8_t *)&cmd, sizeof(cmd)) && GetURCResponse(hTripUnit, &rsp)))
+        {
+            PrintToScreen("no answer to MSG_GET_RESPONSE_4");
+            return false;
+        }
+
+        // trip unit NAKs us while the simulation is still going
+        if (rsp.msgHdr.Type == MSG_NAK)
+        {
+            *stillRunning = true;
+            return false;
+        }
+
+        if (!VerifyMessageIsOK(&rsp, MSG_RSP_TESTSET_RESULTS_4, sizeof(MsgRspTestSetResults4) - sizeof(MsgHdr)))
+        {
+            PrintToScreen("error receiving MSG_RSP_TESTSET_RESULTS_4");
+            return false;
+        }
+
+        *results = rsp.msgRspTestSetResults4.Results;
+        return true;
+    }
+
+    static uint64_t NextPollMS(uint64_t nowMS, uint64_t tripMS)
+    {
+        uint64_t untilTripMS = (tripMS > nowMS) ? tripMS - nowMS : nowMS - tripMS;
+
+        return nowMS + std::clamp<uint64_t>(untilTripMS / POLL_DIVISOR, MIN_POLL_MS, MAX_POLL_MS);
+    }
+
+    bool RunTest(HANDLE hTripUnit, const Injection &injection, SoftTestSetResults4 *results, TestSetStats *stats)
+    {
+        _ASSERT(hTripUnit != INVALID_HANDLE_VALUE);
+
+        TestSetStats localStats;
+        URCMessageUnion sysRsp;
+        URCMessageUnion devRsp;
+
+        if (!stats)
+            stats = &localStats;
+
+        *stats = {0};
+
+        // the A2D scale depends on the CT, and the cycle count on the frequency
+        if (!GetSystemAndDeviceSettings(hTripUnit, &sysRsp, &devRsp))
+            return false;
+
+        int CTRating = sysRsp.msgRspSysSet4.Settings.CTRating;
+        int frequency = sysRsp.msgRspSysSet4.Settings.Frequency;
+
+        double countsPerAmp = CountsPerAmp(CTRating);
+
+        if (countsPerAmp == 0 || frequency == 0)
+        {
+            PrintToScreen("trip unit reports CT rating " + std::to_string(CTRating) + ", " + std::to_string(frequency) + " Hz; cannot run soft test set");
+            return false;
+        }
+
+        SoftTestSetSimulation4 setup = {0};
+
+        uint32_t timeoutMS = injection.timeoutMS ? injection.timeoutMS : injection.expectedMS * 2 + 1000;
+        uint32_t cycles = (std::min)(timeoutMS * (uint64_t)frequency / 1000 + 1, (uint64_t)0xFFFE);
+
+        setup.cycleNumberMax = 0xFFFF; // (we stop long before it wraps)
+        setup.cycleNumberTimeOut = cycles;
+
+        for (int phase = 0; phase < _NUM_PHASES_ABCN; phase++)
+        {
+            int32_t A2D[_SAMPLES_PER_CYCLE];
+
+            // (a sweep keeps asking for the same few cycles)
+            if (!WAVEFORM::Cache().Get(injection.waves[phase], countsPerAmp, A2D))
+            {
+                PrintToScreen("cannot make a waveform for phase " + std::to_string(phase));
+                return false;
+            }
+
+            if (!SetAmpsWaveform(hTripUnit, phase, A2D))
+                return false;
+
+            // inputsA2D: a bit per input, amps A, B, C, N first
+            setup.inputsA2D |= 1 << phase;
+
+            // one more cycle once the actuator fires, then stop
+            setup.ampsOFF[phase] = _SAMPLES_PER_CYCLE;
+            setup.foregroundAmpsTiming[phase].cycleON = 0;
+            setup.foregroundAmpsTiming[phase].cycleOFF = cycles;
+        }
+
+        if (!StartSimulation(hTripUnit, setup))
+            return false;
+
+        uint64_t startMS = SERIAL_RX::NowMS();
+        uint64_t tripMS = startMS + injection.expectedMS;
+        uint64_t deadlineMS = startMS + timeoutMS + RESULTS_MARGIN_MS;
+
+        while (true)
+        {
+            uint64_t nowMS = SERIAL_RX::NowMS();
+            uint64_t pollMS = (std::min)(NextPollMS(nowMS, tripMS), deadlineMS);
+
+            Sleep((DWORD)(pollMS - nowMS));
+
+            bool stillRunning;
+
+            stats->polls++;
+
+            if (GetResults(hTripUnit, results, &stillRunning))
+                break;
+
+            if (!stillRunning)
+                return false;
+
+            stats->naks++;
+
+            if (SERIAL_RX::NowMS() >= deadlineMS)
+            {
+                PrintToScreen("soft test set still running after " + std::to_string(timeoutMS + RESULTS_MARGIN_MS) + " ms; giving up");
+                return false;
+            }
+        }
+
+        stats->elapsedMS = SERIAL_RX::NowMS() - startMS;
+
+        return true;
+    }
+
+    uint32_t MeasuredAmps(const SoftTestSetResults4 &results, bool groundFault)
+    {
+        if (groundFault)
+            return results.calcIgf;
+
+        uint32_t amps = 0;
+
+        for (const PerPhase4 &phase : results.phase)
+            amps = (std::max)(amps, phase.CalcI);
+
+        return amps;
+    }
+
+    bool ResultsCount()
+    {
+        if (!FULL_SCALE_CONFIRMED)
+            PrintToScreen("soft test set trip tests are experimental (the A2D scaling isn't checked against the firmware); results not saved");
+
+        return FULL_SCALE_CONFIRMED;
+    }
+}
@@ -0,0 +1,100 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+
+#pragma once
+
+#include <cstdint>
+
+#include "waveform.hpp"
+#include "../util/urc_protocol.hpp"
+
+// trip tests with no Rigol, no Keithley and no Arduino: the trip unit's own software test
+// set (V4.01+) plays one cycle of A2D samples per phase over and over, as if it came off
+// the CTs, and afterwards tells us how long it took to trip, and what kind of trip it was
+//
+//	-	MSG_SET_TESTSET_AMPS_4 loads the cycle for one phase (see waveform.hpp)
+//	-	MSG_EXE_TESTSET_SETUP_4 says which phases to play, and for how many cycles
+//	-	MSG_GET_RESPONSE_4 (asking for MSG_RSP_TESTSET_RESULTS_4) gets the results; the
+//		trip unit NAKs it until the simulation is over
+//
+// we don't have the firmware's A2D scaling, so the amps we ask for are only roughly what
+// the unit sees; the unit tells us what it actually measured (SoftTestSetResults4
+// phase[].CalcI, calcIgf), and the expected trip time should be worked out from that
+//
+// pickupUntilTripTIMEms is only 16 bits, so anything that takes longer than 65.5 seconds
+// to trip can't be timed this way
+//
+// nothing here talks to anything but the trip unit, so any number of units can be tested
+// at once, a thread each
+
+namespace SOFT_TEST_SET
+{
+    // where full scale is, in peak amps per CT rating; a guess, but it leaves room for INST
+    //
+    // NOT checked against the firmware: the only thing these counts (and the CalcI that
+    // comes back) have been tried on is TRIP_UNIT_SIM, which was written to the same
+    // guess. before soft test set results count for anything, capture a
+    // MSG_SET_TESTSET_AMPS_4 ... MSG_RSP_TESTSET_RESULTS_4 exchange with a real unit (or
+    // get the A2D scaling out of the firmware source) and fix this to match
+    constexpr int FULL_SCALE_CT_MULTIPLE = 12;
+
+    // ... and then set this. until then soft test set trip tests are experimental: they run
+    // and print their results, but nothing goes in the results store
+    constexpr bool FULL_SCALE_CONFIRMED = false;
+
+    // how long past the simulation's own timeout we keep asking for results
+    constexpr uint32_t RESULTS_MARGIN_MS = 2000;
+
+    // longest trip pickupUntilTripTIMEms can tell us about
+    constexpr uint32_t MAX_TRIP_MS = 0xFFFF;
+
+    typedef struct _Injection
+    {
+        WAVEFORM::WaveSpec waves[_NUM_PHASES_ABCN]; // A, B, C, N
+        uint32_t expectedMS; // when we think it trips (only used to decide when to ask)
+        uint32_t timeoutMS;	 // the unit gives up (timedOut) after this; 0 = twice expectedMS, plus a second
+    } Injection;
+
+    typedef struct _TestSetStats
+    {
+        int polls;			// MSG_GET_RESPONSE_4s sent
+        int naks;			// ... that came back "not done yet"
+        uint64_t elapsedMS; // MSG_EXE_TESTSET_SETUP_4 until we had the results
+    } TestSetStats;
+
+    double CountsPerAmp(int CTRating);
+
+    double CycleRMS(const int32_t A2D[_SAMPLES_PER_CYCLE]);
+
+    // balanced three phase (LT, ST, INST)
+    Injection ThreePhase(float ampsRMS, uint32_t expectedMS);
+
+    // all of it on phase A, with nothing coming back on neutral (GF)
+    Injection GroundFault(float ampsRMS, uint32_t expectedMS);
+
+    bool SetAmpsWaveform(HANDLE hTripUnit, int phase, const int32_t A2D[_SAMPLES_PER_CYCLE]);
+    bool StartSimulation(HANDLE hTripUnit, const SoftTestSetSimulation4 &setup);
+
+    // returns false if there are no results yet; *stillRunning tells a NAK from no answer
+    bool GetResults(HANDLE hTripUnit, SoftTestSetResults4 *results, bool *stillRunning);
+
+    // waveforms, setup, and wait for the results; true if we got them (tripped or not)
+    bool RunTest(HANDLE hTripUnit, const Injection &injection, SoftTestSetResults4 *results, TestSetStats *stats = nullptr);
+
+    // the largest phase current the unit saw; or the ground fault current
+    uint32_t MeasuredAmps(const SoftTestSetResults4 &results, bool groundFault);
+
+    // can a run's results go in the results store? (see FULL_SCALE_CONFIRMED); says so if not
+    bool ResultsCount();
+}
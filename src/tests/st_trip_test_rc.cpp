@@ -12,12 +12,13 @@
  *******************************************************************************/
 
 #include <windows.h>
-#include <chrono>
+#include <cmath>
 
 #include "..\autocal_rc.hpp"
 #include "..\util\settings.hpp"
 #include "..\devices\arduino.hpp"
 #include "st_trip_test_rc.hpp"
+#include "soft_test_set.hpp"
 
 extern bool ArduinoAbortTimingTest;
 
@@ -53,21 +54,6 @@ namespace ST_TRIP_TEST_RC
         return SetSystemAndDeviceSettings(hTripUnit, funcptr);
     }
 
-    int TimeTimeToTripMS(int ST_Pickup_AmpsRMS, float ST_Delay_Seconds, bool I2TEnabled, int LT_Pickup_AmpsRMS, int AppliedCurrentAmpsRMS)
-    {
-
-        if (!I2TEnabled || (AppliedCurrentAmpsRMS > 10 * LT_PICKUP_AMPS))
-            return ST_Delay_Seconds * 1000;
-
-        // ST_Delay_Seconds has to be: .07, .10, .15, .20, .30, .40
-        int STTimeBandConstant = ST_Delay_Seconds * 100;
-        float X = (float)AppliedCurrentAmpsRMS / LT_Pickup_AmpsRMS;
-        float second = STTimeBandConstant / (X * X);
-
-        // convert to ms
-        return second * 1000;
-    }
-
     // returns true if all tests were successfully run
     static bool CheckTripTime_Internal(
         HANDLE hTripUnit, HANDLE hKeithley, HANDLE hArduino,
@@ -76,9 +62,6 @@ namespace ST_TRIP_TEST_RC
     {
         int SensitivityAmpsPerVolt = 3800;
 
-        // (MsgRspTimingTestResults is not in URCMessageUnion)
-        ARDUINO::MsgRspTimingTestResults *msgRspTimingTestResults;
-
         URCMessageUnion rsp = {0};
         bool retval;
 
@@ -99,16 +82,13 @@ namespace ST_TRIP_TEST_RC
 
         int TestPoint = 1;
 
+        // the trip unit's thermal memory gets TEST_PLAN::COOL_DOWN_MS between tests; setting
+        // up for the next one happens during it
+        uint64_t coolDownUntilMS = 0;
+
         for (auto testParam : params)
         {
-
-            if (TestPoint > 1)
-            {
-                PrintToScreen("delaying 30 seconds between tests ...");
-                Sleep(1000 * 30);
-            }
-
-            PrintToScreen("Running test point " + std::to_string(TestPoint++));
+            PrintToScreen("Running test point " + std::to_string(TestPoint++) + TEST_PLAN::FileLineNote(testParam.fileLine));
 
             if (!SetupTripUnit(hTripUnit, testParam))
             {
@@ -116,8 +96,12 @@ namespace ST_TRIP_TEST_RC
                 return false;
             }
 
-            PrintToScreen("waiting 2 seconds for trip unit to reboot after sending MSG_SET_USR_SETTINGS_4 ...");
-            Sleep(2000);
+            PrintToScreen("waiting for trip unit to reboot after sending MSG_SET_USR_SETTINGS_4 ...");
+            if (!WaitForTripUnitReady(hTripUnit))
+            {
+                PrintToScreen("Error waiting for trip unit to reboot");
+                return false;
+            }
 
             // clear the trip history
             if (!SendClearTripHistory(hTripUnit))
@@ -126,7 +110,18 @@ namespace ST_TRIP_TEST_RC
                 return false;
             }
 
-            // tell the Arduino to start timing
+            TEST_PLAN::WaitForCoolDown(coolDownUntilMS);
+
+            // the Rigol and the Keithley are ours for this test point; in between points
+            // (reboots, cool-downs) whoever needs them more gets them first
+            INSTRUMENT_BROKER::SourceAndMeter instruments =
+                INSTRUMENT_BROKER::Instruments().AcquireSourceAndMeter(INSTRUMENT_BROKER::RIGOL);
+
+            if (!instruments.Valid())
+                return false;
+
+            // tell the Arduino to start timing (once the Rigol is ours; not while we were
+            // still waiting in line for it)
             SendURCCommand(hArduino, ARDUINO::MSG_START_TIMING_TEST, ARDUINO::ADDR_AUTOCAL_ARDUINO, ADDR_CAL_APP);
             retval = GetURCResponse(hArduino, &rsp) && MessageIsACK(&rsp);
 
@@ -150,13 +145,23 @@ namespace ST_TRIP_TEST_RC
             PrintToScreen("Amps To Apply: " + FloatToString(testParam.AmpsRMSToApply, 2));
             PrintToScreen("Commanding Rigol to output " + std::to_string(RigolVoltage) + " volts RMS");
 
+            if (!instruments.Valid())
+                return false;
+
             RIGOL_DG1000Z::SetupToApplySINWave(false, std::to_string(RigolVoltage));
             RIGOL_DG1000Z::EnableOutput();
 
+            if (!instruments.Valid())
+                return false;
+
             double KeithleyReadingVoltsRMS = KEITHLEY::GetVoltageForAutoRange(hKeithley);
-            if (KeithleyReadingVoltsRMS == std::numeric_limits<double>::quiet_NaN())
+            if (std::isnan(KeithleyReadingVoltsRMS))
             {
                 PrintToScreen("Keithley voltage reading failed; aborted");
+
+                if (instruments.Valid())
+                    RIGOL_DG1000Z::DisableOutput();
+
                 return false;
             }
 
@@ -167,8 +172,6 @@ namespace ST_TRIP_TEST_RC
 
             ArduinoAbortTimingTest = false;
 
-            // just to prevent
-            msgRspTimingTestResults = nullptr;
 
             auto expectedTripTimeMS = TimeTimeToTripMS(
                 testParam.STPickupAMPS,
@@ -177,79 +180,55 @@ namespace ST_TRIP_TEST_RC
                 LT_PICKUP_AMPS,
                 CalculatedCurrentAmps);
 
-            // this timing is just so we can time out if the trip doesn't occur.
-            // so we can just start counting from this point, even though
-            // actually voltage has already been turned on a while ago.
-            auto start = std::chrono::high_resolution_clock::now();
-            auto elapsed = std::chrono::milliseconds(0);
-
-            // TODO:
-            // FIXME:
-            // use MSG_ARDUINO_GET_STATUS
-
-            while (!ArduinoAbortTimingTest)
-            {
-                Sleep(200);
-
-                auto now = std::chrono::high_resolution_clock::now();
-                elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - start);
-
-                // just let this loop run for up to 10 seconds...
-                // (the actual timing will be done by the Arduino)
-                if (elapsed.count() >= 1000 * 10)
-                {
-                    PrintToScreen("Timed out waiting for trip after " + std::to_string(elapsed.count()) + " ms");
-                    PrintToScreen("Expected trip time was " + std::to_string(expectedTripTimeMS) + " ms");
+            uint32_t TimeToWaitMS = 1000 * 10;
 
-                    RIGOL_DG1000Z::DisableOutput();
-                    return false;
-                }
+            // the timeout is just so we don't wait forever if the trip doesn't occur;
+            // we start counting from this point, even though the voltage has already
+            // been turned on a while ago. (the actual timing is done by the Arduino)
+            ARDUINO::TimingTestResults timingTestResults;
 
-                // send message to the arduino, asking for the timing test results
-                SendURCCommand(hArduino, ARDUINO::MSG_GET_TIMING_TEST_RESULTS, ARDUINO::ADDR_AUTOCAL_ARDUINO, ADDR_CAL_APP);
+            ARDUINO::TimingWaitResult waitResult = ARDUINO::WaitForTimingTestResults(
+                hArduino,
+                expectedTripTimeMS,
+                SERIAL_RX::DeadlineFromNow(TimeToWaitMS),
+                &ArduinoAbortTimingTest,
+                &timingTestResults);
 
-                // get MSG_RSP_TIMING_TEST_RESULTS
-                retval = GetURCResponse(hArduino, &rsp);
-
-                if (!retval)
-                {
-                    RIGOL_DG1000Z::DisableOutput();
-                    PrintToScreen("cannot get timing results from the Arduino");
-                    return false;
-                }
+            switch (waitResult)
+            {
+            case ARDUINO::TimingWaitResult::DONE:
+                break;
 
-                // arduino will NAK us if the test is still in progress...
-                if (MSG_NAK == rsp.msgHdr.Type)
-                    continue;
+            case ARDUINO::TimingWaitResult::TIMED_OUT:
+                PrintToScreen("Timed out waiting for trip after " + std::to_string(TimeToWaitMS) + " ms");
+                PrintToScreen("Expected trip time was " + std::to_string(expectedTripTimeMS) + " ms");
+                break;
 
-                retval = VerifyMessageIsOK(&rsp, ARDUINO::MSG_RSP_TIMING_TEST_RESULTS,
-                                           sizeof(ARDUINO::MsgRspTimingTestResults) - sizeof(MsgHdr));
+            case ARDUINO::TimingWaitResult::ABORTED:
+                PrintToScreen("Timing test aborted");
+                break;
 
-                if (!retval)
-                {
-                    RIGOL_DG1000Z::DisableOutput();
-                    PrintToScreen("cannot get timing results from the Arduino");
-                    return false;
-                }
-
-                // check to see if the timing tests are valid yet...
-                msgRspTimingTestResults = reinterpret_cast<ARDUINO::MsgRspTimingTestResults *>(&rsp);
-                if (msgRspTimingTestResults->timingTestResults.ResultsAreValid)
-                    break;
+            default:
+                PrintToScreen("cannot get timing results from the Arduino");
+                break;
             }
 
-            if (ArduinoAbortTimingTest)
-            {
-                PrintToScreen("Timing test aborted");
-                RIGOL_DG1000Z::DisableOutput();
+            // the Rigol goes off through our lease, tripped or not; if somebody else had it while
+            // we were waiting, it is theirs now (leave it alone), and the trip time is no good
+            if (!instruments.Valid())
                 return false;
-            }
 
             RIGOL_DG1000Z::DisableOutput();
+            instruments.Release();
+
+            if (waitResult != ARDUINO::TimingWaitResult::DONE)
+                return false;
 
             PrintToScreen("waiting 5 seconds after trip ...");
             Sleep(5000);
 
+            coolDownUntilMS = SERIAL_RX::DeadlineFromNow(TEST_PLAN::COOL_DOWN_MS);
+
             bool tripTypeIsAsExpected;
 
             // we might have gotten multiple short time trips
@@ -270,11 +249,145 @@ namespace ST_TRIP_TEST_RC
             r.testRan = true;
             r.CalculatedCurrentAmps = CalculatedCurrentAmps;
             r.expectedTimeToTripMS = expectedTripTimeMS;
-            r.measuredTimeToTripMS = msgRspTimingTestResults->timingTestResults.elapsedTime;
+            r.measuredTimeToTripMS = timingTestResults.elapsedTime;
             r.errorPercent =
                 PercentDifference(
                     r.expectedTimeToTripMS,
-                    msgRspTimingTestResults->timingTestResults.elapsedTime);
+                    timingTestResults.elapsedTime);
+
+            results.push_back(r);
+        }
+
+        // we return true if all the tests were ran and completed
+        bool allTestRan = params.size() == results.size();
+        if (allTestRan)
+            for (const auto &r : results)
+                allTestRan &= r.testRan;
+
+        return allTestRan;
+    }
+
+    // results store fields for a point, as for LT; no limit on the error here either
+    static std::vector<std::pair<std::string, double>> PointFields(const testParams &param, const testResults &result, bool & /* passed */)
+    {
+        return {
+            {"STPickupAMPS", param.STPickupAMPS},
+            {"ST_Delay_Seconds", param.ST_Delay_Seconds},
+            {"I2TEnabled", param.I2TEnabled},
+            {"expectedTimeToTripMS", result.expectedTimeToTripMS},
+            {"errorPercent", result.errorPercent},
+        };
+    }
+
+    // the same test points, through the trip unit's own software test set instead of the
+    // Rigol, Keithley and Arduino (see soft_test_set.hpp)
+    static bool CheckTripTime_SoftTestSet_Internal(
+        HANDLE hTripUnit,
+        const std::vector<testParams> &params,
+        std::vector<testResults> &results)
+    {
+        int TestPoint = 1;
+
+        // the soft test set heats up the thermal memory the same as real current does, so
+        // the same cool-down as CheckTripTime_Internal()
+        uint64_t coolDownUntilMS = 0;
+
+        for (auto testParam : params)
+        {
+
+            if (TestPoint > 1)
+            {
+                PrintToScreen("waiting for trip unit to reboot after last trip ...");
+                WaitForTripUnitReady(hTripUnit);
+            }
+
+            PrintToScreen("Running test point " + std::to_string(TestPoint++) + TEST_PLAN::FileLineNote(testParam.fileLine) + " (soft test set)");
+
+            if (!SetupTripUnit(hTripUnit, testParam))
+            {
+                PrintToScreen("Error setting up trip unit");
+                return false;
+            }
+
+            PrintToScreen("waiting for trip unit to reboot after sending MSG_SET_USR_SETTINGS_4 ...");
+            if (!WaitForTripUnitReady(hTripUnit))
+            {
+                PrintToScreen("Error waiting for trip unit to reboot");
+                return false;
+            }
+
+            // clear the trip history
+            if (!SendClearTripHistory(hTripUnit))
+            {
+                PrintToScreen("Error clearing trip history on trip unit");
+                return false;
+            }
+
+            TEST_PLAN::WaitForCoolDown(coolDownUntilMS);
+
+            PrintToScreen("Using Hard-coded value LT_PICKUP_AMPS: " + FloatToString(LT_PICKUP_AMPS, 2));
+            PrintToScreen("STPickupAMPS: " + std::to_string(testParam.STPickupAMPS));
+            PrintToScreen("ST_Delay_Seconds: " + FloatToString(testParam.ST_Delay_Seconds, 2));
+            PrintToScreen("Amps To Simulate: " + FloatToString(testParam.AmpsRMSToApply, 2));
+
+            // (from what we asked for; only used to decide how often to ask for results)
+            auto guessTripTimeMS = TimeTimeToTripMS(
+                testParam.STPickupAMPS,
+                testParam.ST_Delay_Seconds,
+                testParam.I2TEnabled,
+                LT_PICKUP_AMPS,
+                testParam.AmpsRMSToApply);
+
+            if (guessTripTimeMS > SOFT_TEST_SET::MAX_TRIP_MS)
+            {
+                PrintToScreen("expected trip time of " + std::to_string(guessTripTimeMS) + " ms is too long for the soft test set; skipped");
+                results.push_back({false});
+                continue;
+            }
+
+            SoftTestSetResults4 softResults;
+
+            if (!SOFT_TEST_SET::RunTest(hTripUnit, SOFT_TEST_SET::ThreePhase(testParam.AmpsRMSToApply, guessTripTimeMS), &softResults))
+            {
+                PrintToScreen("cannot get soft test set results from the trip unit");
+                return false;
+            }
+
+            if (!softResults.tripped)
+            {
+                PrintToScreen("trip unit did not trip before the soft test set timed out");
+                return false;
+            }
+
+            coolDownUntilMS = SERIAL_RX::DeadlineFromNow(TEST_PLAN::COOL_DOWN_MS);
+
+            // same as CheckForCorrectTrip() failing on the hardware path
+            if (softResults.tripType != _TRIP_TYPE_ST)
+            {
+                PrintToScreen("unexpected trip type: " + std::to_string(softResults.tripType));
+                return false;
+            }
+
+            // what the trip unit says it saw is what the trip time has to be right for
+            int CalculatedCurrentAmps = SOFT_TEST_SET::MeasuredAmps(softResults, false);
+
+            auto expectedTripTimeMS = TimeTimeToTripMS(
+                testParam.STPickupAMPS,
+                testParam.ST_Delay_Seconds,
+                testParam.I2TEnabled,
+                LT_PICKUP_AMPS,
+                CalculatedCurrentAmps);
+
+            testResults r;
+
+            r.testRan = true;
+            r.CalculatedCurrentAmps = CalculatedCurrentAmps;
+            r.expectedTimeToTripMS = expectedTripTimeMS;
+            r.measuredTimeToTripMS = softResults.pickupUntilTripTIMEms;
+            r.errorPercent =
+                PercentDifference(
+                    r.expectedTimeToTripMS,
+                    r.measuredTimeToTripMS);
 
             results.push_back(r);
         }
@@ -296,10 +409,36 @@ namespace ST_TRIP_TEST_RC
         _ASSERT(hKeithley != INVALID_HANDLE_VALUE);
         _ASSERT(hArduino != INVALID_HANDLE_VALUE);
 
-        bool retval = CheckTripTime_Internal(hTripUnit, hKeithley, hArduino, params, results);
+        bool retval;
+
+        {
+            SCPI_SHADOW::RunStats shadowStats;
 
-        // extral level of protection, to guarantee that the rigol is not left on
-        RIGOL_DG1000Z::DisableOutput();
+            retval = CheckTripTime_Internal(hTripUnit, hKeithley, hArduino, params, results);
+
+            // extral level of protection, to guarantee that the rigol is not left on; through a
+            // lease like everything else, so only if nobody else has it (then it is theirs)
+            INSTRUMENT_BROKER::Lease rigol = INSTRUMENT_BROKER::Instruments().AcquireIfIdle(INSTRUMENT_BROKER::RIGOL);
+
+            if (rigol.Valid())
+                RIGOL_DG1000Z::DisableOutput();
+        }
+
+        RESULTS_STORE::AppendTripPoints("st_trip", TripUnitSerialNumber(hTripUnit), params, results, PointFields);
+
+        return retval;
+    }
+
+    bool CheckTripTime_SoftTestSet(
+        HANDLE hTripUnit,
+        const std::vector<testParams> &params, std::vector<testResults> &results)
+    {
+        _ASSERT(hTripUnit != INVALID_HANDLE_VALUE);
+
+        bool retval = CheckTripTime_SoftTestSet_Internal(hTripUnit, params, results);
+
+        if (SOFT_TEST_SET::ResultsCount())
+            RESULTS_STORE::AppendTripPoints("st_trip_soft", TripUnitSerialNumber(hTripUnit), params, results, PointFields);
 
         return retval;
     }
@@ -326,7 +465,7 @@ namespace ST_TRIP_TEST_RC
             const auto &result = results[i];
 
             PrintToScreen("--------------------------------------------------------------");
-            PrintToScreen(Tab(0) + "Test " + std::to_string(i + 1) + ":");
+            PrintToScreen(Tab(0) + "Test " + std::to_string(i + 1) + TEST_PLAN::FileLineNote(param.fileLine) + ":");
             PrintToScreen("--------------------------------------------------------------");
             PrintToScreen(Tab(1) + "Parameters:");
             PrintToScreen(Tab(2) + Dots(35, "STPickupAMPS") + std::to_string(param.STPickupAMPS));
@@ -348,6 +487,12 @@ namespace ST_TRIP_TEST_RC
         }
     }
 
+    TEST_PLAN::Plan PlanTests(std::vector<testParams> &params, bool softTestSet)
+    {
+        return TEST_PLAN::PlanTests(params, TEST_PLAN::TestKind::ST, softTestSet, [](int i, const testParams &p)
+                                    { return TEST_PLAN::STPoint(i, p.STPickupAMPS, p.ST_Delay_Seconds, p.I2TEnabled, LT_PICKUP_AMPS, p.AmpsRMSToApply); });
+    }
+
     // reads in a file like this:
     //  415, 3.5, 1, 2250
     //  625, 24.0, 0, 2250
@@ -363,8 +508,12 @@ namespace ST_TRIP_TEST_RC
         }
 
         std::string line;
+        int lineNumber = 0;
+
         while (std::getline(file, line))
         {
+            lineNumber++;
+
             std::istringstream iss(line);
             std::string token;
             testParams p;
@@ -396,6 +545,7 @@ namespace ST_TRIP_TEST_RC
             p.AmpsRMSToApply = std::stof(token);
 
             // Add the parsed parameters to the vector
+            p.fileLine = lineNumber;
             params.push_back(p);
         }
 
@@ -16,6 +16,9 @@
 #include <windows.h>
 #include <vector>
 
+#include "trip_time_rc.hpp"
+#include "test_plan.hpp"
+
 namespace ST_TRIP_TEST_RC
 {
     struct testParams
@@ -24,6 +27,7 @@ namespace ST_TRIP_TEST_RC
         float ST_Delay_Seconds;
         bool I2TEnabled;
         float AmpsRMSToApply;
+        int fileLine; // where ReadTestFile() found it; 0 if it didn't come from a file
     };
 
     struct testResults
@@ -39,12 +43,19 @@ namespace ST_TRIP_TEST_RC
         HANDLE hTripUnit, HANDLE hKeithley, HANDLE hArduino,
         const std::vector<testParams> &params, std::vector<testResults> &results);
 
+    // same as above, with no Rigol, Keithley or Arduino; see soft_test_set.hpp
+    bool CheckTripTime_SoftTestSet(
+        HANDLE hTripUnit,
+        const std::vector<testParams> &params, std::vector<testResults> &results);
+
     void PrintResults(
         const std::vector<testParams> &params,
         const std::vector<testResults> &results);
 
     bool ReadTestFile(std::string scriptFile, std::vector<testParams> &params);
 
-    int TimeTimeToTripMS(int ST_Pickup_AmpsRMS, float ST_Delay_Seconds, bool I2TEnabled, int LT_Pickup_AmpsRMS, int AppliedCurrentAmpsRMS);
+    // puts params (as read by ReadTestFile()) into the order TEST_PLAN says to run them
+    // in, and prints the plan
+    TEST_PLAN::Plan PlanTests(std::vector<testParams> &params, bool softTestSet);
 
 }
\ No newline at end of file
@@ -0,0 +1,271 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <map>
+
+#include "test_plan.hpp"
+#include "trip_time_rc.hpp"
+#include "../util/screen.hpp"
+#include "../util/serial_rx.hpp"
+
+namespace TEST_PLAN
+{
+    // the soft test set's INST / QT INST time doesn't depend on anything we set; the
+    // test files don't say what frequency the unit runs at, so call it 60hz
+    constexpr int PLAN_FREQUENCY = 60;
+
+    PlanCosts DefaultCosts(TestKind kind, bool softTestSet)
+    {
+        PlanCosts costs;
+
+        // write, 2 second reboot, and WaitForTripUnitReady() noticing
+        costs.settingsMS = 3000;
+
+        // clear history
+        costs.beforeCoolDownMS = 250;
+
+        if (softTestSet)
+        {
+            // waveforms, setup and the last MSG_GET_RESPONSE_4; no wait after the trip
+            costs.afterCoolDownMS = 500;
+            costs.afterTripMS = 0;
+        }
+        else
+        {
+            // Arduino, Rigol, and the Keithley reading
+            costs.afterCoolDownMS = 3750;
+            costs.afterTripMS = 5000;
+        }
+
+        // the thermal memory doesn't care where the current came from
+        costs.coolDownMS = (kind == TestKind::ST || kind == TestKind::INST) ? COOL_DOWN_MS : 0;
+
+        // SetupQuickTrip() waits 5 seconds, every point; before the cool-down wait
+        if (kind == TestKind::INST)
+            costs.beforeCoolDownMS += 5000;
+
+        return costs;
+    }
+
+    static std::string Format(const char *format, ...)
+    {
+        char buffer[128];
+        va_list args;
+
+        va_start(args, format);
+        vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+
+        return buffer;
+    }
+
+    // (0 if the setting doesn't exist; TRIP_CURVE will have said why)
+    static uint32_t ExpectedMS(const TRIP_CURVE::CurveSetting &setting, float amps)
+    {
+        TRIP_CURVE::Curve curve;
+
+        if (!TRIP_CURVE::Compile(setting, &curve))
+            return 0;
+
+        uint32_t ms = TRIP_CURVE::TimeMS(curve, amps);
+        return (ms == TRIP_CURVE::NO_TRIP) ? 0 : ms;
+    }
+
+    PlanPoint LTPoint(int index, int LTPickupAmps, float LTDelaySeconds, float amps)
+    {
+        TRIP_CURVE::CurveSetting setting = {TRIP_CURVE::Element::LT};
+
+        setting.pickupAmps = LTPickupAmps;
+        setting.delay = (int)std::lround(LTDelaySeconds * 10);
+
+        return {index, Format("LT %dA %.1fs", LTPickupAmps, LTDelaySeconds), ExpectedMS(setting, amps)};
+    }
+
+    PlanPoint STPoint(int index, int STPickupAmps, float STDelaySeconds, bool I2TEnabled, int LTPickupAmps, float amps)
+    {
+        TRIP_CURVE::CurveSetting setting = {TRIP_CURVE::Element::ST};
+
+        setting.pickupAmps = STPickupAmps;
+        setting.delay = (int)std::lround(STDelaySeconds * 100);
+        setting.slope = I2TEnabled ? 1 : 0;
+        setting.LTPickupAmps = LTPickupAmps;
+
+        return {index, Format("ST %dA %.2fs%s", STPickupAmps, STDelaySeconds, I2TEnabled ? " I2T" : ""), ExpectedMS(setting, amps)};
+    }
+
+    PlanPoint INSTPoint(int index, int instPickup, int QTInstPickup, bool QTEnabled, float amps)
+    {
+        TRIP_CURVE::CurveSetting setting = {QTEnabled ? TRIP_CURVE::Element::QT_INST : TRIP_CURVE::Element::INST};
+
+        setting.pickupAmps = QTEnabled ? QTInstPickup : instPickup;
+        setting.frequency = PLAN_FREQUENCY;
+
+        return {index, Format("INST %dA QT %dA %s", instPickup, QTInstPickup, QTEnabled ? "on" : "off"), ExpectedMS(setting, amps)};
+    }
+
+    PlanPoint GFPoint(int index, int CTRating, int GFType, int GFPickup, float GFDelaySeconds, int GFSlope, float amps)
+    {
+        TRIP_CURVE::CurveSetting setting = {TRIP_CURVE::Element::GF};
+
+        setting.pickupAmps = GFPickup;
+        setting.delay = (int)std::lround(GFDelaySeconds * 100);
+        setting.slope = GFSlope;
+        setting.CTRating = CTRating;
+
+        return {index, Format("GF CT %dA type %d %dA %.2fs slope %d", CTRating, GFType, GFPickup, GFDelaySeconds, GFSlope), ExpectedMS(setting, amps)};
+    }
+
+    uint32_t PredictMS(const std::vector<PlanPoint> &points, const PlanCosts &costs, std::vector<PlanStep> *steps)
+    {
+        uint32_t nowMS = 0;
+        const std::string *settings = nullptr; // what the trip unit is set to; we don't know, to start with
+
+        if (steps)
+            steps->clear();
+
+        for (size_t i = 0; i < points.size(); i++)
+        {
+            const PlanPoint &point = points[i];
+            PlanStep step = {point.index, point.line};
+
+            step.startMS = nowMS;
+            step.writeSettings = !settings || *settings != point.settings;
+            settings = &point.settings;
+
+            if (step.writeSettings)
+                nowMS += costs.settingsMS;
+
+            nowMS += costs.beforeCoolDownMS;
+
+            // current can't go on until the cool-down since the last point is over
+            if (i > 0)
+            {
+                uint32_t readyMS = step.startMS + costs.coolDownMS;
+
+                step.coolDownWaitMS = (readyMS > nowMS) ? readyMS - nowMS : 0;
+                nowMS += step.coolDownWaitMS;
+            }
+
+            nowMS += costs.afterCoolDownMS + point.expectedTripMS + costs.afterTripMS;
+            step.endMS = nowMS;
+
+            if (steps)
+                steps->push_back(step);
+        }
+
+        return nowMS;
+    }
+
+    static int SettingsWrites(const std::vector<PlanStep> &steps)
+    {
+        return (int)std::count_if(steps.begin(), steps.end(), [](const PlanStep &step)
+                                  { return step.writeSettings; });
+    }
+
+    Plan MakePlan(const std::vector<PlanPoint> &points, const PlanCosts &costs)
+    {
+        Plan plan;
+
+        // file order, for comparison
+        plan.fileOrderMS = PredictMS(points, costs, &plan.steps);
+        plan.fileOrderSettingsWrites = SettingsWrites(plan.steps);
+
+        // group by settings, groups in the order they first show up
+        std::map<std::string, int> groupOf;
+        std::vector<std::vector<PlanPoint>> groups;
+
+        for (const PlanPoint &point : points)
+        {
+            auto it = groupOf.find(point.settings);
+
+            if (it == groupOf.end())
+            {
+                it = groupOf.emplace(point.settings, (int)groups.size()).first;
+                groups.emplace_back();
+            }
+
+            groups[it->second].push_back(point);
+        }
+
+        std::vector<PlanPoint> ordered;
+
+        for (const std::vector<PlanPoint> &group : groups)
+            ordered.insert(ordered.end(), group.begin(), group.end());
+
+        std::vector<PlanStep> orderedSteps;
+        uint32_t orderedMS = PredictMS(ordered, costs, &orderedSteps);
+
+        // fewer writes, but no faster (they were hidden by the cool-down); leave the file's
+        // order alone then
+        plan.reordered = orderedMS < plan.fileOrderMS;
+
+        if (plan.reordered)
+            plan.steps.swap(orderedSteps);
+
+        plan.predictedMS = plan.reordered ? orderedMS : plan.fileOrderMS;
+        plan.settingsWrites = SettingsWrites(plan.steps);
+
+        return plan;
+    }
+
+    void PrintPlan(const Plan &plan)
+    {
+        PrintToScreen("test plan: " + std::to_string(plan.steps.size()) + " points");
+
+        for (size_t i = 0; i < plan.steps.size(); i++)
+        {
+            const PlanStep &step = plan.steps[i];
+
+            scr_printf("  %2zu: line %2d, %s, cool-down wait %5.1f s, done at %6.1f s",
+                       i + 1, step.line, step.writeSettings ? "new settings" : "same settings",
+                       step.coolDownWaitMS / 1000.0, step.endMS / 1000.0);
+        }
+
+        if (plan.reordered)
+            scr_printf("predicted: %.1f s, %d settings writes (in file order: %.1f s, %d settings writes)",
+                       plan.predictedMS / 1000.0, plan.settingsWrites, plan.fileOrderMS / 1000.0, plan.fileOrderSettingsWrites);
+        else
+            scr_printf("predicted: %.1f s, %d settings writes (file order; grouping the settings wouldn't save any time)",
+                       plan.predictedMS / 1000.0, plan.settingsWrites);
+    }
+
+    std::string FileLineNote(int fileLine)
+    {
+        return (fileLine > 0) ? " (test file line " + std::to_string(fileLine) + ")" : "";
+    }
+
+    void PrintPredictedVsActual(const Plan &plan, uint64_t actualMS)
+    {
+        double difference = (double)actualMS - plan.predictedMS;
+
+        scr_printf("test plan: predicted %.1f s, took %.1f s (%+.1f s, %+.1f%%)",
+                   plan.predictedMS / 1000.0, actualMS / 1000.0, difference / 1000.0,
+                   plan.predictedMS ? 100.0 * difference / plan.predictedMS : 0.0);
+    }
+
+    void WaitForCoolDown(uint64_t coolDownUntilMS)
+    {
+        uint64_t nowMS = SERIAL_RX::NowMS();
+
+        if (nowMS >= coolDownUntilMS)
+            return;
+
+        PrintToScreen("cooling down " + std::to_string((coolDownUntilMS - nowMS + 999) / 1000) + " more seconds before the next test ...");
+        Sleep((DWORD)(coolDownUntilMS - nowMS));
+    }
+}
@@ -0,0 +1,154 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// what order to run a trip test file's points in, and how long that should take
+//
+// every point starts with SetupTripUnit(); the trip unit only reboots if the settings
+// actually changed (it NAKs the write otherwise), so points with the same settings
+// should run one after the other. ST and INST also give the trip unit's thermal memory
+// COOL_DOWN_MS between points; that counts from the end of one point to current on for
+// the next, so a settings write (and the reboot) in between isn't extra time at all;
+// neither is the rest of what a point does before it waits for the cool-down (clearing
+// the trip history, and for INST, SetupQuickTrip()).
+//
+// so: each distinct set of settings is written once, in the order the file first asks
+// for it, and the points that share it keep their file order. with every group written
+// once, nothing else about the order changes the total (the cool-downs are the same
+// between any two points)
+//
+// ... if that is any faster. with the default costs it isn't, for ST and INST: the
+// settings write and the rest fit inside the cool-down, so the writes saved are no time
+// saved. then (or whenever grouping doesn't save anything) the points run in file order
+//
+// the costs are guesses to start with (see DefaultCosts()); after a run, compare the
+// predicted time with what it took (PrintPredictedVsActual()), and try other costs
+// offline with test_plan_runner
+
+namespace TEST_PLAN
+{
+    enum class TestKind
+    {
+        LT,
+        ST,
+        INST,
+        GF,
+    };
+
+    // ST and INST, between points
+    constexpr uint32_t COOL_DOWN_MS = 30 * 1000;
+
+    typedef struct _PlanCosts
+    {
+        uint32_t settingsMS;       // MSG_SET_USR_SETTINGS_4 plus the reboot, when the settings changed
+        uint32_t beforeCoolDownMS; // what a point does after the settings, before it waits out the cool-down
+        uint32_t afterCoolDownMS;  // ...and after it, other than the trip itself
+        uint32_t afterTripMS;      // the wait after the trip
+        uint32_t coolDownMS;       // from the end of one point to current on for the next
+    } PlanCosts;
+
+    PlanCosts DefaultCosts(TestKind kind, bool softTestSet);
+
+    typedef struct _PlanPoint
+    {
+        int index;            // in the test file
+        std::string settings; // what SetupTripUnit() writes; same string, same settings
+        uint32_t expectedTripMS;
+        int line; // in the test file (index doesn't count blank lines); just for printing
+    } PlanPoint;
+
+    // a PlanPoint for a line of each kind of test file; expected times are from TRIP_CURVE,
+    // with whatever the test hard codes for the other protections
+    PlanPoint LTPoint(int index, int LTPickupAmps, float LTDelaySeconds, float amps);
+    PlanPoint STPoint(int index, int STPickupAmps, float STDelaySeconds, bool I2TEnabled, int LTPickupAmps, float amps);
+    PlanPoint INSTPoint(int index, int instPickup, int QTInstPickup, bool QTEnabled, float amps);
+    PlanPoint GFPoint(int index, int CTRating, int GFType, int GFPickup, float GFDelaySeconds, int GFSlope, float amps);
+
+    typedef struct _PlanStep
+    {
+        int index; // in the test file
+        int line;
+        bool writeSettings;
+        uint32_t coolDownWaitMS; // what is left of the cool-down after the settings write etc.
+        uint32_t startMS;		 // from the start of the run
+        uint32_t endMS;
+    } PlanStep;
+
+    typedef struct _Plan
+    {
+        std::vector<PlanStep> steps; // in the order to run them
+        uint32_t predictedMS;
+        int settingsWrites;
+        bool reordered; // false: grouping the settings saved no time, so steps are in file order
+
+        // the same points, in file order
+        uint32_t fileOrderMS;
+        int fileOrderSettingsWrites;
+    } Plan;
+
+    // how long points take, in the order given; steps (if not null) gets the details
+    uint32_t PredictMS(const std::vector<PlanPoint> &points, const PlanCosts &costs, std::vector<PlanStep> *steps = nullptr);
+
+    Plan MakePlan(const std::vector<PlanPoint> &points, const PlanCosts &costs);
+
+    // items (one per PlanPoint, in file order) in plan order
+    template <typename T>
+    std::vector<T> Reorder(const std::vector<T> &items, const Plan &plan)
+    {
+        std::vector<T> ordered;
+
+        for (const PlanStep &step : plan.steps)
+            ordered.push_back(items[step.index]);
+
+        return ordered;
+    }
+
+    void PrintPlan(const Plan &plan);
+
+    // points run in plan order, so anything printed about one says where it is in the
+    // file: " (test file line N)", or nothing if it didn't come from a file
+    std::string FileLineNote(int fileLine);
+
+    // what each of the trip tests' PlanTests() does: gives every point in params its
+    // PlanPoint (pointOf(index, param); the line comes from param.fileLine), plans them
+    // for kind, prints the plan, and puts params in plan order
+    template <typename Params, typename PointOf>
+    Plan PlanTests(std::vector<Params> &params, TestKind kind, bool softTestSet, PointOf pointOf)
+    {
+        std::vector<PlanPoint> points;
+
+        for (int i = 0; i < (int)params.size(); i++)
+        {
+            points.push_back(pointOf(i, params[i]));
+            points.back().line = params[i].fileLine;
+        }
+
+        Plan plan = MakePlan(points, DefaultCosts(kind, softTestSet));
+
+        PrintPlan(plan);
+        params = Reorder(params, plan);
+
+        return plan;
+    }
+    void PrintPredictedVsActual(const Plan &plan, uint64_t actualMS);
+
+    // for the runners: sleep until coolDownUntilMS (a SERIAL_RX::NowMS() time), if it is
+    // still in the future
+    void WaitForCoolDown(uint64_t coolDownUntilMS);
+}
@@ -0,0 +1,398 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+
+#include "../util/screen.hpp"
+#include "trip_time_rc.hpp"
+
+namespace TRIP_CURVE
+{
+    // GF time band constants, by GFDelay (seconds * 100); TB2C for I2T, TB5C for I5T
+    // (0.10 -> 0.01 and 0.05 -> 0 are what they have always been here)
+    typedef struct _TimeBand
+    {
+        int delay;
+        double constant;
+    } TimeBand;
+
+    constexpr TimeBand GF_I2T_BANDS[] = {{50, 0.5}, {40, 0.4}, {30, 0.3}, {20, 0.2}, {10, 0.01}, {5, 0.0}};
+    constexpr TimeBand GF_I5T_BANDS[] = {{50, 512}, {40, 409.6}, {30, 307.2}};
+
+    // LT time band constant is 36 x the delay in seconds
+    constexpr double LT_TIME_BAND_PER_SECOND = 36;
+
+    // where the ramps stop, and it's just the delay
+    constexpr double ST_I2T_LT_MULTIPLE = 10;
+    constexpr double GF_I2T_CT_FRACTION = 0.6;
+    constexpr double GF_I5T_PICKUP_MULTIPLE = 4;
+
+    constexpr double NEVER = std::numeric_limits<double>::infinity();
+    constexpr double NO_TRIP_MS = (double)NO_TRIP;
+
+    template <size_t N>
+    static constexpr bool FindTimeBand(const TimeBand (&bands)[N], int delay, double *constant)
+    {
+        for (const TimeBand &band : bands)
+        {
+            if (band.delay == delay)
+            {
+                *constant = band.constant;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // (power 0 is K / 1, so a definite time curve is just K = the delay)
+    static void DefiniteTime(double ms, Curve *curve)
+    {
+        curve->definiteAboveAmps = NEVER;
+        curve->definiteMS = ms;
+        curve->K = ms;
+        curve->power = 0;
+    }
+
+    bool Compile(const CurveSetting &setting, Curve *curve)
+    {
+        *curve = {0};
+        curve->pickupAmps = setting.pickupAmps;
+
+        switch (setting.element)
+        {
+        case Element::LT:
+        {
+            double P = setting.pickupAmps;
+
+            if (P <= 0 || setting.delay <= 0)
+            {
+                PrintToScreen("TRIP_CURVE::Compile() - Invalid LT setting: pickup " + std::to_string(P) + ", delay " + std::to_string(setting.delay));
+                return false;
+            }
+
+            // T = 36 x delay / (I / pickup)^2; delay is in 1/10 seconds, T in ms
+            curve->K = LT_TIME_BAND_PER_SECOND * setting.delay * 100 * P * P;
+            curve->power = 2;
+            curve->definiteAboveAmps = NEVER;
+            return true;
+        }
+
+        case Element::ST:
+        {
+            double P = setting.LTPickupAmps;
+
+            if (setting.slope == 0)
+            {
+                DefiniteTime(setting.delay * 10.0, curve);
+                return true;
+            }
+
+            if (P <= 0)
+            {
+                PrintToScreen("TRIP_CURVE::Compile() - ST I2T needs the LT pickup");
+                return false;
+            }
+
+            // T = delay / (I / LT pickup)^2, up to 10 x the LT pickup; delay is in 1/100 seconds
+            curve->K = setting.delay * 1000.0 * P * P;
+            curve->power = 2;
+            curve->definiteAboveAmps = ST_I2T_LT_MULTIPLE * P;
+            curve->definiteMS = setting.delay * 10.0;
+            return true;
+        }
+
+        case Element::INST:
+        case Element::QT_INST:
+        {
+            if (setting.frequency <= 0)
+            {
+                PrintToScreen("TRIP_CURVE::Compile() - Invalid frequency: " + std::to_string(setting.frequency));
+                return false;
+            }
+
+            int cycles = (setting.element == Element::INST) ? INST_TRIP_CYCLES : QT_INST_TRIP_CYCLES;
+
+            DefiniteTime(cycles * 1000.0 / setting.frequency, curve);
+            return true;
+        }
+
+        case Element::GF:
+        {
+            double constant;
+
+            // special case
+            if (setting.delay == 0 || setting.slope == 0)
+            {
+                DefiniteTime(setting.delay * 10.0, curve);
+                return true;
+            }
+
+            if (setting.slope == 1)
+            {
+                if (!FindTimeBand(GF_I2T_BANDS, setting.delay, &constant))
+                {
+                    PrintToScreen("TRIP_CURVE::Compile() - Invalid GFDelay: " + std::to_string(setting.delay));
+                    return false;
+                }
+
+                if (setting.CTRating <= 0)
+                {
+                    PrintToScreen("TRIP_CURVE::Compile() - GF I2T needs the CT rating");
+                    return false;
+                }
+
+                // T = TB2C / (I / CT)^2, up to 0.6 x the CT
+                double CT = setting.CTRating;
+
+                curve->K = constant * 1000 * CT * CT;
+                curve->power = 2;
+                curve->definiteAboveAmps = GF_I2T_CT_FRACTION * CT;
+                curve->definiteMS = setting.delay * 10.0;
+                return true;
+            }
+
+            if (setting.slope == 2)
+            {
+                double P = setting.pickupAmps;
+
+                if (!FindTimeBand(GF_I5T_BANDS, setting.delay, &constant))
+                {
+                    PrintToScreen("TRIP_CURVE::Compile() - Invalid GFDelay: " + std::to_string(setting.delay));
+                    return false;
+                }
+
+                if (P <= 0)
+                {
+                    PrintToScreen("TRIP_CURVE::Compile() - GF I5T needs the GF pickup");
+                    return false;
+                }
+
+                // T = TB5C / (I / pickup)^5, up to 4 x the pickup
+                curve->K = constant * 1000 * P * P * P * P * P;
+                curve->power = 5;
+                curve->definiteAboveAmps = GF_I5T_PICKUP_MULTIPLE * P;
+                curve->definiteMS = setting.delay * 10.0;
+                return true;
+            }
+
+            PrintToScreen("TRIP_CURVE::Compile() - Invalid GFSlope: " + std::to_string(setting.slope));
+            return false;
+        }
+
+        default:
+            PrintToScreen("TRIP_CURVE::Compile() - Invalid element");
+            return false;
+        }
+    }
+
+    bool Compile(const DeviceSettings4 &dev, const SystemSettings4 &sys, Element element, Curve *curve)
+    {
+        CurveSetting setting = {element};
+
+        setting.LTPickupAmps = dev.LTPickup / 10.0;
+        setting.CTRating = sys.CTRating;
+        setting.frequency = sys.Frequency;
+
+        switch (element)
+        {
+        case Element::LT:
+            setting.pickupAmps = setting.LTPickupAmps;
+            setting.delay = dev.LTDelay;
+            break;
+
+        case Element::ST:
+            setting.pickupAmps = dev.STPickup;
+            setting.delay = dev.STDelay;
+            setting.slope = dev.STI2T;
+            break;
+
+        case Element::INST:
+            setting.pickupAmps = dev.InstantPickup;
+            break;
+
+        case Element::QT_INST:
+            setting.pickupAmps = dev.QTInstPickup;
+            break;
+
+        case Element::GF:
+            setting.pickupAmps = dev.GFPickup;
+            setting.delay = dev.GFDelay;
+            setting.slope = dev.GFI2T;
+            break;
+        }
+
+        return Compile(setting, curve);
+    }
+
+    template <int POWER>
+    static inline double Power(double x)
+    {
+        if (POWER == 0)
+            return 1;
+        if (POWER == 2)
+            return x * x;
+
+        double x2 = x * x;
+        return x2 * x2 * x;
+    }
+
+    // one point; no branches, so the loop in Times() can be vectorized. at or below pickup
+    // is NO_TRIP, whatever K / amps^power came out to (even inf or NaN)
+    template <int POWER>
+    static inline uint32_t Time(const Curve &curve, double amps)
+    {
+        double ms = curve.K / Power<POWER>(amps);
+
+        ms = (amps > curve.definiteAboveAmps) ? curve.definiteMS : ms;
+        ms = (amps > curve.pickupAmps) ? ms + 0.5 : NO_TRIP_MS;
+
+        return (uint32_t)(int64_t)(std::min)(ms, NO_TRIP_MS);
+    }
+
+    template <int POWER>
+    static void Times(const Curve &curve, const float *amps, uint32_t *ms, size_t count)
+    {
+        for (size_t i = 0; i < count; i++)
+            ms[i] = Time<POWER>(curve, amps[i]);
+    }
+
+    uint32_t TimeMS(const Curve &curve, double amps)
+    {
+        switch (curve.power)
+        {
+        case 0:
+            return Time<0>(curve, amps);
+        case 2:
+            return Time<2>(curve, amps);
+        case 5:
+            return Time<5>(curve, amps);
+        default:
+            return NO_TRIP;
+        }
+    }
+
+    void TimesMS(const Curve &curve, const float *amps, uint32_t *ms, size_t count)
+    {
+        switch (curve.power)
+        {
+        case 0:
+            Times<0>(curve, amps, ms, count);
+            break;
+        case 2:
+            Times<2>(curve, amps, ms, count);
+            break;
+        case 5:
+            Times<5>(curve, amps, ms, count);
+            break;
+        default:
+            std::fill(ms, ms + count, NO_TRIP);
+            break;
+        }
+    }
+
+    std::vector<uint32_t> TimesMS(const Curve &curve, const std::vector<float> &amps)
+    {
+        std::vector<uint32_t> ms(amps.size());
+
+        TimesMS(curve, amps.data(), ms.data(), amps.size());
+        return ms;
+    }
+
+    void BandMS(const Curve &curve, double amps, double ampsErrorPercent, uint32_t *minMS, uint32_t *maxMS)
+    {
+        double error = amps * ampsErrorPercent / 100;
+
+        *minMS = TimeMS(curve, amps + error);
+        *maxMS = TimeMS(curve, amps - error);
+    }
+}
+
+namespace LT_TRIP_TEST_RC
+{
+
+    int TimeTimeToTripMS(int LT_Pickup_AmpsRMS, float LT_Delay_Seconds, int AppliedCurrentAmpsRMS)
+    {
+        TRIP_CURVE::CurveSetting setting = {TRIP_CURVE::Element::LT};
+        TRIP_CURVE::Curve curve;
+
+        setting.pickupAmps = LT_Pickup_AmpsRMS;
+        setting.delay = (int)std::lround(LT_Delay_Seconds * 10);
+
+        if (!TRIP_CURVE::Compile(setting, &curve))
+            return 0;
+
+        curve.pickupAmps = 0;
+        return (int)TRIP_CURVE::TimeMS(curve, AppliedCurrentAmpsRMS);
+    }
+
+}
+
+namespace ST_TRIP_TEST_RC
+{
+
+    int TimeTimeToTripMS(int ST_Pickup_AmpsRMS, float ST_Delay_Seconds, bool I2TEnabled, int LT_Pickup_AmpsRMS, int AppliedCurrentAmpsRMS)
+    {
+        TRIP_CURVE::CurveSetting setting = {TRIP_CURVE::Element::ST};
+        TRIP_CURVE::Curve curve;
+
+        // ST_Delay_Seconds has to be: .07, .10, .15, .20, .30, .40
+        setting.pickupAmps = ST_Pickup_AmpsRMS;
+        setting.delay = (int)std::lround(ST_Delay_Seconds * 100);
+        setting.slope = I2TEnabled ? 1 : 0;
+        setting.LTPickupAmps = LT_Pickup_AmpsRMS;
+
+        if (!TRIP_CURVE::Compile(setting, &curve))
+            return 0;
+
+        curve.pickupAmps = 0;
+        return (int)TRIP_CURVE::TimeMS(curve, AppliedCurrentAmpsRMS);
+    }
+
+}
+
+namespace GF_TRIP_TEST_RC
+{
+
+    // Ground Fault:                                                      //  12
+    // uint32_t GFPickup;	 // Ground Fault Pickup
+    // uint16_t GFDelay;	 // Ground Fault Delay * 100
+    // uint8_t GFI2T;		 // Ground Fault 1=I2T or 2=I5T Ramp
+    // uint8_t GFType;		 // Ground Fault Pickup Type
+    // uint8_t GFI2TAmps;	 // GF I2T transition to "definite time".
+
+    // GFSlope 1=I2T or 2=I5T Ramp
+    //
+    uint32_t TimeTimeToTripMS(
+        int CTRating, int GFPickup, float GFDelay, int GFSlope, int GFCurrent)
+    {
+        TRIP_CURVE::CurveSetting setting = {TRIP_CURVE::Element::GF};
+        TRIP_CURVE::Curve curve;
+
+        setting.pickupAmps = GFPickup;
+        setting.delay = (int)std::lround(GFDelay * 100);
+        setting.slope = GFSlope;
+        setting.CTRating = CTRating;
+
+        if (!TRIP_CURVE::Compile(setting, &curve))
+            return 0;
+
+        curve.pickupAmps = 0;
+        return TRIP_CURVE::TimeMS(curve, GFCurrent);
+    }
+
+}
@@ -0,0 +1,114 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../util/urc_protocol.hpp"
+
+// expected time to trip for each of the trip tests, per the formulas in the ACPro2 manual
+//
+// these used to live in each test's .cpp; they are in here by themselves so that they
+// don't drag windows.h, the Keithley, the Arduino etc. along with them (they are part
+// of the headless library; see CMakeLists.txt)
+//
+// all of them come down to the same thing: below pickup, no trip; above some current,
+// a fixed delay; in between, K / I^n (n = 2 for LT, ST I2T and GF I2T; 5 for GF I5T).
+// TRIP_CURVE works out K etc. once for a setting (a Curve), from the settings the way
+// the trip unit keeps them (delays in 1/10 or 1/100 seconds, so there are no floats to
+// compare), and then a Curve can be run over any number of currents at once
+
+namespace TRIP_CURVE
+{
+    enum class Element
+    {
+        LT,
+        ST,
+        INST,
+        QT_INST,
+        GF,
+    };
+
+    // what TimeMS() says when the current is at or below pickup
+    constexpr uint32_t NO_TRIP = UINT32_MAX;
+
+    // INST and QT INST don't have a delay setting; they take this many cycles
+    constexpr int INST_TRIP_CYCLES = 2;
+    constexpr int QT_INST_TRIP_CYCLES = 1;
+
+    // one protection, set up the way DeviceSettings4 has it
+    typedef struct _CurveSetting
+    {
+        Element element;
+        double pickupAmps;
+        int delay;           // LT: seconds * 10; ST, GF: seconds * 100
+        int slope;           // ST: 1 = I2T; GF: 0 = definite time, 1 = I2T, 2 = I5T
+        double LTPickupAmps; // ST I2T is relative to the LT pickup
+        int CTRating;        // GF I2T is relative to the CT
+        int frequency;       // INST / QT INST
+    } CurveSetting;
+
+    // a setting, boiled down:
+    //	-	amps <= pickupAmps: NO_TRIP
+    //	-	amps > definiteAboveAmps (or power == 0): definiteMS
+    //	-	otherwise: K / amps^power
+    typedef struct _Curve
+    {
+        double pickupAmps;
+        double definiteAboveAmps;
+        double definiteMS;
+        double K;
+        int power;
+    } Curve;
+
+    // false (and says why) if the setting isn't one the trip unit has
+    bool Compile(const CurveSetting &setting, Curve *curve);
+
+    // same thing, straight from what the trip unit says it is set to
+    bool Compile(const DeviceSettings4 &dev, const SystemSettings4 &sys, Element element, Curve *curve);
+
+    // rounded to the nearest ms
+    uint32_t TimeMS(const Curve &curve, double amps);
+
+    // the batch version; ms[i] is TimeMS(curve, amps[i]), for all count of them
+    void TimesMS(const Curve &curve, const float *amps, uint32_t *ms, size_t count);
+    std::vector<uint32_t> TimesMS(const Curve &curve, const std::vector<float> &amps);
+
+    // the range of trip times to expect if the current could be off by up to
+    // ampsErrorPercent either way (more current, less time)
+    void BandMS(const Curve &curve, double amps, double ampsErrorPercent, uint32_t *minMS, uint32_t *maxMS);
+}
+
+// the originals, now through TRIP_CURVE; like before, they don't look at pickup, and
+// give 0 for settings that don't exist
+
+namespace LT_TRIP_TEST_RC
+{
+    int TimeTimeToTripMS(int LT_Pickup_AmpsRMS, float LT_Delay_Seconds, int AppliedCurrentAmpsRMS);
+}
+
+namespace ST_TRIP_TEST_RC
+{
+    int TimeTimeToTripMS(int ST_Pickup_AmpsRMS, float ST_Delay_Seconds, bool I2TEnabled, int LT_Pickup_AmpsRMS, int AppliedCurrentAmpsRMS);
+}
+
+namespace GF_TRIP_TEST_RC
+{
+    // GFSlope 1=I2T or 2=I5T Ramp
+    uint32_t TimeTimeToTripMS(
+        int CTRating, int GFPickup, float GFDelay, int GFSlope, int GFCurrent);
+}
@@ -0,0 +1,267 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "waveform.hpp"
+#include "../util/screen.hpp"
+
+namespace WAVEFORM
+{
+    static const double PI = 3.14159265358979323846;
+
+    // sin() and cos() of order * the angle of each sample; the padding at the end is 0
+    typedef struct _PhaseTables
+    {
+        alignas(32) float sine[MAX_ORDER + 1][CYCLE_STRIDE];
+        alignas(32) float cosine[MAX_ORDER + 1][CYCLE_STRIDE];
+    } PhaseTables;
+
+    static PhaseTables BuildTables()
+    {
+        PhaseTables tables = {0};
+
+        for (int order = 0; order <= MAX_ORDER; order++)
+        {
+            for (int i = 0; i < _SAMPLES_PER_CYCLE; i++)
+            {
+                double radians = 2 * PI * order * i / _SAMPLES_PER_CYCLE;
+
+                tables.sine[order][i] = (float)std::sin(radians);
+                tables.cosine[order][i] = (float)std::cos(radians);
+            }
+        }
+
+        return tables;
+    }
+
+    static const PhaseTables &Tables()
+    {
+        static const PhaseTables tables = BuildTables();
+        return tables;
+    }
+
+    // wave += peak * sin(order * angle + degrees), as a weighted sum of two table rows
+    static void AddComponent(float *wave, int order, double peak, double degrees)
+    {
+        const PhaseTables &tables = Tables();
+
+        float a = (float)(peak * std::cos(degrees * PI / 180));
+        float b = (float)(peak * std::sin(degrees * PI / 180));
+
+        const float *sine = tables.sine[order];
+        const float *cosine = tables.cosine[order];
+
+        for (int i = 0; i < CYCLE_STRIDE; i++)
+            wave[i] += a * sine[i] + b * cosine[i];
+    }
+
+    WaveSpec Sine(float ampsRMS, float degrees)
+    {
+        WaveSpec spec;
+
+        spec.ampsRMS = ampsRMS;
+        spec.degrees = degrees;
+
+        return spec;
+    }
+
+    bool Generate(const WaveSpec &spec, double countsPerAmp, int32_t A2D[_SAMPLES_PER_CYCLE])
+    {
+        if (countsPerAmp <= 0 || spec.numHarmonics < 0 || spec.numHarmonics > MAX_HARMONICS)
+            return false;
+
+        for (int h = 0; h < spec.numHarmonics; h++)
+        {
+            if (spec.harmonics[h].order < 2 || spec.harmonics[h].order > MAX_ORDER)
+                return false;
+        }
+
+        alignas(32) float wave[CYCLE_STRIDE];
+        alignas(32) int32_t samples[CYCLE_STRIDE];
+
+        double peak = spec.ampsRMS * countsPerAmp * std::sqrt(2.0);
+        float offset = (float)(spec.offsetAmps * countsPerAmp);
+
+        for (int i = 0; i < CYCLE_STRIDE; i++)
+            wave[i] = offset;
+
+        AddComponent(wave, 1, peak, spec.degrees);
+
+        for (int h = 0; h < spec.numHarmonics; h++)
+            AddComponent(wave, spec.harmonics[h].order, peak * spec.harmonics[h].percent / 100, spec.harmonics[h].degrees);
+
+        switch (spec.shape)
+        {
+        case Shape::CLIPPED:
+        {
+            float level = (float)(peak * spec.clipPercent / 100);
+
+            for (int i = 0; i < CYCLE_STRIDE; i++)
+                wave[i] = (std::min)((std::max)(wave[i], -level), level);
+
+            break;
+        }
+
+        case Shape::HALF_WAVE:
+            for (int i = 0; i < CYCLE_STRIDE; i++)
+                wave[i] = (std::max)(wave[i], 0.0f);
+
+            break;
+
+        default:
+            break;
+        }
+
+        // clip to the A/D, and round to the nearest count
+        const float fullScale = (float)A2D_FULL_SCALE;
+
+        for (int i = 0; i < CYCLE_STRIDE; i++)
+        {
+            float x = (std::min)((std::max)(wave[i], -fullScale), fullScale);
+            samples[i] = (int32_t)(x + (x >= 0 ? 0.5f : -0.5f));
+        }
+
+        memcpy(A2D, samples, sizeof(int32_t) * _SAMPLES_PER_CYCLE);
+
+        return true;
+    }
+
+    static int64_t Hundredths(double value)
+    {
+        return std::llround(value * 100);
+    }
+
+    static int64_t CentiDegrees(double degrees)
+    {
+        return ((Hundredths(degrees) % 36000) + 36000) % 36000;
+    }
+
+    WaveformCache::WaveformCache(size_t maxEntries) : maxEntries(maxEntries)
+    {
+    }
+
+    WaveformCache::Key WaveformCache::MakeKey(const WaveSpec &spec, double countsPerAmp)
+    {
+        Key key = {0};
+        int64_t countsBits;
+
+        memcpy(&countsBits, &countsPerAmp, sizeof(countsBits));
+
+        key[0] = std::llround(spec.ampsRMS * 1000.0);
+        key[1] = CentiDegrees(spec.degrees);
+        key[2] = std::llround(spec.offsetAmps * 1000.0);
+        key[3] = (int64_t)spec.shape;
+        key[4] = (spec.shape == Shape::CLIPPED) ? Hundredths(spec.clipPercent) : 0;
+        key[5] = countsBits;
+        key[6] = spec.numHarmonics;
+
+        for (int h = 0; h < spec.numHarmonics && h < MAX_HARMONICS; h++)
+        {
+            key[7 + 3 * h] = spec.harmonics[h].order;
+            key[8 + 3 * h] = Hundredths(spec.harmonics[h].percent);
+            key[9 + 3 * h] = CentiDegrees(spec.harmonics[h].degrees);
+        }
+
+        return key;
+    }
+
+    // FNV-1a, a word at a time
+    size_t WaveformCache::KeyHash::operator()(const Key &key) const
+    {
+        uint64_t hash = 14695981039346656037ull;
+
+        for (int64_t word : key)
+        {
+            hash ^= (uint64_t)word;
+            hash *= 1099511628211ull;
+        }
+
+        return (size_t)hash;
+    }
+
+    bool WaveformCache::Get(const WaveSpec &spec, double countsPerAmp, int32_t A2D[_SAMPLES_PER_CYCLE])
+    {
+        Key key = MakeKey(spec, countsPerAmp);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            auto it = cycles.find(key);
+
+            if (it != cycles.end())
+            {
+                stats.hits++;
+                memcpy(A2D, it->second.data(), sizeof(int32_t) * _SAMPLES_PER_CYCLE);
+                return true;
+            }
+        }
+
+        // (not holding the lock; somebody else may be making the same one, which is fine)
+        Cycle cycle;
+
+        if (!Generate(spec, countsPerAmp, cycle.data()))
+            return false;
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        stats.misses++;
+
+        // full; just start over, a sweep will fill it right back up with what it needs
+        if (cycles.size() >= maxEntries)
+        {
+            cycles.clear();
+            stats.flushes++;
+        }
+
+        cycles.emplace(key, cycle);
+
+        memcpy(A2D, cycle.data(), sizeof(int32_t) * _SAMPLES_PER_CYCLE);
+        return true;
+    }
+
+    CacheStats WaveformCache::Stats()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        CacheStats s = stats;
+        s.entries = cycles.size();
+
+        return s;
+    }
+
+    void WaveformCache::PrintStats()
+    {
+        CacheStats s = Stats();
+
+        scr_printf("waveform cache: %llu hits, %llu misses, %zu cycles kept, %llu flushes",
+                   (unsigned long long)s.hits, (unsigned long long)s.misses, s.entries, (unsigned long long)s.flushes);
+    }
+
+    void WaveformCache::Clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        cycles.clear();
+        stats = {0};
+    }
+
+    WaveformCache &Cache()
+    {
+        static WaveformCache cache;
+        return cache;
+    }
+}
@@ -0,0 +1,125 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+#include "../util/urc_protocol.hpp"
+
+// one cycle of current, as the _SAMPLES_PER_CYCLE A2D samples MSG_SET_TESTSET_AMPS_4 wants
+// (see soft_test_set.hpp)
+//
+// a cycle is a fundamental, plus harmonics, plus a DC offset, and then optionally bent
+// into the shape of a fault:
+//	-	CLIPPED: flat topped at clipPercent of the peak, like a saturated CT
+//	-	HALF_WAVE: only the positive half cycles, like an arcing / rectified fault
+//
+// every sample is at a fixed angle, so sin() and cos() of every harmonic at every sample
+// are worked out once (a table per order); a cycle is then just a weighted sum of table
+// rows, which the compiler turns into SIMD. padded out to CYCLE_STRIDE so those loops
+// don't have a leftover sample at the end
+//
+// a sweep asks for the same handful of cycles over and over, so WaveformCache keeps what
+// it has made, keyed on everything that goes into one (amps to the mA, angles to 0.01
+// degree)
+
+namespace WAVEFORM
+{
+    // 18-bit signed A/D
+    constexpr int32_t A2D_FULL_SCALE = 131071;
+
+    // highest order that still fits in _SAMPLES_PER_CYCLE samples
+    constexpr int MAX_ORDER = _SAMPLES_PER_CYCLE / 2;
+
+    constexpr int MAX_HARMONICS = 8;
+
+    constexpr int CYCLE_STRIDE = 64;
+
+    constexpr size_t DEFAULT_CACHE_ENTRIES = 4096;
+
+    enum class Shape
+    {
+        SINE,
+        CLIPPED,
+        HALF_WAVE,
+    };
+
+    typedef struct _Harmonic
+    {
+        int order;	   // 2 .. MAX_ORDER
+        float percent; // of the fundamental
+        float degrees;
+    } Harmonic;
+
+    typedef struct _WaveSpec
+    {
+        float ampsRMS = 0; // the fundamental
+        float degrees = 0;
+        float offsetAmps = 0; // DC
+        Shape shape = Shape::SINE;
+        float clipPercent = 100; // CLIPPED: of the peak of the fundamental
+        int numHarmonics = 0;
+        Harmonic harmonics[MAX_HARMONICS] = {};
+    } WaveSpec;
+
+    WaveSpec Sine(float ampsRMS, float degrees);
+
+    // returns false (and leaves A2D alone) if the spec makes no sense
+    bool Generate(const WaveSpec &spec, double countsPerAmp, int32_t A2D[_SAMPLES_PER_CYCLE]);
+
+    typedef struct _CacheStats
+    {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t flushes; // times it filled up and started over
+        size_t entries;
+    } CacheStats;
+
+    class WaveformCache
+    {
+    public:
+        explicit WaveformCache(size_t maxEntries = DEFAULT_CACHE_ENTRIES);
+
+        // same as Generate(), but only the first time for any given spec; safe from any thread
+        bool Get(const WaveSpec &spec, double countsPerAmp, int32_t A2D[_SAMPLES_PER_CYCLE]);
+
+        CacheStats Stats();
+        void PrintStats();
+        void Clear();
+
+    private:
+        // everything about a spec (and the scale), quantized
+        typedef std::array<int64_t, 7 + 3 * MAX_HARMONICS> Key;
+        typedef std::array<int32_t, _SAMPLES_PER_CYCLE> Cycle;
+
+        struct KeyHash
+        {
+            size_t operator()(const Key &key) const;
+        };
+
+        static Key MakeKey(const WaveSpec &spec, double countsPerAmp);
+
+        std::mutex mutex;
+        size_t maxEntries;
+        std::unordered_map<Key, Cycle, KeyHash> cycles;
+        CacheStats stats = {0};
+    };
+
+    // the one SOFT_TEST_SET uses
+    WaveformCache &Cache();
+}
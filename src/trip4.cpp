@@ -13,9 +13,151 @@
 
 #include <fstream>
 #include <iostream>
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+#include "trip4.hpp"
+#include "util/comm.hpp"
+#include "util/urc_connection.hpp"
+#include "util/screen.hpp"
+#include "util/util.hpp"
+
+// the trip unit doesn't go down the instant it ACKs new settings, so an answer to a status
+// request can still be from before the reboot. we used to hold off a fixed 200ms and hope
+// it had gone down by then; nothing said it had to. now, for a reboot we saw start, we
+// keep asking from the ACK on, and don't believe an answer until one has gone unanswered
+// (or NAK'd; it went down), or until we are REBOOT_ASSUME_DONE_MS past the ACK (the fixed
+// 2 second sleep this replaced; if it never went quiet, that is no worse than we always did)
+constexpr int REBOOT_ASSUME_DONE_MS = 2000;
+
+// first status request waits this long for an answer, then twice that, and so on
+constexpr int REBOOT_FIRST_PROBE_MS = 50;
+constexpr int REBOOT_MAX_PROBE_MS = 500;
+
+typedef struct _RebootState
+{
+	uint64_t startedMS; // when it ACK'd the settings; 0 if we don't know of a reboot
+	RebootStats stats;
+} RebootState;
+
+static std::unordered_map<HANDLE, RebootState> rebootStates;
+static std::mutex rebootStatesMutex;
+
+// both SetSystemAndDeviceSettings() call this when the trip unit ACKs new settings
+void NoteRebootStarted(HANDLE hTripUnit)
+{
+	std::lock_guard<std::mutex> lock(rebootStatesMutex);
+	rebootStates[hTripUnit].startedMS = SERIAL_RX::NowMS();
+}
+
+static void NoteRebootFinished(HANDLE hTripUnit, uint64_t tookMS)
+{
+	std::lock_guard<std::mutex> lock(rebootStatesMutex);
+	RebootState &state = rebootStates[hTripUnit];
+
+	state.startedMS = 0;
+	state.stats.count++;
+	state.stats.lastMS = tookMS;
+	state.stats.totalMS += tookMS;
+	if (tookMS > state.stats.maxMS)
+		state.stats.maxMS = tookMS;
+}
+
+RebootStats GetRebootStats(HANDLE hTripUnit)
+{
+	std::lock_guard<std::mutex> lock(rebootStatesMutex);
+	return rebootStates[hTripUnit].stats;
+}
+
+// returns once the trip unit answers a MSG_GET_STATUS, or false after timeoutMS
+// (counted from when it ACK'd the settings that made it reboot, if we saw that)
+bool WaitForTripUnitReady(HANDLE hTripUnit, int timeoutMS)
+{
+	_ASSERT(hTripUnit != INVALID_HANDLE_VALUE);
+
+	uint64_t startMS;
+
+	{
+		std::lock_guard<std::mutex> lock(rebootStatesMutex);
+		startMS = rebootStates[hTripUnit].startedMS;
+	}
+
+	// only reboots we saw start get recorded; otherwise we don't know how long it really took
+	bool knownReboot = (startMS != 0);
+
+	if (!knownReboot)
+		startMS = SERIAL_RX::NowMS();
+
+	uint64_t deadlineMS = startMS + timeoutMS;
+	uint64_t nowMS;
+
+	int probeMS = REBOOT_FIRST_PROBE_MS;
+
+	// (see REBOOT_ASSUME_DONE_MS)
+	bool wentDown = !knownReboot;
+
+	while (SERIAL_RX::NowMS() < deadlineMS)
+	{
+		URCMessageUnion rsp = {0};
+
+		// (the response deadline is the backoff; no point in sleeping on top of it)
+		uint64_t probeDeadlineMS = (std::min)(SERIAL_RX::DeadlineFromNow(probeMS), deadlineMS);
+
+		SendURCCommand(hTripUnit, MSG_GET_STATUS, ADDR_TRIP_UNIT, ADDR_CAL_APP);
+
+		// NAK_ERROR_NOT_READY means it is up, but not all the way
+		bool answered = GetURCConnection(hTripUnit).Receive(&rsp, probeDeadlineMS, true);
+		uint64_t tookMS = SERIAL_RX::NowMS() - startMS;
+
+		if (!answered || rsp.msgHdr.Type == MSG_NAK)
+			wentDown = true;
+
+		if (answered && rsp.msgHdr.Type == MSG_RSP_STATUS_2)
+		{
+			if (wentDown)
+			{
+				if (knownReboot)
+				{
+					NoteRebootFinished(hTripUnit, tookMS);
+					scr_printf("trip unit rebooted in %d ms", (int)tookMS);
+				}
+
+				return true;
+			}
+
+			// it never went quiet; don't count this as a reboot
+			if (tookMS >= REBOOT_ASSUME_DONE_MS)
+			{
+				std::lock_guard<std::mutex> lock(rebootStatesMutex);
+				rebootStates[hTripUnit].startedMS = 0;
+
+				scr_printf("trip unit never went quiet after new settings; carrying on after %d ms", (int)tookMS);
+				return true;
+			}
+		}
+
+		// if it answered, don't hammer it
+		nowMS = SERIAL_RX::NowMS();
+		if (nowMS < probeDeadlineMS)
+			Sleep((DWORD)(probeDeadlineMS - nowMS));
+
+		// (no backing off until it has gone down, or we might ask right past the whole reboot)
+		if (wentDown)
+			probeMS = (std::min)(probeMS * 2, REBOOT_MAX_PROBE_MS);
+	}
 
-#include "autocal_rc.hpp"
+	{
+		std::lock_guard<std::mutex> lock(rebootStatesMutex);
+		rebootStates[hTripUnit].startedMS = 0;
+	}
+
+	scr_printf("trip unit did not come back within %d ms", timeoutMS);
+
+	return false;
+}
 
 bool SendSetQTStatus(HANDLE hTripUnit, bool beOn)
 {
@@ -24,7 +166,7 @@ bool SendSetQTStatus(HANDLE hTripUnit, bool beOn)
 	msg.Hdr.Type = MSG_SET_QT_SWITCH_4;
 	msg.Hdr.Version = PROTOCOL_VERSION;
 	msg.Hdr.Length = 2;
-	msg.Hdr.Seq = SequenceNumber();
+	msg.Hdr.Seq = SequenceNumber(hTripUnit);
 	msg.Hdr.Dst = ADDR_TRIP_UNIT;
 	msg.Hdr.Src = ADDR_CAL_APP;
 
@@ -86,15 +228,10 @@ bool ConnectTripUnit(HANDLE *hTripUnit, int port, TripUnitType *tripUnitType)
 		}
 	}
 
-	// right now we can't differentiate between an ACPRO2 NW and ACPro_RC.
-	// so one way to do that is to send a MSG_GET_CALIBRATION, because
+	// note: right now we can't differentiate between an ACPRO2 NW and ACPro_RC.
+	// one way to do that would be to send a MSG_GET_CALIBRATION, because
 	// the ACPro2_RC has a different response to that command
-	if (retval)
-	{
-		if (ACPRO2_RG::TripUnitisACPro2_RC(*hTripUnit))
-			*tripUnitType = TripUnitType::AC_PRO2_RC;
-	}
-	else
+	if (!retval)
 	{
 		*tripUnitType = TripUnitType::NONE;
 		CloseCommPort(hTripUnit);
@@ -131,7 +268,7 @@ bool SendSetUserSet4(HANDLE hTripUnit, SystemSettings4 *SysSettings, DeviceSetti
 	cmd.Hdr.Type = MSG_SET_USR_SETTINGS_4;
 	cmd.Hdr.Version = PROTOCOL_VERSION;
 	cmd.Hdr.Length = sizeof(MsgSetUserSet4) - sizeof(MsgHdr);
-	cmd.Hdr.Seq = SequenceNumber();
+	cmd.Hdr.Seq = SequenceNumber(hTripUnit);
 	cmd.Hdr.Dst = ADDR_TRIP_UNIT;
 	cmd.Hdr.Src = ADDR_CAL_APP;
 
@@ -225,21 +362,28 @@ bool SetupTripUnitForCalibration(HANDLE hTripUnit, bool Use50Hz)
 	return SetSystemAndDeviceSettings(hTripUnit, funcptr);
 }
 
-bool SetSystemAndDeviceSettings(HANDLE hTripUnit, SetSettingsFuncPtr funcPtr)
+// grabs system settings and device settings from the trip unit
+// both requests go out back to back, and we wait for both answers at the same time,
+// rather than doing one full round trip after the other
+bool GetSystemAndDeviceSettings(HANDLE hTripUnit, URCMessageUnion *sysRsp, URCMessageUnion *devRsp)
 {
 	_ASSERT(hTripUnit != INVALID_HANDLE_VALUE);
 
-	URCMessageUnion rsp1 = {0};
-	URCMessageUnion rsp2 = {0};
-	URCMessageUnion rsp3 = {0};
-
 	bool retval = true;
 
+	std::future<URCReply> sysReply = SendURCCommandAsync(hTripUnit, MSG_GET_SYS_SETTINGS, ADDR_TRIP_UNIT, ADDR_CAL_APP, MSG_RSP_SYS_SETTINGS_4);
+	std::future<URCReply> devReply = SendURCCommandAsync(hTripUnit, MSG_GET_DEV_SETTINGS, ADDR_TRIP_UNIT, ADDR_CAL_APP, MSG_RSP_DEV_SETTINGS_4);
+
+	URCReply sys = sysReply.get();
+	URCReply dev = devReply.get();
+
+	*sysRsp = sys.msg;
+	*devRsp = dev.msg;
+
 	// grab system settings
 	if (retval)
 	{
-		SendURCCommand(hTripUnit, MSG_GET_SYS_SETTINGS, ADDR_TRIP_UNIT, ADDR_CAL_APP);
-		retval = GetURCResponse(hTripUnit, &rsp1) && VerifyMessageIsOK(&rsp1, MSG_RSP_SYS_SETTINGS_4, sizeof(MsgRspSysSet4) - sizeof(MsgHdr));
+		retval = sys.ok && VerifyMessageIsOK(sysRsp, MSG_RSP_SYS_SETTINGS_4, sizeof(MsgRspSysSet4) - sizeof(MsgHdr));
 
 		if (!retval)
 		{
@@ -250,15 +394,33 @@ bool SetSystemAndDeviceSettings(HANDLE hTripUnit, SetSettingsFuncPtr funcPtr)
 	// grab device settings
 	if (retval)
 	{
-		SendURCCommand(hTripUnit, MSG_GET_DEV_SETTINGS, ADDR_TRIP_UNIT, ADDR_CAL_APP);
-		retval = GetURCResponse(hTripUnit, &rsp2) && VerifyMessageIsOK(&rsp2, MSG_RSP_DEV_SETTINGS_4, sizeof(MsgRspDevSet4) - sizeof(MsgHdr));
+		retval = dev.ok && VerifyMessageIsOK(devRsp, MSG_RSP_DEV_SETTINGS_4, sizeof(MsgRspDevSet4) - sizeof(MsgHdr));
 
 		if (!retval)
 		{
-			PrintToScreen("error sending MSG_GET_DEV_SETTINGS");
+			PrintToScreen("error receiving MSG_RSP_DEV_SETTINGS_4");
 		}
 	}
 
+	return retval;
+}
+
+bool SetSystemAndDeviceSettings(HANDLE hTripUnit, SetSettingsFuncPtr funcPtr)
+{
+	_ASSERT(hTripUnit != INVALID_HANDLE_VALUE);
+
+	URCMessageUnion rsp1 = {0};
+	URCMessageUnion rsp2 = {0};
+	URCMessageUnion rsp3 = {0};
+
+	bool retval = true;
+
+	// grab system and device settings
+	if (retval)
+	{
+		retval = GetSystemAndDeviceSettings(hTripUnit, &rsp1, &rsp2);
+	}
+
 	if (retval)
 	{
 		// call function to make any modifications to the settings that we want
@@ -278,6 +440,10 @@ bool SetSystemAndDeviceSettings(HANDLE hTripUnit, SetSettingsFuncPtr funcPtr)
 			retval =
 				(rsp3.msgHdr.Type == MSG_ACK) ||
 				(rsp3.msgHdr.Type == MSG_NAK && rsp3.msgNAK.Error == NAK_NO_CHANGES);
+
+			// ...and only reboots if something did
+			if (rsp3.msgHdr.Type == MSG_ACK)
+				NoteRebootStarted(hTripUnit);
 		}
 
 		if (!retval)
@@ -395,7 +561,8 @@ void DumpCalResults_RC(MsgRspCalibrRC *msg)
 	}
 }
 
-bool GetCalibration(HANDLE hTripUnit)
+// dumps what the trip unit has in FLASH; an AC-PRO-RC's also goes in calRC, if given
+bool GetCalibration(HANDLE hTripUnit, MsgRspCalibrRC *calRC)
 {
 	_ASSERT(hTripUnit != INVALID_HANDLE_VALUE);
 
@@ -442,6 +609,9 @@ bool GetCalibration(HANDLE hTripUnit)
 		{
 			scr_printf("Dumping ACPro_RC calibration results");
 			DumpCalResults_RC(&rsp.msgRspCalibrRC);
+
+			if (calRC)
+				*calRC = rsp.msgRspCalibrRC;
 		}
 		else
 		{
@@ -581,6 +751,17 @@ bool GetSerialNumber(
 	return true;
 }
 
+// for labeling results; empty if the trip unit won't tell us
+std::string TripUnitSerialNumber(HANDLE hTripUnit)
+{
+	char tu_serial_num[12] = {0};
+
+	if (!GetSerialNumber(hTripUnit, tu_serial_num, sizeof(tu_serial_num)))
+		return "";
+
+	return std::string(tu_serial_num, strnlen(tu_serial_num, sizeof(tu_serial_num)));
+}
+
 bool SendSetSerial(HANDLE hTripUnit, int dest, char *serial_num, HardVer hw_version)
 {
 	_ASSERT(hTripUnit != INVALID_HANDLE_VALUE);
@@ -591,7 +772,7 @@ bool SendSetSerial(HANDLE hTripUnit, int dest, char *serial_num, HardVer hw_vers
 	cmd.Hdr.Type = MSG_SET_SER_NUM_4;
 	cmd.Hdr.Version = PROTOCOL_VERSION;
 	cmd.Hdr.Length = sizeof(MsgSetSerNum4) - sizeof(MsgHdr);
-	cmd.Hdr.Seq = SequenceNumber();
+	cmd.Hdr.Seq = SequenceNumber(hTripUnit);
 	cmd.Hdr.Dst = dest;
 	cmd.Hdr.Src = ADDR_CAL_APP;
 
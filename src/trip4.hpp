@@ -13,13 +13,36 @@
 
 #pragma once
 
-#include "autocal_rc.hpp"
+#include <functional>
+#include <string>
+
+#include "util/urc_protocol.hpp"
 
 typedef std::function<bool(SystemSettings4 *Settings, DeviceSettings4 *DevSettings4)> SetSettingsFuncPtr;
 
+// the trip unit reboots after a MSG_SET_USR_SETTINGS_4 that changes something (and after it
+// trips); we used to just sleep 2 seconds and hope. now we keep asking it for its status
+// (backing off a bit each time) and carry on the moment it answers
+//
+// how long it actually took is kept per HANDLE, so we can see what the real ones do
+constexpr int TRIP_UNIT_REBOOT_TIMEOUT_MS = 10000;
+
+typedef struct _RebootStats
+{
+	int count;		  // reboots we have waited for
+	uint64_t lastMS;  // how long the last one took
+	uint64_t totalMS; // all of them added up
+	uint64_t maxMS;	  // longest one
+} RebootStats;
+
+bool WaitForTripUnitReady(HANDLE hTripUnit, int timeoutMS = TRIP_UNIT_REBOOT_TIMEOUT_MS);
+void NoteRebootStarted(HANDLE hTripUnit);
+RebootStats GetRebootStats(HANDLE hTripUnit);
+
 bool ConnectTripUnit(HANDLE *hTripUnit, int port, TripUnitType *tripUnitType);
 bool SendSetUserSet4(HANDLE hTripUnit, SystemSettings4 *SysSettings, DeviceSettings4 *DevSettings);
 bool SetupTripUnitForCalibration(HANDLE hTripUnit, bool Use50Hz);
+bool GetSystemAndDeviceSettings(HANDLE hTripUnit, URCMessageUnion *sysRsp, URCMessageUnion *devRsp);
 bool SetSystemAndDeviceSettings(HANDLE hTripUnit, SetSettingsFuncPtr funcPtr);
 bool GetDynamics(HANDLE hTripUnit, URCMessageUnion *rsp);
 void DumpCalResults(MsgRspCalibr *msg);
@@ -28,8 +51,9 @@ bool SetupTripUnitFrequency(HANDLE hTripUnit, bool Use50Hz);
 bool SendClearTripHistory(HANDLE hTripUnit);
 bool GetTripHistory(HANDLE hTripUnit, URCMessageUnion *msg);
 bool GetSerialNumber(HANDLE hTripUnit, char *tu_serial_num, size_t buffer_size);
+std::string TripUnitSerialNumber(HANDLE hTripUnit);
 bool SetSerialNumber(HANDLE hTripUnit, char *tu_serial_num);
 bool SendSetQTStatus(HANDLE hTripUnit, bool beOn);
 bool CheckForExactlyOneTrip(HANDLE hTripUnit, int ExpectedTripType, bool &tripTypeIsAsExpected);
 bool CheckForCorrectTrip(HANDLE hTripUnit, int ExpectedTripType, bool &tripTypeIsAsExpected);
-bool GetCalibration(HANDLE hTripUnit);
\ No newline at end of file
+bool GetCalibration(HANDLE hTripUnit, MsgRspCalibrRC *calRC = nullptr);
\ No newline at end of file
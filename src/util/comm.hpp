@@ -0,0 +1,55 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+#include "platform.hpp"
+#include "serial_rx.hpp"
+
+// the part of talking to a comm port that doesn't care what is on the other end
+//
+// on windows these are real COM ports; see win32_api_comm.cpp
+// anywhere else, a HANDLE stands for whatever CommTransport got registered for it
+// (a serial device or a pty via InitCommPort(), a simulator, a socket...); see posix_comm.cpp
+
+bool WriteToCommPort(HANDLE hComm, uint8_t *data_ptr, int data_length);
+bool WriteToCommPort_NoPurge(HANDLE hComm, const uint8_t *data_ptr, int data_length);
+bool InitCommPort(HANDLE *hComm, int PortNumber, int Baud);
+bool CloseCommPort(HANDLE *hComm);
+SERIAL_RX::Receiver &getReceiverForHandle(HANDLE hComm);
+
+#ifndef _WIN32
+
+// sends all of len bytes, or returns false
+typedef std::function<bool(const uint8_t *data, int len)> CommWriteFuncPtr;
+
+// whatever is on the other end of a HANDLE
+typedef struct _CommTransport
+{
+	SERIAL_RX::ReadSomeFuncPtr readSome; // see serial_rx.hpp
+	CommWriteFuncPtr write;
+	std::function<void()> purge; // throw away anything buffered underneath us (optional)
+	std::function<void()> close; // called once, from CloseCommPort() (optional)
+} CommTransport;
+
+// hands back a HANDLE that the rest of the code can use like any other comm port
+HANDLE RegisterCommTransport(const CommTransport &transport);
+
+// InitCommPort(PortNumber) opens /dev/ttyS<PortNumber-1> unless told otherwise here
+void SetCommPortPath(int PortNumber, const char *path);
+
+#endif
@@ -0,0 +1,47 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+
+// PrintToScreen() and friends for the headless library (see screen.hpp); the windows
+// app has its own in autocal_rc.cpp, which go to the main window
+
+#include <cstdarg>
+#include <cstdio>
+#include <mutex>
+
+#include "screen.hpp"
+
+bool logData = false;
+
+static std::mutex consoleMutex;
+
+void PrintToScreen(const std::string &message)
+{
+	std::lock_guard<std::mutex> lock(consoleMutex);
+
+	fputs(message.c_str(), stdout);
+	fputc('\n', stdout);
+	fflush(stdout);
+}
+
+void scr_printf(const char *format, ...)
+{
+	char buf[1024];
+	va_list args;
+
+	va_start(args, format);
+	vsnprintf(buf, sizeof(buf), format, args);
+	va_end(args);
+
+	PrintToScreen(buf);
+}
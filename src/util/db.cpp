@@ -14,12 +14,18 @@
 
 #include "..\autocal_rc.hpp"
 
+#include <algorithm>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <windows.h>
 #include <sql.h>
 #include <sqlext.h>
 #include <vector>
 
+#include "db_queue.hpp"
+
 // code for interacting with production database
 
 namespace DB
@@ -29,13 +35,153 @@ namespace DB
 
     bool _connected;
 
-    bool Connect(const std::string &database_file)
+    static std::string databaseFile;
+
+    // the write-behind thread uses the connection too, so anybody touching it holds this
+    static std::mutex dbMutex;
+
+    static std::unique_ptr<DB_QUEUE::WriteBehindQueue> writeQueue;
+
+    // prepared statements, by their SQL; made the first time they are needed on this
+    // connection, and reused after that (parameters get bound every time they are run)
+    static std::map<std::string, SQLHSTMT> statements;
+
+    // some drivers throw away prepared statements on commit / rollback
+    static bool statementsSurviveEndTran = false;
+
+    // autocommit is off for as long as the connection is open, so a read isn't a
+    // transaction of its own; reads just join whatever transaction is open, and the next
+    // write batch ends it. on drivers that throw away prepared statements when a
+    // transaction ends (Access), that is the only time ours go away, so reads in between
+    // batches get to reuse them. false if the driver wouldn't turn autocommit off; then
+    // every read ends a transaction, and (on those drivers) prepares its statement again
+    static bool manualCommit = false;
+
+    // caller holds dbMutex
+    static void FreeStatements()
+    {
+        for (const std::pair<const std::string, SQLHSTMT> &s : statements)
+            SQLFreeHandle(SQL_HANDLE_STMT, s.second);
+
+        statements.clear();
+    }
+
+    // caller holds dbMutex; a transaction just ended: a commit or a rollback, or (with
+    // autocommit on) any statement that ran. on drivers that throw away prepared
+    // statements then (SQL_CB_DELETE), ours are no good any more; they get prepared again
+    // next time they are needed
+    static void TransactionEnded()
+    {
+        if (!statementsSurviveEndTran)
+            FreeStatements();
+    }
+
+    // caller holds dbMutex; a read is done with its statement. with manualCommit, that
+    // ended nothing; the read stays part of the open transaction until the next batch
+    static void ReadDone(SQLHSTMT stmt)
+    {
+        SQLFreeStmt(stmt, SQL_CLOSE);
+
+        if (!manualCommit)
+            TransactionEnded();
+    }
+
+    // after something on handle failed: is it worth trying again? the SQLSTATE classes
+    // below are the statement (or the row) being wrong: 07 is what Access says about a
+    // column it doesn't know ("too few parameters"), 42 is bad SQL / no such table, and
+    // 21, 22, 23 are values that don't fit. everything else (no connection, timeouts,
+    // HY000, which is what Access says when somebody has the file locked) gets retried
+    static DB_QUEUE::WriteResult Classify(SQLSMALLINT handleType, SQLHANDLE handle, std::string &why)
+    {
+        SQLCHAR state[6] = {0};
+        SQLCHAR message[512] = {0};
+        SQLINTEGER nativeError = 0;
+        SQLSMALLINT length = 0;
+
+        if (!SQL_SUCCEEDED(SQLGetDiagRec(handleType, handle, 1, state, &nativeError, message, sizeof(message), &length)))
+        {
+            why = "unknown error";
+            return DB_QUEUE::WRITE_RETRY;
+        }
+
+        std::string sqlState = (char *)state;
+        std::string sqlClass = sqlState.substr(0, 2);
+
+        why = sqlState + ": " + (char *)message;
+
+        if (sqlClass == "07" || sqlClass == "21" || sqlClass == "22" || sqlClass == "23" || sqlClass == "42")
+            return DB_QUEUE::WRITE_REJECTED;
+
+        return DB_QUEUE::WRITE_RETRY;
+    }
+
+    // caller holds dbMutex; NULL if the SQL can't be prepared (and, if result is given,
+    // whether that is worth trying again, and why not)
+    static SQLHSTMT Prepare(const std::string &sql, DB_QUEUE::WriteResult *result = NULL, std::string *why = NULL)
+    {
+        std::map<std::string, SQLHSTMT>::iterator it = statements.find(sql);
+
+        if (it != statements.end())
+            return it->second;
+
+        SQLHSTMT stmt = NULL;
+
+        if (!SQL_SUCCEEDED(SQLAllocHandle(SQL_HANDLE_STMT, dbc, &stmt)))
+        {
+            if (result)
+                *result = Classify(SQL_HANDLE_DBC, dbc, *why);
+
+            return NULL;
+        }
+
+        if (!SQL_SUCCEEDED(SQLPrepare(stmt, (SQLCHAR *)sql.c_str(), SQL_NTS)))
+        {
+            if (result)
+                *result = Classify(SQL_HANDLE_STMT, stmt, *why);
+
+            SQLFreeHandle(SQL_HANDLE_STMT, stmt);
+            return NULL;
+        }
+
+        statements[sql] = stmt;
+
+        return stmt;
+    }
+
+    // caller holds dbMutex
+    static void CloseConnection()
+    {
+        FreeStatements();
+
+        if (dbc != NULL)
+        {
+            // (SQLDisconnect() won't with a transaction open; there's only reads in it, anyway)
+            if (_connected && manualCommit)
+                SQLEndTran(SQL_HANDLE_DBC, dbc, SQL_COMMIT);
+
+            SQLDisconnect(dbc);
+            SQLFreeHandle(SQL_HANDLE_DBC, dbc);
+        }
+
+        if (env != NULL)
+            SQLFreeHandle(SQL_HANDLE_ENV, env);
+
+        dbc = NULL;
+        env = NULL;
+        _connected = false;
+        manualCommit = false;
+    }
+
+    // caller holds dbMutex
+    static bool OpenConnection()
     {
         SQLCHAR outstr[1024];
         SQLSMALLINT outstrlen;
 
         bool retval = false;
 
+        CloseConnection();
+
         // Allocate an environment handle
         SQLAllocHandle(SQL_HANDLE_ENV, SQL_NULL_HANDLE, &env);
 
@@ -49,7 +195,7 @@ namespace DB
         std::string connection_string;
 
         connection_string =
-            "DRIVER={Microsoft Access Driver (*.mdb, *.accdb)}; DBQ=" + database_file;
+            "DRIVER={Microsoft Access Driver (*.mdb, *.accdb)}; DBQ=" + databaseFile;
 
         retval = (SQLDriverConnect(dbc,
                                    NULL,
@@ -60,20 +206,161 @@ namespace DB
                                    &outstrlen,
                                    SQL_DRIVER_NOPROMPT) == SQL_SUCCESS);
 
+        if (retval)
+        {
+            SQLUSMALLINT onCommit = SQL_CB_DELETE;
+            SQLUSMALLINT onRollback = SQL_CB_DELETE;
+
+            SQLGetInfo(dbc, SQL_CURSOR_COMMIT_BEHAVIOR, &onCommit, sizeof(onCommit), NULL);
+            SQLGetInfo(dbc, SQL_CURSOR_ROLLBACK_BEHAVIOR, &onRollback, sizeof(onRollback), NULL);
+
+            statementsSurviveEndTran = (onCommit != SQL_CB_DELETE) && (onRollback != SQL_CB_DELETE);
+
+            manualCommit = SQL_SUCCEEDED(SQLSetConnectAttr(dbc, SQL_ATTR_AUTOCOMMIT, (SQLPOINTER)SQL_AUTOCOMMIT_OFF, SQL_IS_UINTEGER));
+        }
+
         _connected = retval;
         return retval;
     }
 
+    // what the write-behind queue writes through; every batch is one transaction (along with
+    // any reads since the last one; see manualCommit)
+    class ODBCBackend : public DB_QUEUE::Backend
+    {
+    public:
+        DB_QUEUE::WriteResult WriteBatch(const std::vector<DB_QUEUE::RowUpdate> &rows, DB_QUEUE::Rejected &rejected) override
+        {
+            std::lock_guard<std::mutex> lock(dbMutex);
+
+            // if we couldn't get to the database before, maybe we can now
+            if (!_connected)
+                OpenConnection();
+
+            if (!_connected)
+                return DB_QUEUE::WRITE_RETRY;
+
+            if (!manualCommit && !SQL_SUCCEEDED(SQLSetConnectAttr(dbc, SQL_ATTR_AUTOCOMMIT, (SQLPOINTER)SQL_AUTOCOMMIT_OFF, SQL_IS_UINTEGER)))
+                return DB_QUEUE::WRITE_RETRY;
+
+            DB_QUEUE::WriteResult retval = DB_QUEUE::WRITE_OK;
+
+            for (size_t i = 0; retval == DB_QUEUE::WRITE_OK && i < rows.size(); i++)
+            {
+                std::string why;
+                SQLHSTMT stmt = Prepare(DB_QUEUE::UpdateStatement(rows[i]), &retval, &why);
+
+                // the values, then the key; they only have to stay put until SQLExecute()
+                std::vector<SQLINTEGER> params;
+
+                for (const std::pair<std::string, int> &value : rows[i].values)
+                    params.push_back(value.second);
+
+                params.push_back(rows[i].key);
+
+                for (size_t p = 0; stmt != NULL && retval == DB_QUEUE::WRITE_OK && p < params.size(); p++)
+                {
+                    if (!SQL_SUCCEEDED(SQLBindParameter(stmt, (SQLUSMALLINT)(p + 1), SQL_PARAM_INPUT, SQL_C_SLONG, SQL_INTEGER, 0, 0, &params[p], 0, NULL)))
+                        retval = Classify(SQL_HANDLE_STMT, stmt, why);
+                }
+
+                if (stmt != NULL && retval == DB_QUEUE::WRITE_OK)
+                {
+                    SQLRETURN result = SQLExecute(stmt);
+
+                    // SQL_NO_DATA: there's no such row. that used to come back to whoever
+                    // called Write(); now it goes in the dead-letter file, and Flush() says so
+                    if (result == SQL_NO_DATA)
+                    {
+                        why = "no row with " + rows[i].keyColumn + " = " + std::to_string(rows[i].key);
+                        retval = DB_QUEUE::WRITE_REJECTED;
+                    }
+                    else if (!SQL_SUCCEEDED(result))
+                    {
+                        retval = Classify(SQL_HANDLE_STMT, stmt, why);
+                    }
+
+                    SQLFreeStmt(stmt, SQL_CLOSE);
+                }
+
+                if (retval == DB_QUEUE::WRITE_REJECTED)
+                    rejected = {i, why};
+            }
+
+            if (retval == DB_QUEUE::WRITE_OK && !SQL_SUCCEEDED(SQLEndTran(SQL_HANDLE_DBC, dbc, SQL_COMMIT)))
+                retval = DB_QUEUE::WRITE_RETRY;
+
+            if (retval != DB_QUEUE::WRITE_OK)
+                SQLEndTran(SQL_HANDLE_DBC, dbc, SQL_ROLLBACK);
+
+            TransactionEnded();
+
+            if (!manualCommit)
+                SQLSetConnectAttr(dbc, SQL_ATTR_AUTOCOMMIT, (SQLPOINTER)SQL_AUTOCOMMIT_ON, SQL_IS_UINTEGER);
+
+            return retval;
+        }
+
+        std::string Name() const override
+        {
+            return "DB";
+        }
+    };
+
+    bool Connect(const std::string &database_file, const std::string &journal_file)
+    {
+        bool retval = false;
+
+        {
+            std::lock_guard<std::mutex> lock(dbMutex);
+
+            databaseFile = database_file;
+            retval = OpenConnection();
+        }
+
+        // even if we can't get to the database right now, results still get journaled;
+        // the queue keeps trying, and they go in once it is back
+        writeQueue = std::make_unique<DB_QUEUE::WriteBehindQueue>(std::make_unique<ODBCBackend>(), journal_file);
+
+        if (!writeQueue->Start())
+            writeQueue.reset();
+
+        return retval;
+    }
+
     void Disconnect()
     {
-        SQLDisconnect(dbc);
-        SQLFreeHandle(SQL_HANDLE_DBC, dbc);
-        SQLFreeHandle(SQL_HANDLE_ENV, env);
+        if (writeQueue)
+        {
+            writeQueue->Stop(DRAIN_TIMEOUT_MS);
+            writeQueue.reset();
+        }
+
+        std::lock_guard<std::mutex> lock(dbMutex);
+        CloseConnection();
+    }
+
+    bool Flush(int timeoutMS)
+    {
+        if (!writeQueue)
+            return true;
+
+        return writeQueue->Flush(timeoutMS);
     }
 
-    static std::string bool_to_zero_or_one(bool b)
+    // through the queue; unless we couldn't start it (no journal), then straight to the
+    // database, like it always used to
+    static bool WriteRow(const DB_QUEUE::RowUpdate &row)
     {
-        return b ? "1" : "0";
+        if (writeQueue)
+            return writeQueue->Enqueue(row);
+
+        DB_QUEUE::Rejected rejected = {0};
+        DB_QUEUE::WriteResult result = ODBCBackend().WriteBatch({row}, rejected);
+
+        if (result == DB_QUEUE::WRITE_REJECTED)
+            PrintToScreen("Database update of " + row.table + " " + std::to_string(row.key) + " rejected: " + rejected.why);
+
+        return (result == DB_QUEUE::WRITE_OK);
     }
 
     // code for dealing with columns re: to the LT Threshold Test
@@ -83,11 +370,10 @@ namespace DB
         // fills in record, for the row with the given serial number
         bool Read(LTThresholdRecord &record, const std::string &serial_num)
         {
-            SQLHSTMT stmt = NULL;
-            SQLRETURN result;
-
             bool retval = false;
 
+            std::lock_guard<std::mutex> lock(dbMutex);
+
             if (!_connected)
                 return false;
 
@@ -100,16 +386,24 @@ namespace DB
                 "[LTPu_C]";
 
             std::string sql_query_string =
-                "SELECT ID, " + column_list + " FROM AutoTestResults WHERE [Serial Number] = " + "'" + serial_num + "'";
+                "SELECT ID, " + column_list + " FROM AutoTestResults WHERE [Serial Number] = ?";
 
-            // Allocate a statement handle
-            SQLAllocHandle(SQL_HANDLE_STMT, dbc, &stmt);
+            // the serial number comes off a scanner; it goes in as a parameter, never as part of the SQL
+            SQLLEN serial_num_len = SQL_NTS;
+            SQLHSTMT stmt = Prepare(sql_query_string);
+
+            if (stmt == NULL)
+                return false;
+
+            if (!SQL_SUCCEEDED(SQLBindParameter(stmt, 1, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, (std::max)(serial_num.size(), (size_t)1), 0,
+                                                (SQLPOINTER)serial_num.c_str(), 0, &serial_num_len)))
+                return false;
 
             // Execute the query
-            SQLExecDirect(stmt, (SQLCHAR *)sql_query_string.c_str(), SQL_NTS);
+            bool executed = SQL_SUCCEEDED(SQLExecute(stmt));
 
             // query should contain only one row; extract its contents in record
-            if (SQLFetch(stmt) == SQL_SUCCESS)
+            if (executed && SQLFetch(stmt) == SQL_SUCCESS)
             {
                 // save the serial number this record is for
                 record.SerialNum = serial_num;
@@ -144,6 +438,9 @@ namespace DB
                 retval = everythingOK;
             }
 
+            // done with the results; the statement itself stays prepared for next time
+            ReadDone(stmt);
+
             return retval;
         }
 
@@ -151,33 +448,24 @@ namespace DB
         // record already contains the serial number
         bool Write(const LTThresholdRecord &record)
         {
-            SQLHSTMT stmt = NULL;
-            bool retval = false;
-
-            if (!_connected)
-                return false;
-
             if (record.ID == 0 || record.SerialNum.empty())
                 return false;
 
-            std::string sql_query_string =
-                "UPDATE AutoTestResults SET "
-                "LTNoPu_A = " +
-                std::to_string(record.LTNoPu_A) + ", " +
-                "LTPu_A = " + std::to_string(record.LTPu_A) + ", " +
-                "LTNoPu_B = " + std::to_string(record.LTNoPu_B) + ", " +
-                "LTPu_B = " + std::to_string(record.LTPu_B) + ", " +
-                "LTNoPu_C = " + std::to_string(record.LTNoPu_C) + ", " +
-                "LTPu_C = " + std::to_string(record.LTPu_C) + " " +
-                "WHERE ID = " + std::to_string(record.ID);
-
-            // Allocate a statement handle
-            SQLAllocHandle(SQL_HANDLE_STMT, dbc, &stmt);
-
-            // Execute the query
-            retval = (SQLExecDirect(stmt, (SQLCHAR *)sql_query_string.c_str(), SQL_NTS) == SQL_SUCCESS);
-
-            return retval;
+            DB_QUEUE::RowUpdate row;
+
+            row.table = "AutoTestResults";
+            row.keyColumn = "ID";
+            row.key = record.ID;
+            row.values = {
+                {"LTNoPu_A", record.LTNoPu_A},
+                {"LTPu_A", record.LTPu_A},
+                {"LTNoPu_B", record.LTNoPu_B},
+                {"LTPu_B", record.LTPu_B},
+                {"LTNoPu_C", record.LTNoPu_C},
+                {"LTPu_C", record.LTPu_C},
+            };
+
+            return WriteRow(row);
         }
     }
 
@@ -186,10 +474,10 @@ namespace DB
     {
         bool Read(PersonalityRecord &record, const std::string &serial_num)
         {
-
-            SQLHSTMT stmt = NULL;
             bool retval = false;
 
+            std::lock_guard<std::mutex> lock(dbMutex);
+
             if (!_connected)
                 return false;
 
@@ -203,16 +491,24 @@ namespace DB
                 "[GF Only Personality]";
 
             std::string sql_query_string =
-                "SELECT ID, " + column_list + " FROM AutoTestResults WHERE [Serial Number] = " + "'" + serial_num + "'";
+                "SELECT ID, " + column_list + " FROM AutoTestResults WHERE [Serial Number] = ?";
 
-            // Allocate a statement handle
-            SQLAllocHandle(SQL_HANDLE_STMT, dbc, &stmt);
+            // the serial number comes off a scanner; it goes in as a parameter, never as part of the SQL
+            SQLLEN serial_num_len = SQL_NTS;
+            SQLHSTMT stmt = Prepare(sql_query_string);
+
+            if (stmt == NULL)
+                return false;
+
+            if (!SQL_SUCCEEDED(SQLBindParameter(stmt, 1, SQL_PARAM_INPUT, SQL_C_CHAR, SQL_VARCHAR, (std::max)(serial_num.size(), (size_t)1), 0,
+                                                (SQLPOINTER)serial_num.c_str(), 0, &serial_num_len)))
+                return false;
 
             // Execute the query
-            SQLExecDirect(stmt, (SQLCHAR *)sql_query_string.c_str(), SQL_NTS);
+            bool executed = SQL_SUCCEEDED(SQLExecute(stmt));
 
             // query should contain only one row; extrat its contents in record
-            if (SQLFetch(stmt) == SQL_SUCCESS)
+            if (executed && SQLFetch(stmt) == SQL_SUCCESS)
             {
                 // save the serial number this record is for
                 record.SerialNum = serial_num;
@@ -268,41 +564,33 @@ namespace DB
                 retval = true;
             }
 
+            // same as for the LT Threshold record
+            ReadDone(stmt);
+
             return retval;
         }
 
         bool Write(const PersonalityRecord &record)
         {
-
-            SQLHSTMT stmt = NULL;
-            bool retval = false;
-
-            if (!_connected)
-                return false;
-
             if (record.ID == 0 || record.SerialNum.empty())
                 return false;
 
-            std::string sql_query_string =
-                "UPDATE AutoTestResults SET "
-                "[LT PU On/Off Personalitity] = " +
-                bool_to_zero_or_one(record.LTPUOnOffPersonalitity) + ", " +
-                "[LT PU to 120% Personality] = " + bool_to_zero_or_one(record.LTPUto120PercentPersonality) + ", "
-                                                                                                             "[LT Dly to 50 sec Personality] = " +
-                bool_to_zero_or_one(record.LTDlyto50secPersonality) + ", "
-                                                                      "[Inst Override Personality] = " +
-                bool_to_zero_or_one(record.InstOverridePersonality) + ", "
-                                                                      "[Inst Close Personality] = " +
-                bool_to_zero_or_one(record.InstClosePersonality) + ", " +
-                "[Inst Block Personality] = " + bool_to_zero_or_one(record.InstBlockPersonality) + ", " +
-                "[GF Only Personality] = " + bool_to_zero_or_one(record.GFOnlyPersonality) +
-                " WHERE ID = " + std::to_string(record.ID);
-
-            // Allocate a statement handle
-            SQLAllocHandle(SQL_HANDLE_STMT, dbc, &stmt);
-
-            // Execute the query
-            retval = (SQLExecDirect(stmt, (SQLCHAR *)sql_query_string.c_str(), SQL_NTS) == SQL_SUCCESS);
+            DB_QUEUE::RowUpdate row;
+
+            row.table = "AutoTestResults";
+            row.keyColumn = "ID";
+            row.key = record.ID;
+            row.values = {
+                {"LT PU On/Off Personalitity", record.LTPUOnOffPersonalitity},
+                {"LT PU to 120% Personality", record.LTPUto120PercentPersonality},
+                {"LT Dly to 50 sec Personality", record.LTDlyto50secPersonality},
+                {"Inst Override Personality", record.InstOverridePersonality},
+                {"Inst Close Personality", record.InstClosePersonality},
+                {"Inst Block Personality", record.InstBlockPersonality},
+                {"GF Only Personality", record.GFOnlyPersonality},
+            };
+
+            return WriteRow(row);
         }
 
     }
@@ -17,9 +17,22 @@
 namespace DB
 {
 
-    bool Connect(const std::string &database_file);
+    // how long Flush() callers wait, and how long Disconnect() keeps trying to get
+    // what's still queued into the database
+    const int FLUSH_TIMEOUT_MS = 1000 * 10;
+    const int DRAIN_TIMEOUT_MS = 1000 * 5;
+
+    // writes don't go straight to the database; they are journaled to journal_file and
+    // written in the background (see util\db_queue.hpp). so Write() returning true means
+    // the record is safe, not that it is in the database yet; use Flush() for that
+    bool Connect(const std::string &database_file, const std::string &journal_file);
     void Disconnect();
 
+    // wait for everything written so far to be in the database; false if it timed out, or
+    // if the database turned any of it down (no such row, say); those are in the journal's
+    // dead-letter file, and the reason is printed when it happens
+    bool Flush(int timeoutMS);
+
     namespace TLThreshold
     {
 
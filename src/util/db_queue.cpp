@@ -0,0 +1,449 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "db_queue.hpp"
+#include "serial_rx.hpp"
+#include "screen.hpp"
+
+// the journal is a text file, one line per thing that happened, fields separated by tabs:
+//
+//	W	seq	table	keyColumn	key	column=value	column=value ...
+//	C	seq
+//	D	seq
+//
+// W is a row somebody Enqueue()d; C means everything up to (and including) seq is in the
+// database; D means that one row got rejected, and is in the dead-letter file instead.
+// once everything is in, the file gets emptied out
+//
+// the dead-letter file has the W line for each rejected row, after a # line saying why;
+// once whatever was wrong is fixed, the W lines can be pasted back into the journal
+
+namespace DB_QUEUE
+{
+	std::string UpdateStatement(const RowUpdate &row)
+	{
+		std::ostringstream sql;
+
+		sql << "UPDATE [" << row.table << "] SET ";
+
+		for (size_t i = 0; i < row.values.size(); i++)
+			sql << ((i > 0) ? ", " : "") << "[" << row.values[i].first << "] = ?";
+
+		sql << " WHERE [" << row.keyColumn << "] = ?";
+
+		return sql.str();
+	}
+
+	static std::string JournalLine(uint64_t seq, const RowUpdate &row)
+	{
+		std::ostringstream line;
+
+		line << "W\t" << seq << "\t" << row.table << "\t" << row.keyColumn << "\t" << row.key;
+
+		for (const std::pair<std::string, int> &value : row.values)
+			line << "\t" << value.first << "=" << value.second;
+
+		line << "\n";
+
+		return line.str();
+	}
+
+	static std::vector<std::string> SplitTabs(const std::string &line)
+	{
+		std::vector<std::string> fields;
+		size_t start = 0;
+
+		for (;;)
+		{
+			size_t tab = line.find('\t', start);
+
+			fields.push_back(line.substr(start, tab - start));
+
+			if (tab == std::string::npos)
+				break;
+
+			start = tab + 1;
+		}
+
+		return fields;
+	}
+
+	WriteBehindQueue::WriteBehindQueue(std::unique_ptr<Backend> backend, const std::string &journalFile, const QueueConfig &config)
+		: backend(std::move(backend)), journalFile(journalFile), config(config)
+	{
+	}
+
+	WriteBehindQueue::~WriteBehindQueue()
+	{
+		Stop();
+	}
+
+	// everything that has a W but no C after it goes back in the queue, in the same order
+	bool WriteBehindQueue::LoadJournal()
+	{
+		std::ifstream file(journalFile);
+		std::string line;
+		std::vector<Pending> rows;
+		std::set<uint64_t> rejected;
+		uint64_t done = 0;
+
+		// no journal yet is fine
+		if (!file)
+			return true;
+
+		while (std::getline(file, line))
+		{
+			if (!line.empty() && line.back() == '\r')
+				line.pop_back();
+
+			std::vector<std::string> fields = SplitTabs(line);
+
+			if (fields.size() == 2 && fields[0] == "C")
+			{
+				done = (std::max)(done, (uint64_t)strtoull(fields[1].c_str(), nullptr, 10));
+			}
+			else if (fields.size() == 2 && fields[0] == "D")
+			{
+				rejected.insert(strtoull(fields[1].c_str(), nullptr, 10));
+			}
+			else if (fields.size() >= 5 && fields[0] == "W")
+			{
+				Pending p;
+
+				p.seq = strtoull(fields[1].c_str(), nullptr, 10);
+				p.row.table = fields[2];
+				p.row.keyColumn = fields[3];
+				p.row.key = atoi(fields[4].c_str());
+
+				for (size_t i = 5; i < fields.size(); i++)
+				{
+					size_t equals = fields[i].rfind('=');
+
+					if (equals != std::string::npos)
+						p.row.values.push_back({fields[i].substr(0, equals), atoi(fields[i].c_str() + equals + 1)});
+				}
+
+				rows.push_back(p);
+			}
+
+			// anything else is a line that didn't get finished when we went down; skip it
+		}
+
+		for (const Pending &p : rows)
+		{
+			nextSeq = (std::max)(nextSeq, p.seq + 1);
+
+			if (p.seq > done && rejected.count(p.seq) == 0)
+				pending.push_back(p);
+		}
+
+		doneSeq = pending.empty() ? nextSeq - 1 : pending.front().seq - 1;
+		stats.replayed = pending.size();
+
+		return true;
+	}
+
+	// caller holds mutex
+	bool WriteBehindQueue::AppendToJournal(const std::string &line)
+	{
+		if (!journal)
+			return false;
+
+		bool retval = (fputs(line.c_str(), journal) >= 0) && (fflush(journal) == 0);
+
+		// fflush() only gets it as far as the OS; make sure it is actually on the disk
+		if (retval)
+#ifdef _WIN32
+			retval = (_commit(_fileno(journal)) == 0);
+#else
+			retval = (fsync(fileno(journal)) == 0);
+#endif
+
+		return retval;
+	}
+
+	// caller holds mutex; only when everything is in the database
+	bool WriteBehindQueue::TruncateJournal()
+	{
+		if (journal)
+			fclose(journal);
+
+		journal = fopen(journalFile.c_str(), "wb");
+
+		return (journal != nullptr);
+	}
+
+	// caller holds mutex
+	void WriteBehindQueue::DeadLetter(const Pending &p, const std::string &why)
+	{
+		FILE *file = fopen(DeadLetterFile().c_str(), "ab");
+		bool saved = (file != nullptr);
+
+		if (saved)
+		{
+			saved = (fprintf(file, "# %s\n", why.c_str()) >= 0) && (fputs(JournalLine(p.seq, p.row).c_str(), file) >= 0);
+			saved &= (fclose(file) == 0);
+		}
+
+		scr_printf("%s: update of %s %d rejected (%s); %s", backend->Name().c_str(), p.row.table.c_str(), p.row.key, why.c_str(),
+				   saved ? ("it is in " + DeadLetterFile()).c_str() : "and it cannot be saved to the dead-letter file");
+
+		// if we can't save it, leave it in the journal; better it holds things up on the next
+		// Start() than it gets lost
+		if (saved && !AppendToJournal("D\t" + std::to_string(p.seq) + "\n"))
+			scr_printf("%s: cannot update journal %s", backend->Name().c_str(), journalFile.c_str());
+	}
+
+	bool WriteBehindQueue::Start()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (running)
+			return true;
+
+		bool retval = LoadJournal();
+
+		if (retval)
+		{
+			journal = fopen(journalFile.c_str(), "ab");
+			retval = (journal != nullptr);
+
+			if (!retval)
+				scr_printf("%s: cannot open journal %s", backend->Name().c_str(), journalFile.c_str());
+		}
+
+		if (retval)
+		{
+			if (!pending.empty())
+				scr_printf("%s: %d row(s) left over in %s from last time; writing them now", backend->Name().c_str(), (int)pending.size(), journalFile.c_str());
+
+			running = true;
+			stopping = false;
+
+			worker = std::thread(&WriteBehindQueue::Worker, this);
+		}
+
+		return retval;
+	}
+
+	void WriteBehindQueue::Stop(int drainMS)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			if (!running)
+				return;
+
+			stopping = true;
+			stopDeadlineMS = SERIAL_RX::NowMS() + (std::max)(drainMS, 0);
+		}
+
+		changed.notify_all();
+		worker.join();
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (!pending.empty())
+			scr_printf("%s: %d row(s) not written yet; they are in %s for next time", backend->Name().c_str(), (int)pending.size(), journalFile.c_str());
+
+		if (journal)
+			fclose(journal);
+
+		journal = nullptr;
+		running = false;
+	}
+
+	bool WriteBehindQueue::Enqueue(const RowUpdate &row)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		bool retval;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			retval = running && !stopping;
+
+			// journal first; if it isn't in there, it isn't queued
+			if (retval)
+				retval = AppendToJournal(JournalLine(nextSeq, row));
+
+			if (retval)
+			{
+				pending.push_back({nextSeq++, row});
+				stats.queued++;
+			}
+
+			uint64_t us = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+			stats.maxEnqueueUS = (std::max)(stats.maxEnqueueUS, us);
+		}
+
+		if (retval)
+			changed.notify_all();
+		else
+			scr_printf("%s: cannot queue update of %s %d", backend->Name().c_str(), row.table.c_str(), row.key);
+
+		return retval;
+	}
+
+	bool WriteBehindQueue::Flush(int timeoutMS)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+
+		uint64_t target = nextSeq - 1;
+		uint64_t from = doneSeq;
+
+		flushWaiters++;
+		changed.notify_all();
+
+		bool retval = changed.wait_for(lock, std::chrono::milliseconds(timeoutMS), [&]
+									   { return doneSeq >= target; });
+
+		flushWaiters--;
+
+		// something that wasn't done yet when we got here went in the dead-letter file
+		return retval && (rejectedSeq <= from);
+	}
+
+	void WriteBehindQueue::Worker()
+	{
+		int retryMS = config.retryMS;
+
+		std::unique_lock<std::mutex> lock(mutex);
+
+		for (;;)
+		{
+			if (pending.empty())
+			{
+				if (stopping)
+					break;
+
+				changed.wait(lock);
+				continue;
+			}
+
+			if (stopping && SERIAL_RX::NowMS() >= stopDeadlineMS)
+				break;
+
+			// give everybody a chance to add to this batch; unless we are trying to get out,
+			// or somebody is waiting on it
+			if (!stopping && flushWaiters == 0 && (int)pending.size() < config.maxBatch)
+			{
+				changed.wait_for(lock, std::chrono::milliseconds(config.batchWaitMS), [&]
+								 { return stopping || flushWaiters > 0 || (int)pending.size() >= config.maxBatch; });
+			}
+
+			// only we ever take things off the front, so these stay put while we are unlocked
+			size_t n = (std::min)(pending.size(), (size_t)(std::max)(config.maxBatch, 1));
+			std::vector<RowUpdate> rows;
+
+			for (size_t i = 0; i < n; i++)
+				rows.push_back(pending[i].row);
+
+			Rejected rejected = {0};
+
+			lock.unlock();
+			WriteResult result = backend->WriteBatch(rows, rejected);
+			lock.lock();
+
+			if (result == WRITE_OK)
+			{
+				pending.erase(pending.begin(), pending.begin() + n);
+
+				stats.written += n;
+				stats.batches++;
+			}
+			else if (result == WRITE_REJECTED && rejected.row < n)
+			{
+				// the rest of the batch didn't go in either; they go again without it, right away
+				Pending p = pending[rejected.row];
+
+				pending.erase(pending.begin() + rejected.row);
+
+				stats.rejected++;
+				rejectedSeq = p.seq;
+
+				DeadLetter(p, rejected.why);
+			}
+
+			if (result == WRITE_OK || (result == WRITE_REJECTED && rejected.row < n))
+			{
+				uint64_t wasDone = doneSeq;
+
+				doneSeq = pending.empty() ? nextSeq - 1 : pending.front().seq - 1;
+				retryMS = config.retryMS;
+
+				bool journaled = true;
+
+				if (pending.empty())
+					journaled = TruncateJournal();
+				else if (doneSeq > wasDone)
+					journaled = AppendToJournal("C\t" + std::to_string(doneSeq) + "\n");
+
+				// worst case, those rows get written again next time; they are UPDATEs, so no harm done
+				if (!journaled)
+					scr_printf("%s: cannot update journal %s", backend->Name().c_str(), journalFile.c_str());
+
+				changed.notify_all();
+			}
+			else
+			{
+				stats.failedBatches++;
+
+				int waitMS = retryMS;
+				bool wasStopping = stopping;
+
+				// if we are draining, still back off, but not past the deadline
+				if (stopping)
+					waitMS = (int)(std::min)((int64_t)waitMS, (std::max)((int64_t)0, (int64_t)(stopDeadlineMS - SERIAL_RX::NowMS())));
+
+				changed.wait_for(lock, std::chrono::milliseconds(waitMS), [&]
+								 { return stopping && !wasStopping; });
+
+				retryMS = (std::min)(retryMS * 2, config.maxRetryMS);
+			}
+		}
+	}
+
+	QueueStats WriteBehindQueue::Stats()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		QueueStats s = stats;
+		s.pending = pending.size();
+
+		return s;
+	}
+
+	void WriteBehindQueue::PrintStats()
+	{
+		QueueStats s = Stats();
+
+		scr_printf("%s: queued %llu, written %llu in %llu batch(es), %llu failed batch(es), %llu rejected, replayed %llu, pending %llu, slowest Enqueue() %llu us",
+				   backend->Name().c_str(), (unsigned long long)s.queued, (unsigned long long)s.written, (unsigned long long)s.batches,
+				   (unsigned long long)s.failedBatches, (unsigned long long)s.rejected, (unsigned long long)s.replayed, (unsigned long long)s.pending,
+				   (unsigned long long)s.maxEnqueueUS);
+	}
+}
@@ -0,0 +1,167 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// getting test results into the production database without the test waiting on it
+//
+// the database is an Access file on a shared drive; it can be slow, or somebody can have
+// it locked, and a test used to just sit there (or fail) until the UPDATE went through.
+// now the test hands the row to a WriteBehindQueue and carries on:
+//
+//	-	Enqueue() puts the row in a journal file on the local disk first (and flushes it),
+//		so once it returns, the row can't get lost; not even if the app dies
+//	-	a background thread writes the rows to the database, as many at a time as it has
+//		(up to maxBatch), in one transaction; if that fails, it tries again later
+//	-	unless the database says a row is never going in (there's no such row, or no such
+//		column...); trying again won't change that, and it would hold up everything behind
+//		it, so that row goes in the dead-letter file (the journal's name + ".failed") and
+//		the rest carry on
+//	-	whatever is still in the journal when we start up gets written first
+//
+// the database itself is behind a Backend (ODBC on windows, see db.cpp; SQLite for trying
+// it out anywhere else, see sim/sqlite_backend.cpp)
+
+namespace DB_QUEUE
+{
+	// UPDATE table SET column = value, ... WHERE keyColumn = key
+	// (everything we write is a number; booleans are 0 / 1)
+	typedef struct _RowUpdate
+	{
+		std::string table;
+		std::string keyColumn;
+		int key;
+		std::vector<std::pair<std::string, int>> values;
+	} RowUpdate;
+
+	// the SQL for a RowUpdate, with a ? for each value and then one for the key (bind them
+	// in that order); rows that set the same columns get the same SQL, so backends can
+	// prepare it once and reuse it. names go in [brackets], since some of them have spaces
+	std::string UpdateStatement(const RowUpdate &row);
+
+	typedef enum _WriteResult
+	{
+		WRITE_OK,		// all in
+		WRITE_RETRY,	// none in, but they might go later (can't get to the database, it's locked...)
+		WRITE_REJECTED, // none in, and one of them never will; see Rejected
+	} WriteResult;
+
+	typedef struct _Rejected
+	{
+		size_t row;		 // which one
+		std::string why; // for the log, and the dead-letter file
+	} Rejected;
+
+	class Backend
+	{
+	public:
+		virtual ~Backend() = default;
+
+		// all of rows in one transaction; either they all make it or none of them do.
+		// on WRITE_REJECTED, fills in rejected
+		virtual WriteResult WriteBatch(const std::vector<RowUpdate> &rows, Rejected &rejected) = 0;
+
+		virtual std::string Name() const = 0;
+	};
+
+	typedef struct _QueueConfig
+	{
+		int maxBatch = 50;		   // rows per transaction
+		int batchWaitMS = 250;	   // after the first row shows up, wait this long for more
+		int retryMS = 1000;		   // after a batch fails; doubles every time it fails again...
+		int maxRetryMS = 1000 * 30; // ...up to this
+	} QueueConfig;
+
+	typedef struct _QueueStats
+	{
+		uint64_t queued;		// Enqueue()d
+		uint64_t written;		// in the database
+		uint64_t batches;		// transactions that went through
+		uint64_t failedBatches; // ...and ones that didn't
+		uint64_t rejected;		// went in the dead-letter file instead
+		uint64_t replayed;		// found in the journal at Start()
+		uint64_t pending;		// not in the database yet
+		uint64_t maxEnqueueUS;	// longest anybody waited on Enqueue()
+	} QueueStats;
+
+	class WriteBehindQueue
+	{
+	public:
+		WriteBehindQueue(std::unique_ptr<Backend> backend, const std::string &journalFile, const QueueConfig &config = QueueConfig());
+		~WriteBehindQueue();
+
+		// pick up whatever is left in the journal, and start writing
+		bool Start();
+
+		// keep writing for up to drainMS; anything that doesn't make it stays in the journal,
+		// for the next Start()
+		void Stop(int drainMS = 5000);
+
+		// once this returns true, row is safe in the journal
+		bool Enqueue(const RowUpdate &row);
+
+		// wait (up to timeoutMS) for everything Enqueue()d so far to be in the database;
+		// false if it timed out, or if any of it got rejected
+		bool Flush(int timeoutMS);
+
+		std::string DeadLetterFile() const { return journalFile + ".failed"; }
+
+		QueueStats Stats();
+		void PrintStats();
+
+	private:
+		typedef struct _Pending
+		{
+			uint64_t seq;
+			RowUpdate row;
+		} Pending;
+
+		void Worker();
+		bool LoadJournal();
+		bool AppendToJournal(const std::string &line);
+		bool TruncateJournal();
+		void DeadLetter(const Pending &p, const std::string &why);
+
+		std::unique_ptr<Backend> backend;
+		std::string journalFile;
+		QueueConfig config;
+
+		std::mutex mutex;
+		std::condition_variable changed; // something got queued or written, or we are stopping
+		std::deque<Pending> pending;
+		uint64_t nextSeq = 1;
+		uint64_t doneSeq = 0;	  // everything up to here is in the database, or dead-lettered
+		uint64_t rejectedSeq = 0; // the last one that got dead-lettered
+
+		FILE *journal = nullptr;
+		bool running = false;
+		bool stopping = false;
+		int flushWaiters = 0; // don't hang around filling up a batch while anybody is in Flush()
+		uint64_t stopDeadlineMS = 0;
+
+		QueueStats stats = {0};
+
+		std::thread worker;
+	};
+}
@@ -0,0 +1,284 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "discovery.hpp"
+#include "comm.hpp"
+#include "screen.hpp"
+
+namespace DISCOVERY
+{
+	static const DeviceKind ALL_KINDS[] = {DeviceKind::KEITHLEY, DeviceKind::TRIP_UNIT, DeviceKind::ARDUINO};
+
+	std::string DeviceKindToString(DeviceKind kind)
+	{
+		switch (kind)
+		{
+		case DeviceKind::KEITHLEY:
+			return "KEITHLEY";
+		case DeviceKind::TRIP_UNIT:
+			return "TRIP_UNIT";
+		case DeviceKind::ARDUINO:
+			return "ARDUINO";
+		default:
+			return "???";
+		}
+	}
+
+	static bool StringToDeviceKind(const std::string &s, DeviceKind *kind)
+	{
+		for (DeviceKind k : ALL_KINDS)
+		{
+			if (DeviceKindToString(k) == s)
+			{
+				*kind = k;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	bool DiscoveryCache::Load(const std::string &filename)
+	{
+		std::ifstream file(filename);
+		std::string line;
+
+		if (!file)
+			return false;
+
+		entries.clear();
+
+		while (std::getline(file, line))
+		{
+			std::istringstream fields(line);
+			std::string kindString;
+			CacheEntry entry = {0};
+			DeviceKind kind;
+
+			if (!(fields >> kindString >> entry.port) || !StringToDeviceKind(kindString, &kind))
+				continue;
+
+			// (not there if we didn't know it)
+			fields >> entry.usbSerial;
+
+			entries[kind] = entry;
+		}
+
+		return true;
+	}
+
+	bool DiscoveryCache::Save(const std::string &filename) const
+	{
+		std::ofstream file(filename);
+
+		if (!file)
+			return false;
+
+		for (auto &entry : entries)
+			file << DeviceKindToString(entry.first) << " " << entry.second.port << " " << entry.second.usbSerial << "\n";
+
+		return (bool)file;
+	}
+
+	bool DiscoveryCache::Lookup(DeviceKind kind, CacheEntry *entry) const
+	{
+		auto it = entries.find(kind);
+
+		if (it == entries.end())
+			return false;
+
+		*entry = it->second;
+		return true;
+	}
+
+	void DiscoveryCache::Remember(DeviceKind kind, int port, const std::string &usbSerial)
+	{
+		entries[kind] = {port, usbSerial};
+	}
+
+	void DiscoveryCache::Forget(DeviceKind kind)
+	{
+		entries.erase(kind);
+	}
+
+	// what all of the probing threads share
+	class Search
+	{
+	public:
+		explicit Search(const std::vector<DeviceKind> &wanted) : wanted(wanted) {}
+
+		// still looking for this?
+		bool Needed(DeviceKind kind)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return std::find(wanted.begin(), wanted.end(), kind) != wanted.end() && !Have(kind);
+		}
+
+		// the first one of each kind wins; returns false if somebody beat us to it
+		bool Claim(const FoundDevice &device)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			if (Have(device.kind))
+				return false;
+
+			found.push_back(device);
+			return true;
+		}
+
+		std::vector<FoundDevice> Found()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return found;
+		}
+
+	private:
+		bool Have(DeviceKind kind)
+		{
+			for (FoundDevice &device : found)
+			{
+				if (device.kind == kind)
+					return true;
+			}
+
+			return false;
+		}
+
+		std::vector<DeviceKind> wanted;
+		std::vector<FoundDevice> found;
+		std::mutex mutex;
+	};
+
+	// tries kinds on port, in order, skipping anything that has been found already;
+	// returns true if port turned out to be something
+	static bool ProbePort(Search &search, const ProbeFuncPtr &probe, int port,
+						  const std::vector<DeviceKind> &kinds, const std::string &usbSerial)
+	{
+		for (DeviceKind kind : kinds)
+		{
+			if (!search.Needed(kind))
+				continue;
+
+			HANDLE handle = INVALID_HANDLE_VALUE;
+
+			if (!probe(port, kind, &handle))
+				continue;
+
+			if (!search.Claim({kind, port, handle, usbSerial}))
+			{
+				PrintToScreen("another " + DeviceKindToString(kind) + " found on comm port " + std::to_string(port) + "; ignoring it");
+				CloseCommPort(&handle);
+			}
+
+			// whatever it is, it isn't going to be anything else too
+			return true;
+		}
+
+		return false;
+	}
+
+	std::vector<FoundDevice> FindDevices(
+		const std::vector<int> &ports,
+		const std::vector<DeviceKind> &wanted,
+		const ProbeFuncPtr &probe,
+		const USBSerialFuncPtr &usbSerial,
+		DiscoveryCache &cache)
+	{
+		Search search(wanted);
+		std::map<int, std::string> serials;
+		std::map<int, bool> portUsed;
+
+		// (the FTDI driver gets asked one port at a time, before any of the threads start)
+		for (int port : ports)
+			serials[port] = usbSerial ? usbSerial(port) : "";
+
+		// 1st: where the cache says things are
+		std::vector<std::thread> threads;
+
+		for (DeviceKind kind : wanted)
+		{
+			CacheEntry entry;
+			int port = 0;
+
+			if (!cache.Lookup(kind, &entry))
+				continue;
+
+			for (int p : ports)
+			{
+				// same adapter (wherever it is now), or same port if we never knew the adapter
+				if (entry.usbSerial.empty() ? (p == entry.port) : (serials[p] == entry.usbSerial))
+					port = p;
+			}
+
+			if (port == 0 || portUsed[port])
+				continue;
+
+			portUsed[port] = true;
+
+			std::string serial = serials[port];
+
+			threads.emplace_back([&search, &probe, kind, port, serial]
+								 { ProbePort(search, probe, port, {kind}, serial); });
+		}
+
+		for (std::thread &thread : threads)
+			thread.join();
+
+		threads.clear();
+
+		// 2nd: everything else, all at once
+		std::vector<DeviceKind> kinds;
+
+		for (DeviceKind kind : ALL_KINDS)
+		{
+			if (search.Needed(kind))
+				kinds.push_back(kind);
+		}
+
+		if (!kinds.empty())
+		{
+			std::vector<FoundDevice> alreadyFound = search.Found();
+
+			for (int port : ports)
+			{
+				bool taken = std::any_of(alreadyFound.begin(), alreadyFound.end(),
+										 [port](const FoundDevice &device)
+										 { return device.port == port; });
+
+				if (taken)
+					continue;
+
+				std::string serial = serials[port];
+
+				threads.emplace_back([&search, &probe, &kinds, port, serial]
+									 { ProbePort(search, probe, port, kinds, serial); });
+			}
+
+			for (std::thread &thread : threads)
+				thread.join();
+		}
+
+		std::vector<FoundDevice> found = search.Found();
+
+		for (FoundDevice &device : found)
+			cache.Remember(device.kind, device.port, device.usbSerial);
+
+		return found;
+	}
+}
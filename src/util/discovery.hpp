@@ -0,0 +1,92 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "platform.hpp"
+
+// finding out which COM port the Keithley, trip unit and Arduino are on
+//
+// we used to try every port for the Keithley, then every port for the trip unit, then
+// every port for the Arduino, one at a time; every port that isn't the right thing costs
+// a full timeout, so with a hub full of USB serial adapters that added up fast. now:
+//
+//	-	wherever the cache says a device was last time gets tried first (if we know its USB
+//		serial number and it has moved to another port since, we follow it there)
+//	-	then all the other ports get probed at once, one thread per port; each thread tries
+//		the kinds of devices nobody has found yet, in turn, on its port
+//
+// we don't throw *IDN? and a URC MSG_CONNECT at the same port at the same time; the
+// Keithley doesn't like binary garbage, and we don't know what the trip unit does with
+// ASCII. so it's one probe at a time per port, but all of the ports at once
+
+namespace DISCOVERY
+{
+	enum class DeviceKind
+	{
+		KEITHLEY,
+		TRIP_UNIT,
+		ARDUINO,
+	};
+
+	std::string DeviceKindToString(DeviceKind kind);
+
+	// opens port and checks whether kind of device is on the other end;
+	// if so, leaves it open in *handle and returns true
+	typedef std::function<bool(int port, DeviceKind kind, HANDLE *handle)> ProbeFuncPtr;
+
+	// USB serial number of the adapter behind port, or "" if we can't tell
+	typedef std::function<std::string(int port)> USBSerialFuncPtr;
+
+	typedef struct _FoundDevice
+	{
+		DeviceKind kind;
+		int port;
+		HANDLE handle;
+		std::string usbSerial;
+	} FoundDevice;
+
+	typedef struct _CacheEntry
+	{
+		int port;
+		std::string usbSerial; // "" if we couldn't tell
+	} CacheEntry;
+
+	// where things were last time; a text file, one "KIND port [usb serial]" per line
+	class DiscoveryCache
+	{
+	public:
+		bool Load(const std::string &filename);
+		bool Save(const std::string &filename) const;
+
+		bool Lookup(DeviceKind kind, CacheEntry *entry) const;
+		void Remember(DeviceKind kind, int port, const std::string &usbSerial);
+		void Forget(DeviceKind kind);
+
+	private:
+		std::map<DeviceKind, CacheEntry> entries;
+	};
+
+	// finds whichever of wanted are on ports; the cache gets updated with what was found
+	std::vector<FoundDevice> FindDevices(
+		const std::vector<int> &ports,
+		const std::vector<DeviceKind> &wanted,
+		const ProbeFuncPtr &probe,
+		const USBSerialFuncPtr &usbSerial,
+		DiscoveryCache &cache);
+}
@@ -0,0 +1,244 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+#include "instrument_broker.hpp"
+#include "serial_rx.hpp"
+#include "screen.hpp"
+
+namespace INSTRUMENT_BROKER
+{
+	Lease::Lease(Lease &&other) noexcept
+	{
+		*this = std::move(other);
+	}
+
+	Lease &Lease::operator=(Lease &&other) noexcept
+	{
+		if (this != &other)
+		{
+			Release();
+
+			broker = other.broker;
+			resource = std::move(other.resource);
+			ticket = other.ticket;
+			waitedMS = other.waitedMS;
+
+			other.broker = nullptr;
+			other.ticket = 0;
+		}
+
+		return *this;
+	}
+
+	bool Lease::Valid() const
+	{
+		return broker && broker->IsHolder(resource, ticket);
+	}
+
+	void Lease::Release()
+	{
+		if (broker)
+			broker->Release(resource, ticket);
+
+		broker = nullptr;
+		ticket = 0;
+	}
+
+	bool SourceAndMeter::Valid() const
+	{
+		for (const Lease *lease : {&source, &meter})
+		{
+			if (!lease->Valid())
+			{
+				PrintToScreen("lost the lease on " + lease->Resource() + " (somebody else needed it); aborting");
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	void SourceAndMeter::Release()
+	{
+		meter.Release();
+		source.Release();
+	}
+
+	// higher priority first, then whoever got here first
+	bool Broker::NextInLine(const Instrument &instrument, uint64_t ticket)
+	{
+		const Waiter *best = nullptr;
+
+		for (const Waiter &waiter : instrument.waiting)
+		{
+			if (!best || waiter.priority > best->priority || (waiter.priority == best->priority && waiter.ticket < best->ticket))
+				best = &waiter;
+		}
+
+		return best && best->ticket == ticket;
+	}
+
+	void Broker::RemoveWaiter(Instrument &instrument, uint64_t ticket)
+	{
+		instrument.waiting.erase(
+			std::remove_if(instrument.waiting.begin(), instrument.waiting.end(),
+						   [ticket](const Waiter &waiter)
+						   { return waiter.ticket == ticket; }),
+			instrument.waiting.end());
+	}
+
+	Lease Broker::Acquire(const std::string &resource, int priority, int maxHoldMS, int waitTimeoutMS)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+
+		Instrument &instrument = instruments[resource];
+		uint64_t ticket = nextTicket++;
+		uint64_t startMS = SERIAL_RX::NowMS();
+		uint64_t deadlineMS = (waitTimeoutMS == WAIT_FOREVER) ? (std::numeric_limits<uint64_t>::max)() : startMS + waitTimeoutMS;
+
+		instrument.waiting.push_back({ticket, priority});
+
+		for (;;)
+		{
+			uint64_t nowMS = SERIAL_RX::NowMS();
+
+			// we are waiting on somebody who has had it too long
+			if (instrument.holder && nowMS >= instrument.expiresMS)
+			{
+				PrintToScreen("lease on " + resource + " held past its limit; taking it back");
+
+				instrument.stats.revoked++;
+				instrument.stats.totalHeldMS += nowMS - instrument.heldSinceMS;
+				instrument.holder = 0;
+			}
+
+			if (!instrument.holder && NextInLine(instrument, ticket))
+			{
+				RemoveWaiter(instrument, ticket);
+
+				instrument.holder = ticket;
+				instrument.heldSinceMS = nowMS;
+				instrument.expiresMS = nowMS + maxHoldMS;
+
+				Lease lease;
+
+				lease.broker = this;
+				lease.resource = resource;
+				lease.ticket = ticket;
+				lease.waitedMS = nowMS - startMS;
+
+				instrument.stats.leases++;
+				instrument.stats.totalWaitMS += lease.waitedMS;
+				instrument.stats.maxWaitMS = (std::max)(instrument.stats.maxWaitMS, lease.waitedMS);
+
+				return lease;
+			}
+
+			if (nowMS >= deadlineMS)
+			{
+				RemoveWaiter(instrument, ticket);
+				instrument.stats.timedOut++;
+
+				// somebody behind us might be next now
+				changed.notify_all();
+
+				return Lease();
+			}
+
+			// sleep until something changes, the holder's time runs out, or we give up
+			uint64_t wakeMS = deadlineMS;
+			if (instrument.holder)
+				wakeMS = (std::min)(wakeMS, instrument.expiresMS);
+
+			if (wakeMS == (std::numeric_limits<uint64_t>::max)())
+				changed.wait(lock);
+			else
+				changed.wait_for(lock, std::chrono::milliseconds(wakeMS - nowMS));
+		}
+	}
+
+	Lease Broker::AcquireIfIdle(const std::string &resource)
+	{
+		return Acquire(resource, PRIORITY_NORMAL, DEFAULT_MAX_HOLD_MS, 0);
+	}
+
+	SourceAndMeter Broker::AcquireSourceAndMeter(const std::string &source, int priority, int maxHoldMS)
+	{
+		SourceAndMeter leases;
+
+		leases.source = Acquire(source, priority, maxHoldMS);
+		leases.meter = Acquire(KEITHLEY, priority, maxHoldMS);
+
+		return leases;
+	}
+
+	bool Broker::IsHolder(const std::string &resource, uint64_t ticket)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto it = instruments.find(resource);
+		if (it == instruments.end())
+			return false;
+
+		Instrument &instrument = it->second;
+
+		// past its time, but nobody has come along to take it back yet: still ours
+		return ticket != 0 && instrument.holder == ticket;
+	}
+
+	void Broker::Release(const std::string &resource, uint64_t ticket)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		Instrument &instrument = instruments[resource];
+
+		// (already taken back, if not)
+		if (instrument.holder != ticket)
+			return;
+
+		instrument.stats.totalHeldMS += SERIAL_RX::NowMS() - instrument.heldSinceMS;
+		instrument.holder = 0;
+
+		changed.notify_all();
+	}
+
+	LeaseStats Broker::Stats(const std::string &resource)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return instruments[resource].stats;
+	}
+
+	void Broker::PrintStats()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (auto &it : instruments)
+		{
+			const LeaseStats &s = it.second.stats;
+
+			scr_printf("%-20s leases: %4d  waited: %8.1f s (max %6.1f s)  held: %8.1f s  timed out: %d  revoked: %d",
+					   it.first.c_str(), s.leases, s.totalWaitMS / 1000.0, s.maxWaitMS / 1000.0,
+					   s.totalHeldMS / 1000.0, s.timedOut, s.revoked);
+		}
+	}
+
+	Broker &Instruments()
+	{
+		static Broker broker;
+		return broker;
+	}
+}
@@ -0,0 +1,172 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// who gets to use the signal generator / meter right now
+//
+// the Rigol and the BK are process-wide (each driver has the one SCPI_TRANSPORT it talks
+// through), and the Keithley handle gets passed around to whoever wants it; nothing used to
+// stop one thread from reprogramming the source while another one was in the middle of a
+// measurement with it. now you ask the broker for a lease on an instrument first:
+//
+//	-	only one lease per instrument at a time; everybody else waits in line, higher
+//		priority first, then first come first served
+//	-	a lease is only good for so long (maxHoldMS); past that, if somebody is waiting, they
+//		get it, and the old lease stops being Valid(). check before doing anything important
+//	-	how long everybody waited (and held on) is kept per instrument
+//
+// if you need more than one, always ask for the source before the meter; otherwise two
+// threads can each end up holding the one the other one is waiting for (or just use
+// AcquireSourceAndMeter(), which does it in that order)
+//
+// nobody gets a lease taken away just because somebody more important showed up; that
+// would pull the source out from under a measurement. priority decides who goes next, so
+// hold leases for one test point (one calibration gain, ...) at a time, not for a whole
+// test; in between points, a calibration waiting at PRIORITY_HIGH gets in ahead of
+// whatever trip test is waiting for its next point
+
+namespace INSTRUMENT_BROKER
+{
+	// what we hand out leases on
+	constexpr const char *RIGOL = "RIGOL_DG1000Z"; // both channels together (they get synced to each other)
+	constexpr const char *BK_9801 = "BK_PRECISION_9801";
+	constexpr const char *KEITHLEY = "KEITHLEY";
+
+	constexpr int PRIORITY_LOW = 0;		// manual / menu stuff
+	constexpr int PRIORITY_NORMAL = 1;	// trip tests
+	constexpr int PRIORITY_HIGH = 2;	// calibration; a trip unit is sitting there half calibrated
+
+	constexpr int DEFAULT_MAX_HOLD_MS = 1000 * 60 * 10;	  // 10 minutes
+	constexpr int TEST_POINT_MAX_HOLD_MS = 1000 * 60 * 15; // one test point: a slow LT trip (waited on up to 1.5x), plus setting up
+	constexpr int WAIT_FOREVER = -1;
+
+	typedef struct _LeaseStats
+	{
+		int leases;			  // handed out
+		int timedOut;		  // gave up waiting
+		int revoked;		  // taken back after maxHoldMS
+		uint64_t totalWaitMS; // waiting in line, for all of the leases handed out
+		uint64_t maxWaitMS;
+		uint64_t totalHeldMS;
+	} LeaseStats;
+
+	class Broker;
+
+	// gives the instrument back when it goes away (or on Release())
+	class Lease
+	{
+	public:
+		Lease() = default;
+		Lease(Lease &&other) noexcept;
+		Lease &operator=(Lease &&other) noexcept;
+		~Lease() { Release(); }
+
+		Lease(const Lease &) = delete;
+		Lease &operator=(const Lease &) = delete;
+
+		// we have it, and it hasn't been taken back
+		bool Valid() const;
+
+		uint64_t WaitedMS() const { return waitedMS; }
+		const std::string &Resource() const { return resource; }
+
+		void Release();
+
+	private:
+		friend class Broker;
+
+		Broker *broker = nullptr;
+		std::string resource;
+		uint64_t ticket = 0;
+		uint64_t waitedMS = 0;
+	};
+
+	// the source and the meter, for one test point / calibration gain
+	//
+	// check Valid() before each step that uses them, and after waiting on something (a trip,
+	// MSG_EXE_CALIBRATE_AD); if either one was taken back, somebody else may have reprogrammed
+	// the source in the meantime, so the point is no good. don't touch the source after that
+	// either (it is somebody else's now)
+	class SourceAndMeter
+	{
+	public:
+		// says which one we lost, if we did
+		bool Valid() const;
+
+		void Release();
+
+		Lease source;
+		Lease meter;
+	};
+
+	class Broker
+	{
+	public:
+		// returns a lease that isn't Valid() if we waited waitTimeoutMS and still didn't get it
+		Lease Acquire(const std::string &resource,
+					  int priority = PRIORITY_NORMAL,
+					  int maxHoldMS = DEFAULT_MAX_HOLD_MS,
+					  int waitTimeoutMS = WAIT_FOREVER);
+
+		// right away if nobody has it or is waiting for it; otherwise a lease that isn't Valid()
+		Lease AcquireIfIdle(const std::string &resource);
+
+		// source (RIGOL, BK_9801) first, then the KEITHLEY
+		SourceAndMeter AcquireSourceAndMeter(const std::string &source,
+											 int priority = PRIORITY_NORMAL,
+											 int maxHoldMS = TEST_POINT_MAX_HOLD_MS);
+
+		LeaseStats Stats(const std::string &resource);
+		void PrintStats();
+
+	private:
+		friend class Lease;
+
+		typedef struct _Waiter
+		{
+			uint64_t ticket;
+			int priority;
+		} Waiter;
+
+		typedef struct _Instrument
+		{
+			uint64_t holder = 0; // ticket of whoever has it; 0 if nobody
+			uint64_t heldSinceMS = 0;
+			uint64_t expiresMS = 0;
+			std::vector<Waiter> waiting;
+			LeaseStats stats = {0};
+		} Instrument;
+
+		bool IsHolder(const std::string &resource, uint64_t ticket);
+		void Release(const std::string &resource, uint64_t ticket);
+
+		static bool NextInLine(const Instrument &instrument, uint64_t ticket);
+		static void RemoveWaiter(Instrument &instrument, uint64_t ticket);
+
+		std::mutex mutex;
+		std::condition_variable changed;
+		std::map<std::string, Instrument> instruments;
+		uint64_t nextTicket = 1;
+	};
+
+	// the one everybody in the app shares
+	Broker &Instruments();
+}
@@ -0,0 +1,284 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#include "log_ring.hpp"
+
+// the ring is the usual bounded queue where every slot carries a sequence number:
+//
+//	-	slot i starts out with seq = i
+//	-	a producer that got position pos (by bumping enqueuePos) may fill the slot once its
+//		seq == pos, and then sets seq = pos + 1 to say it is full
+//	-	the consumer, at position pos, waits for seq == pos + 1, empties it, and sets
+//		seq = pos + capacity; so the producer that comes around next time sees its pos
+//
+// a producer that finds seq < pos has caught up with the consumer: the ring is full. it
+// doesn't drop its line; it drains the ring itself (under drainMutex, like the consumer),
+// and tries again
+
+namespace LOG_RING
+{
+	static size_t RoundUpToPowerOf2(size_t n)
+	{
+		size_t p = 1;
+
+		while (p < n)
+			p <<= 1;
+
+		return p;
+	}
+
+	LogPipeline::LogPipeline(const LogConfig &config) : config(config)
+	{
+		size_t capacity = RoundUpToPowerOf2((std::max)(config.capacity, (size_t)2));
+
+		slots.reset(new Slot[capacity]);
+		mask = capacity - 1;
+
+		for (size_t i = 0; i < capacity; i++)
+			slots[i].seq.store(i, std::memory_order_relaxed);
+	}
+
+	LogPipeline::~LogPipeline()
+	{
+		Stop();
+
+		if (file)
+			fclose(file);
+	}
+
+	bool LogPipeline::OpenFile(const std::string &filename)
+	{
+		std::lock_guard<std::mutex> lock(drainMutex);
+
+		if (file)
+			fclose(file);
+
+		file = fopen(filename.c_str(), "ab");
+
+		return (file != nullptr);
+	}
+
+	void LogPipeline::Post(const char *text, size_t len)
+	{
+		size_t pos = enqueuePos.load(std::memory_order_relaxed);
+		Slot *slot;
+
+		for (;;)
+		{
+			slot = &slots[pos & mask];
+
+			size_t seq = slot->seq.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+			if (diff == 0)
+			{
+				// it's free; if nobody beat us to it, it's ours
+				if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0)
+			{
+				// full; whoever has the slot the consumer is at may not have filled it yet,
+				// then there's nothing to take out, and we let them get on with it
+				waited.fetch_add(1, std::memory_order_relaxed);
+
+				if (Drain() == 0)
+					std::this_thread::yield();
+
+				pos = enqueuePos.load(std::memory_order_relaxed);
+			}
+			else
+			{
+				pos = enqueuePos.load(std::memory_order_relaxed);
+			}
+		}
+
+		if (len > LINE_BYTES)
+		{
+			len = LINE_BYTES;
+			truncated.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		memcpy(slot->text, text, len);
+		slot->len = (uint32_t)len;
+
+		slot->seq.store(pos + 1, std::memory_order_release);
+		posted.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// under drainMutex
+	bool LogPipeline::Pop(Slot **slot)
+	{
+		Slot *s = &slots[dequeuePos & mask];
+
+		if (s->seq.load(std::memory_order_acquire) != dequeuePos + 1)
+			return false;
+
+		*slot = s;
+		return true;
+	}
+
+	// under drainMutex; done with the slot Pop() gave us
+	void LogPipeline::Release(Slot *slot)
+	{
+		slot->seq.store(dequeuePos + mask + 1, std::memory_order_release);
+		dequeuePos++;
+	}
+
+	// everything that's in the ring right now goes to the file and the window's text; the
+	// consumer does this, and so does a producer that found the ring full
+	size_t LogPipeline::Drain()
+	{
+		std::lock_guard<std::mutex> lock(drainMutex);
+
+		std::string batch;
+		Slot *slot;
+		size_t lines = 0;
+
+		while (Pop(&slot))
+		{
+			size_t len = slot->len;
+			bool lineBreak = true;
+
+			if (len >= 2 && slot->text[len - 2] == '|' && slot->text[len - 1] == '|')
+			{
+				len -= 2;
+				lineBreak = false;
+			}
+
+			if (file)
+			{
+				fwrite(slot->text, 1, len, file);
+
+				if (lineBreak)
+					fputc('\n', file);
+			}
+
+			batch.append(slot->text, len);
+
+			if (lineBreak)
+				batch.append("\r\n");
+
+			Release(slot);
+			lines++;
+		}
+
+		if (lines == 0)
+			return 0;
+
+		if (file)
+			fflush(file);
+
+		written += lines;
+		batches++;
+
+		std::lock_guard<std::mutex> uiLock(uiMutex);
+
+		uiText += batch;
+
+		// nobody is picking it up; the oldest goes (from a line break, if there is one)
+		if (uiText.size() > config.maxUIBytes)
+		{
+			size_t cut = uiText.size() - config.maxUIBytes;
+			size_t lineEnd = uiText.find('\n', cut);
+
+			if (lineEnd != std::string::npos)
+				cut = lineEnd + 1;
+
+			uiText.erase(0, cut);
+			uiDropped += cut;
+		}
+
+		return lines;
+	}
+
+	void LogPipeline::Consumer()
+	{
+		std::unique_lock<std::mutex> lock(wakeMutex);
+
+		while (!stopping)
+		{
+			wake.wait_for(lock, std::chrono::milliseconds(config.flushIntervalMS));
+
+			lock.unlock();
+			Drain();
+			lock.lock();
+		}
+	}
+
+	void LogPipeline::Start()
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+
+		if (consumer.joinable())
+			return;
+
+		stopping = false;
+		consumer = std::thread(&LogPipeline::Consumer, this);
+	}
+
+	void LogPipeline::Stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(wakeMutex);
+			stopping = true;
+		}
+
+		wake.notify_all();
+
+		if (consumer.joinable())
+			consumer.join();
+
+		// whatever got in after the consumer's last look
+		Drain();
+	}
+
+	std::string LogPipeline::TakeUIText()
+	{
+		std::lock_guard<std::mutex> lock(uiMutex);
+
+		std::string text;
+		text.swap(uiText);
+
+		return text;
+	}
+
+	LogStats LogPipeline::Stats()
+	{
+		LogStats stats;
+
+		stats.posted = posted.load();
+		stats.waited = waited.load();
+		stats.truncated = truncated.load();
+
+		{
+			std::lock_guard<std::mutex> lock(drainMutex);
+
+			stats.written = written;
+			stats.batches = batches;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(uiMutex);
+			stats.uiDropped = uiDropped;
+		}
+
+		return stats;
+	}
+}
@@ -0,0 +1,132 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// getting PrintToScreen() lines to the log file and the main window, without the thread
+// that printed them paying for it
+//
+// every thread that prints puts its line in a ring of fixed size slots (made up front,
+// so printing never allocates, and never takes a lock). one thread takes lines out every
+// flushIntervalMS and:
+//
+//	-	writes them to the log file, and flushes it once per batch
+//	-	adds them to the text waiting for the window; the UI thread picks all of that up
+//		at once with TakeUIText() (the app does it on a timer), so the edit control gets
+//		one append per tick instead of one per line
+//
+// memory is bounded, and the log file doesn't lose lines: if the ring is full, the thread
+// that printed empties it itself (to the file and the window's text, same as the consumer
+// would) before its line goes in; so it waits on the file then, and only then. the only
+// thing that gets thrown away is the window's text, the oldest of it, if nobody picks it
+// up. a line too long for a slot gets cut
+//
+// a line ending in "||" doesn't get a line break after it (the "||" is removed)
+
+namespace LOG_RING
+{
+	const size_t LINE_BYTES = 1024; // same as scr_printf()'s buffer
+
+	typedef struct _LogConfig
+	{
+		size_t capacity = 4096;			// lines in the ring; rounded up to a power of 2
+		int flushIntervalMS = 50;		// how often the consumer looks for lines
+		size_t maxUIBytes = 1024 * 1024; // text waiting for the window, at most
+	} LogConfig;
+
+	typedef struct _LogStats
+	{
+		uint64_t posted;	// lines that went in the ring (all of them)
+		uint64_t waited;	// times a thread found the ring full, and emptied it itself
+		uint64_t truncated; // lines that got cut to LINE_BYTES
+		uint64_t written;	// lines the consumer took out
+		uint64_t batches;	// times the consumer found something
+		uint64_t uiDropped; // bytes of window text thrown away before anybody picked them up
+	} LogStats;
+
+	class LogPipeline
+	{
+	public:
+		explicit LogPipeline(const LogConfig &config = LogConfig());
+		~LogPipeline();
+
+		// the log file is optional; lines get appended to it
+		bool OpenFile(const std::string &filename);
+
+		void Start();
+
+		// takes out whatever is left, then stops
+		void Stop();
+
+		// any thread; doesn't allocate, and doesn't block unless the ring is full (see above)
+		void Post(const char *text, size_t len);
+		void Post(const std::string &text) { Post(text.data(), text.size()); }
+
+		// everything for the window since last time, with "\r\n" line breaks
+		std::string TakeUIText();
+
+		LogStats Stats();
+
+	private:
+		typedef struct _Slot
+		{
+			std::atomic<size_t> seq;
+			uint32_t len;
+			char text[LINE_BYTES];
+		} Slot;
+
+		bool Pop(Slot **slot);
+		void Release(Slot *slot);
+		size_t Drain();
+		void Consumer();
+
+		LogConfig config;
+
+		std::unique_ptr<Slot[]> slots;
+		size_t mask;
+
+		// producers fight over enqueuePos; only the consumer touches dequeuePos
+		alignas(64) std::atomic<size_t> enqueuePos{0};
+		alignas(64) size_t dequeuePos = 0;
+
+		std::atomic<uint64_t> posted{0};
+		std::atomic<uint64_t> waited{0};
+		std::atomic<uint64_t> truncated{0};
+
+		// the consumer's side
+		std::mutex drainMutex; // so Stop() and the consumer thread don't both drain
+		FILE *file = nullptr;
+		uint64_t written = 0;
+		uint64_t batches = 0;
+
+		// shared between the consumer and the UI thread
+		std::mutex uiMutex;
+		std::string uiText;
+		uint64_t uiDropped = 0;
+
+		std::mutex wakeMutex;
+		std::condition_variable wake;
+		bool stopping = false;
+		std::thread consumer;
+	};
+}
@@ -0,0 +1,71 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+
+#pragma once
+
+// the little bit of windows.h that the protocol code (urc_protocol, trip4, settings, etc.) needs
+//
+// on windows, this is just windows.h; anywhere else we fill in enough of it that
+// the same code builds and runs headless (see CMakeLists.txt). a HANDLE there is just
+// a key that comm.hpp hands out; it doesn't point at anything
+
+#ifdef _WIN32
+
+#include <windows.h>
+
+#else
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+#include <thread>
+
+typedef void *HANDLE;
+typedef uint32_t DWORD;
+typedef unsigned int UINT;
+typedef int BOOL;
+
+#define INVALID_HANDLE_VALUE ((HANDLE)(intptr_t)-1)
+
+#ifndef TRUE
+#define TRUE 1
+#define FALSE 0
+#endif
+
+#define _ASSERT(expr) assert(expr)
+
+inline void Sleep(DWORD ms)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+inline int strcpy_s(char *dst, size_t dstSize, const char *src)
+{
+	if (dst == nullptr || dstSize == 0)
+		return -1;
+
+	strncpy(dst, src, dstSize - 1);
+	dst[dstSize - 1] = '\0';
+
+	return 0;
+}
+
+template <size_t N>
+inline int strcpy_s(char (&dst)[N], const char *src)
+{
+	return strcpy_s(dst, N, src);
+}
+
+#endif
@@ -0,0 +1,207 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+
+// comm.hpp for everything that isn't windows (see win32_api_comm.cpp for the real thing)
+//
+// a HANDLE here is just a number we hand out; behind it is whatever CommTransport
+// somebody registered (InitCommPort() registers a serial device or pty)
+
+#ifndef _WIN32
+
+#include <unordered_map>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <cerrno>
+#include <cstdio>
+
+#include <termios.h>
+#include <unistd.h>
+
+#include "comm.hpp"
+#include "screen.hpp"
+#include "urc_protocol.hpp"
+
+typedef struct _PosixPort
+{
+	CommTransport transport;
+	std::unique_ptr<SERIAL_RX::Receiver> rx;
+	std::mutex mtx; // one writer at a time
+} PosixPort;
+
+static std::unordered_map<HANDLE, std::shared_ptr<PosixPort>> hCommPortMap;
+static std::unordered_map<int, std::string> commPortPaths;
+static std::mutex portMapMutex;
+static intptr_t nextHandle = 1;
+
+static std::shared_ptr<PosixPort> getPortForHandle(HANDLE hComm)
+{
+	std::lock_guard<std::mutex> lock(portMapMutex);
+
+	auto it = hCommPortMap.find(hComm);
+	return (it != hCommPortMap.end()) ? it->second : nullptr;
+}
+
+HANDLE RegisterCommTransport(const CommTransport &transport)
+{
+	std::shared_ptr<PosixPort> port = std::make_shared<PosixPort>();
+
+	port->transport = transport;
+	port->rx = std::make_unique<SERIAL_RX::Receiver>(transport.readSome);
+
+	std::lock_guard<std::mutex> lock(portMapMutex);
+
+	HANDLE hComm = (HANDLE)nextHandle++;
+	hCommPortMap[hComm] = port;
+
+	return hComm;
+}
+
+void SetCommPortPath(int PortNumber, const char *path)
+{
+	std::lock_guard<std::mutex> lock(portMapMutex);
+	commPortPaths[PortNumber] = path;
+}
+
+SERIAL_RX::Receiver &getReceiverForHandle(HANDLE hComm)
+{
+	std::shared_ptr<PosixPort> port = getPortForHandle(hComm);
+
+	// same as using a HANDLE that CloseCommPort() already closed on windows
+	_ASSERT(port != nullptr);
+
+	return *port->rx;
+}
+
+bool WriteToCommPort(HANDLE hComm, uint8_t *data_ptr, int data_length)
+{
+	std::shared_ptr<PosixPort> port = getPortForHandle(hComm);
+
+	if (!port)
+		return false;
+
+	// because we are dealing with a command/response type protocol, whenever we go
+	// to send a command, we need to make sure that the buffer is cleared out to begin
+	// with
+	{
+		std::lock_guard<std::mutex> lock(port->mtx);
+
+		if (port->transport.purge)
+			port->transport.purge();
+
+		port->rx->Flush();
+	}
+
+	return WriteToCommPort_NoPurge(hComm, data_ptr, data_length);
+}
+
+bool WriteToCommPort_NoPurge(HANDLE hComm, const uint8_t *data_ptr, int data_length)
+{
+	std::shared_ptr<PosixPort> port = getPortForHandle(hComm);
+
+	if (!port)
+		return false;
+
+	std::lock_guard<std::mutex> lock(port->mtx);
+
+	bool Status = port->transport.write(data_ptr, data_length);
+
+	if (!Status)
+		scr_printf("\nwrite() failed to write all bytes.");
+
+	return Status;
+}
+
+bool InitCommPort(HANDLE *hComm, int PortNumber, int Baud)
+{
+	std::string path;
+	int fd;
+
+	{
+		std::lock_guard<std::mutex> lock(portMapMutex);
+
+		auto it = commPortPaths.find(PortNumber);
+		path = (it != commPortPaths.end()) ? it->second : "/dev/ttyS" + std::to_string(PortNumber - 1);
+	}
+
+	*hComm = INVALID_HANDLE_VALUE;
+
+	if (!SERIAL_RX::OpenPosixPort(path.c_str(), Baud, &fd))
+		return false;
+
+	CommTransport transport;
+
+	transport.readSome = SERIAL_RX::PosixBackend(fd);
+
+	transport.write = [fd](const uint8_t *data, int len) -> bool
+	{
+		int sent = 0;
+
+		while (sent < len)
+		{
+			ssize_t n = write(fd, data + sent, len - sent);
+
+			if (n < 0 && errno == EINTR)
+				continue;
+
+			if (n <= 0)
+				return false;
+
+			sent += (int)n;
+		}
+
+		return true;
+	};
+
+	transport.purge = [fd]()
+	{ tcflush(fd, TCIOFLUSH); };
+
+	transport.close = [fd]()
+	{ close(fd); };
+
+	*hComm = RegisterCommTransport(transport);
+	return true;
+}
+
+bool CloseCommPort(HANDLE *hComm)
+{
+	std::shared_ptr<PosixPort> port;
+
+	// none of the URC state for this port can outlive it (the pipeline's reader thread
+	// reads from our receiver)
+	ForgetURCStateForHandle(*hComm);
+
+	{
+		std::lock_guard<std::mutex> lock(portMapMutex);
+
+		auto it = hCommPortMap.find(*hComm);
+		if (it != hCommPortMap.end())
+		{
+			port = it->second;
+			hCommPortMap.erase(it);
+		}
+	}
+
+	*hComm = INVALID_HANDLE_VALUE;
+
+	if (!port)
+		return false;
+
+	if (port->transport.close)
+		port->transport.close();
+
+	return true;
+}
+
+#endif
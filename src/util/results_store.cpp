@@ -0,0 +1,483 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+#include "results_store.hpp"
+#include "screen.hpp"
+
+namespace RESULTS_STORE
+{
+	static const char COLUMNAR_MAGIC[] = "URCCOL1\n";
+
+	// tabs / line breaks would split the record up
+	static std::string Clean(const std::string &s)
+	{
+		std::string clean = s;
+
+		for (char &c : clean)
+		{
+			if (c == '\t' || c == '\r' || c == '\n')
+				c = ' ';
+		}
+
+		return clean;
+	}
+
+	static std::vector<std::string> SplitTabs(const std::string &line)
+	{
+		std::vector<std::string> fields;
+		size_t start = 0;
+
+		for (;;)
+		{
+			size_t tab = line.find('\t', start);
+
+			fields.push_back(line.substr(start, tab - start));
+
+			if (tab == std::string::npos)
+				break;
+
+			start = tab + 1;
+		}
+
+		return fields;
+	}
+
+	ResultsStore::~ResultsStore()
+	{
+		Close();
+	}
+
+	bool ResultsStore::Open(const std::string &filename)
+	{
+		Close();
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		this->filename = filename;
+		file = fopen(filename.c_str(), "ab");
+
+		return (file != nullptr);
+	}
+
+	void ResultsStore::Close()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (file)
+			fclose(file);
+
+		file = nullptr;
+	}
+
+	bool ResultsStore::IsOpen()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		return (file != nullptr);
+	}
+
+	bool ResultsStore::Append(const ResultRecord &record)
+	{
+		std::ostringstream line;
+
+		line.precision(9);
+		line << "R\t" << (record.time ? record.time : (int64_t)time(nullptr)) << "\t" << Clean(record.kind) << "\t" << Clean(record.serial);
+
+		for (const std::pair<std::string, double> &field : record.fields)
+			line << "\t" << Clean(field.first) << "=" << field.second;
+
+		line << "\n";
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (!file)
+			return false;
+
+		return (fputs(line.str().c_str(), file) >= 0) && (fflush(file) == 0);
+	}
+
+	bool ResultsStore::Load(std::vector<ResultRecord> &records, const std::string &kind)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		std::ifstream in(filename, std::ios::binary);
+		std::string line;
+
+		records.clear();
+
+		if (!in)
+			return false;
+
+		while (std::getline(in, line))
+		{
+			// not finished; we must have gone down while writing it
+			if (in.eof())
+				break;
+
+			if (!line.empty() && line.back() == '\r')
+				line.pop_back();
+
+			std::vector<std::string> fields = SplitTabs(line);
+
+			if (fields.size() < 4 || fields[0] != "R")
+				continue;
+
+			if (!kind.empty() && fields[2] != kind)
+				continue;
+
+			ResultRecord record;
+
+			record.time = strtoll(fields[1].c_str(), nullptr, 10);
+			record.kind = fields[2];
+			record.serial = fields[3];
+
+			for (size_t i = 4; i < fields.size(); i++)
+			{
+				size_t equals = fields[i].rfind('=');
+
+				if (equals != std::string::npos)
+					record.fields.push_back({fields[i].substr(0, equals), strtod(fields[i].c_str() + equals + 1, nullptr)});
+			}
+
+			records.push_back(record);
+		}
+
+		return true;
+	}
+
+	ResultsStore &Results()
+	{
+		static ResultsStore store;
+		return store;
+	}
+
+	std::vector<Column> ToColumns(const std::vector<ResultRecord> &records)
+	{
+		std::vector<Column> columns = {
+			{"time", false, {}, {}},
+			{"kind", true, {}, {}},
+			{"serial", true, {}, {}},
+		};
+
+		// where each field's column is
+		std::map<std::string, size_t> index;
+
+		for (const ResultRecord &record : records)
+		{
+			for (const std::pair<std::string, double> &field : record.fields)
+			{
+				if (index.count(field.first) == 0)
+				{
+					index[field.first] = columns.size();
+					columns.push_back({field.first, false, {}, {}});
+				}
+			}
+		}
+
+		for (Column &column : columns)
+		{
+			if (!column.isText)
+				column.numbers.assign(records.size(), NAN);
+		}
+
+		for (size_t row = 0; row < records.size(); row++)
+		{
+			const ResultRecord &record = records[row];
+
+			columns[0].numbers[row] = (double)record.time;
+			columns[1].text.push_back(record.kind);
+			columns[2].text.push_back(record.serial);
+
+			for (const std::pair<std::string, double> &field : record.fields)
+				columns[index[field.first]].numbers[row] = field.second;
+		}
+
+		return columns;
+	}
+
+	static std::string CSVText(const std::string &s)
+	{
+		if (s.find_first_of(",\"") == std::string::npos)
+			return s;
+
+		std::string quoted = "\"";
+
+		for (char c : s)
+		{
+			if (c == '"')
+				quoted += '"';
+			quoted += c;
+		}
+
+		return quoted + "\"";
+	}
+
+	bool ExportCSV(const std::string &filename, const std::vector<ResultRecord> &records)
+	{
+		std::vector<Column> columns = ToColumns(records);
+		std::ofstream file(filename);
+
+		if (!file)
+			return false;
+
+		file.precision(9);
+
+		for (size_t c = 0; c < columns.size(); c++)
+			file << ((c > 0) ? "," : "") << CSVText(columns[c].name);
+
+		file << "\n";
+
+		for (size_t row = 0; row < records.size(); row++)
+		{
+			for (size_t c = 0; c < columns.size(); c++)
+			{
+				const Column &column = columns[c];
+
+				if (c > 0)
+					file << ",";
+
+				// a field the record doesn't have is just an empty cell
+				if (column.isText)
+					file << CSVText(column.text[row]);
+				else if (!std::isnan(column.numbers[row]))
+					file << ((c == 0) ? (int64_t)column.numbers[row] : column.numbers[row]);
+			}
+
+			file << "\n";
+		}
+
+		return (bool)file;
+	}
+
+	template <typename T>
+	static void Put(std::string &out, T value)
+	{
+		out.append((const char *)&value, sizeof(value));
+	}
+
+	template <typename T>
+	static bool Get(const std::string &in, size_t *pos, T *value)
+	{
+		if (*pos + sizeof(T) > in.size())
+			return false;
+
+		memcpy(value, in.data() + *pos, sizeof(T));
+		*pos += sizeof(T);
+
+		return true;
+	}
+
+	bool ExportColumnar(const std::string &filename, const std::vector<ResultRecord> &records)
+	{
+		std::vector<Column> columns = ToColumns(records);
+		std::vector<std::string> data;
+
+		for (const Column &column : columns)
+		{
+			std::string out;
+
+			if (column.isText)
+			{
+				for (const std::string &s : column.text)
+				{
+					uint16_t len = (uint16_t)(std::min)(s.size(), (size_t)0xFFFF);
+
+					Put(out, len);
+					out.append(s, 0, len);
+				}
+			}
+			else
+			{
+				for (double d : column.numbers)
+					Put(out, d);
+			}
+
+			data.push_back(out);
+		}
+
+		// the directory goes first, so we need to know how big it is to know where the columns start
+		uint64_t offset = strlen(COLUMNAR_MAGIC) + sizeof(uint32_t) * 2;
+
+		for (const Column &column : columns)
+			offset += sizeof(uint16_t) + column.name.size() + sizeof(uint8_t) + sizeof(uint64_t) * 2;
+
+		std::string header = COLUMNAR_MAGIC;
+
+		Put(header, (uint32_t)records.size());
+		Put(header, (uint32_t)columns.size());
+
+		for (size_t c = 0; c < columns.size(); c++)
+		{
+			Put(header, (uint16_t)columns[c].name.size());
+			header += columns[c].name;
+			Put(header, (uint8_t)(columns[c].isText ? 1 : 0));
+			Put(header, offset);
+			Put(header, (uint64_t)data[c].size());
+
+			offset += data[c].size();
+		}
+
+		std::ofstream file(filename, std::ios::binary);
+
+		if (!file)
+			return false;
+
+		file.write(header.data(), header.size());
+
+		for (const std::string &d : data)
+			file.write(d.data(), d.size());
+
+		return (bool)file;
+	}
+
+	bool LoadColumnar(const std::string &filename, std::vector<Column> &columns, const std::vector<std::string> &names)
+	{
+		std::ifstream file(filename, std::ios::binary);
+
+		columns.clear();
+
+		if (!file)
+			return false;
+
+		// the magic number and the counts, then the directory
+		std::string header(strlen(COLUMNAR_MAGIC) + sizeof(uint32_t) * 2, '\0');
+
+		if (!file.read(&header[0], header.size()) || header.compare(0, strlen(COLUMNAR_MAGIC), COLUMNAR_MAGIC) != 0)
+			return false;
+
+		size_t pos = strlen(COLUMNAR_MAGIC);
+		uint32_t rows = 0;
+		uint32_t count = 0;
+
+		Get(header, &pos, &rows);
+		Get(header, &pos, &count);
+
+		for (uint32_t c = 0; c < count; c++)
+		{
+			uint16_t nameLen = 0;
+			uint8_t isText = 0;
+			uint64_t offset = 0;
+			uint64_t size = 0;
+			std::string name;
+
+			if (!file.read((char *)&nameLen, sizeof(nameLen)))
+				return false;
+
+			name.resize(nameLen);
+
+			if (!file.read(&name[0], nameLen) || !file.read((char *)&isText, sizeof(isText)) ||
+				!file.read((char *)&offset, sizeof(offset)) || !file.read((char *)&size, sizeof(size)))
+				return false;
+
+			if (!names.empty() && std::find(names.begin(), names.end(), name) == names.end())
+				continue;
+
+			// just this column
+			std::streampos next = file.tellg();
+			std::string data(size, '\0');
+
+			file.seekg(offset);
+
+			if (!file.read(&data[0], size))
+				return false;
+
+			file.seekg(next);
+
+			Column column = {name, isText != 0, {}, {}};
+			size_t at = 0;
+
+			for (uint32_t row = 0; row < rows; row++)
+			{
+				if (column.isText)
+				{
+					uint16_t len = 0;
+
+					if (!Get(data, &at, &len) || at + len > data.size())
+						return false;
+
+					column.text.push_back(data.substr(at, len));
+					at += len;
+				}
+				else
+				{
+					double d = 0;
+
+					if (!Get(data, &at, &d))
+						return false;
+
+					column.numbers.push_back(d);
+				}
+			}
+
+			columns.push_back(column);
+		}
+
+		return true;
+	}
+
+	std::vector<FieldSummary> Summarize(const std::vector<ResultRecord> &records)
+	{
+		std::vector<FieldSummary> summary;
+
+		for (const Column &column : ToColumns(records))
+		{
+			if (column.isText || column.name == "time")
+				continue;
+
+			FieldSummary s = {column.name, 0, 0, 0, 0, 0};
+			double sum = 0;
+			double sumSquares = 0;
+
+			for (double d : column.numbers)
+			{
+				if (std::isnan(d))
+					continue;
+
+				s.minValue = (s.count == 0) ? d : (std::min)(s.minValue, d);
+				s.maxValue = (s.count == 0) ? d : (std::max)(s.maxValue, d);
+
+				sum += d;
+				sumSquares += d * d;
+				s.count++;
+			}
+
+			if (s.count > 0)
+				s.mean = sum / s.count;
+
+			if (s.count > 1)
+				s.stddev = std::sqrt((std::max)(0.0, (sumSquares - s.count * s.mean * s.mean) / (s.count - 1)));
+
+			summary.push_back(s);
+		}
+
+		return summary;
+	}
+
+	void PrintSummary(const std::vector<FieldSummary> &summary)
+	{
+		for (const FieldSummary &s : summary)
+		{
+			scr_printf("%-40s n: %6d  mean: %12.4f  stddev: %12.4f  min: %12.4f  max: %12.4f",
+					   s.name.c_str(), s.count, s.mean, s.stddev, s.minValue, s.maxValue);
+		}
+	}
+}
@@ -0,0 +1,148 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// every result we get off a unit (calibration, trip tests, short test), kept on the local disk
+//
+// the store is one text file that only ever gets added to; one line per record:
+//
+//	R	time	kind	serial	name=value	name=value ...
+//
+// (tabs between fields, time is seconds since 1970). a line that didn't get finished (we
+// went down in the middle of writing it) is just skipped when it is read back
+//
+// for looking at a lot of units at once, records can go out as:
+//	-	.csv: one row per record, one column per field
+//	-	columnar: the same table, but stored a column at a time, so pulling one field for
+//		thousands of units means reading just that column (see ExportColumnar())
+
+namespace RESULTS_STORE
+{
+	typedef struct _ResultRecord
+	{
+		std::string kind;	// what sort of result: "cal_step", "lt_trip", "short_test", ...
+		std::string serial; // unit serial number; empty if we couldn't get it
+		int64_t time;		// when; seconds since 1970 (Append() fills it in if it is 0)
+		std::vector<std::pair<std::string, double>> fields;
+	} ResultRecord;
+
+	class ResultsStore
+	{
+	public:
+		~ResultsStore();
+
+		bool Open(const std::string &filename);
+		void Close();
+		bool IsOpen();
+
+		// safe from any thread; the record is flushed to the OS before this returns
+		bool Append(const ResultRecord &record);
+
+		// everything in the store (or just one kind of record), oldest first
+		bool Load(std::vector<ResultRecord> &records, const std::string &kind = "");
+
+		std::string Filename() const { return filename; }
+
+	private:
+		std::mutex mutex;
+		std::string filename;
+		FILE *file = nullptr;
+	};
+
+	// the one the app records into
+	ResultsStore &Results();
+
+	// trip test points, one record each, into Results(); every trip test (lt_trip,
+	// st_trip, gf_trip, inst_trip, and their _soft versions, once the soft test set is out
+	// of experimental; see SOFT_TEST_SET::FULL_SCALE_CONFIRMED) starts with the same fields:
+	//
+	//	point, fileLine, passed, testRan, AmpsRMSToApply, CalculatedCurrentAmps, measuredTimeToTripMS
+	//
+	// and then whatever pointFields(param, result, passed) returns for that test (its
+	// settings, expected time, etc.). passed starts out as testRan; pointFields clears it
+	// if the test has anything else a point has to get right
+	template <typename Params, typename TestResults, typename PointFields>
+	void AppendTripPoints(const std::string &kind, const std::string &serial,
+						  const std::vector<Params> &params, const std::vector<TestResults> &results, PointFields pointFields)
+	{
+		for (size_t i = 0; i < params.size() && i < results.size(); i++)
+		{
+			bool passed = results[i].testRan;
+			std::vector<std::pair<std::string, double>> fields = pointFields(params[i], results[i], passed);
+
+			ResultRecord record = {kind, serial, 0, {}};
+
+			record.fields = {
+				{"point", (double)(i + 1)},
+				{"fileLine", params[i].fileLine},
+				{"passed", passed},
+				{"testRan", results[i].testRan},
+				{"AmpsRMSToApply", params[i].AmpsRMSToApply},
+				{"CalculatedCurrentAmps", results[i].CalculatedCurrentAmps},
+				{"measuredTimeToTripMS", results[i].measuredTimeToTripMS},
+			};
+
+			record.fields.insert(record.fields.end(), fields.begin(), fields.end());
+
+			Results().Append(record);
+		}
+	}
+
+	// records as a table: time, kind and serial, then one column per field name (in the
+	// order they first show up); a record without a field gets NaN there
+	typedef struct _Column
+	{
+		std::string name;
+		bool isText;
+		std::vector<double> numbers;
+		std::vector<std::string> text;
+	} Column;
+
+	std::vector<Column> ToColumns(const std::vector<ResultRecord> &records);
+
+	bool ExportCSV(const std::string &filename, const std::vector<ResultRecord> &records);
+
+	// columnar file:
+	//
+	//	"URCCOL1\n", uint32 rows, uint32 columns
+	//	for each column: uint16 name length, name, uint8 isText, uint64 offset, uint64 size
+	//	the columns: numbers are doubles, text is uint16 length + characters
+	//
+	// everything little endian (which is all we run on)
+	bool ExportColumnar(const std::string &filename, const std::vector<ResultRecord> &records);
+
+	// only reads the columns asked for (all of them if names is empty)
+	bool LoadColumnar(const std::string &filename, std::vector<Column> &columns, const std::vector<std::string> &names = {});
+
+	// for yield / drift over a lot of units: count, mean, spread, etc. of every number column
+	typedef struct _FieldSummary
+	{
+		std::string name;
+		int count; // records that have this field
+		double mean;
+		double stddev;
+		double minValue;
+		double maxValue;
+	} FieldSummary;
+
+	std::vector<FieldSummary> Summarize(const std::vector<ResultRecord> &records);
+	void PrintSummary(const std::vector<FieldSummary> &summary);
+}
@@ -0,0 +1,124 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#include <algorithm>
+#include <vector>
+
+#include "scpi_shadow.hpp"
+#include "serial_rx.hpp"
+#include "screen.hpp"
+
+namespace SCPI_SHADOW
+{
+	static std::vector<ShadowState *> allShadows;
+	static std::mutex allShadowsMutex;
+
+	ShadowState::ShadowState(const std::string &name) : name(name)
+	{
+		std::lock_guard<std::mutex> lock(allShadowsMutex);
+		allShadows.push_back(this);
+	}
+
+	ShadowState::~ShadowState()
+	{
+		std::lock_guard<std::mutex> lock(allShadowsMutex);
+		allShadows.erase(std::remove(allShadows.begin(), allShadows.end(), this), allShadows.end());
+	}
+
+	bool ShadowState::Apply(const std::string &key, const std::string &value, const std::function<bool()> &send)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			auto it = settings.find(key);
+			if (it != settings.end() && it->second.value == value)
+			{
+				stats.skipped++;
+				stats.savedMS += it->second.costMS;
+				return true;
+			}
+		}
+
+		uint64_t startMS = SERIAL_RX::NowMS();
+		bool ok = send();
+		uint64_t costMS = SERIAL_RX::NowMS() - startMS;
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		stats.sent++;
+
+		if (ok)
+			settings[key] = {value, costMS};
+		else
+			settings.erase(key);
+
+		return ok;
+	}
+
+	void ShadowState::Sent(const std::string &key, const std::string &value, bool ok)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		stats.sent++;
+
+		if (ok)
+			settings[key] = {value, 0};
+		else
+			settings.erase(key);
+	}
+
+	void ShadowState::Invalidate()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		settings.clear();
+	}
+
+	void ShadowState::Invalidate(const std::string &key)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		settings.erase(key);
+	}
+
+	ShadowStats ShadowState::Stats()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return stats;
+	}
+
+	void ShadowState::ResetStats()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stats = {0};
+	}
+
+	void PrintAllStats()
+	{
+		std::lock_guard<std::mutex> lock(allShadowsMutex);
+
+		for (ShadowState *shadow : allShadows)
+		{
+			ShadowStats s = shadow->Stats();
+
+			scr_printf("%-20s commands sent: %4d  skipped: %4d  time saved: %6.1f s",
+					   shadow->Name().c_str(), s.sent, s.skipped, s.savedMS / 1000.0);
+		}
+	}
+
+	void ResetAllStats()
+	{
+		std::lock_guard<std::mutex> lock(allShadowsMutex);
+
+		for (ShadowState *shadow : allShadows)
+			shadow->ResetStats();
+	}
+}
@@ -0,0 +1,96 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+// remembers what we last told an instrument to do, so we don't keep telling it
+//
+// the calibration and the trip tests set the source up from scratch every time
+// (:SOUR1:APPL:SIN..., :OUTP1 ON), even when it is already set up exactly like that, and
+// the BK wants a second between commands; the Keithley got told to auto-range before
+// every single reading. now each of those goes through Apply() with the setting it
+// changes (the key) and what it gets set to (the value); if that is what the instrument
+// is already set to, the command doesn't go out at all
+//
+// we only know what we sent, so anything that could have changed the instrument behind
+// our back has to call Invalidate(): *RST, a failed write or read, a SCPI script,
+// reconnecting. and anything that makes things safe (output OFF) should always be sent
+// anyway; use Sent() for those, so we still know what state it is in
+
+namespace SCPI_SHADOW
+{
+	typedef struct _ShadowStats
+	{
+		int sent;		  // commands that actually went out
+		int skipped;	  // ...and ones that didn't need to
+		uint64_t savedMS; // what the skipped ones took the last time they did go out
+	} ShadowStats;
+
+	class ShadowState
+	{
+	public:
+		// name is just for PrintAllStats()
+		explicit ShadowState(const std::string &name);
+		~ShadowState();
+
+		// calls send() unless key is already known to be value; returns what send() did
+		// (or true, if it was skipped)
+		bool Apply(const std::string &key, const std::string &value, const std::function<bool()> &send);
+
+		// we sent key = value ourselves (ok is whether that worked)
+		void Sent(const std::string &key, const std::string &value, bool ok);
+
+		// forget everything (or just key); the next Apply() for it will go out
+		void Invalidate();
+		void Invalidate(const std::string &key);
+
+		ShadowStats Stats();
+		void ResetStats();
+
+		const std::string &Name() const { return name; }
+
+	private:
+		typedef struct _Setting
+		{
+			std::string value;
+			uint64_t costMS; // how long it took to send, the last time
+		} Setting;
+
+		std::string name;
+		std::map<std::string, Setting> settings;
+		ShadowStats stats = {0};
+		std::mutex mutex;
+	};
+
+	// every ShadowState there is, one line each; then start counting over
+	void PrintAllStats();
+	void ResetAllStats();
+
+	// for one whole run (a trip test, a full calibration): counts from zero, and prints what
+	// the instruments didn't have to be told again when it goes out of scope
+	class RunStats
+	{
+	public:
+		RunStats() { ResetAllStats(); }
+		~RunStats() { PrintAllStats(); }
+
+		RunStats(const RunStats &) = delete;
+		RunStats &operator=(const RunStats &) = delete;
+	};
+}
@@ -0,0 +1,127 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+#include "scpi_sync.hpp"
+#include "serial_rx.hpp"
+#include "screen.hpp"
+
+namespace SCPI_SYNC
+{
+	static bool WaitWithOPCQuery(
+		const SCPIWriteFuncPtr &writeFunc, const SCPIReadFuncPtr &readFunc,
+		const std::string &command, int ceilingMS)
+	{
+		std::string response;
+
+		if (!writeFunc(command.empty() ? "*OPC?" : command + ";*OPC?"))
+			return false;
+
+		// a response that got left behind by somebody else could be sitting in front of
+		// ours; keep reading until we see the "1", or run out of time
+		uint64_t deadlineMS = SERIAL_RX::NowMS() + ceilingMS;
+
+		while (true)
+		{
+			int64_t remainingMS = (int64_t)(deadlineMS - SERIAL_RX::NowMS());
+
+			if (remainingMS <= 0 || !readFunc(response, (int)remainingMS))
+			{
+				scr_printf("SCPI: no operation complete within %d ms: %s", ceilingMS, command.c_str());
+				return false;
+			}
+
+			if (atoi(response.c_str()) == 1)
+				return true;
+		}
+	}
+
+	static bool WaitWithESRPoll(
+		const SCPIWriteFuncPtr &writeFunc, const SCPIReadFuncPtr &readFunc,
+		const std::string &command, int ceilingMS)
+	{
+		std::string response;
+
+		// start from a clean status register, so the OPC bit we see is ours
+		if (!writeFunc("*CLS"))
+			return false;
+
+		if (!writeFunc(command.empty() ? "*OPC" : command + ";*OPC"))
+			return false;
+
+		uint64_t deadlineMS = SERIAL_RX::NowMS() + ceilingMS;
+
+		while (true)
+		{
+			int64_t remainingMS = (int64_t)(deadlineMS - SERIAL_RX::NowMS());
+
+			if (remainingMS <= 0)
+			{
+				scr_printf("SCPI: no operation complete within %d ms: %s", ceilingMS, command.c_str());
+				return false;
+			}
+
+			// *ESR? can only be answered once the commands in front of it are done, so
+			// the read itself might take a while
+			if (!writeFunc("*ESR?"))
+				return false;
+
+			if (!readFunc(response, (int)remainingMS))
+			{
+				scr_printf("SCPI: no operation complete within %d ms: %s", ceilingMS, command.c_str());
+				return false;
+			}
+
+			int esr = atoi(response.c_str());
+
+			if (esr & ESR_ANY_ERROR)
+			{
+				scr_printf("SCPI: instrument reported an error (*ESR? %d): %s", esr, command.c_str());
+				return false;
+			}
+
+			if (esr & ESR_OPC)
+				return true;
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(ESR_POLL_MS));
+		}
+	}
+
+	bool WriteAndWait(
+		const SCPIWriteFuncPtr &writeFunc, const SCPIReadFuncPtr &readFunc,
+		const std::string &command, int ceilingMS, SyncMethod method, int *waitedMS)
+	{
+		uint64_t startMS = SERIAL_RX::NowMS();
+		bool retval;
+
+		if (method == SyncMethod::ESR_POLL)
+			retval = WaitWithESRPoll(writeFunc, readFunc, command, ceilingMS);
+		else
+			retval = WaitWithOPCQuery(writeFunc, readFunc, command, ceilingMS);
+
+		if (waitedMS)
+			*waitedMS = (int)(SERIAL_RX::NowMS() - startMS);
+
+		return retval;
+	}
+
+	bool WaitForOperationComplete(
+		const SCPIWriteFuncPtr &writeFunc, const SCPIReadFuncPtr &readFunc,
+		int ceilingMS, SyncMethod method, int *waitedMS)
+	{
+		return WriteAndWait(writeFunc, readFunc, "", ceilingMS, method, waitedMS);
+	}
+}
@@ -0,0 +1,77 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <functional>
+#include <string>
+
+// waiting for a SCPI instrument to actually finish something, instead of Sleep()ing and
+// hoping
+//
+// the Rigol and the BK take commands as fast as we can send them, and then work through
+// them in order; so after something slow (:SOUR1:PHAS:INIT, :SOUR:FREQ on the BK) we used
+// to wait a second or two before sending anything else. IEEE 488.2 gives us two ways to
+// find out when it is really done:
+//
+//	-	OPC_QUERY: tack ";*OPC?" onto the command. the instrument doesn't answer the *OPC?
+//		until everything in front of it is finished, so we just read; what would have been
+//		the Sleep() is now the read timeout (ceilingMS)
+//	-	ESR_POLL: "*CLS", then the command with ";*OPC" on it, then keep asking "*ESR?"
+//		until the operation complete bit shows up. for when a read can't be left hanging
+//		that long; also tells us if the instrument didn't like the command
+//
+// it only needs a way to write a command and a way to read a response (with a timeout),
+// so it works with VISA, or anything else that looks like it (see sim/scpi_instrument_sim)
+
+namespace SCPI_SYNC
+{
+	// write one command (no terminator; that's up to the driver)
+	typedef std::function<bool(const std::string &command)> SCPIWriteFuncPtr;
+
+	// read one response, waiting at most timeoutMS for it
+	typedef std::function<bool(std::string &response, int timeoutMS)> SCPIReadFuncPtr;
+
+	enum class SyncMethod
+	{
+		OPC_QUERY,
+		ESR_POLL,
+	};
+
+	// longest we wait for a command to finish, unless told otherwise
+	constexpr int DEFAULT_OPC_TIMEOUT_MS = 5000;
+
+	// how often ESR_POLL asks
+	constexpr int ESR_POLL_MS = 20;
+
+	// standard event status register bits (*ESR?)
+	constexpr int ESR_OPC = 0x01;				  // operation complete
+	constexpr int ESR_QUERY_ERROR = 0x04;		  // QYE
+	constexpr int ESR_DEVICE_ERROR = 0x08;		  // DDE
+	constexpr int ESR_EXECUTION_ERROR = 0x10;	  // EXE
+	constexpr int ESR_COMMAND_ERROR = 0x20;		  // CME
+	constexpr int ESR_ANY_ERROR = ESR_QUERY_ERROR | ESR_DEVICE_ERROR | ESR_EXECUTION_ERROR | ESR_COMMAND_ERROR;
+
+	// send command, and don't come back until the instrument says it is done with it (or
+	// ceilingMS goes by; then it returns false). waitedMS (if given) is how long that took
+	bool WriteAndWait(
+		const SCPIWriteFuncPtr &writeFunc, const SCPIReadFuncPtr &readFunc,
+		const std::string &command, int ceilingMS = DEFAULT_OPC_TIMEOUT_MS,
+		SyncMethod method = SyncMethod::OPC_QUERY, int *waitedMS = nullptr);
+
+	// wait for everything already sent to be done
+	bool WaitForOperationComplete(
+		const SCPIWriteFuncPtr &writeFunc, const SCPIReadFuncPtr &readFunc,
+		int ceilingMS = DEFAULT_OPC_TIMEOUT_MS, SyncMethod method = SyncMethod::OPC_QUERY,
+		int *waitedMS = nullptr);
+}
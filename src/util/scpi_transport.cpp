@@ -0,0 +1,332 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+// winsock2.h has to come before anything that pulls in windows.h
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <cstdlib>
+#include <mutex>
+
+#include "scpi_transport.hpp"
+#include "serial_rx.hpp"
+#include "screen.hpp"
+
+namespace SCPI_TRANSPORT
+{
+#ifdef _WIN32
+	typedef SOCKET SocketType;
+
+	static void CloseSocket(SocketType s)
+	{
+		closesocket(s);
+	}
+
+	static bool StartSockets()
+	{
+		static std::once_flag once;
+		static bool started = false;
+
+		std::call_once(once, []()
+					   {
+						   WSADATA wsaData;
+						   started = (WSAStartup(MAKEWORD(2, 2), &wsaData) == 0); });
+
+		return started;
+	}
+#else
+	typedef int SocketType;
+	constexpr SocketType INVALID_SOCKET = -1;
+
+	static void CloseSocket(SocketType s)
+	{
+		close(s);
+	}
+
+	static bool StartSockets()
+	{
+		return true;
+	}
+#endif
+
+	///////////////////////////////////////////////////////////////////////////////////////
+	// TCP
+	///////////////////////////////////////////////////////////////////////////////////////
+
+	TcpTransport::TcpTransport(intptr_t sock, const std::string &host, int port, const std::string &terminator)
+		: sock(sock), host(host), port(port), terminator(terminator)
+	{
+	}
+
+	TcpTransport::~TcpTransport()
+	{
+		CloseSocket((SocketType)sock);
+	}
+
+	TransportPtr TcpTransport::Connect(const std::string &host, int port, const std::string &terminator)
+	{
+		if (!StartSockets())
+		{
+			PrintToScreen("SCPI: cannot start winsock");
+			return nullptr;
+		}
+
+		addrinfo hints = {0};
+		addrinfo *addresses = nullptr;
+
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+
+		if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0)
+		{
+			PrintToScreen("SCPI: cannot find " + host);
+			return nullptr;
+		}
+
+		SocketType s = INVALID_SOCKET;
+
+		for (addrinfo *a = addresses; a != nullptr; a = a->ai_next)
+		{
+			s = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+
+			if (s == INVALID_SOCKET)
+				continue;
+
+			if (connect(s, a->ai_addr, (int)a->ai_addrlen) == 0)
+				break;
+
+			CloseSocket(s);
+			s = INVALID_SOCKET;
+		}
+
+		freeaddrinfo(addresses);
+
+		if (s == INVALID_SOCKET)
+		{
+			PrintToScreen("SCPI: cannot connect to " + host + ":" + std::to_string(port));
+			return nullptr;
+		}
+
+		// commands are small, and we usually wait for an answer to each one; don't let
+		// them sit around waiting to be combined with the next one
+		int noDelay = 1;
+		setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char *)&noDelay, sizeof(noDelay));
+
+		return TransportPtr(new TcpTransport((intptr_t)s, host, port, terminator.empty() ? "\n" : terminator));
+	}
+
+	bool TcpTransport::Write(const std::string &command)
+	{
+		std::string message = command + terminator;
+		size_t sent = 0;
+
+#ifdef MSG_NOSIGNAL
+		const int flags = MSG_NOSIGNAL; // a dropped connection is an error, not a SIGPIPE
+#else
+		const int flags = 0;
+#endif
+
+		while (sent < message.size())
+		{
+			int n = (int)send((SocketType)sock, message.data() + sent, (int)(message.size() - sent), flags);
+
+			if (n <= 0)
+			{
+				PrintToScreen("SCPI: cannot write to " + Name());
+				return false;
+			}
+
+			sent += n;
+		}
+
+		return true;
+	}
+
+	bool TcpTransport::Read(std::string &response, int timeoutMS)
+	{
+		uint64_t deadlineMS = SERIAL_RX::NowMS() + timeoutMS;
+
+		while (true)
+		{
+			size_t newline = pending.find('\n');
+
+			if (newline != std::string::npos)
+			{
+				response = pending.substr(0, newline);
+				pending.erase(0, newline + 1);
+
+				if (!response.empty() && response.back() == '\r')
+					response.pop_back();
+
+				return true;
+			}
+
+			int64_t remainingMS = (int64_t)(deadlineMS - SERIAL_RX::NowMS());
+
+			if (remainingMS <= 0)
+				return false;
+
+			fd_set readable;
+			FD_ZERO(&readable);
+			FD_SET((SocketType)sock, &readable);
+
+			timeval tv;
+			tv.tv_sec = (long)(remainingMS / 1000);
+			tv.tv_usec = (long)((remainingMS % 1000) * 1000);
+
+			int ready = select((int)sock + 1, &readable, nullptr, nullptr, &tv);
+
+			if (ready < 0)
+				return false;
+
+			if (ready == 0)
+				continue;
+
+			char buffer[1024];
+			int n = (int)recv((SocketType)sock, buffer, sizeof(buffer), 0);
+
+			if (n <= 0)
+			{
+				PrintToScreen("SCPI: connection to " + Name() + " closed");
+				return false;
+			}
+
+			pending.append(buffer, n);
+		}
+	}
+
+	std::string TcpTransport::Name() const
+	{
+		return "TCPIP::" + host + "::" + std::to_string(port) + "::SOCKET";
+	}
+
+	///////////////////////////////////////////////////////////////////////////////////////
+	// in-process
+	///////////////////////////////////////////////////////////////////////////////////////
+
+	InProcessTransport::InProcessTransport(const std::string &name, SCPI_SYNC::SCPIWriteFuncPtr writeFunc, SCPI_SYNC::SCPIReadFuncPtr readFunc)
+		: name(name), writeFunc(writeFunc), readFunc(readFunc)
+	{
+	}
+
+	bool InProcessTransport::Write(const std::string &command)
+	{
+		return writeFunc(command);
+	}
+
+	bool InProcessTransport::Read(std::string &response, int timeoutMS)
+	{
+		return readFunc(response, timeoutMS);
+	}
+
+	std::string InProcessTransport::Name() const
+	{
+		return name;
+	}
+
+	///////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _WIN32
+	// the real one is in visa_transport.cpp
+	TransportPtr OpenVISA(const std::string &, const std::string &, const std::string &, int)
+	{
+		PrintToScreen("SCPI: VISA is only available on windows; use a TCP address instead");
+		return nullptr;
+	}
+#endif
+
+	// "host", "host:port", or "TCPIP::host::port::SOCKET"
+	static void ParseTCPAddress(const std::string &where, std::string *host, int *port)
+	{
+		*port = SCPI_RAW_PORT;
+
+		if (where.compare(0, 7, "TCPIP::") == 0)
+		{
+			std::string rest = where.substr(7);
+			size_t sep = rest.find("::");
+
+			*host = rest.substr(0, sep);
+
+			if (sep != std::string::npos)
+				*port = atoi(rest.c_str() + sep + 2);
+		}
+		else
+		{
+			size_t colon = where.rfind(':');
+
+			*host = where.substr(0, colon);
+
+			if (colon != std::string::npos)
+				*port = atoi(where.c_str() + colon + 1);
+		}
+	}
+
+	TransportPtr Open(const std::string &where, const std::string &idnMatch, const std::string &terminator)
+	{
+		if (where.empty() || where == "USB")
+			return OpenVISA("USB", idnMatch, terminator);
+
+		std::string host;
+		int port;
+
+		ParseTCPAddress(where, &host, &port);
+
+		TransportPtr transport = TcpTransport::Connect(host, port, terminator);
+
+		if (transport && !Identify(*transport, idnMatch))
+		{
+			PrintToScreen("SCPI: " + transport->Name() + " is not a " + idnMatch);
+			transport.reset();
+		}
+
+		return transport;
+	}
+
+	bool Query(Transport &transport, const std::string &query, std::string &response, int timeoutMS)
+	{
+		return transport.Write(query) && transport.Read(response, timeoutMS);
+	}
+
+	bool Identify(Transport &transport, const std::string &idnMatch, std::string *idn)
+	{
+		std::string response;
+
+		if (!Query(transport, "*IDN?", response))
+			return false;
+
+		if (idn)
+			*idn = response;
+
+		return response.find(idnMatch) != std::string::npos;
+	}
+
+	bool WriteAndWait(Transport &transport, const std::string &command, int ceilingMS, SCPI_SYNC::SyncMethod method)
+	{
+		return SCPI_SYNC::WriteAndWait(
+			[&transport](const std::string &c)
+			{ return transport.Write(c); },
+			[&transport](std::string &response, int timeoutMS)
+			{ return transport.Read(response, timeoutMS); },
+			command, ceilingMS, method);
+	}
+}
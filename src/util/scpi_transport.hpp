@@ -0,0 +1,120 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "scpi_sync.hpp"
+
+// how SCPI commands get to an instrument (the Rigol, the BK)
+//
+// the drivers used to each have their own copy of the VISA code; now they just talk to a
+// Transport, and don't care which one it is:
+//
+//	-	VISA (USBTMC); windows only, see visa_transport.cpp. this is the only place that
+//		needs visa.h and the VISA runtime
+//	-	a raw TCP socket; both instruments take SCPI on port 5025 over the LAN
+//	-	in-process: hand it a function to write and one to read (a simulator, a test)
+//
+// Open() picks VISA or TCP from a string, so the app can be pointed at either one
+
+namespace SCPI_TRANSPORT
+{
+	// default time to wait for a response from the instrument
+	constexpr int SCPI_TIMEOUT_MS = 5000;
+
+	// "SCPI-RAW"; the port both the Rigol and the BK listen on
+	constexpr int SCPI_RAW_PORT = 5025;
+
+	class Transport
+	{
+	public:
+		virtual ~Transport() = default;
+
+		// one command (or query); the transport puts the terminator on
+		virtual bool Write(const std::string &command) = 0;
+
+		// one response, without its terminator; false if nothing shows up within timeoutMS
+		virtual bool Read(std::string &response, int timeoutMS) = 0;
+
+		// something like "TCPIP::192.168.1.50::5025::SOCKET", for messages
+		virtual std::string Name() const = 0;
+	};
+
+	typedef std::unique_ptr<Transport> TransportPtr;
+
+	class TcpTransport : public Transport
+	{
+	public:
+		~TcpTransport() override;
+
+		// nullptr if it can't connect; a raw socket has no end of message, so the
+		// terminator can't be empty
+		static TransportPtr Connect(const std::string &host, int port = SCPI_RAW_PORT, const std::string &terminator = "\n");
+
+		bool Write(const std::string &command) override;
+		bool Read(std::string &response, int timeoutMS) override;
+		std::string Name() const override;
+
+	private:
+		TcpTransport(intptr_t sock, const std::string &host, int port, const std::string &terminator);
+
+		intptr_t sock;
+		std::string host;
+		int port;
+		std::string terminator;
+		std::string pending; // what we have read past the end of the last response
+	};
+
+	class InProcessTransport : public Transport
+	{
+	public:
+		InProcessTransport(const std::string &name, SCPI_SYNC::SCPIWriteFuncPtr writeFunc, SCPI_SYNC::SCPIReadFuncPtr readFunc);
+
+		bool Write(const std::string &command) override;
+		bool Read(std::string &response, int timeoutMS) override;
+		std::string Name() const override;
+
+	private:
+		std::string name;
+		SCPI_SYNC::SCPIWriteFuncPtr writeFunc;
+		SCPI_SYNC::SCPIReadFuncPtr readFunc;
+	};
+
+	// every VISA resource with resourceFilter in its name ("USB") gets opened and asked
+	// *IDN?; the first one with idnMatch in its answer is it. nullptr if none is (or, if
+	// this isn't windows, always)
+	TransportPtr OpenVISA(const std::string &resourceFilter, const std::string &idnMatch, const std::string &terminator, int timeoutMS = SCPI_TIMEOUT_MS);
+
+	// where is one of:
+	//	"USB"						first VISA USB instrument that answers *IDN? with idnMatch
+	//	"192.168.1.50"				raw SCPI on port 5025
+	//	"192.168.1.50:5026"			...or some other port
+	//	"TCPIP::192.168.1.50::5025::SOCKET"	(how VISA would write it)
+	// a TCP instrument has to answer *IDN? with idnMatch too
+	TransportPtr Open(const std::string &where, const std::string &idnMatch, const std::string &terminator);
+
+	// write query, read back the answer
+	bool Query(Transport &transport, const std::string &query, std::string &response, int timeoutMS = SCPI_TIMEOUT_MS);
+
+	// *IDN?, and check that idnMatch is in the answer
+	bool Identify(Transport &transport, const std::string &idnMatch, std::string *idn = nullptr);
+
+	// SCPI_SYNC::WriteAndWait() on a transport
+	bool WriteAndWait(
+		Transport &transport, const std::string &command, int ceilingMS = SCPI_SYNC::DEFAULT_OPC_TIMEOUT_MS,
+		SCPI_SYNC::SyncMethod method = SCPI_SYNC::SyncMethod::OPC_QUERY);
+}
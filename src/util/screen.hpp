@@ -0,0 +1,28 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+
+#pragma once
+
+#include <string>
+
+// everything that wants to show something to the operator goes through these
+//
+// the windows app sends it to the main window (and the log file); see autocal_rc.cpp
+// the headless library (CMakeLists.txt) just writes to stdout; see console.cpp
+
+void PrintToScreen(const std::string &message);
+void scr_printf(const char *format, ...);
+
+// when set, every URC message sent or received gets dumped to the screen
+extern bool logData;
@@ -0,0 +1,272 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+
+#include "serial_rx.hpp"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+namespace SERIAL_RX
+{
+	uint64_t NowMS()
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+				   std::chrono::steady_clock::now().time_since_epoch())
+			.count();
+	}
+
+	uint64_t DeadlineFromNow(int timeoutMS)
+	{
+		return NowMS() + (timeoutMS > 0 ? timeoutMS : 0);
+	}
+
+	int RingBuffer::Push(const uint8_t *src, int len)
+	{
+		len = (std::min)(len, Free());
+
+		for (int i = 0; i < len; i++)
+			data[(head + i) & (RING_BUFFER_SIZE - 1)] = src[i];
+
+		head += len;
+		return len;
+	}
+
+	int RingBuffer::Peek(uint8_t *dst, int len) const
+	{
+		len = (std::min)(len, Count());
+
+		// at most two memcpy()s, depending on whether we wrap around the end of data[]
+		uint32_t start = tail & (RING_BUFFER_SIZE - 1);
+		int firstPart = (std::min)(len, RING_BUFFER_SIZE - (int)start);
+
+		memcpy(dst, &data[start], firstPart);
+		memcpy(dst + firstPart, &data[0], len - firstPart);
+
+		return len;
+	}
+
+	int RingBuffer::Pop(uint8_t *dst, int len)
+	{
+		len = Peek(dst, len);
+		tail += len;
+		return len;
+	}
+
+	Receiver::Receiver(ReadSomeFuncPtr readSome) : readSome(readSome)
+	{
+	}
+
+	bool Receiver::Fill(uint64_t deadlineMS)
+	{
+		uint8_t tmp[RING_BUFFER_SIZE];
+		int room;
+
+		{
+			std::lock_guard<std::mutex> lock(ringMutex);
+			room = ring.Free();
+		}
+
+		// nothing to do until somebody drains the ring
+		if (room == 0)
+			return true;
+
+		// never park inside the driver for too long at once; on a synchronous handle that would
+		// hold off anybody trying to write to the same port
+		uint64_t now = NowMS();
+		int waitMS = (deadlineMS > now) ? (int)(std::min)(deadlineMS - now, (uint64_t)RX_WAIT_SLICE_MS) : 0;
+
+		int bytesRead = readSome(tmp, room, waitMS);
+
+		if (bytesRead < 0)
+			return false;
+
+		if (bytesRead > 0)
+		{
+			std::lock_guard<std::mutex> lock(ringMutex);
+			ring.Push(tmp, bytesRead);
+		}
+
+		return true;
+	}
+
+	bool Receiver::Read(uint8_t *dst, int len, uint64_t deadlineMS)
+	{
+		std::lock_guard<std::mutex> lock(readMutex);
+		int got = 0;
+
+		do
+		{
+			{
+				std::lock_guard<std::mutex> ringLock(ringMutex);
+				got += ring.Pop(dst + got, len - got);
+			}
+
+			if (got >= len)
+				return true;
+
+			if (NowMS() >= deadlineMS)
+				return false;
+
+		} while (Fill(deadlineMS));
+
+		// port died
+		return false;
+	}
+
+	int Receiver::ReadSome(uint8_t *dst, int maxLen, uint64_t deadlineMS)
+	{
+		std::lock_guard<std::mutex> lock(readMutex);
+		int got = 0;
+
+		do
+		{
+			{
+				std::lock_guard<std::mutex> ringLock(ringMutex);
+				got = ring.Pop(dst, maxLen);
+			}
+
+			if (got > 0 || NowMS() >= deadlineMS)
+				break;
+
+		} while (Fill(deadlineMS));
+
+		return got;
+	}
+
+	void Receiver::Flush()
+	{
+		std::lock_guard<std::mutex> lock(ringMutex);
+		ring.Clear();
+		flushCount++;
+	}
+
+#ifdef _WIN32
+
+	ReadSomeFuncPtr Win32Backend(HANDLE hComm)
+	{
+		DWORD lastTimeoutMS = MAXDWORD;
+
+		return [hComm, lastTimeoutMS](uint8_t *buf, int maxLen, int timeoutMS) mutable -> int
+		{
+			// https://docs.microsoft.com/en-us/windows/win32/api/winbase/ns-winbase-commtimeouts
+			// with ReadIntervalTimeout and ReadTotalTimeoutMultiplier both MAXDWORD, ReadFile() returns
+			// at once with whatever is in the input buffer; if the buffer is empty, it waits for the
+			// first byte to arrive (up to ReadTotalTimeoutConstant) and returns right away with it
+			if ((DWORD)timeoutMS != lastTimeoutMS)
+			{
+				COMMTIMEOUTS timeouts = {0};
+
+				timeouts.ReadIntervalTimeout = MAXDWORD;
+				timeouts.ReadTotalTimeoutMultiplier = (timeoutMS > 0) ? MAXDWORD : 0;
+				timeouts.ReadTotalTimeoutConstant = timeoutMS;
+
+				if (!SetCommTimeouts(hComm, &timeouts))
+					return -1;
+
+				lastTimeoutMS = timeoutMS;
+			}
+
+			DWORD bytesRead = 0;
+
+			if (!ReadFile(hComm, buf, maxLen, &bytesRead, NULL))
+				return -1;
+
+			return (int)bytesRead;
+		};
+	}
+
+#else
+
+	ReadSomeFuncPtr PosixBackend(int fd)
+	{
+		return [fd](uint8_t *buf, int maxLen, int timeoutMS) -> int
+		{
+			struct pollfd pfd = {0};
+
+			pfd.fd = fd;
+			pfd.events = POLLIN;
+
+			int ready = poll(&pfd, 1, timeoutMS);
+
+			if (ready < 0)
+				return (errno == EINTR) ? 0 : -1;
+
+			if (ready == 0)
+				return 0;
+
+			// other end of a pty went away
+			if ((pfd.revents & POLLIN) == 0)
+				return -1;
+
+			ssize_t bytesRead = read(fd, buf, maxLen);
+
+			if (bytesRead < 0)
+				return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+
+			return (int)bytesRead;
+		};
+	}
+
+	static speed_t BaudToSpeed(int baud)
+	{
+		switch (baud)
+		{
+		case 9600:
+			return B9600;
+		case 19200:
+			return B19200;
+		case 38400:
+			return B38400;
+		case 57600:
+			return B57600;
+		case 115200:
+			return B115200;
+		default:
+			return B19200;
+		}
+	}
+
+	bool OpenPosixPort(const char *path, int baud, int *fd)
+	{
+		struct termios tio;
+
+		*fd = open(path, O_RDWR | O_NOCTTY);
+		if (*fd < 0)
+			return false;
+
+		// ptys don't care about the baud rate, but real USB serial adapters do
+		if (tcgetattr(*fd, &tio) == 0)
+		{
+			cfmakeraw(&tio);
+			cfsetispeed(&tio, BaudToSpeed(baud));
+			cfsetospeed(&tio, BaudToSpeed(baud));
+			tio.c_cc[VMIN] = 0;
+			tio.c_cc[VTIME] = 0;
+			tcsetattr(*fd, TCSANOW, &tio);
+		}
+
+		tcflush(*fd, TCIOFLUSH);
+		return true;
+	}
+
+#endif
+}
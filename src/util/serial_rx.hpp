@@ -0,0 +1,108 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// receive side of a serial port
+//
+// instead of calling ReadFile() for one byte at a time in a tight loop, we block
+// until the driver has data for us, pull everything it has in one read, and park
+// it in a ring buffer; callers then take whole headers / messages out of the ring
+//
+// the engine itself doesn't know anything about the OS; the OS specific part is
+// the "backend" function that waits for data and reads it (Win32 COMM port, or a
+// POSIX tty / pty so we can run against a simulated trip unit on Linux)
+
+namespace SERIAL_RX
+{
+	constexpr int RING_BUFFER_SIZE = 4096; // must be a power of 2
+	constexpr int RX_WAIT_SLICE_MS = 50;   // longest we ever block inside the driver in one go
+
+	// waits up to timeoutMS for at least one byte to arrive, then reads as many bytes
+	// as are available (up to maxLen) into buf
+	// returns number of bytes read; 0 if we timed out; -1 if the port is dead
+	typedef std::function<int(uint8_t *buf, int maxLen, int timeoutMS)> ReadSomeFuncPtr;
+
+	// milliseconds on a monotonic clock; all deadlines are expressed in this
+	uint64_t NowMS();
+	uint64_t DeadlineFromNow(int timeoutMS);
+
+	class RingBuffer
+	{
+	public:
+		int Count() const { return (int)(head - tail); }
+		int Free() const { return RING_BUFFER_SIZE - Count(); }
+
+		// these return the number of bytes actually moved
+		int Push(const uint8_t *src, int len);
+		int Pop(uint8_t *dst, int len);
+		int Peek(uint8_t *dst, int len) const;
+		void Clear() { tail = head; }
+
+	private:
+		uint8_t data[RING_BUFFER_SIZE] = {0};
+		uint32_t head = 0; // next byte to write
+		uint32_t tail = 0; // next byte to read
+	};
+
+	class Receiver
+	{
+	public:
+		explicit Receiver(ReadSomeFuncPtr readSome);
+
+		// copies exactly len bytes into dst; returns false if deadlineMS passes, or the port
+		// fails, before we have that many
+		bool Read(uint8_t *dst, int len, uint64_t deadlineMS);
+
+		// copies whatever has arrived (up to maxLen bytes) into dst, waiting until deadlineMS
+		// for at least one byte; returns the number of bytes copied
+		int ReadSome(uint8_t *dst, int maxLen, uint64_t deadlineMS);
+
+		// throw away everything we've received so far
+		void Flush();
+
+		// bumped every time Flush() is called; lets anybody holding on to bytes they took
+		// out of here earlier (like a URC decoder) know those are stale now
+		uint32_t FlushCount() const { return flushCount; }
+
+	private:
+		// waits (at most until deadlineMS) for the driver to have data, then moves everything
+		// it has into the ring buffer; returns false if the port is dead
+		bool Fill(uint64_t deadlineMS);
+
+		ReadSomeFuncPtr readSome;
+		RingBuffer ring;
+		std::atomic<uint32_t> flushCount = 0;
+
+		std::mutex readMutex; // one reader at a time
+		std::mutex ringMutex; // protects ring; only ever held for a memcpy
+	};
+
+#ifdef _WIN32
+	ReadSomeFuncPtr Win32Backend(HANDLE hComm);
+#else
+	ReadSomeFuncPtr PosixBackend(int fd);
+
+	// opens a tty (or pty) in raw mode; returns false if it couldn't be opened
+	bool OpenPosixPort(const char *path, int baud, int *fd);
+#endif
+}
@@ -11,8 +11,12 @@
  *
  *******************************************************************************/
 
-#include "..\autocal_rc.hpp"
+#include "settings.hpp"
+#include "screen.hpp"
+#include "util.hpp"
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <unordered_map>
@@ -369,41 +373,16 @@ bool SetSystemAndDeviceSettings(
     bool retval = true;
     SettingsUpdatedOnTripUnit = false;
 
-    // grab existing system settings from trip unit
+    // grab existing system and device settings from trip unit
     if (retval)
     {
-        SendURCCommand(hTripUnit, MSG_GET_SYS_SETTINGS, ADDR_TRIP_UNIT, ADDR_CAL_APP);
-        retval = GetURCResponse(hTripUnit, &rsp1) &&
-                 VerifyMessageIsOK(&rsp1, MSG_RSP_SYS_SETTINGS_4, sizeof(MsgRspSysSet4) - sizeof(MsgHdr));
-
-        if (!retval)
-        {
-            PrintToScreen("error receiving MSG_RSP_SYS_SETTINGS_4");
-        }
+        retval = GetSystemAndDeviceSettings(hTripUnit, &rsp1, &rsp2);
     }
 
     if (retval)
     {
-        // save a copy of existing system settings
+        // save a copy of existing settings
         sysSettings = rsp1.msgRspSysSet4.Settings;
-    }
-
-    // grab existing device settings from trip unit
-    if (retval)
-    {
-        SendURCCommand(hTripUnit, MSG_GET_DEV_SETTINGS, ADDR_TRIP_UNIT, ADDR_CAL_APP);
-        retval = GetURCResponse(hTripUnit, &rsp2) &&
-                 VerifyMessageIsOK(&rsp2, MSG_RSP_DEV_SETTINGS_4, sizeof(MsgRspDevSet4) - sizeof(MsgHdr));
-
-        if (!retval)
-        {
-            PrintToScreen("error receiving MSG_RSP_DEV_SETTINGS_4");
-        }
-    }
-
-    if (retval)
-    {
-        // save a copy of existing device settings
         deviceSettings = rsp2.msgRspDevSet4.Settings;
     }
 
@@ -443,7 +422,12 @@ bool SetSystemAndDeviceSettings(
             }
 
             if (retval)
+            {
                 SettingsUpdatedOnTripUnit = true;
+
+                // it reboots now; see WaitForTripUnitReady()
+                NoteRebootStarted(hTripUnit);
+            }
             else
             {
                 PrintToScreen("did not receive ACK from MSG_SET_USR_SETTINGS_4");
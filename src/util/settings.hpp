@@ -14,13 +14,13 @@
 #pragma once
 
 #include <stdbool.h>
-#include <windows.h>
 #include <unordered_map>
 #include <fstream>
 #include <sstream>
 #include <functional>
 
-#include "..\trip4.hpp"
+#include "platform.hpp"
+#include "../trip4.hpp"
 
 std::unordered_map<std::string, std::string> ParseTripUnitSettingsFile(const std::string &filename);
 
@@ -0,0 +1,216 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+
+#include "stability.hpp"
+#include "screen.hpp"
+
+namespace STABILITY
+{
+	StabilityDetector::StabilityDetector(const StabilityCriteria &criteria) : criteria(criteria)
+	{
+	}
+
+	void StabilityDetector::Reset()
+	{
+		decision = Decision::PENDING;
+		samples = 0;
+
+		window.clear();
+		sum = sumSquares = sumXY = 0;
+
+		maxIndexes.clear();
+		minIndexes.clear();
+
+		trace.clear();
+	}
+
+	double StabilityDetector::Threshold(double mean) const
+	{
+		return (mean > criteria.highVoltsAbove) ? criteria.thresholdHigh : criteria.thresholdLow;
+	}
+
+	Decision StabilityDetector::Add(double reading)
+	{
+		if (decision != Decision::PENDING)
+			return decision;
+
+		int x = samples++;
+
+		window.push_back(reading);
+		sum += reading;
+		sumSquares += reading * reading;
+		sumXY += x * reading;
+
+		int first = samples - (int)window.size(); // sample number of window.front()
+
+		// keep the running max / min: anything that can never be the max (or min) of the
+		// window again, because something newer beats it, gets dropped
+		while (!maxIndexes.empty() && window[maxIndexes.back() - first] <= reading)
+			maxIndexes.pop_back();
+		maxIndexes.push_back(x);
+
+		while (!minIndexes.empty() && window[minIndexes.back() - first] >= reading)
+			minIndexes.pop_back();
+		minIndexes.push_back(x);
+
+		// slide the window
+		if ((int)window.size() > criteria.window)
+		{
+			double old = window.front();
+
+			window.pop_front();
+			sum -= old;
+			sumSquares -= old * old;
+			sumXY -= first * old;
+
+			if (maxIndexes.front() == first)
+				maxIndexes.pop_front();
+			if (minIndexes.front() == first)
+				minIndexes.pop_front();
+
+			first++;
+		}
+
+		StabilityStep step;
+		int n = (int)window.size();
+
+		step.sample = x;
+		step.reading = reading;
+		step.mean = sum / n;
+		step.stddev = (n > 1) ? std::sqrt((std::max)(0.0, (sumSquares - n * step.mean * step.mean) / (n - 1))) : 0;
+		step.maxValue = window[maxIndexes.front() - first];
+		step.minValue = window[minIndexes.front() - first];
+		step.spread = step.maxValue - step.minValue;
+		step.threshold = Threshold(step.mean);
+
+		// least squares slope of reading vs. sample number; sum of x and of x squared over
+		// first .. first + n - 1 don't need to be kept, we can just work them out
+		double sumX = n * (double)first + n * (n - 1) / 2.0;
+		double denom = n * (double)n * ((double)n * n - 1) / 12.0;
+		double slope = (denom > 0) ? (n * sumXY - sumX * sum) / denom : 0;
+
+		step.drift = std::fabs(slope) * (n - 1);
+
+		if (n >= criteria.minSamples)
+		{
+			if (step.drift > step.threshold * criteria.rampFactor)
+				decision = Decision::UNSTABLE;
+			else if (n >= criteria.window && step.spread < step.threshold)
+				decision = Decision::STABLE;
+		}
+
+		if (decision == Decision::PENDING && samples >= criteria.maxSamples)
+			decision = Decision::UNSTABLE;
+
+		step.decision = decision;
+		trace.push_back(step);
+
+		return decision;
+	}
+
+	std::string DecisionToString(Decision decision)
+	{
+		switch (decision)
+		{
+		case Decision::PENDING:
+			return "PENDING";
+		case Decision::STABLE:
+			return "STABLE";
+		case Decision::UNSTABLE:
+			return "UNSTABLE";
+		default:
+			return "???";
+		}
+	}
+
+	void DumpTrace(const std::vector<StabilityStep> &trace)
+	{
+		for (const StabilityStep &step : trace)
+		{
+			scr_printf("sample #: %d, reading: %.6f, mean: %.6f, spread: %.6f, drift: %.6f, threshold: %.4f -> %s",
+					   step.sample, step.reading, step.mean, step.spread, step.drift, step.threshold,
+					   DecisionToString(step.decision).c_str());
+		}
+	}
+
+	bool SaveTrace(const std::string &filename, const std::vector<StabilityStep> &trace)
+	{
+		std::ofstream file(filename);
+
+		if (!file)
+			return false;
+
+		file << "sample,reading,mean,stddev,min,max,spread,drift,threshold,decision\n";
+		file.precision(9);
+
+		for (const StabilityStep &step : trace)
+		{
+			file << step.sample << "," << step.reading << "," << step.mean << "," << step.stddev << ","
+				 << step.minValue << "," << step.maxValue << "," << step.spread << "," << step.drift << ","
+				 << step.threshold << "," << DecisionToString(step.decision) << "\n";
+		}
+
+		return (bool)file;
+	}
+
+	// takes either a trace written by SaveTrace() (readings are the 2nd column), or just
+	// one reading per line
+	bool LoadReadings(const std::string &filename, std::vector<double> &readings)
+	{
+		std::ifstream file(filename);
+		std::string line;
+
+		if (!file)
+			return false;
+
+		readings.clear();
+
+		while (std::getline(file, line))
+		{
+			size_t comma = line.find(',');
+			const char *p = line.c_str() + ((comma != std::string::npos) ? comma + 1 : 0);
+			char *end;
+
+			double reading = strtod(p, &end);
+
+			// header, or blank line
+			if (end == p)
+				continue;
+
+			readings.push_back(reading);
+		}
+
+		return true;
+	}
+
+	Decision Evaluate(const std::vector<double> &readings, const StabilityCriteria &criteria, std::vector<StabilityStep> *trace)
+	{
+		StabilityDetector detector(criteria);
+
+		for (double reading : readings)
+		{
+			if (detector.Add(reading) != Decision::PENDING)
+				break;
+		}
+
+		if (trace)
+			*trace = detector.Trace();
+
+		return detector.Result();
+	}
+}
@@ -0,0 +1,128 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <deque>
+#include <string>
+#include <vector>
+
+// decides whether a stream of readings (Keithley volts RMS) has settled down
+//
+// readings go in one at a time, as they come off the meter; after each one we look at
+// the last few (a sliding window) and say one of:
+//
+//	-	STABLE: the window is full, and its spread (max - min) is under the threshold
+//	-	UNSTABLE: the readings are clearly ramping (the best fit line through the window
+//		moves a lot more than the threshold), or we ran out of samples
+//	-	PENDING: keep going
+//
+// the default criteria are exactly the old check: the first 5 readings (1 second apart)
+// decide, STABLE if their spread is under the threshold and UNSTABLE otherwise. a ramp
+// that big across 3 or 4 readings already puts the spread of the 5 over the threshold,
+// so turning it down early never changes the answer, it just saves the rest of the
+// readings. raising maxSamples past the window keeps sliding the window along instead of
+// giving up after the first 5; that passes some voltages the old check turned down
+// (still settling during the first 5, then steady), so it changes what calibration
+// accepts. stability_runner shows which ones
+//
+// every step is kept (see Trace()), so you can see afterwards why it decided what it did;
+// Evaluate() runs a recorded set of readings through, for trying out different criteria
+
+namespace STABILITY
+{
+	enum class Decision
+	{
+		PENDING,
+		STABLE,
+		UNSTABLE,
+	};
+
+	typedef struct _StabilityCriteria
+	{
+		int window = 5;			 // readings the spread is taken over
+		int minSamples = 3;		 // never call it a ramp on fewer than this
+		int maxSamples = 5;		 // give up (UNSTABLE) after this many; more than window slides it along
+		double rampFactor = 3.0; // UNSTABLE if the fitted line moves > threshold * this across the window
+
+		// 16-dec-2024
+		// per Joe N. ---> for voltages over 3vRMS, use one threshold, otherwise a tighter window
+		double highVoltsAbove = 3.0;
+		double thresholdHigh = 0.0030;
+		double thresholdLow = 0.0015;
+	} StabilityCriteria;
+
+	// one line of the decision trace; everything is for the window as of this reading
+	typedef struct _StabilityStep
+	{
+		int sample;
+		double reading;
+		double mean;
+		double stddev;
+		double minValue;
+		double maxValue;
+		double spread;
+		double drift; // how far the best fit line moves across the window
+		double threshold;
+		Decision decision;
+	} StabilityStep;
+
+	class StabilityDetector
+	{
+	public:
+		explicit StabilityDetector(const StabilityCriteria &criteria = StabilityCriteria());
+
+		// once this returns something other than PENDING, it keeps returning that
+		Decision Add(double reading);
+
+		Decision Result() const { return decision; }
+		int Samples() const { return samples; }
+
+		const StabilityCriteria &Criteria() const { return criteria; }
+		const std::vector<StabilityStep> &Trace() const { return trace; }
+
+		void Reset();
+
+	private:
+		double Threshold(double mean) const;
+
+		StabilityCriteria criteria;
+		Decision decision = Decision::PENDING;
+		int samples = 0;
+
+		// the window, plus running sums over it: sum of readings, sum of squares, and sum of
+		// sample number * reading (for the slope)
+		std::deque<double> window;
+		double sum = 0;
+		double sumSquares = 0;
+		double sumXY = 0;
+
+		// sample numbers of the readings in the window, largest / smallest at the front
+		std::deque<int> maxIndexes;
+		std::deque<int> minIndexes;
+
+		std::vector<StabilityStep> trace;
+	};
+
+	std::string DecisionToString(Decision decision);
+
+	// print the trace one line per reading
+	void DumpTrace(const std::vector<StabilityStep> &trace);
+
+	// recorded traces are .csv files, one StabilityStep per line (with a header)
+	bool SaveTrace(const std::string &filename, const std::vector<StabilityStep> &trace);
+	bool LoadReadings(const std::string &filename, std::vector<double> &readings);
+
+	// feed readings through a fresh detector until it decides (or we run out)
+	Decision Evaluate(const std::vector<double> &readings, const StabilityCriteria &criteria, std::vector<StabilityStep> *trace = nullptr);
+}
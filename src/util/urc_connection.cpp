@@ -0,0 +1,132 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+
+#include <cstring>
+
+#include "urc_connection.hpp"
+#include "screen.hpp"
+#include "util.hpp"
+
+URCConnection::URCConnection(SERIAL_RX::Receiver &rx, URCWriteFuncPtr writeFunc)
+	: rx(rx), writeFunc(writeFunc)
+{
+}
+
+URCConnection::~URCConnection()
+{
+	// the pipeline has to go first; its reader thread is sitting in Receive()
+	std::lock_guard<std::mutex> lock(pipelineMutex);
+	pipeline.reset();
+}
+
+// bytes come out of the port's receive ring buffer (see serial_rx.hpp), so we
+// sleep inside the driver until data shows up instead of spinning on ReadFile();
+// they then go through a URC_DECODER::FrameDecoder, which skips over garbage
+// instead of making us purge the port
+bool URCConnection::Receive(URCMessageUnion *msg, uint64_t deadlineMS, bool quiet)
+{
+	URC_DECODER::FrameView frame;
+
+	std::lock_guard<std::mutex> lock(rxMutex);
+
+	// somebody purged the port since we were last here (WriteToCommPort() does that before
+	// every command), so anything we are holding on to is from an old exchange
+	if (flushCount != rx.FlushCount())
+	{
+		decoder.Reset();
+		flushCount = rx.FlushCount();
+	}
+
+	uint32_t skippedBefore = decoder.Stats().bytesSkipped;
+
+	while (!decoder.Next(&frame))
+	{
+		int room;
+		uint8_t *dst = decoder.WritePtr(&room);
+		int bytesRead = rx.ReadSome(dst, room, deadlineMS);
+
+		if (bytesRead == 0)
+		{
+			if (!quiet)
+			{
+				if (decoder.Pending() < (int)sizeof(MsgHdr))
+					scr_printf("\n**** timed out waiting for msg header ****");
+				else
+					scr_printf("\n**** timed out waiting for rest of message ****");
+			}
+
+			return false;
+		}
+
+		decoder.Commit(bytesRead);
+	}
+
+	if (decoder.Stats().bytesSkipped != skippedBefore)
+	{
+		scr_printf("**** resync: skipped %u bytes of garbage before good msg ****",
+				   decoder.Stats().bytesSkipped - skippedBefore);
+	}
+
+	memcpy(msg->buf, frame.data, frame.length);
+
+	// we are still going to return true if the response was a NAK...
+	// however, we will make a note of it here just to help with debugging
+	if (true)
+	{
+		if (false && MSG_NAK == msg->msgHdr.Type)
+		{
+			scr_printf("\n**** NAK seen to msg %d; error code = %d", msg->msgNAK.NAKSeq, msg->msgNAK.Error);
+			scr_printf(NAKCodeToString(msg->msgNAK.Error).c_str());
+		}
+	}
+
+	if (logData)
+	{
+		DumpRawMsgData((uint8_t *)msg, sizeof(MsgHdr) + msg->msgHdr.Length, false);
+	}
+
+	return true;
+}
+
+std::future<URCReply> URCConnection::SendAsync(URCMessageUnion *msg, int expectedRspType, int timeoutMS)
+{
+	msg->msgHdr.Seq = NextSequenceNumber();
+	msg->msgHdr.ChkSum = 0;
+	msg->msgHdr.ChkSum = CalcChecksum(msg->buf, sizeof(MsgHdr) + msg->msgHdr.Length);
+
+	if (logData)
+	{
+		DumpRawMsgData(msg->buf, sizeof(MsgHdr) + msg->msgHdr.Length, true);
+	}
+
+	URCPipeline *p;
+
+	{
+		std::lock_guard<std::mutex> lock(pipelineMutex);
+
+		if (!pipeline)
+		{
+			pipeline = std::make_unique<URCPipeline>(
+				[this](URCMessageUnion *rsp, uint64_t deadlineMS) -> bool
+				{
+					return Receive(rsp, deadlineMS, true);
+				},
+				writeFunc);
+		}
+
+		p = pipeline.get();
+	}
+
+	return p->Send(*msg, expectedRspType, timeoutMS);
+}
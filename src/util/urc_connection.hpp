@@ -0,0 +1,74 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
+
+#include "urc_protocol.hpp"
+#include "urc_pipeline.hpp"
+#include "urc_decoder.hpp"
+#include "serial_rx.hpp"
+
+// everything we keep around for talking URC to one device
+//
+// we used to have one global sequence number and one global timeout (which
+// GetURCResponse_Long() would overwrite and then put back), shared by every port;
+// that falls apart as soon as the Keithley monitor thread, the trip unit dialog's
+// timer and a calibration thread are all talking at once. now each connection has
+// its own sequence counter, and every receive says for itself how long it is willing
+// to wait
+//
+// one of these per HANDLE; see GetURCConnection() in urc_protocol.cpp
+
+class URCConnection
+{
+public:
+	// rx is where the bytes come from (see serial_rx.hpp); writeFunc sends bytes out
+	// without purging anything (the pipeline can't have the port purged out from under it)
+	URCConnection(SERIAL_RX::Receiver &rx, URCWriteFuncPtr writeFunc);
+	~URCConnection();
+
+	// safe to call from any thread
+	uint16_t NextSequenceNumber() { return seq.fetch_add(1, std::memory_order_relaxed); }
+
+	// used by GetURCResponse() when the caller doesn't say how long to wait
+	int DefaultTimeoutMS() const { return defaultTimeoutMS; }
+	void SetDefaultTimeoutMS(int timeoutMS) { defaultTimeoutMS = timeoutMS; }
+
+	// pulls the next good URC message off of the port into msg, waiting until deadlineMS at most
+	// quiet: don't complain about timing out (the pipeline reader times out all the time on purpose)
+	bool Receive(URCMessageUnion *msg, uint64_t deadlineMS, bool quiet = false);
+
+	// fills in Seq and ChkSum, and sends msg without waiting for the response; see urc_pipeline.hpp
+	std::future<URCReply> SendAsync(URCMessageUnion *msg, int expectedRspType, int timeoutMS);
+
+private:
+	SERIAL_RX::Receiver &rx;
+	URCWriteFuncPtr writeFunc;
+
+	std::atomic<uint16_t> seq{0};
+	std::atomic<int> defaultTimeoutMS{DEFAULT_TIMEOUT_MS};
+
+	// receive side
+	URC_DECODER::FrameDecoder decoder;
+	uint32_t flushCount = 0; // rx.FlushCount() the last time we looked
+	std::mutex rxMutex;
+
+	// created the first time somebody sends something async
+	std::unique_ptr<URCPipeline> pipeline;
+	std::mutex pipelineMutex;
+};
@@ -0,0 +1,229 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#include <cstring>
+#include <algorithm>
+
+#include "urc_decoder.hpp"
+
+namespace URC_DECODER
+{
+	static uint16_t ReadU16(const uint8_t *p)
+	{
+		// little endian on the wire
+		return (uint16_t)(p[0] | (p[1] << 8));
+	}
+
+	uint16_t FrameChecksum(const uint8_t *frame, int length)
+	{
+		uint16_t chkSum = 0;
+
+		// same as CalcChecksum(); every odd byte goes in inverted
+		for (int i = 0; i < length; i++)
+		{
+			uint8_t b = (i == CHKSUM_OFFSET || i == CHKSUM_OFFSET + 1) ? 0 : frame[i];
+			chkSum += ((i & 1) == 1 ? (uint8_t)~b : b);
+		}
+
+		return chkSum;
+	}
+
+	uint8_t *FrameDecoder::WritePtr(int *room)
+	{
+		// slide what we have down to the front once we get near the end of the buffer;
+		// we never have to do this in the middle of a message somebody is looking at,
+		// because views are only good until the next time we get called here
+		if (start == end)
+		{
+			start = end = scanFrom = 0;
+			notGood.reset();
+		}
+		else if (BUFFER_SIZE - end < MAX_FRAME_SIZE)
+		{
+			memmove(buf, buf + start, end - start);
+			end -= start;
+			scanFrom = (std::max)(scanFrom - start, 0);
+			notGood >>= start;
+			start = 0;
+		}
+
+		*room = BUFFER_SIZE - end;
+		return buf + end;
+	}
+
+	void FrameDecoder::Commit(int len)
+	{
+		end = (std::min)(end + len, BUFFER_SIZE);
+	}
+
+	int FrameDecoder::Feed(const uint8_t *data, int len)
+	{
+		int room;
+		uint8_t *dst = WritePtr(&room);
+
+		len = (std::min)(len, room);
+		memcpy(dst, data, len);
+		Commit(len);
+
+		return len;
+	}
+
+	void FrameDecoder::SkipOneByte()
+	{
+		start++;
+		stats.bytesSkipped++;
+	}
+
+	void FrameDecoder::SkipTo(int offset)
+	{
+		stats.bytesSkipped += offset - start;
+		start = offset;
+	}
+
+	int FrameDecoder::GoodFrameLength(int k)
+	{
+		if (end - k < HEADER_SIZE)
+			return -1;
+
+		const uint8_t *p = buf + k;
+		int length = HEADER_SIZE + ReadU16(p + LENGTH_OFFSET);
+
+		if (length > MAX_FRAME_SIZE || notGood[k])
+			return 0;
+
+		if (end - k < length)
+			return -1;
+
+		if (FrameChecksum(p, length) == ReadU16(p + CHKSUM_OFFSET))
+			return length;
+
+		notGood[k] = true;
+		return 0;
+	}
+
+	bool FrameDecoder::RunsTo(int k, int to)
+	{
+		while (k < to)
+		{
+			int length = GoodFrameLength(k);
+
+			if (length <= 0)
+				return false;
+
+			k += length;
+		}
+
+		return true;
+	}
+
+	int FrameDecoder::FindGoodFrame(int next, bool runToNext)
+	{
+		// scanFrom only moves past offsets that can never be a good message, whatever
+		// comes in later, and notGood remembers the ones after that; so coming back here
+		// with a few more bytes doesn't check the same message twice
+		int open = -1;
+		int k = (std::max)(scanFrom, start + 1);
+
+		for (; end - k >= HEADER_SIZE; k++)
+		{
+			// most bytes can't even be a length; keep those cheap
+			if (HEADER_SIZE + ReadU16(buf + k + LENGTH_OFFSET) > MAX_FRAME_SIZE)
+				continue;
+
+			int length = GoodFrameLength(k);
+
+			// not there yet, or good but (so far) only part of the payload around it
+			if (length != 0 && open < 0)
+				open = k;
+
+			if (length > 0 && (k >= next || !runToNext || RunsTo(k, next)))
+				break;
+		}
+
+		scanFrom = open < 0 ? k : open;
+		return end - k >= HEADER_SIZE ? k : -1;
+	}
+
+	bool FrameDecoder::Next(FrameView *frame)
+	{
+		while (end - start >= HEADER_SIZE)
+		{
+			const uint8_t *p = buf + start;
+			int length = HEADER_SIZE + ReadU16(p + LENGTH_OFFSET);
+
+			// can't be a real header
+			if (length > MAX_FRAME_SIZE)
+			{
+				stats.badLengths++;
+				SkipOneByte();
+				continue;
+			}
+
+			// looks OK so far, but we don't have all of it yet; unless there is a good
+			// message further on, in which case this header was garbage
+			if (end - start < length)
+			{
+				int next = FindGoodFrame(start + length, false);
+
+				if (next < 0)
+					return false;
+
+				stats.lookaheads++;
+				SkipTo(next);
+				continue;
+			}
+
+			if (GoodFrameLength(start) == 0)
+			{
+				// a good message right after this one says its length was right, and only its
+				// payload got hit; anything else says the header was garbage
+				int after = GoodFrameLength(start + length);
+				int next = FindGoodFrame(start + length, after > 0);
+
+				if (next < 0)
+				{
+					// nothing good yet, and we can't tell where this one ends; wait for more
+					if (after < 0)
+						return false;
+
+					// nothing good anywhere before scanFrom
+					next = scanFrom;
+				}
+				else
+				{
+					stats.lookaheads++;
+				}
+
+				stats.checksumErrors++;
+				SkipTo(next);
+				continue;
+			}
+
+			frame->data = p;
+			frame->length = length;
+
+			start += length;
+			stats.frames++;
+
+			return true;
+		}
+
+		return false;
+	}
+
+	void FrameDecoder::Reset()
+	{
+		start = end = scanFrom = 0;
+		notGood.reset();
+	}
+}
@@ -0,0 +1,116 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <bitset>
+#include <cstdint>
+
+// streaming decoder for URC messages
+//
+// bytes go in as whatever chunks the serial port gives us; complete messages with
+// a good checksum come out as views into our own buffer (no copy). if what we are
+// looking at can't be a header (impossible length), we slide forward by one byte and
+// try again, so a good message sitting behind a corrupted one still gets through,
+// instead of being thrown away along with everything else in the port
+//
+// a corrupted header can also have a believable length, longer than what actually
+// follows it; rather than sit there waiting for bytes that aren't coming, we look
+// further on for a complete message that checks out, and pick up from there
+//
+// a message that fails its checksum, with a good message right after it, was a real
+// message with a damaged payload; we skip it whole, so nothing in its payload that
+// happens to look like a message can come out. a good message inside it only counts
+// if good messages run from there, back to back, up to the one after it. if what
+// follows it isn't a good message, its length was garbage too, and we look for the
+// next good message wherever it is. either way, we only work out the checksum at
+// any one offset once, however many times we come back to look
+
+namespace URC_DECODER
+{
+	// these have to agree with MsgHdr in urc_protocol.hpp
+	constexpr int HEADER_SIZE = 10;
+	constexpr int LENGTH_OFFSET = 2;
+	constexpr int CHKSUM_OFFSET = 8;
+
+	constexpr int MAX_FRAME_SIZE = 1024; // sizeof(URCMessageUnion)
+	constexpr int BUFFER_SIZE = 4 * MAX_FRAME_SIZE;
+
+	// a complete, checksum verified message (header + payload)
+	// points into the decoder's buffer; only good until the next WritePtr(), Feed() or Reset()
+	typedef struct _FrameView
+	{
+		const uint8_t *data;
+		int length;
+	} FrameView;
+
+	typedef struct _DecoderStats
+	{
+		uint32_t frames;		 // good messages handed out
+		uint32_t checksumErrors; // candidate headers that failed the checksum
+		uint32_t badLengths;	 // candidate headers with an impossible length
+		uint32_t bytesSkipped;	 // bytes thrown away while resyncing
+		uint32_t lookaheads;	 // bad or partial messages given up on, because a good one turned up behind them
+	} DecoderStats;
+
+	// checksum of a whole message, as if the ChkSum field in the header were 0
+	uint16_t FrameChecksum(const uint8_t *frame, int length);
+
+	class FrameDecoder
+	{
+	public:
+		// lets the caller read straight into our buffer; then call Commit() with
+		// however many bytes actually got written
+		uint8_t *WritePtr(int *room);
+		void Commit(int len);
+
+		// same as above, but copies from somebody else's buffer; returns bytes taken
+		int Feed(const uint8_t *data, int len);
+
+		// returns true and fills in frame if a complete message is available
+		bool Next(FrameView *frame);
+
+		// throw away anything buffered
+		void Reset();
+
+		int Pending() const { return end - start; }
+		const DecoderStats &Stats() const { return stats; }
+
+	private:
+		void SkipOneByte();
+
+		// length of the good message at k; 0 if there isn't one there, -1 if we can't tell yet
+		int GoodFrameLength(int k);
+
+		// true if good messages follow each other from k up to (or past) to
+		bool RunsTo(int k, int to);
+
+		// offset of the first good message after start to pick up from; -1 if none yet.
+		// next is where the message at start claims to end; with runToNext set, a good
+		// message before next only counts if RunsTo(next)
+		int FindGoodFrame(int next, bool runToNext);
+
+		// give up on everything before offset, and decode from there
+		void SkipTo(int offset);
+
+		uint8_t buf[BUFFER_SIZE] = {0};
+		int start = 0;	  // first byte not yet decoded
+		int end = 0;	  // one past the last byte received
+		int scanFrom = 0; // FindGoodFrame() already knows nothing good starts before here
+
+		// offsets already found not to be a good message, so we don't work out
+		// their checksums again every time a few more bytes come in
+		std::bitset<BUFFER_SIZE> notGood;
+		DecoderStats stats = {0};
+	};
+}
@@ -0,0 +1,172 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#include <algorithm>
+
+#include "screen.hpp"
+#include "urc_pipeline.hpp"
+#include "serial_rx.hpp"
+
+// how long the reader thread sits in one read before it goes and checks for expired
+// requests (or for us shutting down)
+constexpr int PIPELINE_READ_SLICE_MS = 50;
+
+URCPipeline::URCPipeline(URCReadFuncPtr readFunc, URCWriteFuncPtr writeFunc)
+	: readFunc(readFunc), writeFunc(writeFunc)
+{
+	reader = std::thread(&URCPipeline::ReaderThread, this);
+}
+
+URCPipeline::~URCPipeline()
+{
+	{
+		std::lock_guard<std::mutex> lock(pendingMutex);
+		shuttingDown = true;
+	}
+
+	wakeReader.notify_all();
+	reader.join();
+
+	// anybody still waiting gets told no
+	for (PendingRequest &request : pending)
+		request.promise.set_value(URCReply{false});
+}
+
+std::future<URCReply> URCPipeline::Send(const URCMessageUnion &msg, int expectedType, int timeoutMS)
+{
+	std::future<URCReply> reply;
+	std::list<PendingRequest>::iterator it;
+
+	// register the request before it goes out the door, so that even a really fast
+	// response has something to match up with
+	{
+		std::lock_guard<std::mutex> lock(pendingMutex);
+
+		it = pending.insert(pending.end(), PendingRequest{msg.msgHdr.Seq, expectedType, SERIAL_RX::DeadlineFromNow(timeoutMS)});
+		reply = it->promise.get_future();
+	}
+
+	if (!writeFunc(msg.buf, sizeof(MsgHdr) + msg.msgHdr.Length))
+	{
+		std::lock_guard<std::mutex> lock(pendingMutex);
+
+		it->promise.set_value(URCReply{false});
+		pending.erase(it);
+
+		return reply;
+	}
+
+	wakeReader.notify_all();
+	return reply;
+}
+
+int URCPipeline::InFlight()
+{
+	std::lock_guard<std::mutex> lock(pendingMutex);
+	return (int)pending.size();
+}
+
+// figure out which request rsp belongs to, and hand it over
+// called with pendingMutex held
+void URCPipeline::Dispatch(const URCMessageUnion &rsp)
+{
+	auto answers = [&rsp](const PendingRequest &request) -> bool
+	{
+		if (rsp.msgHdr.Type == MSG_ACK)
+			return request.seq == rsp.msgACK.AckSeq;
+
+		if (rsp.msgHdr.Type == MSG_NAK)
+			return request.seq == rsp.msgNAK.NAKSeq;
+
+		return request.seq == rsp.msgHdr.Seq &&
+			   (request.expectedType == MSG_NONE || request.expectedType == rsp.msgHdr.Type);
+	};
+
+	auto it = std::find_if(pending.begin(), pending.end(), answers);
+
+	// the other side didn't echo our sequence number; take the oldest request that was
+	// waiting for this kind of response
+	if (it == pending.end())
+	{
+		it = std::find_if(pending.begin(), pending.end(),
+						  [&rsp](const PendingRequest &request)
+						  { return request.expectedType == rsp.msgHdr.Type; });
+	}
+
+	if (it == pending.end())
+	{
+		scr_printf("**** pipeline: nobody waiting for msg type %d (seq %u); dropped ****", rsp.msgHdr.Type, rsp.msgHdr.Seq);
+		return;
+	}
+
+	URCReply reply;
+	reply.ok = true;
+	reply.msg = rsp;
+
+	it->promise.set_value(reply);
+	pending.erase(it);
+}
+
+// called with pendingMutex held
+void URCPipeline::ExpireRequests()
+{
+	uint64_t now = SERIAL_RX::NowMS();
+
+	for (auto it = pending.begin(); it != pending.end();)
+	{
+		if (now >= it->deadlineMS)
+		{
+			scr_printf("**** pipeline: timed out waiting for response to seq %u ****", it->seq);
+
+			it->promise.set_value(URCReply{false});
+			it = pending.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
+void URCPipeline::ReaderThread()
+{
+	URCMessageUnion rsp = {0};
+
+	std::unique_lock<std::mutex> lock(pendingMutex);
+
+	while (!shuttingDown)
+	{
+		// nothing outstanding; stay off the port completely until somebody sends something
+		if (pending.empty())
+		{
+			wakeReader.wait(lock, [this]
+							{ return shuttingDown || !pending.empty(); });
+			continue;
+		}
+
+		// don't sleep in the read past the point where somebody's timeout runs out
+		uint64_t deadline = SERIAL_RX::DeadlineFromNow(PIPELINE_READ_SLICE_MS);
+		for (const PendingRequest &request : pending)
+			deadline = (std::min)(deadline, request.deadlineMS);
+
+		// let Send() get in while we wait on the port
+		lock.unlock();
+		bool gotOne = readFunc(&rsp, deadline);
+		lock.lock();
+
+		if (gotOne)
+			Dispatch(rsp);
+
+		ExpireRequests();
+	}
+}
@@ -0,0 +1,84 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <list>
+#include <mutex>
+#include <thread>
+
+#include "urc_protocol.hpp"
+
+// lets us have more than one URC request outstanding on a port at a time
+//
+// normally we do SendURCCommand() and then sit in GetURCResponse() until the answer
+// comes back. with this, we send as many requests as we want, and a reader thread
+// matches each response that comes back to the request it belongs to:
+//
+//	-	ACK / NAK carry the sequence number they are answering (AckSeq / NAKSeq)
+//	-	anything else is matched by Seq if the other side echoed ours, otherwise by
+//		the response type the request said it was expecting (oldest first)
+//
+// callers get a std::future for each request, which is fulfilled when the response
+// shows up, or with ok = false once that request's own timeout runs out (see URCReply
+// in urc_protocol.hpp)
+//
+// note: while there are requests in flight, the reader thread owns the receive side
+// of the port; don't mix in plain GetURCResponse() calls on the same port from
+// another thread at the same time (they would steal each other's responses anyway)
+
+// pulls the next good message off the port; returns false if deadlineMS passes first
+typedef std::function<bool(URCMessageUnion *msg, uint64_t deadlineMS)> URCReadFuncPtr;
+
+// sends bytes out the port (without purging anything we haven't read yet!)
+typedef std::function<bool(const uint8_t *data, int len)> URCWriteFuncPtr;
+
+class URCPipeline
+{
+public:
+	URCPipeline(URCReadFuncPtr readFunc, URCWriteFuncPtr writeFunc);
+	~URCPipeline();
+
+	// msg must be ready to go out (Seq and ChkSum already filled in)
+	// expectedType is the msg type of the response we want, or MSG_NONE if we'll
+	// take whatever comes back with our sequence number on it (ACK/NAK, etc.)
+	std::future<URCReply> Send(const URCMessageUnion &msg, int expectedType, int timeoutMS);
+
+	int InFlight();
+
+private:
+	typedef struct _PendingRequest
+	{
+		uint16_t seq;
+		int expectedType;
+		uint64_t deadlineMS;
+		std::promise<URCReply> promise;
+	} PendingRequest;
+
+	void ReaderThread();
+	void Dispatch(const URCMessageUnion &rsp);
+	void ExpireRequests();
+
+	URCReadFuncPtr readFunc;
+	URCWriteFuncPtr writeFunc;
+
+	std::list<PendingRequest> pending; // oldest first
+	std::mutex pendingMutex;
+	std::condition_variable wakeReader;
+	bool shuttingDown = false;
+
+	std::thread reader;
+};
@@ -11,15 +11,21 @@
  *
  *******************************************************************************/
 
-#include "..\autocal_rc.hpp"
-
-#define DEFAULT_TIMEOUT_MS 1000
-
-int timoutTimeMS = DEFAULT_TIMEOUT_MS;
-
-uint16_t _SequenceNumber = 0; // local sequence number
-
-extern bool logData;
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+
+#include "urc_protocol.hpp"
+#include "urc_decoder.hpp"
+#include "urc_connection.hpp"
+#include "comm.hpp"
+#include "screen.hpp"
+#include "util.hpp"
+
+static_assert(sizeof(MsgHdr) == URC_DECODER::HEADER_SIZE, "URC_DECODER out of sync with MsgHdr");
+static_assert(offsetof(MsgHdr, Length) == URC_DECODER::LENGTH_OFFSET, "URC_DECODER out of sync with MsgHdr");
+static_assert(offsetof(MsgHdr, ChkSum) == URC_DECODER::CHKSUM_OFFSET, "URC_DECODER out of sync with MsgHdr");
+static_assert(sizeof(URCMessageUnion) == URC_DECODER::MAX_FRAME_SIZE, "URC_DECODER out of sync with URCMessageUnion");
 
 void DumpHeader(MsgHdr *hdr)
 {
@@ -100,9 +106,10 @@ void DumpRawMsgData(uint8_t *data_ptr, int data_length, bool AmSending)
 	DumpHeader((MsgHdr *)data_ptr);
 }
 
-uint16_t SequenceNumber()
+// each connection counts on its own; see urc_connection.hpp
+uint16_t SequenceNumber(HANDLE hComm)
 {
-	return _SequenceNumber++;
+	return GetURCConnection(hComm).NextSequenceNumber();
 }
 
 uint16_t CalcChecksum(const uint8_t *dataBuf, uint16_t length)
@@ -125,7 +132,7 @@ bool SendURCCommand(HANDLE hComm, uint8_t msgType, uint8_t dst, uint8_t src)
 	msg.msgHdr.Type = msgType;
 	msg.msgHdr.Version = PROTOCOL_VERSION;
 	msg.msgHdr.Length = 0;
-	msg.msgHdr.Seq = SequenceNumber();
+	msg.msgHdr.Seq = SequenceNumber(hComm);
 	msg.msgHdr.Dst = dst;
 	msg.msgHdr.Src = src;
 
@@ -146,7 +153,7 @@ bool SendAck(HANDLE hComm, MsgHdr hdr)
 	a.Hdr.Type = MSG_ACK;
 	a.Hdr.Version = 0;
 	a.Hdr.Length = 2;
-	a.Hdr.Seq = SequenceNumber();
+	a.Hdr.Seq = SequenceNumber(hComm);
 	a.Hdr.Dst = hdr.Src;
 	a.Hdr.Src = hdr.Dst;
 	a.AckSeq = hdr.Seq;
@@ -155,142 +162,85 @@ bool SendAck(HANDLE hComm, MsgHdr hdr)
 	return WriteToCommPort(hComm, (uint8_t *)&a, sizeof(a));
 }
 
-// read from serial port, puts message into msg
-// 	-	data in msg is not valid if return value is false
-//	-	TimeToReceiveCmd is not valid if return value is false
-// this could be made generic...
-// but right now, it uses Win32 COMM port functions like:
-//		ReadFile()
-//
-bool GetURCResponse(HANDLE hComm, URCMessageUnion *msg)
-{
-	int TotalBytesRead = 0;
-	bool Status = false;
-	bool TimedOut = false;
-	ULONGLONG StartTime = 0;
-	uint8_t b;
-	DWORD tmpByteCount;
-
-	StartTime = GetTickCount64();
-
-	// grab an entire header, or timeout
-	do
-	{
-		// read one byte
-		Status = ReadFile(hComm, &b, 1, &tmpByteCount, NULL);
-
-		// can't read from port at all??
-		if (!Status)
-			return false;
-
-		// put one byte into our buffer
-		if (tmpByteCount == 1)
-		{
-			msg->buf[TotalBytesRead++] = b;
-		}
-
-		// did we time out yet??
-		if (GetTickCount64() - StartTime > timoutTimeMS)
-		{
-			TimedOut = true;
-			break;
-		}
-
-	} while (TotalBytesRead < sizeof(MsgHdr));
-
-	if (TimedOut)
-	{
-		scr_printf("\n**** timed out waiting for msg header ****");
-		return false;
-	}
-
-	// read as many more bytes as the header's length indicates there is
-	do
-	{
-		// read one byte
-		Status = ReadFile(hComm, &b, 1, &tmpByteCount, NULL);
+static std::unordered_map<HANDLE, std::unique_ptr<URCConnection>> hCommConnectionMap;
+static std::mutex connectionMapMutex;
 
-		// can't read from port at all??
-		if (!Status)
-			return false;
-
-		// put one byte into our buffer
-		if (tmpByteCount == 1)
-		{
-			msg->buf[TotalBytesRead++] = b;
-		}
-
-		// did we time out yet??
-		if (GetTickCount64() - StartTime > timoutTimeMS)
-		{
-			TimedOut = true;
-			break;
-		}
-
-	} while (TotalBytesRead < msg->msgHdr.Length + sizeof(MsgHdr));
+// each port gets its own connection state the first time anybody talks URC on it
+URCConnection &GetURCConnection(HANDLE hComm)
+{
+	std::lock_guard<std::mutex> lock(connectionMapMutex);
 
-	if (TimedOut)
+	std::unique_ptr<URCConnection> &connection = hCommConnectionMap[hComm];
+	if (!connection)
 	{
-		scr_printf("\n**** timed out waiting for rest of message ****");
-		return false;
+		connection = std::make_unique<URCConnection>(
+			getReceiverForHandle(hComm),
+			[hComm](const uint8_t *data, int len) -> bool
+			{
+				return WriteToCommPort_NoPurge(hComm, data, len);
+			});
 	}
 
-	// verify checksum
-	// grab their original checksum
-	uint16_t origCheckSum = msg->msgHdr.ChkSum;
-
-	// and blank it out, so that we can calculate it ourselves
-	msg->msgHdr.ChkSum = 0;
-
-	uint16_t tmpCheckSum = CalcChecksum((uint8_t *)msg, sizeof(MsgHdr) + msg->msgHdr.Length);
-
-	// put the bytes back in there, just in case somebody looks later
-	msg->msgHdr.ChkSum = origCheckSum;
-
-	if (tmpCheckSum != origCheckSum)
-	{
-
-		// this line is very important!! if for some reason we timed out, or had an error
-		// we have to make sure to get rid of the whole rest of the buffer
-		PurgeComm(hComm, PURGE_RXCLEAR | PURGE_TXCLEAR);
-
-		scr_printf("**** checksum received: received checksum %d; calc'd checksum:%d ****", origCheckSum, tmpCheckSum);
-
-		for (int index = 0; index < TotalBytesRead; ++index)
-			scr_printf("%d ", msg->buf[index]);
+	return *connection;
+}
 
-		scr_printf("");
-		return false;
-	}
+// CloseCommPort() calls this so that none of our per-port state outlives the HANDLE
+void ForgetURCStateForHandle(HANDLE hComm)
+{
+	std::unique_ptr<URCConnection> connection;
 
-	// we are still going to return true if the response was a NAK...
-	// however, we will make a note of it here just to help with debugging
-	if (true)
+	// tear it down outside of the lock; the pipeline's reader thread may take a bit to let go
 	{
-		if (false && MSG_NAK == msg->msgHdr.Type)
+		std::lock_guard<std::mutex> lock(connectionMapMutex);
+		auto it = hCommConnectionMap.find(hComm);
+		if (it != hCommConnectionMap.end())
 		{
-			scr_printf("\n**** NAK seen to msg %d; error code = %d", msg->msgNAK.NAKSeq, msg->msgNAK.Error);
-			scr_printf(NAKCodeToString(msg->msgNAK.Error).c_str());
+			connection = std::move(it->second);
+			hCommConnectionMap.erase(it);
 		}
 	}
+}
 
-	if (logData)
-	{
-		DumpRawMsgData((uint8_t *)msg, sizeof(MsgHdr) + msg->msgHdr.Length, false);
-	}
+// read from serial port, puts message into msg
+// 	-	data in msg is not valid if return value is false
+//	-	TimeToReceiveCmd is not valid if return value is false
+//
+bool GetURCResponse(HANDLE hComm, URCMessageUnion *msg)
+{
+	URCConnection &connection = GetURCConnection(hComm);
+	return connection.Receive(msg, SERIAL_RX::DeadlineFromNow(connection.DefaultTimeoutMS()));
+}
 
-	return true;
+// same as above, but gives up at deadlineMS (see SERIAL_RX::DeadlineFromNow())
+bool GetURCResponse_Deadline(HANDLE hComm, URCMessageUnion *msg, uint64_t deadlineMS)
+{
+	return GetURCConnection(hComm).Receive(msg, deadlineMS);
 }
 
 bool GetURCResponse_Long(HANDLE hComm, URCMessageUnion *msg, int longTimeOutMS)
 {
-	bool retval;
+	return GetURCResponse_Deadline(hComm, msg, SERIAL_RX::DeadlineFromNow(longTimeOutMS));
+}
+
+// sends a command that is already filled in (except for Seq and ChkSum) without waiting for
+// the response; see urc_pipeline.hpp
+std::future<URCReply> SendURCMessageAsync(HANDLE hComm, URCMessageUnion *msg, int expectedRspType, int timeoutMS)
+{
+	return GetURCConnection(hComm).SendAsync(msg, expectedRspType, timeoutMS);
+}
 
-	timoutTimeMS = longTimeOutMS;
-	retval = GetURCResponse(hComm, msg);
-	timoutTimeMS = DEFAULT_TIMEOUT_MS;
+// async version of SendURCCommand()
+std::future<URCReply> SendURCCommandAsync(HANDLE hComm, uint8_t msgType, uint8_t dst, uint8_t src, int expectedRspType, int timeoutMS)
+{
+	URCMessageUnion msg = {0};
+
+	msg.msgHdr.Type = msgType;
+	msg.msgHdr.Version = PROTOCOL_VERSION;
+	msg.msgHdr.Length = 0;
+	msg.msgHdr.Dst = dst;
+	msg.msgHdr.Src = src;
 
-	return retval;
+	return SendURCMessageAsync(hComm, &msg, expectedRspType, timeoutMS);
 }
 
 bool VerifyMessageIsOK(URCMessageUnion *msg, int ExpectedMessageType, int ExpectedMessageLength)
@@ -338,7 +288,7 @@ UINT SendRemoteSoftkeyCommand(HANDLE hComm, uint8_t key)
 	msg.Hdr.Type = MSG_REMOTE_SOFTKEYS;
 	msg.Hdr.Version = PROTOCOL_VERSION;
 	msg.Hdr.Length = 2;
-	msg.Hdr.Seq = SequenceNumber();
+	msg.Hdr.Seq = SequenceNumber(hComm);
 	msg.Hdr.Dst = ADDR_TRIP_UNIT;
 	msg.Hdr.Src = ADDR_INFOPRO_AC;
 
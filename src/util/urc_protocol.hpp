@@ -13,8 +13,13 @@
 
 #pragma once
 
-#include "..\autocal_rc.hpp"
-#include "..\misc_defines.hpp"
+#include <cstdint>
+#include <future>
+#include <string>
+
+// no windows.h / autocal_rc.hpp in here; this has to build headless too (see CMakeLists.txt)
+#include "platform.hpp"
+#include "../misc_defines.hpp"
 
 enum TripUnitType
 {
@@ -1108,6 +1113,7 @@ typedef union _URCMessageUnion
 	MsgRemoteScreen4 msgRemoteScreen4;
 	MsgRspLEDs msgRspLEDs;
 	MsgExeTestSet4 msgExeTestSet4;
+	MsgSetTestSetAmps4 msgSetTestSetAmps4;
 	MsgRspTestSetResults4 msgRspTestSetResults4;
 	MsgGetRsp4 msgGetRsp4;
 	MsgSetBaudRate msgSetBaudRate;
@@ -1124,9 +1130,15 @@ typedef union _URCMessageUnion
 
 #pragma pack()
 
+#define DEFAULT_TIMEOUT_MS 1000
+
+// per-connection state (sequence number, decoder, pipeline); see urc_connection.hpp
+class URCConnection;
+URCConnection &GetURCConnection(HANDLE hComm);
+
 // function prototypes
 
-uint16_t SequenceNumber();
+uint16_t SequenceNumber(HANDLE hComm);
 uint16_t CalcChecksum(const uint8_t *dataBuf, uint16_t length);
 
 bool SendURCCommand(HANDLE hComm, uint8_t msgType, uint8_t dst, uint8_t src);
@@ -1134,6 +1146,8 @@ bool GetAckURCResponse(HANDLE hComm, URCMessageUnion *msg);
 bool GetURCResponse(HANDLE hComm, URCMessageUnion *msg);
 bool SendAck(HANDLE hComm, MsgHdr hdr);
 bool GetURCResponse_Long(HANDLE hComm, URCMessageUnion *msg, int longTimeOutMS);
+bool GetURCResponse_Deadline(HANDLE hComm, URCMessageUnion *msg, uint64_t deadlineMS);
+void ForgetURCStateForHandle(HANDLE hComm);
 void PrintAddress(int addr);
 void DumpHeader(MsgHdr *hdr);
 void PrintAddress(int addr);
@@ -1142,4 +1156,15 @@ void HexDumpBuffer(uint8_t *buf, int len);
 bool VerifyMessageIsOK(URCMessageUnion *msg, int ExpectedMessageType, int ExpectedMessageLength);
 bool MessageIsACK(URCMessageUnion *msg);
 UINT SendRemoteSoftkeyCommand(HANDLE hComm, uint8_t key);
-bool VerifyMessageIsOK(URCMessageUnion *msg, int ExpectedMessageType, int ExpectedMessageLength, int ExpectedDst, int ExpectedSrc);
\ No newline at end of file
+bool VerifyMessageIsOK(URCMessageUnion *msg, int ExpectedMessageType, int ExpectedMessageLength, int ExpectedDst, int ExpectedSrc);
+
+// pipelined (async) requests; see urc_pipeline.hpp
+
+typedef struct _URCReply
+{
+	bool ok; // false if we timed out, or the port died, before the response showed up
+	URCMessageUnion msg;
+} URCReply;
+
+std::future<URCReply> SendURCMessageAsync(HANDLE hComm, URCMessageUnion *msg, int expectedRspType, int timeoutMS = DEFAULT_TIMEOUT_MS);
+std::future<URCReply> SendURCCommandAsync(HANDLE hComm, uint8_t msgType, uint8_t dst, uint8_t src, int expectedRspType, int timeoutMS = DEFAULT_TIMEOUT_MS);
@@ -13,6 +13,7 @@
  *******************************************************************************/
 
 #include "util.hpp"
+#include "../misc_defines.hpp"
 #include <sstream>
 #include <iomanip>
 #include <map>
@@ -261,6 +262,8 @@ float convertToFloat(const char *str)
     return floatValue; // Return the converted float value
 }
 
+#ifdef _WIN32
+
 std::string SelectFileToSave(HWND hwnd)
 {
     OPENFILENAME ofn; // common dialog box structure
@@ -315,3 +318,5 @@ std::string SelectFileToOpen(HWND hwnd)
 
     return std::string();
 }
+
+#endif
@@ -13,7 +13,7 @@
 
 #pragma once
 
-#include "..\autocal_rc.hpp"
+#include "platform.hpp"
 #include <string>
 #include <chrono>
 
@@ -30,5 +30,8 @@ std::string rightjustify(int width, const std::string &str);
 float convertToFloat(const char *str);
 std::string BoolToString(bool b);
 std::string BoolToYesNo(bool pass);
+
+#ifdef _WIN32
 std::string SelectFileToOpen(HWND hwnd);
 std::string SelectFileToSave(HWND hwnd);
+#endif
@@ -0,0 +1,190 @@
+/*******************************************************************************
+
+ * Copyright 2024  Utility Relay Company (URC) Chagrin Falls, Ohio.
+ * All Rights Reserved.
+ *
+ * The information contained herein is confidential property of URC.  All uasge,
+ * copying, transfer, or disclosure of this information is prohibited by law.
+ *
+ *  AutoCAL_RC - ACPro2-RC testing and calibration software
+ *  Original Author: Benjamin Pritchard
+ *
+ *******************************************************************************/
+
+// SCPI_TRANSPORT::OpenVISA(), for windows; the only thing that needs the VISA runtime
+
+#include <string>
+#include <vector>
+
+#include "scpi_transport.hpp"
+#include "screen.hpp"
+
+// note: this includes the file for the VISA Library 5.1 specification, not something
+//       not something from our project. Normally it should be located at:
+//		 C:\Program Files\IVI Foundation\VISA\Win64\Include\visa.h
+#include <C:\Program Files\IVI Foundation\VISA\Win64\Include\visa.h>
+
+// VISA =  (Virtual Instrument Software Architecture) library
+// NI-VISA = National Instruments VISA
+// USBTMC = USB Test and Measurement Class
+// SCPI = Standard Commands for Programmable Instruments
+
+namespace SCPI_TRANSPORT
+{
+	class VisaTransport : public Transport
+	{
+	public:
+		VisaTransport(ViSession resource_manager, ViSession session, const std::string &resourceName,
+					  const std::string &terminator, ViUInt32 timeout_ms)
+			: resource_manager(resource_manager), session(session), resourceName(resourceName),
+			  terminator(terminator), timeout_ms(timeout_ms)
+		{
+		}
+
+		~VisaTransport() override
+		{
+			viClose(session);
+			viClose(resource_manager);
+		}
+
+		bool Write(const std::string &command) override
+		{
+			std::string command_with_terminator = command + terminator;
+
+			ViBuf scpi_command = (ViBuf)command_with_terminator.c_str();
+			ViUInt32 bytes_to_write = (ViUInt32)command_with_terminator.length();
+			ViUInt32 write_count;
+
+			ViStatus status = viWrite(session, scpi_command, bytes_to_write, &write_count);
+			if (status < VI_SUCCESS || write_count != bytes_to_write)
+			{
+				PrintToScreen("SCPI: cannot write to VISA instrument " + resourceName);
+				return false;
+			}
+
+			return true;
+		}
+
+		bool Read(std::string &response, int timeoutMS) override
+		{
+			const ViUInt32 read_buffer_size = 1000;
+			ViChar read_buffer[read_buffer_size];
+			ViUInt32 bytes_read;
+
+			if ((ViUInt32)timeoutMS != timeout_ms)
+				viSetAttribute(session, VI_ATTR_TMO_VALUE, (ViUInt32)timeoutMS);
+
+			ViStatus status = viRead(session, (ViBuf)read_buffer, read_buffer_size, &bytes_read);
+
+			if ((ViUInt32)timeoutMS != timeout_ms)
+				viSetAttribute(session, VI_ATTR_TMO_VALUE, timeout_ms);
+
+			if (status < VI_SUCCESS || bytes_read == 0)
+				return false;
+
+			// null terminate the string we read back
+			if (bytes_read < read_buffer_size)
+				read_buffer[bytes_read] = '\0';
+			else
+				read_buffer[read_buffer_size - 1] = '\0';
+
+			response = read_buffer;
+
+			// USBTMC hands us the newline the instrument ended its answer with
+			while (!response.empty() && (response.back() == '\n' || response.back() == '\r'))
+				response.pop_back();
+
+			return true;
+		}
+
+		std::string Name() const override
+		{
+			return resourceName;
+		}
+
+	private:
+		ViSession resource_manager;
+		ViSession session;
+		std::string resourceName;
+		std::string terminator;
+		ViUInt32 timeout_ms;
+	};
+
+	TransportPtr OpenVISA(const std::string &resourceFilter, const std::string &idnMatch, const std::string &terminator, int timeoutMS)
+	{
+		ViSession resource_manager;
+		ViStatus status;
+
+		status = viOpenDefaultRM(&resource_manager);
+		if (status < VI_SUCCESS)
+		{
+			PrintToScreen("SCPI: cannot open VISA resource manager");
+			return nullptr;
+		}
+
+		// find all instruments connected to the computer
+		ViFindList findList;
+		ViUInt32 retcnt;
+		ViChar instrDesc[1000];
+		ViChar search_expression[] = "?*";
+		status = viFindRsrc(resource_manager, search_expression, &findList, &retcnt, instrDesc);
+		if (status < VI_SUCCESS)
+		{
+			PrintToScreen("SCPI: no VISA instruments found");
+			viClose(resource_manager);
+			return nullptr;
+		}
+
+		// first just enumerate all the VISA devices
+		std::vector<std::string> deviceNames;
+		while (status != VI_ERROR_RSRC_NFOUND)
+		{
+			deviceNames.push_back(std::string(instrDesc));
+			status = viFindNext(findList, instrDesc);
+		}
+
+		viClose(findList);
+
+		viClose(resource_manager);
+
+		// now we are going to go through each one in turn, open it if we can, and ask it
+		// to identify itself...
+		for (const std::string &deviceName : deviceNames)
+		{
+			if (deviceName.find(resourceFilter) == std::string::npos)
+				continue;
+
+			// each instrument gets a resource manager session of its own, so closing one
+			// doesn't close the others
+			ViSession instrument_manager;
+			ViSession session;
+
+			if (viOpenDefaultRM(&instrument_manager) < VI_SUCCESS)
+				continue;
+
+			status = viOpen(instrument_manager, (ViRsrc)deviceName.c_str(), VI_NULL, VI_NULL, &session);
+			if (status != VI_SUCCESS)
+			{
+				viClose(instrument_manager);
+				continue;
+			}
+
+			viSetAttribute(session, VI_ATTR_TMO_VALUE, (ViUInt32)timeoutMS);
+
+			TransportPtr transport(new VisaTransport(instrument_manager, session, deviceName, terminator, (ViUInt32)timeoutMS));
+			std::string idn;
+
+			bool found = Identify(*transport, idnMatch, &idn);
+
+			PrintToScreen("full *IDN? response: " + idn);
+
+			if (found)
+				return transport;
+
+			// close this device, and move onto next one
+		}
+
+		PrintToScreen("SCPI: no VISA instrument answers *IDN? with " + idnMatch);
+		return nullptr;
+	}
+}
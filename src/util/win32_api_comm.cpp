@@ -13,8 +13,10 @@
 
 #include <unordered_map>
 #include <mutex>
+#include <memory>
 
 #include "..\autocal_rc.hpp"
+#include "serial_rx.hpp"
 
 // Global unordered_map to store HANDLE to mutex mapping
 // we do it like this because we want a mutex in GetRawResponse() that is specific to
@@ -31,6 +33,28 @@ std::mutex &getMutexForHandle(HANDLE hComm)
 	return hCommMutexMap[hComm];
 }
 
+// same idea as above; each comm port gets its own receive ring buffer, which lives
+// until the port is closed
+std::unordered_map<HANDLE, std::unique_ptr<SERIAL_RX::Receiver>> hCommReceiverMap;
+static std::mutex receiverMapMutex;
+
+SERIAL_RX::Receiver &getReceiverForHandle(HANDLE hComm)
+{
+	std::lock_guard<std::mutex> lock(receiverMapMutex);
+
+	std::unique_ptr<SERIAL_RX::Receiver> &rx = hCommReceiverMap[hComm];
+	if (!rx)
+		rx = std::make_unique<SERIAL_RX::Receiver>(SERIAL_RX::Win32Backend(hComm));
+
+	return *rx;
+}
+
+static void forgetReceiverForHandle(HANDLE hComm)
+{
+	std::lock_guard<std::mutex> lock(receiverMapMutex);
+	hCommReceiverMap.erase(hComm);
+}
+
 bool GetExpectedString(HANDLE hComm, int total_time_to_wait_ms, const char *expectedResponseString)
 {
 	URCMessageUnion rsp = {0};
@@ -53,47 +77,68 @@ bool GetExpectedString(HANDLE hComm, int total_time_to_wait_ms, const char *expe
 bool GetRawResponse(HANDLE hComm, uint8_t *msg, int total_time_to_wait_ms, int bytesExpected)
 {
 	int TotalBytesRead = 0;
-	bool Status = false;
-	bool TimedOut = false;
-	ULONGLONG StartTime = 0;
-	uint8_t b;
-	DWORD tmpByteCount;
+	SERIAL_RX::Receiver &rx = getReceiverForHandle(hComm);
+	uint64_t deadline = SERIAL_RX::DeadlineFromNow(total_time_to_wait_ms);
 
 	// this will block if another thread is currently writing to the port identified by hComm
 	std::mutex &mtx = getMutexForHandle(hComm);
 	std::lock_guard<std::mutex> lock(mtx);
 
-	StartTime = GetTickCount64();
+	// if we don't know how many bytes to expect, we just keep taking whatever shows up
+	// until we time out (but never more than fits in a URC message buffer)
+	int bytesWanted = (bytesExpected != -1) ? bytesExpected : sizeof(URCMessageUnion);
 
-	do
+	while (TotalBytesRead < bytesWanted)
 	{
-		// read one byte
-		Status = ReadFile(hComm, &b, 1, &tmpByteCount, NULL);
-
-		// got some data?
-		if (Status)
-		{
-			// put one byte into our buffer
-			if (tmpByteCount == 1)
-			{
-				msg[TotalBytesRead++] = b;
-			}
-		}
+		int bytesRead = rx.ReadSome(msg + TotalBytesRead, bytesWanted - TotalBytesRead, deadline);
 
 		// did we timeout
-		if (GetTickCount64() - StartTime > total_time_to_wait_ms)
+		if (bytesRead == 0)
 			break;
 
-		// if we know how many bytes we are expecting, then we can stop when we get that many
-		if (bytesExpected != -1)
+		TotalBytesRead += bytesRead;
+	}
+
+	return (TotalBytesRead > 0);
+}
+
+// read one line of text (SCPI instruments, etc.); stops at the first CR or LF instead of
+// sitting there until total_time_to_wait_ms runs out like GetRawResponse(hComm, ..., -1) does
+// line always comes back null terminated, without the line ending
+// returns false if the line ending never showed up
+bool GetResponseLine(HANDLE hComm, char *line, int maxLen, int total_time_to_wait_ms)
+{
+	int TotalBytesRead = 0;
+	SERIAL_RX::Receiver &rx = getReceiverForHandle(hComm);
+	uint64_t deadline = SERIAL_RX::DeadlineFromNow(total_time_to_wait_ms);
+
+	std::mutex &mtx = getMutexForHandle(hComm);
+	std::lock_guard<std::mutex> lock(mtx);
+
+	line[0] = 0;
+
+	while (TotalBytesRead < maxLen - 1)
+	{
+		uint8_t c;
+
+		if (!rx.Read(&c, 1, deadline))
+			break;
+
+		if (c == '\r' || c == '\n')
 		{
-			if (TotalBytesRead >= bytesExpected)
-				break;
+			// the LF left over from the CR LF on the end of the last line
+			if (TotalBytesRead == 0)
+				continue;
+
+			line[TotalBytesRead] = 0;
+			return true;
 		}
 
-	} while (true);
+		line[TotalBytesRead++] = (char)c;
+	}
 
-	return (TotalBytesRead > 0);
+	line[TotalBytesRead] = 0;
+	return false;
 }
 
 bool WriteToCommPort_Str(HANDLE hComm, const char *str)
@@ -113,6 +158,24 @@ bool WriteToCommPort_Str2(HANDLE hComm, const char *str)
 }
 
 bool WriteToCommPort(HANDLE hComm, uint8_t *data_ptr, int data_length)
+{
+	// because we are dealing with a command/response type protocol, whenever we go
+	// to send a command, we need to make sure that the buffer is cleared out to begin
+	// with
+	{
+		std::mutex &mtx = getMutexForHandle(hComm);
+		std::lock_guard<std::mutex> lock(mtx);
+
+		PurgeComm(hComm, PURGE_RXCLEAR | PURGE_TXCLEAR);
+		getReceiverForHandle(hComm).Flush();
+	}
+
+	return WriteToCommPort_NoPurge(hComm, data_ptr, data_length);
+}
+
+// same as above, but leaves whatever has been received (and not read yet) alone; this
+// is what lets us have more than one URC request in flight at a time (see urc_pipeline.hpp)
+bool WriteToCommPort_NoPurge(HANDLE hComm, const uint8_t *data_ptr, int data_length)
 {
 	DWORD actual_length;
 
@@ -120,11 +183,6 @@ bool WriteToCommPort(HANDLE hComm, uint8_t *data_ptr, int data_length)
 	std::mutex &mtx = getMutexForHandle(hComm);
 	std::lock_guard<std::mutex> lock(mtx);
 
-	// because we are dealing with a command/response type protocol, whenever we go
-	// to send a command, we need to make sure that the buffer is cleared out to begin
-	// with
-	PurgeComm(hComm, PURGE_RXCLEAR | PURGE_TXCLEAR);
-
 	bool Status = WriteFile(
 		hComm,	  // Handle to the Serialport
 		data_ptr, // Data to be written to the port
@@ -192,10 +250,12 @@ bool InitCommPort(HANDLE *hComm, int PortNumber, int Baud)
 
 	// setup the timeouts for the SerialPort
 	// https://docs.microsoft.com/en-us/windows/win32/api/winbase/ns-winbase-commtimeouts
+	// ReadFile() returns as soon as anything is available, but blocks (for a little while)
+	// when nothing is; see SERIAL_RX::Win32Backend(), which adjusts the constant per read
 
 	timeouts.ReadIntervalTimeout = MAXDWORD;
-	timeouts.ReadTotalTimeoutMultiplier = 0;
-	timeouts.ReadTotalTimeoutConstant = 0;
+	timeouts.ReadTotalTimeoutMultiplier = MAXDWORD;
+	timeouts.ReadTotalTimeoutConstant = SERIAL_RX::RX_WAIT_SLICE_MS;
 
 	timeouts.WriteTotalTimeoutConstant = 0;
 	timeouts.WriteTotalTimeoutMultiplier = 0;
@@ -214,6 +274,10 @@ bool CloseCommPort(HANDLE *hComm)
 {
 	if (hComm == INVALID_HANDLE_VALUE)
 		return false;
+
+	ForgetURCStateForHandle(*hComm);
+	forgetReceiverForHandle(*hComm);
+
 	if (!CloseHandle(*hComm))
 		return false;
 
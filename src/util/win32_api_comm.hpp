@@ -14,12 +14,14 @@
 #pragma once
 
 #include "autocal_rc.hpp"
+#include "comm.hpp"
+#include "serial_rx.hpp"
+
+// (WriteToCommPort(), InitCommPort(), CloseCommPort() etc. are in comm.hpp)
 
-bool WriteToCommPort(HANDLE hComm, uint8_t *data_ptr, int data_length);
 bool SetLocalBaudRate(HANDLE hComm, DWORD baudrate);
-bool InitCommPort(HANDLE *hComm, int PortNumber, int Baud);
-bool CloseCommPort(HANDLE *hComm);
 bool WriteToCommPort_Str(HANDLE hComm, const char *str);
 bool WriteToCommPort_Str2(HANDLE hComm, const char *str);
 bool GetRawResponse(HANDLE hComm, uint8_t *msg, int total_time_to_wait_ms, int bytesExpected);
 bool GetExpectedString(HANDLE hComm, int total_time_to_wait_ms, const char *expectedResponseString);
+bool GetResponseLine(HANDLE hComm, char *line, int maxLen, int total_time_to_wait_ms);